@@ -9,110 +9,352 @@
  */
 
 #include "Trill.h"
-
-// some implementations of Wire (e.g.: Particle OS) do not define BUFFER_LENGTH
-#ifndef BUFFER_LENGTH
-#define BUFFER_LENGTH 32
-#endif // BUFFER_LENGTH
+#include "TrillHistory.h"
 
 #define MAX_TOUCH_1D_OR_2D (((device_type_ == TRILL_SQUARE || device_type_ == TRILL_HEX) ? kMaxTouchNum2D : kMaxTouchNum1D))
 #define RAW_LENGTH ((device_type_ == TRILL_BAR ? 2 * kNumChannelsBar \
 			: device_type_ == TRILL_RING ? 2 * kNumChannelsRing \
 			: 2 * kNumChannelsMax))
 
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#define TRILL_PROGMEM PROGMEM
+#else
+#define TRILL_PROGMEM
+#endif
+
+#define TRILL_DEFAULTS(device) {device, defaultModeOf(device), defaultAddressOf(device)}
+const struct Trill::TrillDefaults Trill::trillDefaults[TRILL_NUM_DEVICES + 1] TRILL_PROGMEM = {
+	TRILL_DEFAULTS(TRILL_NONE),
+	TRILL_DEFAULTS(TRILL_UNKNOWN),
+	TRILL_DEFAULTS(TRILL_BAR),
+	TRILL_DEFAULTS(TRILL_SQUARE),
+	TRILL_DEFAULTS(TRILL_CRAFT),
+	TRILL_DEFAULTS(TRILL_RING),
+	TRILL_DEFAULTS(TRILL_HEX),
+	TRILL_DEFAULTS(TRILL_FLEX),
+};
+#undef TRILL_DEFAULTS
+
+Trill::TrillDefaults Trill::getDefaults(Device device) {
+	TrillDefaults defaults;
+#ifdef __AVR__
+	memcpy_P(&defaults, &trillDefaults[device + 1], sizeof(defaults));
+#else
+	defaults = trillDefaults[device + 1];
+#endif
+	return defaults;
+}
+
 Trill::Trill()
-: wire_(&Wire), device_type_(TRILL_NONE), mode_(AUTO),
-  firmware_version_(0), last_read_loc_(0xFF), raw_bytes_left_(0)
+: wire_(&Wire), device_type_(TRILL_NONE),
+  firmware_version_(0), last_read_loc_(0xFF), raw_index_(0), raw_length_(0),
+  init_state_(kInitIdle), init_result_(kBeginNotStarted), init_device_(TRILL_NONE),
+  last_command_us_(0), command_delay_us_(0),
+  settings_{ AUTO, 0, 12, 1, 0, 0, 0, 1 }, target_(settings_),
+  settings_sent_(0), settings_resend_(0),
+  read_state_(kReadIdle), read_length_(0), read_words_(0), read_dst_(buffer_),
+  read_centroids_(false),
+  evt_pin_(-1), evt_slot_(-1), frame_pending_(0), last_frame_us_(0),
+  new_frame_(false), num_reads_(0), num_stale_reads_(0),
+  history_(nullptr), raw_data_(buffer_ + kRawOffset)
 {
+	setMaxTransferLength(TRILL_WIRE_BUFFER_LENGTH < 255 ? TRILL_WIRE_BUFFER_LENGTH : 255);
+}
+
+Trill::~Trill() {
+	setEventPin(-1);
 }
 
 /* Initialise the hardware. Returns the type of device attached, or 0
    if none is attached. */
-int Trill::begin(Device device, uint8_t i2c_address, TwoWire* wire) {
+int Trill::begin(Device device, uint8_t i2c_address, TwoWire* wire, int evt_pin) {
+	int ret = beginAsync(device, i2c_address, wire, evt_pin);
+	while(kBeginInProgress == ret) {
+		/* Wait for the last command to be processed */
+		delay((commandDelayRemaining() + 999) / 1000);
+		ret = poll();
+	}
+	return ret;
+}
+
+int Trill::beginAsync(Device device, uint8_t i2c_address, TwoWire* wire, int evt_pin) {
 	wire_ = wire;
+	init_state_ = kInitDone;
+	/* Forget the previous device, whether or not this one answers */
+	device_type_ = TRILL_NONE;
+	firmware_version_ = 0;
+	if(evt_pin >= 0)
+		setEventPin(evt_pin);
 
 	if(128 <= i2c_address)
-		i2c_address = trillDefaults[device+1].address;
+		i2c_address = getDefaults(device).address;
 
 	/* Unknown default address */
 	if(128 <= i2c_address) {
-		return  -2;
+		init_result_ = -2;
+		return init_result_;
 	}
 
 	i2c_address_ = i2c_address;
+	init_device_ = device;
+	/* Drop what applySettings() hadn't sent yet */
+	target_ = settings_;
+	settings_resend_ = 0;
 
 	/* Start I2C */
 	wire_->begin();
 
-	/* Check the type of device attached */
-	if(identify() != 0) {
+	/* Ask the device to identify itself */
+	if(requestIdentify() != 0) {
 		// Unable to identify device
-		return 2;
+		init_result_ = 2;
+		return init_result_;
 	}
+	scheduleNextCommand(25);
+	init_state_ = kInitIdentify;
+	return kBeginInProgress;
+}
 
-	/* Check for wrong device type */
-	if(TRILL_UNKNOWN != device && device_type_ != device) {
-		device_type_ = TRILL_NONE;
-		return -3;
+int Trill::poll() {
+	if(kInitIdle == init_state_)
+		return kBeginNotStarted;
+	if(kInitDone == init_state_)
+		return init_result_;
+	if(commandDelayRemaining())
+		return kBeginInProgress;
+
+	switch(init_state_) {
+	case kInitIdentify:
+	{
+		init_state_ = kInitDone;
+		/* Check the type of device attached */
+		if(readIdentity() != 0) {
+			// Unable to identify device
+			init_result_ = 2;
+			return init_result_;
+		}
+
+		/* Check for wrong device type */
+		if(TRILL_UNKNOWN != init_device_ && device_type_ != init_device_) {
+			device_type_ = TRILL_NONE;
+			init_result_ = -3;
+			return init_result_;
+		}
+
+		/* Check for device mode */
+		Mode mode = getDefaults(init_device_).mode;
+		if(AUTO == mode) {
+			init_result_ = -1;
+			return init_result_;
+		}
+
+		/* Put the device in the correspondent mode */
+		setMode(mode);
+		scheduleNextCommand(interCommandDelay);
+
+		setCentroidData(buffer_);
+		if(!is2D())
+			horizontal.num_touches = 0;
+		init_state_ = kInitMode;
+		break;
+	}
+	case kInitMode:
+		/* Set default scan settings */
+		setScanSettings(0, 12);
+		scheduleNextCommand(interCommandDelay);
+		init_state_ = kInitScanSettings;
+		break;
+	case kInitScanSettings:
+		updateBaseline();
+		scheduleNextCommand((firmware_version_ >= 3 ? 10 : 1) * interCommandDelay); // not really needed, but it ensures the first command the user sends after calling setup() will be adequately timed. Hopefully this is not a source of confusion...
+		init_state_ = kInitBaseline;
+		break;
+	case kInitBaseline:
+		init_state_ = kInitDone;
+		init_result_ = 0;
+		return init_result_;
 	}
+	return kBeginInProgress;
+}
 
-	/* Check for device mode */
-	Mode mode = trillDefaults[device+1].mode;
-	if(AUTO == mode) {
-		return -1;
+/* Recover from a dropout with as little traffic and waiting as possible */
+int Trill::reconnect(uint8_t attempts) {
+	/* Don't leave a split-phase read pending across the recovery */
+	if(kReadIdle != read_state_)
+		finishRead();
+	/* The device may have reset, and its read pointer with it */
+	last_read_loc_ = 0xFF;
+	init_state_ = kInitDone;
+
+	uint8_t backoff_ms = 1;
+	boolean found = false;
+	for(uint8_t n = 0; n < attempts; ++n) {
+		if(n) {
+			TRILL_STATS(&stats_, retries++);
+			delay(backoff_ms);
+			backoff_ms *= 2;
+		}
+		if(answers()) {
+			found = true;
+			break;
+		}
+	}
+	if(!found) {
+		init_result_ = 2;
+		return init_result_;
 	}
 
-	/* Put the device in the correspondent mode */
-	setMode(mode);
-	delay(interCommandDelay);
+	/* The status area still holds the identity of the device, so a
+	   device of the same type can be recognised without waiting for
+	   the identify command */
+	Device device;
+	uint8_t firmware_version;
+	if(readIdentity(wire_, i2c_address_, last_read_loc_, device, firmware_version TRILL_STATS_ARG(&stats_)) != 0 || device != device_type_) {
+		Device expected = device_type_;
+		if(identify() != 0) {
+			init_result_ = 2;
+			return init_result_;
+		}
+		if(device_type_ != expected) {
+			device_type_ = TRILL_NONE;
+			init_result_ = -3;
+			return init_result_;
+		}
+	}
 
-	Touches::centroids = buffer_;
-	Touches::sizes = buffer_ + MAX_TOUCH_1D_OR_2D;
-	if(is2D()) {
-		horizontal.centroids = buffer_ + 2 * MAX_TOUCH_1D_OR_2D;
-		horizontal.sizes = buffer_ + 3 * MAX_TOUCH_1D_OR_2D;
-	} else
-		horizontal.num_touches = 0;
+	/* Send everything again, in case the device was reset, and take a
+	   new baseline with those settings */
+	target_ = settings_;
+	settings_resend_ = settings_sent_;
+	scheduleNextCommand(0);
+	if(sendSettings(true)) {
+		init_result_ = -1;
+		return init_result_;
+	}
+	updateBaseline();
+	init_result_ = 0;
+	return init_result_;
+}
 
-	/* Set default scan settings */
-	setScanSettings(0, 12);
-	delay(interCommandDelay);
+/* Whether the device acknowledges its address */
+boolean Trill::answers() {
+	wire_->beginTransmission(i2c_address_);
+	return wire_->endTransmission() == 0;
+}
 
-	updateBaseline();
-	delay((firmware_version_ >= 3 ? 10 : 1) * interCommandDelay); // not really needed, but it ensures the first command the user sends after calling setup() will be adequately timed. Hopefully this is not a source of confusion...
+/* Remember that the device needs delay_ms to process the command just sent */
+void Trill::scheduleNextCommand(uint16_t delay_ms) {
+	last_command_us_ = micros();
+	command_delay_us_ = delay_ms * 1000UL;
+}
 
-	return 0;
+/* How many microseconds until the device is ready for the next command */
+uint32_t Trill::commandDelayRemaining() {
+	uint32_t elapsed = micros() - last_command_us_;
+	if(elapsed >= command_delay_us_)
+		return 0;
+	return command_delay_us_ - elapsed;
 }
 
 /* Return the type of device attached, or 0 if none is attached. */
 int Trill::identify() {
-	wire_->beginTransmission(i2c_address_);
-	wire_->write(kOffsetCommand);
-	wire_->write(kCommandIdentify);
-	int ret = wire_->endTransmission();
+	int ret = requestIdentify();
 	if(ret)
 		return ret;
 
 	/* Give Trill time to process this command */
 	delay(25);
 
-	last_read_loc_ = kOffsetCommand;
-	wire_->requestFrom(i2c_address_, (uint8_t)3);
+	return readIdentity();
+}
 
-	if(wire_->available() < 3) {
+/* Send the identify command */
+int Trill::requestIdentify() {
+	return writeCommand(wire_, i2c_address_, last_read_loc_, kCommandIdentify, nullptr, 0 TRILL_STATS_ARG(&stats_));
+}
+
+/* Read the response to the identify command */
+int Trill::readIdentity() {
+	int ret = readIdentity(wire_, i2c_address_, last_read_loc_, device_type_, firmware_version_ TRILL_STATS_ARG(&stats_));
+	if(ret) {
 		/* Unexpected or no response; no valid device connected */
 		device_type_ = TRILL_NONE;
 		firmware_version_ = 0;
-		return -1;
 	}
+	return ret;
+}
+
+int Trill::readIdentity(TwoWire* wire, uint8_t address, uint8_t& read_loc, Device& device, uint8_t& firmware_version TRILL_STATS_ARG(TrillStats* stats)) {
+	seek(wire, address, read_loc, kOffsetCommand TRILL_STATS_ARG(stats));
+	uint8_t received = wire->requestFrom(address, (uint8_t)3);
+	TRILL_STATS(stats, read(3, received));
+
+	if(received < 3)
+		return -1;
 
-	wire_->read();	// Discard first input
-	device_type_ = (Device)wire_->read();
-	firmware_version_ = wire_->read();
+	wire->read();	// Discard first input
+	device = (Device)wire->read();
+	firmware_version = wire->read();
 
 	return 0;
 }
 
+/* Find the Trill devices on a bus. An empty write is enough to find out
+   whether an address is taken. Sending the identify command to all the
+   devices that answer before reading any identity lets them process it
+   at the same time: the scan waits for the slowest one only. Addresses
+   that answer are kept apart from the table, so that other devices
+   don't take the room of Trills. */
+uint8_t Trill::scanBus(BusDevice* devices, uint8_t maxDevices, TwoWire* wire, uint8_t first, uint8_t last) {
+	uint8_t answered[128 / 8] = { 0 };	/* One bit per address */
+
+	if(last > 127)
+		last = 127;
+	wire->begin();
+	for(uint16_t address = first; address <= last; ++address) {
+		wire->beginTransmission((uint8_t)address);
+		if(wire->endTransmission() == 0)
+			answered[address / 8] |= 1 << (address % 8);
+	}
+
+	/* Ask them all to identify themselves */
+	boolean asked = false;
+	for(uint16_t address = first; address <= last; ++address) {
+		if(!(answered[address / 8] & (1 << (address % 8))))
+			continue;
+		uint8_t read_loc;
+		if(writeCommand(wire, address, read_loc, kCommandIdentify, nullptr, 0 TRILL_STATS_ARG(nullptr)) == 0)
+			asked = true;
+		else
+			answered[address / 8] &= ~(1 << (address % 8));
+	}
+	if(!asked)
+		return 0;
+
+	/* Give Trill time to process this command */
+	delay(25);
+
+	uint8_t numTrills = 0;
+	for(uint16_t address = first; address <= last && numTrills < maxDevices; ++address) {
+		if(!(answered[address / 8] & (1 << (address % 8))))
+			continue;
+		uint8_t read_loc = kOffsetCommand;
+		Device device;
+		uint8_t firmware;
+		if(readIdentity(wire, address, read_loc, device, firmware TRILL_STATS_ARG(nullptr)) != 0)
+			continue;
+		/* Whatever else answered */
+		if(device <= TRILL_UNKNOWN || device >= TRILL_NUM_DEVICES)
+			continue;
+		devices[numTrills].address = address;
+		devices[numTrills].device = device;
+		devices[numTrills].firmware = firmware;
+		++numTrills;
+	}
+	return numTrills;
+}
+
 /* Get the name of a given device */
 const char* Trill::getNameFromDevice(Device device) {
 	switch(device) {
@@ -120,6 +362,8 @@ const char* Trill::getNameFromDevice(Device device) {
 		return "Bar";
 	case TRILL_SQUARE:
 		return "Square";
+	case TRILL_CRAFT:
+		return "Craft";
 	case TRILL_RING:
 		return "Ring";
 	case TRILL_FLEX:
@@ -133,30 +377,42 @@ const char* Trill::getNameFromDevice(Device device) {
 
 /* Read the latest scan value from the sensor. Returns true on success. */
 boolean Trill::read() {
-	if(CENTROID != mode_)
+	if(CENTROID != settings_.mode)
 		return false;
-	uint8_t loc = 0;
-	uint8_t length = kCentroidLengthDefault;
+	uint8_t length = centroidLength();
+	startFrameTimer();
 
-	/* Set the read location to the right place if needed */
-	prepareForDataRead();
+	/* This also sets the read location to the right place if needed */
+	uint16_t* dst = frameDestination(length / 2, buffer_);
+	uint8_t loc = readData(dst, length);
 
-	if(device_type_ == TRILL_SQUARE || device_type_ == TRILL_HEX)
-		length = kCentroidLength2D;
+	return processCentroidData(dst, loc, length);
+}
 
+/* Length in bytes of the centroid frame for the current device */
+uint8_t Trill::centroidLength() {
+	if(device_type_ == TRILL_SQUARE || device_type_ == TRILL_HEX)
+		return kCentroidLength2D;
 	if(device_type_ == TRILL_RING)
-		length = kCentroidLengthRing;
+		return kCentroidLengthRing;
+	return kCentroidLengthDefault;
+}
 
-	wire_->requestFrom(i2c_address_, length);
-	while(wire_->available() >= 2) {
-		uint8_t msb = wire_->read();
-		uint8_t lsb = wire_->read();
-		buffer_[loc] = lsb + (msb << 8);
-		++loc;
+/* Point the touches at a centroid frame */
+void Trill::setCentroidData(const uint16_t* words) {
+	Touches::centroids = words;
+	Touches::sizes = words + MAX_TOUCH_1D_OR_2D;
+	if(is2D()) {
+		horizontal.centroids = words + 2 * MAX_TOUCH_1D_OR_2D;
+		horizontal.sizes = words + 3 * MAX_TOUCH_1D_OR_2D;
 	}
+}
 
+/* Count the touches in the words of centroid data just read */
+boolean Trill::processCentroidData(const uint16_t* words, uint8_t loc, uint8_t length) {
 	uint8_t maxNumCentroids = MAX_TOUCH_1D_OR_2D;
 	boolean ret = true;
+	setCentroidData(words);
 	/* Check for read error */
 	if(loc * 2 < length) {
 		maxNumCentroids = 0;
@@ -167,186 +423,736 @@ boolean Trill::read() {
 	if(is2D())
 		horizontal.processCentroids(maxNumCentroids);
 
+	if(ret)
+		trackFrame(words, length / 2);
+	else
+		frameFailed();
 	return ret;
 }
 
-/* Update the baseline value on the sensor */
-void Trill::updateBaseline() {
-	wire_->beginTransmission(i2c_address_);
-	wire_->write(kOffsetCommand);
-	wire_->write(kCommandBaselineUpdate);
-	wire_->endTransmission();
+/* Where to read a frame of count words: the next slot of the history, if
+   there is one with room for it, or else fallback */
+uint16_t* Trill::frameDestination(uint8_t count, uint16_t* fallback) {
+	uint16_t* slot = history_ ? history_->acquire(count) : nullptr;
+	return slot ? slot : fallback;
+}
 
-	last_read_loc_ = kOffsetCommand;
+void Trill::setHistory(TrillFrameHistory* history) {
+	history_ = history;
 }
 
-/* Request raw data; wrappers for Wire */
-boolean Trill::requestRawData(uint8_t max_length) {
-	uint8_t length = 0;
+/* Count a frame just read, find out whether it is new and, if so and it
+   was read into the history, keep it there */
+void Trill::trackFrame(const uint16_t* words, uint8_t count) {
+	new_frame_ = last_frame_.update(words, count);
+	++num_reads_;
+	if(!new_frame_)
+		++num_stale_reads_;
+	else if(history_ && words == history_->slot()) {
+		boolean centroids = CENTROID == settings_.mode;
+		history_->commit(micros(), settings_.mode, count, centroids ? num_touches : 0,
+			centroids ? horizontal.num_touches : 0);
+	}
+#ifdef TRILL_ENABLE_STATS
+	stats_.frame(true, micros() - read_start_us_);
+#endif
+}
 
-	prepareForDataRead();
+/* Count a frame that could not be read */
+void Trill::frameFailed() {
+	new_frame_ = false;
+#ifdef TRILL_ENABLE_STATS
+	stats_.frame(false, micros() - read_start_us_);
+#endif
+}
 
-	if(max_length == 0xFF) {
-		length = RAW_LENGTH;
+/* Split-phase read. Where Wire can transfer in the background the
+   request is only started here and each chunk of the frame is started
+   as soon as the previous one is complete; otherwise the whole frame
+   is read here and isReadComplete() returns true straight away. */
+boolean Trill::startRead() {
+	if(kReadIdle != read_state_)
+		return false;
+	startFrameTimer();
+	read_length_ = RAW_LENGTH;
+	read_centroids_ = CENTROID == settings_.mode;
+	if(read_centroids_) {
+		read_length_ = centroidLength();
+		read_dst_ = frameDestination(read_length_ / 2, buffer_);
+	} else {
+		if(read_length_ > kRawLength)
+			read_length_ = kRawLength;
+		read_dst_ = frameDestination(read_length_ / 2, buffer_ + kRawOffset);
+		raw_index_ = raw_length_ = 0;
 	}
-	if(length > kRawLength)
-		length = kRawLength;
+	read_words_ = 0;
+#ifdef TRILL_WIRE_HAS_ASYNC
+	read_chunk_ = 0;
+	read_first_chunk_ = firstChunk(last_read_loc_, max_transfer_, read_length_);
+	read_state_ = kReadPending;
+	if(!startChunk())
+		read_state_ = kReadDone;
+#else
+	read_words_ = readData(read_dst_, read_length_);
+	read_state_ = kReadDone;
+#endif
+	return true;
+}
 
-	/* The raw data might be longer than the Wire.h maximum buffer
-	 * (BUFFER_LENGTH in Wire.h).
-	 * If so, split it into two reads. */
-	if(length <= BUFFER_LENGTH) {
-		wire_->requestFrom(i2c_address_, length);
-		raw_bytes_left_ = 0;
-	}
-	else {
-		int ret = wire_->requestFrom(i2c_address_, (uint8_t)BUFFER_LENGTH);
-		if(ret > 0)
-			raw_bytes_left_ = length - ret;
-		else {
-			// failed transmission. Device died?
-			raw_bytes_left_ = 0;
-			return false;
+boolean Trill::isReadComplete() {
+#ifdef TRILL_WIRE_HAS_ASYNC
+	while(kReadPending == read_state_) {
+		const uint8_t chunk = max_transfer_;
+		const uint8_t numChunks = (read_length_ + chunk - 1) / chunk;
+		uint8_t start = ((read_first_chunk_ + read_chunk_) % numChunks) * chunk;
+		uint8_t size = read_length_ - start < chunk ? read_length_ - start : chunk;
+		if(!wire_->finishedAsync()) {
+			if(micros() - read_chunk_us_ < kReadTimeoutUs)
+				return false;
+			/* Stuck, e.g.: a device holding SCL low */
+			wire_->abortAsync();
+			TRILL_STATS(&stats_, read(size, 0));
+			readFailed();
+			break;
 		}
+		/* The chunk is in; convert it and start the next one, if any */
+		uint16_t* words = read_dst_ + start / 2;
+		/* Wire doesn't say how much a background transfer got, but one
+		   that stops part way leaves the rest of the chunk as
+		   startChunk() filled it. The last word of a centroid frame is
+		   the size of a touch, never 0xFFFF, so that tells how much came
+		   in. Any other chunk counts as complete: unused locations are
+		   0xFFFF, and so is a saturated 16-bit channel */
+		uint8_t received = size;
+		if(read_centroids_ && start + size == read_length_)
+			received = receivedLength(words, size);
+		TRILL_STATS(&stats_, read(size, received));
+		if(received < size) {
+			readFailed();
+			break;
+		}
+		swapWords(words, size / 2);
+		if(++read_chunk_ >= numChunks) {
+			read_words_ = read_length_ / 2;
+			read_state_ = kReadDone;
+		} else if(!startChunk())
+			read_state_ = kReadDone;
 	}
+#endif
+	return kReadPending != read_state_;
+}
+
+boolean Trill::finishRead() {
+	if(kReadIdle == read_state_)
+		return false;
+	while(!isReadComplete())
+		delayMicroseconds(10);
+	read_state_ = kReadIdle;
+	if(read_centroids_)
+		return processCentroidData(read_dst_, read_words_, read_length_);
+	raw_data_ = read_dst_;
+	raw_index_ = 0;
+	raw_length_ = read_words_;
+	if(!raw_length_) {
+		frameFailed();
+		return false;
+	}
+	trackFrame(read_dst_, raw_length_);
 	return true;
 }
 
+#ifdef TRILL_WIRE_HAS_ASYNC
+/* Start the background transfer of chunk read_chunk_ of the pending
+   read, setting the read pointer in the same transaction if needed. The
+   chunk is filled with 0xFF first, so that a transfer that fails part
+   way can be told from one that completed */
+boolean Trill::startChunk() {
+	const uint8_t chunk = max_transfer_;
+	const uint8_t numChunks = (read_length_ + chunk - 1) / chunk;
+	uint8_t start = ((read_first_chunk_ + read_chunk_) % numChunks) * chunk;
+	uint8_t size = read_length_ - start < chunk ? read_length_ - start : chunk;
+	read_loc_ = kOffsetData + start;
+	size_t seekBytes = last_read_loc_ != read_loc_;
+	if(seekBytes)
+		TRILL_STATS(&stats_, seek());
+	memset(read_dst_ + start / 2, 0xFF, size);
+	read_chunk_us_ = micros();
+	if(wire_->writeReadAsync(i2c_address_, &read_loc_, seekBytes, read_dst_ + start / 2, size, true)) {
+		last_read_loc_ = read_loc_;
+		return true;
+	}
+	/* Where the read pointer is now isn't known */
+	last_read_loc_ = 0xFF;
+	TRILL_STATS(&stats_, read(size, 0));
+	return false;
+}
+
+/* Give up on the pending read. Only whole frames are returned, and the
+   device's read pointer isn't known any more */
+void Trill::readFailed() {
+	read_words_ = 0;
+	read_state_ = kReadDone;
+	last_read_loc_ = 0xFF;
+}
+
+/* Bytes of a chunk of size bytes up to the last word that isn't 0xFFFF */
+uint8_t Trill::receivedLength(const uint16_t* words, uint8_t size) {
+	uint8_t count = size / 2;
+	while(count && 0xFFFF == words[count - 1])
+		--count;
+	return 2 * count;
+}
+#endif // TRILL_WIRE_HAS_ASYNC
+
+/* Update the baseline value on the sensor */
+void Trill::updateBaseline() {
+	if(writeCommand(wire_, i2c_address_, last_read_loc_, kCommandBaselineUpdate, nullptr, 0 TRILL_STATS_ARG(&stats_)) == 0)
+		scheduleNextCommand(interCommandDelay);
+}
+
+/* Request raw data; wrappers for Wire */
+boolean Trill::requestRawData(uint8_t max_length) {
+	return requestRawChannels(0, max_length / 2);
+}
+
+/* Request the raw data of some channels only */
+boolean Trill::requestRawChannels(uint8_t first, uint8_t count) {
+	ChannelWindow window = { first, count };
+	uint8_t numChannels = RAW_LENGTH / 2;
+	uint8_t words = first < numChannels ? numChannels - first : 0;
+	if(count < words)
+		words = count;
+	uint16_t* dst = frameDestination(words, buffer_ + kRawOffset);
+
+	raw_index_ = 0;
+	raw_length_ = readRawChannels(&window, 1, dst);
+	raw_data_ = dst;
+	return raw_length_ > 0;
+}
+
 int Trill::rawDataAvailable() {
 	/* Raw data items are 2 bytes long; return number of them available */
-	return ((wire_->available() + raw_bytes_left_) >> 1);
+	return raw_length_ - raw_index_;
 }
 
-/* Raw data is in 16-bit big-endian format */
+/* Raw data is in 16-bit big-endian format; requestRawData() has already
+   converted it */
 int Trill::rawDataRead() {
+	if(raw_index_ >= raw_length_)
+		return 0;
+	return raw_data_[raw_index_++];
+}
 
-	if(wire_->available() < 2) {
-		/* Read more bytes if we need it */
-		if(raw_bytes_left_ > 0) {
-			/* Move read pointer on device */
-			wire_->beginTransmission(i2c_address_);
-			wire_->write(kOffsetData + BUFFER_LENGTH);
-			wire_->endTransmission();
-			last_read_loc_ = kOffsetData + BUFFER_LENGTH;
-
-			/* Now gather what's left */
-			wire_->requestFrom(i2c_address_, raw_bytes_left_);
-			raw_bytes_left_ = 0;
+/* Request a whole raw frame and decode it into dst in bulk */
+int Trill::readRawFrame(uint16_t* dst, size_t maxChannels) {
+	uint8_t length = RAW_LENGTH;
+	if(maxChannels * 2 >= length) {
+		/* Decode straight into dst */
+		raw_index_ = raw_length_ = 0;
+		startFrameTimer();
+		uint8_t words = readData(dst, length);
+		if(words)
+			trackFrame(dst, words);
+		else
+			frameFailed();
+		return words;
+	}
+	if(!requestRawData())
+		return 0;
+	memcpy(dst, raw_data_, maxChannels * sizeof(dst[0]));
+	raw_index_ = maxChannels;
+	return maxChannels;
+}
+
+/* How many of the channels of window w the device has */
+static uint8_t windowChannels(const Trill::ChannelWindow& w, uint8_t numChannels) {
+	if(w.first >= numChannels)
+		return 0;
+	return w.count < numChannels - w.first ? w.count : numChannels - w.first;
+}
+
+/* The windows from n on that are adjacent on the device are read as one.
+   Returns the index of the window after them, and their channels in count. */
+static uint8_t windowRun(const Trill::ChannelWindow* windows, uint8_t numWindows, uint8_t n, uint8_t numChannels, uint8_t& count) {
+	uint8_t next = n + 1;
+	count = windowChannels(windows[n], numChannels);
+	while(next < numWindows && windows[next].first == windows[n].first + count) {
+		count += windowChannels(windows[next], numChannels);
+		++next;
+	}
+	return next;
+}
+
+/* Read some windows of channels into dst, one after the other. Like the
+ * chunks in readData(), each run of adjacent windows needs the read
+ * pointer moved to its first channel, so we start from the run the
+ * pointer is already in: reading the same windows every frame needs one
+ * seek fewer than there are runs. */
+int Trill::readRawChannels(const ChannelWindow* windows, uint8_t numWindows, uint16_t* dst) {
+	uint8_t numChannels = RAW_LENGTH / 2;
+	if(numChannels > kRawLength / 2)
+		numChannels = kRawLength / 2;
+	startFrameTimer();
+
+	/* Find the run the read pointer is in, and where it goes in dst */
+	uint8_t start = 0;
+	uint8_t startIndex = 0;
+	uint8_t total = 0;
+	for(uint8_t n = 0; n < numWindows; ) {
+		uint8_t count;
+		uint8_t next = windowRun(windows, numWindows, n, numChannels, count);
+		uint8_t loc = kOffsetData + 2 * windows[n].first;
+		if(count && last_read_loc_ >= loc && last_read_loc_ < loc + 2 * count) {
+			start = n;
+			startIndex = total;
 		}
+		total += count;
+		n = next;
+	}
+	if(!total) {
+		frameFailed();
+		return 0;
+	}
 
-		/* Check again if we've got anything... */
-		if(wire_->available() < 2)
+	uint8_t n = start;
+	uint8_t index = startIndex;
+	do {
+		uint8_t count;
+		uint8_t next = windowRun(windows, numWindows, n, numChannels, count);
+		if(count && !readData(wire_, i2c_address_, last_read_loc_, max_transfer_, dst + index, 2 * count, 2 * windows[n].first TRILL_STATS_ARG(&stats_))) {
+			frameFailed();
 			return 0;
+		}
+		index += count;
+		n = next;
+		if(n >= numWindows)
+			n = index = 0;
+	} while(n != start);
+
+	trackFrame(dst, total);
+	return total;
+}
+
+/* Read length bytes from the data area into dst. The data might be longer
+ * than the largest transfer Wire can do (see setMaxTransferLength()), in
+ * which case it is split into chunks, each needing its own read pointer.
+ * Moving the pointer costs a transaction, so we start from the chunk
+ * the pointer is already at, if any: the chunk read last in a frame is
+ * then read first in the next one and steady-state polling needs one
+ * seek fewer than there are chunks.
+ * Returns the number of words read, or 0 on failure. */
+uint8_t Trill::readData(uint16_t* dst, uint8_t length) {
+	return readData(wire_, i2c_address_, last_read_loc_, max_transfer_, dst, length, 0 TRILL_STATS_ARG(&stats_));
+}
+
+/* The same, for any device, starting offset bytes into the data area:
+   read_loc tracks the read pointer of the device */
+uint8_t Trill::readData(TwoWire* wire, uint8_t address, uint8_t& read_loc, uint8_t max_transfer, uint16_t* dst, uint8_t length, uint8_t offset TRILL_STATS_ARG(TrillStats* stats)) {
+	const uint8_t chunk = max_transfer;
+	const uint8_t numChunks = (length + chunk - 1) / chunk;
+	const uint8_t first = firstChunk(read_loc, max_transfer, length, offset);
+	for(uint8_t n = 0; n < numChunks; ++n) {
+		uint8_t start = ((first + n) % numChunks) * chunk;
+		uint8_t size = length - start < chunk ? length - start : chunk;
+		seek(wire, address, read_loc, kOffsetData + offset + start TRILL_STATS_ARG(stats));
+		uint8_t received = wire->requestFrom(address, size);
+		TRILL_STATS(stats, read(size, received));
+		if(received < size) {
+			// failed transmission. Device died?
+			return 0;
+		}
+		readWords(wire, dst + start / 2, size / 2);
 	}
+	return length / 2;
+}
 
-	int result = ((uint8_t)wire_->read()) << 8;
-	result += (int)wire_->read();
-	return result;
+/* The chunk of a read of length bytes from offset in the data area that
+   the read pointer is at, or 0 */
+uint8_t Trill::firstChunk(uint8_t read_loc, uint8_t max_transfer, uint8_t length, uint8_t offset) {
+	const uint8_t chunk = max_transfer;
+	const uint8_t numChunks = (length + chunk - 1) / chunk;
+	if(read_loc >= kOffsetData + offset) {
+		uint8_t position = read_loc - kOffsetData - offset;
+		if(position % chunk == 0 && position / chunk < numChunks)
+			return position / chunk;
+	}
+	return 0;
+}
+
+/* Drain up to count big-endian words from the Wire buffer into dst,
+   converting them to the native byte order. Returns how many words
+   were read. */
+size_t Trill::readWords(TwoWire* wire, uint16_t* dst, size_t count) {
+	size_t available = wire->available() >> 1;
+	if(count > available)
+		count = available;
+	uint8_t* bytes = (uint8_t*)dst;
+	size_t length = count << 1;
+#ifdef TRILL_WIRE_HAS_BULK_READ
+	length = wire->readBytes(bytes, length);
+	count = length >> 1;
+#else
+	for(size_t n = 0; n < length; ++n)
+		bytes[n] = wire->read();
+#endif
+	swapWords(dst, count);
+	return count;
+}
+
+/* Convert big-endian words to the native byte order, in place */
+void Trill::swapWords(uint16_t* words, size_t count) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	(void)words;
+	(void)count;
+#elif defined(__AVR__)
+	/* On 8-bit cores swapping the two bytes is just two moves */
+	uint8_t* bytes = (uint8_t*)words;
+	for(size_t n = 0; n < count; ++n, bytes += 2) {
+		uint8_t msb = bytes[0];
+		bytes[0] = bytes[1];
+		bytes[1] = msb;
+	}
+#else
+	/* Elsewhere, swap two words at a time with 32-bit operations */
+	size_t n = 0;
+	for(; n + 2 <= count; n += 2) {
+		uint32_t pair;
+		memcpy(&pair, words + n, sizeof(pair));
+		pair = ((pair >> 8) & 0x00FF00FF) | ((pair & 0x00FF00FF) << 8);
+		memcpy(words + n, &pair, sizeof(pair));
+	}
+	if(n < count)
+		words[n] = (words[n] >> 8) | (words[n] << 8);
+#endif
 }
 
 /* Scan configuration settings */
 void Trill::setMode(Mode mode) {
-	wire_->beginTransmission(i2c_address_);
-	wire_->write(kOffsetCommand);
-	wire_->write(kCommandMode);
-	wire_->write(mode);
-	wire_->endTransmission();
+	target_.mode = mode;
+	sendSetting(kSettingMode);
+}
 
-	mode_ = mode;
-	last_read_loc_ = kOffsetCommand;
-	num_touches = 0;
+/* Keep the scan settings in the range the firmware accepts */
+static void clampScanSettings(Trill::Settings& settings) {
+	if(settings.speed > 3)
+		settings.speed = 3;
+	if(settings.num_bits < 9)
+		settings.num_bits = 9;
+	if(settings.num_bits > 16)
+		settings.num_bits = 16;
 }
 
 void Trill::setScanSettings(uint8_t speed, uint8_t num_bits) {
-	if(speed > 3)
-		speed = 3;
-	if(num_bits < 9)
-		num_bits = 9;
-	if(num_bits > 16)
-		num_bits = 16;
-	wire_->beginTransmission(i2c_address_);
-	wire_->write(kOffsetCommand);
-	wire_->write(kCommandScanSettings);
-	wire_->write(speed);
-	wire_->write(num_bits);
-	wire_->endTransmission();
-
-	last_read_loc_ = kOffsetCommand;
+	target_.speed = speed;
+	target_.num_bits = num_bits;
+	clampScanSettings(target_);
+	sendSetting(kSettingScan);
 }
 
 void Trill::setPrescaler(uint8_t prescaler) {
-	wire_->beginTransmission(i2c_address_);
-	wire_->write(kOffsetCommand);
-	wire_->write(kCommandPrescaler);
-	wire_->write(prescaler);
-	wire_->endTransmission();
-
-	last_read_loc_ = kOffsetCommand;
+	target_.prescaler = prescaler;
+	sendSetting(kSettingPrescaler);
 }
 
 void Trill::setNoiseThreshold(uint8_t threshold) {
-	wire_->beginTransmission(i2c_address_);
-	wire_->write(kOffsetCommand);
-	wire_->write(kCommandNoiseThreshold);
-	wire_->write(threshold);
-	wire_->endTransmission();
-
-	last_read_loc_ = kOffsetCommand;
+	target_.noise_threshold = threshold;
+	sendSetting(kSettingNoiseThreshold);
 }
 
 void Trill::setIDACValue(uint8_t value) {
-	wire_->beginTransmission(i2c_address_);
-	wire_->write(kOffsetCommand);
-	wire_->write(kCommandIdac);
-	wire_->write(value);
-	wire_->endTransmission();
-
-	last_read_loc_ = kOffsetCommand;
+	target_.idac = value;
+	sendSetting(kSettingIdac);
 }
 
 void Trill::setMinimumTouchSize(uint16_t size) {
-	wire_->beginTransmission(i2c_address_);
-	wire_->write(kOffsetCommand);
-	wire_->write(kCommandMinimumSize);
-	wire_->write(size >> 8);
-	wire_->write(size & 0xFF);
-	wire_->endTransmission();
-
-	last_read_loc_ = kOffsetCommand;
+	target_.minimum_size = size;
+	sendSetting(kSettingMinimumSize);
 }
 
 void Trill::setAutoScanInterval(uint16_t interval) {
-	wire_->beginTransmission(i2c_address_);
-	wire_->write(kOffsetCommand);
-	wire_->write(kCommandAutoScanInterval);
-	wire_->write(interval >> 8);
-	wire_->write(interval & 0xFF);
-	wire_->endTransmission();
+	target_.auto_scan_interval = interval;
+	sendSetting(kSettingAutoScanInterval);
+}
+
+/* Send one field of target_. On success it becomes part of settings_
+   and the next command is held back until the device has processed
+   this one. */
+int Trill::sendSetting(uint8_t setting) {
+	Settings previous = settings_;
+	uint8_t command;
+	uint8_t args[2];
+	uint8_t num_args = 1;
+
+	switch(setting) {
+	case kSettingMode:
+		command = kCommandMode;
+		args[0] = target_.mode;
+		settings_.mode = target_.mode;
+		break;
+	case kSettingScan:
+		command = kCommandScanSettings;
+		args[0] = target_.speed;
+		args[1] = target_.num_bits;
+		num_args = 2;
+		settings_.speed = target_.speed;
+		settings_.num_bits = target_.num_bits;
+		break;
+	case kSettingPrescaler:
+		command = kCommandPrescaler;
+		args[0] = settings_.prescaler = target_.prescaler;
+		break;
+	case kSettingNoiseThreshold:
+		command = kCommandNoiseThreshold;
+		args[0] = settings_.noise_threshold = target_.noise_threshold;
+		break;
+	case kSettingIdac:
+		command = kCommandIdac;
+		args[0] = settings_.idac = target_.idac;
+		break;
+	case kSettingMinimumSize:
+		command = kCommandMinimumSize;
+		args[0] = target_.minimum_size >> 8;
+		args[1] = target_.minimum_size & 0xFF;
+		num_args = 2;
+		settings_.minimum_size = target_.minimum_size;
+		break;
+	case kSettingAutoScanInterval:
+		command = kCommandAutoScanInterval;
+		args[0] = target_.auto_scan_interval >> 8;
+		args[1] = target_.auto_scan_interval & 0xFF;
+		num_args = 2;
+		settings_.auto_scan_interval = target_.auto_scan_interval;
+		break;
+	default:
+		return -1;
+	}
+
+	int ret = writeCommand(wire_, i2c_address_, last_read_loc_, command, args, num_args TRILL_STATS_ARG(&stats_));
+	if(ret) {
+		settings_ = previous;
+		return ret;
+	}
+	if(kSettingMode == setting) {
+		num_touches = 0;
+		last_frame_.invalidate();
+	}
+	settings_sent_ |= setting;
+	settings_resend_ &= ~setting;
+	scheduleNextCommand(interCommandDelay);
+	return 0;
+}
+
+/* Which fields of target_ differ from settings_ */
+uint8_t Trill::changedSettings() {
+	uint8_t changed = 0;
+
+	if(target_.mode != settings_.mode)
+		changed |= kSettingMode;
+	if(target_.speed != settings_.speed || target_.num_bits != settings_.num_bits)
+		changed |= kSettingScan;
+	if(target_.prescaler != settings_.prescaler)
+		changed |= kSettingPrescaler;
+	if(target_.noise_threshold != settings_.noise_threshold)
+		changed |= kSettingNoiseThreshold;
+	if(target_.idac != settings_.idac)
+		changed |= kSettingIdac;
+	if(target_.minimum_size != settings_.minimum_size)
+		changed |= kSettingMinimumSize;
+	if(target_.auto_scan_interval != settings_.auto_scan_interval)
+		changed |= kSettingAutoScanInterval;
+	return changed | settings_resend_;
+}
 
-	last_read_loc_ = kOffsetCommand;
+int Trill::applySettings(const Settings& settings, boolean wait, boolean sync_all) {
+	target_ = settings;
+	clampScanSettings(target_);
+	/* settings_ only guesses the fields never sent */
+	if(sync_all)
+		settings_resend_ |= kSettingAll & ~settings_sent_;
+	return sendSettings(wait);
+}
+
+/* Send target_, waiting for the device if wait */
+int Trill::sendSettings(boolean wait) {
+	int ret = pollSettings();
+	while(wait && kSettingsPending == ret) {
+		/* Wait for the last command to be processed */
+		delay((commandDelayRemaining() + 999) / 1000);
+		ret = pollSettings();
+	}
+	return ret;
+}
+
+/* Send one changed setting at a time, once the device is ready for it */
+int Trill::pollSettings() {
+	if(commandDelayRemaining())
+		return kSettingsPending;
+	uint8_t changed = changedSettings();
+	if(!changed)
+		return 0;
+	/* The lowest changed field first */
+	if(sendSetting(changed & (~changed + 1)))
+		return -1;
+	return kSettingsPending;
+}
+
+/* Each channel takes roughly 57us to scan at 12 bits in ULTRA_FAST mode,
+   twice as long for each step down in speed and for each extra bit. The
+   auto-scan interval is in ticks of the 32kHz clock. */
+uint32_t Trill::getScanPeriod() {
+	uint32_t scan = (57UL << settings_.speed) * getNumChannels() * (1UL << settings_.num_bits) / 4096;
+	/* 1000000 / 32768 is 15625 / 512, which can't overflow */
+	uint32_t interval = settings_.auto_scan_interval * 15625UL / 512;
+	return scan > interval ? scan : interval;
+}
+
+void Trill::setMaxTransferLength(uint8_t length) {
+	/* Reads are split on word boundaries */
+	length &= ~1;
+	if(length < 2)
+		length = 2;
+	max_transfer_ = length;
+}
+
+/* The instance using each EVT interrupt handler */
+static Trill* volatile gEventTrills[Trill::kMaxEventPins];
+
+template <uint8_t slot>
+void Trill::onEvent() {
+	Trill* t = gEventTrills[slot];
+	if(t)
+		t->frame_pending_ = 1;
+}
+
+boolean Trill::setEventPin(int pin) {
+	if(evt_slot_ >= 0) {
+		detachInterrupt(digitalPinToInterrupt(evt_pin_));
+		gEventTrills[evt_slot_] = nullptr;
+		evt_slot_ = -1;
+	}
+	evt_pin_ = -1;
+	if(pin < 0)
+		return true;
+	int interrupt = digitalPinToInterrupt(pin);
+#ifdef NOT_AN_INTERRUPT
+	if(NOT_AN_INTERRUPT == interrupt)
+		return false;
+#endif // NOT_AN_INTERRUPT
+	/* attachInterrupt() takes no argument for the handler, so each slot
+	   has its own */
+	static void (* const handlers[kMaxEventPins])(void) = {
+		onEvent<0>, onEvent<1>, onEvent<2>, onEvent<3>,
+	};
+	for(uint8_t n = 0; n < kMaxEventPins; ++n) {
+		if(gEventTrills[n])
+			continue;
+		evt_pin_ = pin;
+		evt_slot_ = n;
+		frame_pending_ = 0;
+		gEventTrills[n] = this;
+		pinMode(pin, INPUT);
+		attachInterrupt(interrupt, handlers[n], RISING);
+		return true;
+	}
+	return false;
+}
+
+boolean Trill::isFramePending() {
+	if(evt_slot_ >= 0)
+		return frame_pending_;
+	return micros() - last_frame_us_ >= getScanPeriod();
+}
+
+boolean Trill::readIfReady() {
+	if(!isFramePending())
+		return false;
+	/* A scan that ends from here on is read next time */
+	frame_pending_ = 0;
+	last_frame_us_ = micros();
+	if(CENTROID == settings_.mode)
+		return read();
+	return requestRawData();
+}
+
+/* Results of probeMaxTransferLength(), shared by all devices on a bus */
+static struct {
+	TwoWire* wire;
+	uint8_t length;
+} gMaxTransferLengths[4];
+
+uint8_t Trill::probeMaxTransferLength() {
+	const unsigned int numEntries = sizeof(gMaxTransferLengths) / sizeof(gMaxTransferLengths[0]);
+	for(unsigned int n = 0; n < numEntries; ++n) {
+		if(gMaxTransferLengths[n].wire == wire_) {
+			setMaxTransferLength(gMaxTransferLengths[n].length);
+			return max_transfer_;
+		}
+	}
+	/* Ask for a whole raw frame: Wire clips requests to what it can
+	   handle and tells us how many bytes it actually read */
+	prepareForDataRead();
+	uint8_t length = wire_->requestFrom(i2c_address_, (uint8_t)kRawLength);
+	/* A short read is expected here */
+	TRILL_STATS(&stats_, read(length, length));
+	if(length < 2)
+		return max_transfer_;
+	setMaxTransferLength(length);
+	for(unsigned int n = 0; n < numEntries; ++n) {
+		if(!gMaxTransferLengths[n].wire) {
+			gMaxTransferLengths[n].wire = wire_;
+			gMaxTransferLengths[n].length = max_transfer_;
+			break;
+		}
+	}
+	return max_transfer_;
 }
 
 /* Prepare the device to read data if it is not already prepared */
 void Trill::prepareForDataRead() {
-	if(last_read_loc_ != kOffsetData) {
-		wire_->beginTransmission(i2c_address_);
-		wire_->write(kOffsetData);
-		wire_->endTransmission();
+	seek(kOffsetData);
+}
+
+/* Move the read pointer on the device, unless it is already there */
+void Trill::seek(uint8_t loc) {
+	seek(wire_, i2c_address_, last_read_loc_, loc TRILL_STATS_ARG(&stats_));
+}
 
-		last_read_loc_ = kOffsetData;
+void Trill::seek(TwoWire* wire, uint8_t address, uint8_t& read_loc, uint8_t loc TRILL_STATS_ARG(TrillStats* stats)) {
+	if(read_loc != loc) {
+		wire->beginTransmission(address);
+		wire->write(loc);
+		wire->endTransmission();
+		TRILL_STATS(stats, seek());
+
+		read_loc = loc;
 	}
 }
 
+/* Send a command with its arguments. This moves the read pointer to the
+   command area. */
+int Trill::writeCommand(TwoWire* wire, uint8_t address, uint8_t& read_loc, uint8_t command, const uint8_t* args, uint8_t num_args TRILL_STATS_ARG(TrillStats* stats)) {
+	wire->beginTransmission(address);
+	wire->write(kOffsetCommand);
+	wire->write(command);
+	for(uint8_t n = 0; n < num_args; ++n)
+		wire->write(args[n]);
+	int ret = wire->endTransmission();
+	TRILL_STATS(stats, write(2 + num_args));
+
+	read_loc = kOffsetCommand;
+	return ret;
+}
+
 int Trill::getButtonValue(uint8_t button_num)
 {
-	if(mode_ != CENTROID)
+	if(settings_.mode != CENTROID)
 		return -1;
 	if(button_num > 1)
 		return -1;
 	if(device_type_ != TRILL_RING)
 		return -1;
 
-	return buffer_[2 * MAX_TOUCH_1D_OR_2D + button_num];
+	return Touches::centroids[2 * MAX_TOUCH_1D_OR_2D + button_num];
 }
 
 unsigned int Trill::getNumChannels()
@@ -360,7 +1166,7 @@ unsigned int Trill::getNumChannels()
 
 bool Trill::is1D()
 {
-	if(CENTROID != mode_)
+	if(CENTROID != settings_.mode)
 		return false;
 	switch(device_type_) {
 		case TRILL_BAR:
@@ -375,7 +1181,7 @@ bool Trill::is1D()
 
 bool Trill::is2D()
 {
-	if(CENTROID != mode_)
+	if(CENTROID != settings_.mode)
 		return false;
 	switch(device_type_) {
 		case TRILL_SQUARE:
@@ -421,6 +1227,94 @@ void Touches::processCentroids(uint8_t maxCentroids) {
 	// now num_touches is the number of active touches in the array
 }
 
+bool LastFrame::update(const uint16_t* words, uint8_t count) {
+	/* The length counts too, so that a shorter frame of zeros differs */
+	bool changed = !valid_ || count != count_;
+	if(count > kMaxWords) {
+		valid_ = false;
+		return true;
+	}
+	for(uint8_t n = 0; n < count; ++n) {
+		changed |= words[n] != words_[n];
+		words_[n] = words[n];
+	}
+	count_ = count;
+	valid_ = true;
+	return changed;
+}
+
+#ifdef TRILL_ENABLE_STATS
+void TrillStats::frame(boolean ok, uint32_t latency_us) {
+	if(!ok) {
+		++failed_frames;
+		return;
+	}
+	++frames;
+	if(latency_us > max_latency_us)
+		max_latency_us = latency_us;
+	/* Bucket n holds latencies under 256us << n */
+	uint8_t bucket = 0;
+	for(uint32_t scaled = latency_us >> 8; scaled && bucket < kNumLatencyBuckets - 1; scaled >>= 1)
+		++bucket;
+	++latency[bucket];
+}
+
+void TrillStats::dump(Print& out) const {
+	const char* names[] = {
+		"transactions", "bytes written", "bytes read", "short reads", "seeks",
+		"retries", "frames", "failed frames", "max latency/us",
+	};
+	const uint32_t values[] = {
+		transactions, bytes_written, bytes_read, short_reads, seeks,
+		retries, frames, failed_frames, max_latency_us,
+	};
+	for(unsigned int n = 0; n < sizeof(values) / sizeof(values[0]); ++n) {
+		out.print(names[n]);
+		out.print(": ");
+		out.println((unsigned long)values[n]);
+	}
+	for(unsigned int n = 0; n < kNumLatencyBuckets; ++n) {
+		out.print(n + 1 < kNumLatencyBuckets ? "latency < " : "latency >= ");
+		out.print((unsigned long)256 << (n + 1 < kNumLatencyBuckets ? n : n - 1));
+		out.print("us: ");
+		out.println((unsigned long)latency[n]);
+	}
+}
+#endif // TRILL_ENABLE_STATS
+
+uint32_t trillDivide(uint16_t dividend, uint16_t divisor, uint8_t shift) {
+	/* Normalise the divisor to [2^15, 2^16) */
+	uint8_t s = 0;
+	uint16_t d = divisor;
+	while(!(d & 0x8000)) {
+		d <<= 1;
+		++s;
+	}
+	/* r approximates 2^31 / d: a linear estimate good to 1/17, then two
+	   Newton-Raphson steps and a final correction to floor(2^31 / d) */
+	uint32_t r = 92521 - (((uint32_t)d * 61681) >> 16);
+	for(unsigned int n = 0; n < 2; ++n) {
+		int32_t e = (int32_t)(0x80000000 - (uint32_t)d * r);
+		r += (int32_t)(r * (e >> 15)) >> 16;
+	}
+	while((uint32_t)d * (r + 1) <= 0x80000000)
+		++r;
+	while((uint32_t)d * r > 0x80000000)
+		--r;
+	/* Integer part, low by at most one */
+	uint16_t q = (((uint32_t)dividend * r) >> 16) >> (15 - s);
+	uint16_t rem = dividend - q * divisor;
+	if(rem >= divisor) {
+		++q;
+		rem -= divisor;
+	}
+	/* Fractional part, low by at most one */
+	uint16_t f = (((uint32_t)(rem << s) * r) >> 16) >> (15 - shift);
+	if((uint32_t)(f + 1) * divisor <= ((uint32_t)rem << shift))
+		++f;
+	return ((uint32_t)q << shift) + f;
+}
+
 /* These methods for horizontal touches on 2D sliders */
 int Touches2D::touchHorizontalLocation(uint8_t touch_num) {
 	return horizontal.touchLocation(touch_num);
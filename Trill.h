@@ -18,11 +18,119 @@
 #endif
 #include "Wire.h"
 
+// The largest transfer Wire can do. Some cores have a larger buffer than
+// BUFFER_LENGTH suggests, and some (e.g.: Particle OS) don't define it.
+#ifndef TRILL_WIRE_BUFFER_LENGTH
+#if defined(I2C_BUFFER_LENGTH) // ESP32
+#define TRILL_WIRE_BUFFER_LENGTH I2C_BUFFER_LENGTH
+#elif defined(WIRE_BUFFER_SIZE) // RP2040 (arduino-pico)
+#define TRILL_WIRE_BUFFER_LENGTH WIRE_BUFFER_SIZE
+#elif defined(BUFFER_LENGTH)
+#define TRILL_WIRE_BUFFER_LENGTH BUFFER_LENGTH
+#else
+#define TRILL_WIRE_BUFFER_LENGTH 32
+#endif
+#endif // TRILL_WIRE_BUFFER_LENGTH
+
+// Cores that can run an I2C write + read in the background, with the
+// writeReadAsync()/finishedAsync() interface of arduino-pico, define
+// TRILL_WIRE_HAS_ASYNC so that startRead() doesn't block. It is on for
+// arduino-pico 4 and later; define TRILL_WIRE_NO_ASYNC for the whole build
+// (e.g. build_flags in PlatformIO, compiler.cpp.extra_flags in
+// platform.local.txt) to turn it off, or TRILL_WIRE_HAS_ASYNC for another
+// core with the same interface.
+#if !defined(TRILL_WIRE_HAS_ASYNC) && !defined(TRILL_WIRE_NO_ASYNC)
+#if defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_MBED) \
+		&& defined(ARDUINO_PICO_MAJOR) && ARDUINO_PICO_MAJOR >= 4
+#define TRILL_WIRE_HAS_ASYNC
+#endif
+#endif
+
+// Cores whose TwoWire::readBytes() copies straight out of the receive
+// buffer can define TRILL_WIRE_HAS_BULK_READ, in the same way, to drain it
+// in one call. Elsewhere readBytes() falls back to Stream's timed per-byte
+// reads, which are slower than calling read() in a loop. No core is known
+// to do this in every version, so it is never on by default.
+
 #define TRILL_SPEED_ULTRA_FAST 	0
 #define TRILL_SPEED_FAST	1
 #define TRILL_SPEED_NORMAL    	2
 #define TRILL_SPEED_SLOW	3
 
+// Define TRILL_ENABLE_STATS for the whole build (e.g. with
+// -DTRILL_ENABLE_STATS, not in a sketch) to have every Trill count its
+// bus traffic and time its reads, see Trill::getStats(). Without it
+// none of the counting code is compiled in.
+#ifdef TRILL_ENABLE_STATS
+#define TRILL_STATS_ARG(arg) , arg
+#define TRILL_STATS(stats, call) do { if(stats) (stats)->call; } while(0)
+
+struct TrillStats
+{
+	enum {
+		kNumLatencyBuckets = 8
+	};
+	uint32_t transactions;	/* Reads and writes on the bus */
+	uint32_t bytes_written;	/* Not counting addresses */
+	uint32_t bytes_read;
+	uint32_t short_reads;	/* Transactions that returned fewer bytes than asked for.
+				   With TRILL_WIRE_HAS_ASYNC, the bytes of a background
+				   transfer are worked out from what it left unwritten,
+				   which is only possible for the last chunk of a
+				   centroid frame */
+	uint32_t seeks;	/* Writes that only move the read pointer */
+	uint32_t retries;	/* Attempts repeated by reconnect() */
+	uint32_t frames;	/* Frames read successfully */
+	uint32_t failed_frames;
+	uint32_t max_latency_us;
+	/* Frames by the time taken to read them: under 256us, under 512us
+	   and so on, the last bucket counting 16384us and over */
+	uint32_t latency[kNumLatencyBuckets];
+
+	TrillStats() { reset(); }
+	void reset() { memset(this, 0, sizeof(*this)); }
+	void write(uint8_t bytes) {
+		++transactions;
+		bytes_written += bytes;
+	}
+	void seek() {
+		write(1);
+		++seeks;
+	}
+	void read(uint8_t requested, uint8_t received) {
+		++transactions;
+		bytes_read += received;
+		if(received < requested)
+			++short_reads;
+	}
+	void frame(boolean ok, uint32_t latency_us);
+	/* Print all the counters, one per line */
+	void dump(Print& out) const;
+};
+#else
+#define TRILL_STATS_ARG(arg)
+#define TRILL_STATS(stats, call) do {} while(0)
+#endif // TRILL_ENABLE_STATS
+
+/* A copy of the last frame, to tell whether the next one is new. Frames
+   are compared word by word, so that any change counts, however small
+   and whatever its pattern. */
+class LastFrame
+{
+public:
+	enum { kMaxWords = 30 };
+	LastFrame() : count_(0), valid_(false) {}
+	/* Returns true unless words are the same as last time */
+	bool update(const uint16_t* words, uint8_t count);
+	void invalidate() { valid_ = false; }
+private:
+	uint16_t words_[kMaxWords];
+	uint8_t count_;
+	bool valid_;
+};
+
+class TrillFrameHistory;
+
 class Touches
 {
 public:
@@ -55,6 +163,7 @@ class Trill : public Touches2D
 {
 	public:
 		Trill();
+		~Trill();
 
 		enum Mode {
 			AUTO = -1,
@@ -84,16 +193,9 @@ class Trill : public Touches2D
 			uint8_t address;
 		};
 
-		struct TrillDefaults trillDefaults[TRILL_NUM_DEVICES + 1] = {
-			{TRILL_NONE, AUTO, 0xFF},
-			{TRILL_UNKNOWN, AUTO, 0xFF},
-			{TRILL_BAR, CENTROID, 0x20},
-			{TRILL_SQUARE, CENTROID, 0x28},
-			{TRILL_CRAFT, DIFF, 0x30},
-			{TRILL_RING, CENTROID, 0x38},
-			{TRILL_HEX, CENTROID, 0x40},
-			{TRILL_FLEX, DIFF, 0x48},
-		};
+		/* The default mode and address of a device. See TrillTraits
+		   for compile-time constants */
+		static TrillDefaults getDefaults(Device device);
 
 		static constexpr uint8_t interCommandDelay = 15;
 		/**
@@ -107,10 +209,63 @@ class Trill : public Touches2D
 		static constexpr uint8_t prescalerMax = 8;
 
 
-		/* Initialise the hardware */
-		int begin(Device device, uint8_t i2c_address = 255, TwoWire* wire = &Wire);
+		/**
+		 * Returned by beginAsync() and poll() while initialisation
+		 * is still in progress.
+		 */
+		static constexpr int kBeginInProgress = 1;
+		/**
+		 * Returned by poll() if beginAsync() was never called.
+		 */
+		static constexpr int kBeginNotStarted = -4;
+
+		/* Initialise the hardware. If evt_pin is given, see setEventPin() */
+		int begin(Device device, uint8_t i2c_address = 255, TwoWire* wire = &Wire, int evt_pin = -1);
 		/* Initialise the hardware, it's the same as begin() */
-		int setup(Device device, uint8_t i2c_address = 255, TwoWire* wire = &Wire) { return begin(device, i2c_address, wire); }
+		int setup(Device device, uint8_t i2c_address = 255, TwoWire* wire = &Wire, int evt_pin = -1) { return begin(device, i2c_address, wire, evt_pin); }
+
+		/**
+		 * Start initialising the hardware without blocking.
+		 *
+		 * This performs the same steps as begin(), but instead of
+		 * waiting for the device to process each command it returns
+		 * #kBeginInProgress straight away. Call poll() repeatedly
+		 * until it returns something else. Several sensors on the same
+		 * bus can be brought up at the same time this way, so that
+		 * they wait for their commands to complete in parallel.
+		 * deviceType() is #TRILL_NONE until the device has identified
+		 * itself as the one requested.
+		 *
+		 * @return #kBeginInProgress on success, or one of the error
+		 * codes of begin().
+		 */
+		int beginAsync(Device device, uint8_t i2c_address = 255, TwoWire* wire = &Wire, int evt_pin = -1);
+		/**
+		 * Advance the initialisation started by beginAsync(). This
+		 * only sends the next command once enough time has passed
+		 * since the previous one and never blocks.
+		 *
+		 * @return #kBeginInProgress while initialisation is ongoing,
+		 * then the same value begin() would have returned.
+		 */
+		int poll();
+
+		/**
+		 * Bring back a device that stopped answering, e.g. after a
+		 * loose cable or a power glitch, without the delays of
+		 * begin(). The address is checked for an ACK up to `attempts`
+		 * times, 1ms, 2ms, 4ms... apart. If it still reports the
+		 * device type found by begin(), it is not identified again.
+		 * The settings sent so far (see getSettings()) are then sent
+		 * again, as the device may have reset. With the default
+		 * mode and scan settings this takes about 30ms, against over
+		 * 200ms for begin().
+		 *
+		 * @return 0 on success, 2 if nothing answers, -3 if a
+		 * different device does, or -1 if the device didn't take the
+		 * settings
+		 */
+		int reconnect(uint8_t attempts = 5);
 
 		/* --- Main communication --- */
 
@@ -135,20 +290,45 @@ class Trill : public Touches2D
 		 */
 		bool is2D();
 
+		/* Return the type of device at i2c_address on Wire, or
+		   TRILL_NONE if there is none. The device is not initialised:
+		   call begin() to use it. */
 		static Device probe(uint8_t i2c_address) {
-			Trill t;
-
-			/* Start I2C */
-			t.begin(Trill::TRILL_UNKNOWN, i2c_address);
+			BusDevice found;
 
-			/* Check the type of device attached */
-			if(t.identify() != 0) {
-				// Unable to identify device
+			if(!scanBus(&found, 1, &Wire, i2c_address, i2c_address))
 				return Trill::TRILL_NONE;
-			}
-			return t.deviceType();
+			return (Device)found.device;
 		}
 
+		/* A device found by scanBus() */
+		struct BusDevice {
+			uint8_t address;
+			uint8_t device;	/* A Device */
+			uint8_t firmware;
+		};
+		/**
+		 * Find the Trill devices on a bus, without initialising them.
+		 * Every address in the range is first checked for an ACK, which
+		 * costs a single byte on the bus. The identify command is then
+		 * sent to every address that answered and all their identities
+		 * are read after a single wait, so a scan takes about 25ms
+		 * however many addresses are empty or taken.
+		 *
+		 * Like any bus scan, this might upset non-Trill peripherals
+		 * that answer within the range.
+		 *
+		 * @param devices the table to fill, in order of address
+		 * @param maxDevices the number of entries in `devices`. Only
+		 * Trills take an entry: the scan stops once that many are found,
+		 * however many other devices answered before them
+		 * @param wire the bus to scan
+		 * @param first the first address to check
+		 * @param last the last address to check
+		 * @return the number of devices found
+		 */
+		static uint8_t scanBus(BusDevice* devices, uint8_t maxDevices, TwoWire* wire = &Wire, uint8_t first = 0x20, uint8_t last = 0x50);
+
 		/* Return the device type already identified */
 		Device deviceType() { return device_type_; };
 
@@ -159,7 +339,7 @@ class Trill : public Touches2D
 		int firmwareVersion() { return firmware_version_; }
 
 		/* Get the mode that the device is currently in */
-		Mode getMode() { return mode_; }
+		Mode getMode() { return settings_.mode; }
 
 		/* Get the current address of the device */
 		uint8_t getAddress() { return i2c_address_; }
@@ -176,6 +356,117 @@ class Trill : public Touches2D
 		/* Update the baseline value on the sensor */
 		void updateBaseline();
 
+		/* --- Split-phase reads --- */
+
+		/**
+		 * Start reading the latest frame: centroids in #CENTROID mode,
+		 * raw data otherwise. On cores where Wire can transfer in the
+		 * background this returns straight away, leaving the sketch
+		 * free to do other work. Elsewhere the frame is read before
+		 * returning.
+		 *
+		 * @return `false` if the previous read has not been completed
+		 * with finishRead() yet
+		 */
+		boolean startRead();
+		/**
+		 * Whether the read started with startRead() has completed.
+		 * Call this regularly while the read is pending: it starts
+		 * the transfer of the next part of frames that don't fit in
+		 * a single transaction.
+		 */
+		boolean isReadComplete();
+		/**
+		 * Complete the read started with startRead(), waiting for it
+		 * if needed, and make its data available as after read() or
+		 * requestRawData().
+		 *
+		 * @return `true` on success
+		 */
+		boolean finishRead();
+
+		/* --- Frame tracking --- */
+
+		/**
+		 * Whether the frame got by the last read(), requestRawData(),
+		 * readRawFrame(), finishRead() or readIfReady() differs from
+		 * the one before. Reading more often than the sensor scans
+		 * returns the same frame again: there is no need to process
+		 * it. The firmware doesn't number its scans, so frames are
+		 * told apart by their content; a centroid frame
+		 * with no touches is the same as the previous one with no
+		 * touches.
+		 */
+		boolean isNewFrame() { return new_frame_; }
+		/* Number of frames read, and of those that were not new, since
+		   the last resetReadCounters() */
+		uint32_t getNumReads() { return num_reads_; }
+		uint32_t getNumStaleReads() { return num_stale_reads_; }
+		void resetReadCounters() { num_reads_ = num_stale_reads_ = 0; }
+
+		/* --- Frame history --- */
+
+		/**
+		 * Read frames straight into history, and keep each new one
+		 * there with the time it was read at (see TrillHistory.h).
+		 * This covers read(), requestRawData(), requestRawChannels(),
+		 * startRead()/finishRead() and readIfReady(); touchLocation()
+		 * and rawDataRead() then read from the history. Frames longer
+		 * than its slots, and those that readRawChannels() or
+		 * readRawFrame() decode into an array of the caller, are read
+		 * as without a history. Don't change it while a split-phase
+		 * read is in progress.
+		 *
+		 * @param history the history, or nullptr to stop using one
+		 */
+		void setHistory(TrillFrameHistory* history);
+		TrillFrameHistory* getHistory() { return history_; }
+
+#ifdef TRILL_ENABLE_STATS
+		/* --- Statistics --- */
+
+		/**
+		 * Counters of the bus traffic of this device and of the time
+		 * taken by each frame read with read(), requestRawData(),
+		 * requestRawChannels(), readRawChannels() or readRawFrame(),
+		 * or from startRead() to finishRead(). Only available if the
+		 * library is built with TRILL_ENABLE_STATS.
+		 */
+		const TrillStats& getStats() { return stats_; }
+		void resetStats() { stats_.reset(); }
+		void dumpStats(Print& out) { stats_.dump(out); }
+
+#endif // TRILL_ENABLE_STATS
+		/* --- Data-ready pin --- */
+
+		/**
+		 * Use the EVT pin of the device, connected to `pin`, to find
+		 * out when a new scan is available: a rising edge on it marks
+		 * a frame as pending, from an interrupt. Up to
+		 * #kMaxEventPins devices can use a pin at the same time.
+		 *
+		 * @param pin the pin, or -1 to stop using it
+		 * @return `false` if the pin can't raise interrupts or too
+		 * many pins are in use
+		 */
+		boolean setEventPin(int pin);
+		int getEventPin() { return evt_pin_; }
+		static constexpr uint8_t kMaxEventPins = 4;
+		/**
+		 * Whether a scan has completed since the last readIfReady().
+		 * Without an EVT pin this is estimated from getScanPeriod().
+		 */
+		boolean isFramePending();
+		/**
+		 * Read the latest frame, as read() in #CENTROID mode or
+		 * requestRawData() otherwise, but only if isFramePending().
+		 * Calling this as often as convenient reads each scan once,
+		 * soon after it completes.
+		 *
+		 * @return `true` if a new frame was read
+		 */
+		boolean readIfReady();
+
 		/* --- Data processing --- */
 
 		/* Button value for Ring? */
@@ -183,12 +474,133 @@ class Trill : public Touches2D
 
 		/* --- Raw data handling --- */
 
-		/* Request raw data; wrappers for Wire */
+		/* Request raw data; wrappers for Wire. max_length limits the
+		   request to the first max_length bytes of the frame. */
 		boolean requestRawData(uint8_t max_length = 0xFF);
 		int rawDataAvailable();
 		int rawDataRead();
+		/**
+		 * Request a raw frame and decode it into an array in a single
+		 * call. This is faster than calling rawDataRead() for each
+		 * channel, as the Wire buffer is drained in bulk.
+		 *
+		 * @param dst the array to write into
+		 * @param maxChannels the maximum number of channels to write
+		 * @return the number of channels written to `dst`, 0 on failure.
+		 */
+		int readRawFrame(uint16_t* dst, size_t maxChannels);
+
+		/* --- Channel windows --- */
+
+		/* A run of adjacent channels */
+		struct ChannelWindow {
+			uint8_t first;
+			uint8_t count;
+		};
+		/**
+		 * Request the raw data of channels `first` to
+		 * `first + count - 1` only, for rawDataAvailable() and
+		 * rawDataRead(). The bus time is that of the channels read,
+		 * not of the whole frame: a Craft with 6 pads wired reads 12
+		 * bytes instead of 60.
+		 *
+		 * @return `true` on success
+		 */
+		boolean requestRawChannels(uint8_t first, uint8_t count);
+		/**
+		 * Read the raw data of a few windows of channels, one after
+		 * the other, into `dst`. Each window not adjacent to the one
+		 * before costs a transaction to move the read pointer, except
+		 * that the window read last in a frame is read first in the
+		 * next one; a gap of a channel or two is cheaper to read
+		 * through with a wider window. Channels past the last one of
+		 * the device are left out.
+		 *
+		 * @param windows the windows to read, in the order to write
+		 * them to `dst`
+		 * @param numWindows the number of windows
+		 * @param dst the array to write into, with room for the
+		 * channels of all the windows
+		 * @return the number of channels written to `dst`, 0 on failure.
+		 */
+		int readRawChannels(const ChannelWindow* windows, uint8_t numWindows, uint16_t* dst);
+
+		/* --- Transfer size --- */
+
+		/**
+		 * Set the largest number of bytes read from the device in a
+		 * single I2C transaction. Reads longer than this are split.
+		 * It defaults to the size of the Wire buffer, if known for the
+		 * current core, or BUFFER_LENGTH.
+		 */
+		void setMaxTransferLength(uint8_t length);
+		uint8_t getMaxTransferLength() { return max_transfer_; }
+		/**
+		 * Find out how many bytes the Wire object in use can read in a
+		 * single transaction, by asking it for a full raw frame, and
+		 * use that as the maximum transfer length. The result is
+		 * remembered per TwoWire object, so only the first device on
+		 * each bus generates traffic. Call after begin().
+		 *
+		 * @return the new maximum transfer length
+		 */
+		uint8_t probeMaxTransferLength();
 
 		/* --- Scan configuration settings --- */
+
+		/* The scan configuration of a device */
+		struct Settings {
+			Mode mode;
+			uint8_t speed;
+			uint8_t num_bits;
+			uint8_t prescaler;
+			uint8_t noise_threshold;
+			uint8_t idac;
+			uint16_t minimum_size;
+			uint16_t auto_scan_interval;
+		};
+		/**
+		 * Returned by applySettings() and pollSettings() while some
+		 * settings are still to be sent or processed.
+		 */
+		static constexpr int kSettingsPending = 1;
+		/**
+		 * The settings last sent to the device, by begin(), the
+		 * setters below or applySettings(). Fields that were never
+		 * sent read the defaults of the firmware, which the device
+		 * may not be at, e.g. if an earlier sketch changed them.
+		 */
+		const Settings& getSettings() { return settings_; }
+		/**
+		 * Send the fields of `settings` that differ from
+		 * getSettings(), and only those. Each command is sent as soon
+		 * as the device has had time to process the previous one,
+		 * whatever sent it: only the time left since then is waited
+		 * for, measured with micros().
+		 *
+		 * @param settings the settings wanted, e.g. a copy of
+		 * getSettings() with a few fields changed
+		 * @param wait if `false`, return straight away instead of
+		 * waiting for the device, leaving pollSettings() to send the
+		 * rest
+		 * @param sync_all also send the fields never sent before,
+		 * whether they differ or not, so that the device is known to
+		 * hold all of `settings` (see getSettings())
+		 * @return 0 once all the settings have been sent and
+		 * processed, #kSettingsPending if `wait` is `false` and some
+		 * are left, -1 if the device didn't take a command
+		 */
+		int applySettings(const Settings& settings, boolean wait = true, boolean sync_all = false);
+		/**
+		 * Send the next setting left by applySettings(), if the device
+		 * is ready for it. This never blocks: call it on every loop.
+		 *
+		 * @return the same as applySettings()
+		 */
+		int pollSettings();
+
+		/* These send their command straight away, whether the value
+		   has changed or not, and without waiting for the device */
 		void setMode(Mode mode);
 		void setScanSettings(uint8_t speed, uint8_t num_bits);
 		void setPrescaler(uint8_t prescaler);
@@ -197,8 +609,76 @@ class Trill : public Touches2D
 		void setMinimumTouchSize(uint16_t size);
 		void setAutoScanInterval(uint16_t interval);
 
+		/**
+		 * Estimate the time between two scans, in microseconds, from
+		 * the scan settings and auto-scan interval last set. Reading
+		 * more often than this returns the same frame again.
+		 */
+		uint32_t getScanPeriod();
+
 	private:
+		template <Device, Mode> friend class TrillDevice;
+		template <Device> friend struct TrillTraits;
+
+		/* The one source of the defaults, for trillDefaults and
+		   TrillTraits */
+		static constexpr Mode defaultModeOf(Device device) {
+			return TRILL_CRAFT == device || TRILL_FLEX == device ? DIFF
+				: device >= TRILL_BAR && device < TRILL_NUM_DEVICES ? CENTROID
+				: AUTO;
+		}
+		static constexpr uint8_t defaultAddressOf(Device device) {
+			return device >= TRILL_BAR && device < TRILL_NUM_DEVICES ? 0x20 + 8 * (device - TRILL_BAR) : 0xFF;
+		}
+		/* Shared by all instances. On AVR it is kept in program memory,
+		   so it is only read through getDefaults() */
+		static const struct TrillDefaults trillDefaults[TRILL_NUM_DEVICES + 1];
+
 		void prepareForDataRead();
+		void seek(uint8_t loc);
+		uint8_t readData(uint16_t* dst, uint8_t length);
+		uint8_t centroidLength();
+		boolean processCentroidData(const uint16_t* words, uint8_t loc, uint8_t length);
+		void setCentroidData(const uint16_t* words);
+		uint16_t* frameDestination(uint8_t count, uint16_t* fallback);
+		void trackFrame(const uint16_t* words, uint8_t count);
+		void frameFailed();
+#ifdef TRILL_ENABLE_STATS
+		void startFrameTimer() { read_start_us_ = micros(); }
+#else
+		void startFrameTimer() {}
+#endif
+		boolean startChunk();
+		void readFailed();
+		static uint8_t receivedLength(const uint16_t* words, uint8_t size);
+		int requestIdentify();
+		int readIdentity();
+
+		/* The I2C protocol, shared with TrillDevice. read_loc tracks
+		   the read pointer of the device at address. */
+		static void seek(TwoWire* wire, uint8_t address, uint8_t& read_loc, uint8_t loc TRILL_STATS_ARG(TrillStats* stats));
+		static uint8_t readData(TwoWire* wire, uint8_t address, uint8_t& read_loc, uint8_t max_transfer, uint16_t* dst, uint8_t length, uint8_t offset TRILL_STATS_ARG(TrillStats* stats));
+		static uint8_t firstChunk(uint8_t read_loc, uint8_t max_transfer, uint8_t length, uint8_t offset = 0);
+		static size_t readWords(TwoWire* wire, uint16_t* dst, size_t count);
+		static void swapWords(uint16_t* words, size_t count);
+		static int writeCommand(TwoWire* wire, uint8_t address, uint8_t& read_loc, uint8_t command, const uint8_t* args, uint8_t num_args TRILL_STATS_ARG(TrillStats* stats));
+		static int readIdentity(TwoWire* wire, uint8_t address, uint8_t& read_loc, Device& device, uint8_t& firmware_version TRILL_STATS_ARG(TrillStats* stats));
+		template <uint8_t slot> static void onEvent();
+		void scheduleNextCommand(uint16_t delay_ms);
+		uint32_t commandDelayRemaining();
+		uint8_t changedSettings();
+		int sendSettings(boolean wait);
+		boolean answers();
+		int sendSetting(uint8_t setting);
+
+		enum {
+			kInitIdle,
+			kInitIdentify,
+			kInitMode,
+			kInitScanSettings,
+			kInitBaseline,
+			kInitDone
+		};
 
 		enum {
 			kCommandNone = 0,
@@ -213,6 +693,28 @@ class Trill : public Touches2D
 			kCommandIdentify = 255
 		};
 
+		/* Fields of Settings, each set by one command */
+		enum {
+			kSettingMode = 1 << 0,
+			kSettingScan = 1 << 1,
+			kSettingPrescaler = 1 << 2,
+			kSettingNoiseThreshold = 1 << 3,
+			kSettingIdac = 1 << 4,
+			kSettingMinimumSize = 1 << 5,
+			kSettingAutoScanInterval = 1 << 6,
+			kSettingAll = (1 << 7) - 1
+		};
+
+		enum {
+			kReadIdle,
+			kReadPending,
+			kReadDone
+		};
+
+		enum {
+			kReadTimeoutUs = 20000	/* For each chunk of a background read */
+		};
+
 		enum {
 			kOffsetCommand = 0,
 			kOffsetData = 4
@@ -236,6 +738,10 @@ class Trill : public Touches2D
 			kNumChannelsMax = 30
 		};
 
+		enum {
+			kRawOffset = kCentroidLength2D / 2	/* Raw words live in buffer_ after the centroids */
+		};
+
 		enum {
 			kRawLengthBar = 52,
 			kRawLengthHex = 60,
@@ -244,13 +750,78 @@ class Trill : public Touches2D
 		TwoWire* wire_;
 
 		Device device_type_;	/* Which type of device is connected, if any */
-		Mode mode_;			/* Which mode the device is in */
 		uint8_t firmware_version_;	/* Firmware version running on the device */
 		uint8_t last_read_loc_;	/* Which byte reads will begin from on the device */
-		uint8_t raw_bytes_left_; /* How many bytes still remaining to request? */
+		uint8_t raw_index_;	/* Next raw word returned by rawDataRead() */
+		uint8_t raw_length_;	/* Number of raw words in the buffer */
+		uint8_t max_transfer_;	/* Largest read in a single transaction */
 		uint8_t i2c_address_;	/* Address of this slider on I2C bus */
+		uint8_t init_state_;	/* Progress of beginAsync()/poll() */
+		int8_t init_result_;	/* Return value of poll() once kInitDone */
+		Device init_device_;	/* Device requested in beginAsync() */
+		uint32_t last_command_us_;	/* micros() at the time of the last timed command */
+		uint32_t command_delay_us_;	/* How long that command takes to process */
+		Settings settings_;	/* Last values sent to the device */
+		Settings target_;	/* Values applySettings() is sending */
+		uint8_t settings_sent_;	/* Fields of settings_ ever sent, as kSetting* flags */
+		uint8_t settings_resend_;	/* Fields pollSettings() must send even if unchanged */
+		uint8_t read_state_;	/* Progress of startRead()/finishRead() */
+		uint8_t read_length_;	/* Bytes requested by startRead() */
+		uint8_t read_words_;	/* Words read once complete */
+		uint16_t* read_dst_;	/* Where startRead() reads into */
+		boolean read_centroids_;	/* Whether startRead() reads a centroid frame */
+		/* Only used with TRILL_WIRE_HAS_ASYNC */
+		uint8_t read_chunk_;	/* Chunks of the frame already transferred */
+		uint8_t read_first_chunk_;
+		uint8_t read_loc_;	/* Read pointer written by the transfer in progress */
+		uint32_t read_chunk_us_;	/* micros() when the transfer in progress started */
+		int8_t evt_pin_;	/* Pin connected to EVT, or -1 */
+		int8_t evt_slot_;	/* Which interrupt handler serves evt_pin_, or -1 */
+		volatile uint8_t frame_pending_;	/* Set from the EVT interrupt */
+		uint32_t last_frame_us_;	/* micros() at the last readIfReady() without EVT */
+		LastFrame last_frame_;	/* To tell whether the next frame is new */
+		boolean new_frame_;
+		uint32_t num_reads_;
+		uint32_t num_stale_reads_;
+		TrillFrameHistory* history_;	/* Where frames are read into, if not buffer_ */
+		const uint16_t* raw_data_;	/* The words rawDataRead() returns */
+#ifdef TRILL_ENABLE_STATS
+		TrillStats stats_;
+		uint32_t read_start_us_;	/* micros() at the start of the frame read in progress */
+#endif // TRILL_ENABLE_STATS
+
+		uint16_t buffer_[kCentroidLength2D * 2];/* Buffer for centroid and raw responses */
+};
 
-		uint16_t buffer_[kCentroidLength2D * 2];/* Buffer for centroid response */
+/* Returns ((uint32_t)dividend << shift) / divisor, for divisor > 0 and
+   shift <= 15, using a few multiplications in place of the division.
+   The result is exact: a Newton-Raphson reciprocal of the divisor is
+   corrected to be exact before use and each partial quotient is
+   corrected by at most one. On cores without a hardware divider
+   (e.g.: AVR) this is much cheaper than a 32-bit division. */
+uint32_t trillDivide(uint16_t dividend, uint16_t divisor, uint8_t shift);
+
+// a small helper class, whose main purpose is to wrap the #include
+// and make all the variables related to it private and multi-instance safe.
+// Shared by CentroidDetection and CustomSliders (see TrillSliders.h)
+class TrillCentroidCalculator
+{
+public:
+	typedef uint16_t WORD;
+	typedef uint8_t BYTE;
+	WORD wMinimumCentroidSize = 0;
+	BYTE SLIDER_BITS = 7;
+	WORD wAdjacentCentroidNoiseThreshold = 400; // Trough between peaks needed to identify two centroids
+	BYTE bDivisionFree = 0;
+	long centroidFraction(WORD weightedSum, WORD unweightedSum) {
+		if(bDivisionFree)
+			return trillDivide(weightedSum, unweightedSum, SLIDER_BITS);
+		return ((long)weightedSum << SLIDER_BITS) / unweightedSum;
+	}
+	//template <typename Readings>
+	//WORD calculateCentroids(const Readings& CSD_waSnsDiff, WORD *centroidBuffer, WORD *sizeBuffer, BYTE maxNumCentroids, BYTE minSensor, BYTE maxSensor, BYTE numSensors);
+	// calculateCentroids is defined here:
+	#include "calculateCentroids.h"
 };
 
 // first template argument is the max num of centroids
@@ -273,51 +844,52 @@ public:
 		Touches::sizes = this->sizes;
 		num_touches = 0;
 		this->orderLength = orderLength;
+		dataValid = false;
 		if(orderLength > _numReadings)
 			return -1; // cannot work with more than _numReadings
 		return 0;
 	}
 
-	void process(const WORD* rawData) {
+	// returns false if the readings are the same as last time, in which
+	// case the touches are left as they are
+	boolean process(const WORD* rawData) {
 		uint8_t nMax = _numReadings < orderLength ? _numReadings : orderLength;
-		if(order) {
-			for(unsigned int n = 0; n < nMax; ++n) {
-				data[n] = rawData[order[n]];
-			}
-			cc.CSD_waSnsDiff = data;
-		} else {
-			// no reordering needed
-			cc.CSD_waSnsDiff = rawData;
+		// keep the readings in data, comparing them with the last ones
+		// on the way
+		bool changed = !dataValid;
+		for(unsigned int n = 0; n < nMax; ++n) {
+			WORD value = order ? rawData[order[n]] : rawData[n];
+			changed |= value != data[n];
+			data[n] = value;
 		}
-		cc.calculateCentroids(centroids, sizes, _maxNumCentroids, 0, nMax, nMax);
+		dataValid = true;
+		if(!changed)
+			return false;
+		cc.calculateCentroids(data, centroids, sizes, _maxNumCentroids, 0, nMax, nMax);
 		processCentroids(_maxNumCentroids);
+		return true;
 	}
 
 	void setMinimumTouchSize(TouchData_t minSize) {
 		cc.wMinimumCentroidSize = minSize;
+		dataValid = false;
+	}
+
+	/* Compute the location of each touch with trillDivide() instead of
+	   a division. The results are the same either way. */
+	void setDivisionFree(bool divisionFree) {
+		cc.bDivisionFree = divisionFree;
+		dataValid = false;
 	}
 
 private:
-	// a small helper class, whose main purpose is to wrap the #include
-	// and make all the variables related to it private and multi-instance safe
-	class CalculateCentroids
-	{
-	public:
-		typedef uint8_t BYTE;
-		WORD const * CSD_waSnsDiff;
-		WORD wMinimumCentroidSize = 0;
-		BYTE SLIDER_BITS = 7;
-		WORD wAdjacentCentroidNoiseThreshold = 400; // Trough between peaks needed to identify two centroids
-		//WORD calculateCentroids(WORD *centroidBuffer, WORD *sizeBuffer, BYTE maxNumCentroids, BYTE minSensor, BYTE maxSensor, BYTE numSensors);
-		// calculateCentroids is defined here:
-		#include "calculateCentroids.h"
-	};
 	TouchData_t centroids[_maxNumCentroids];
 	TouchData_t sizes[_maxNumCentroids * 2];
 	const uint8_t* order;
 	unsigned int orderLength;
-	WORD data[_numReadings];
-	CalculateCentroids cc;
+	WORD data[_numReadings];	// the last readings, in order
+	TrillCentroidCalculator cc;
+	bool dataValid = false;	// whether data holds the last readings
 };
 
 class CustomSlider : public CentroidDetection<5, 30> {};
@@ -0,0 +1,148 @@
+/*
+ * Trill library for Arduino
+ * (c) 2020 bela.io
+ *
+ * Schedules reads from several Trill sensors sharing an I2C bus.
+ *
+ * BSD license
+ */
+
+#include "TrillBus.h"
+
+TrillBus::TrillBus()
+: num_devices_(0), next_(0), policy_(ROUND_ROBIN), budget_us_(2000)
+{
+}
+
+int TrillBus::add(Trill& trill, uint8_t priority) {
+	if(num_devices_ >= kMaxDevices)
+		return -1;
+	unsigned int n = num_devices_;
+	Device& d = devices_[n];
+	d.trill = &trill;
+	d.interval_us = 0;
+	d.due_us = micros();
+	d.cost_us = 0;
+	d.estimate_us = 0;
+	d.period_us = 0;
+	d.last_frame_us = 0;
+	d.frames = 0;
+	d.errors = 0;
+	d.priority = priority;
+	d.fresh = false;
+	d.repeated = false;
+	/* Keep by_priority_ sorted by decreasing priority, so that PRIORITY
+	   only has to walk it in order */
+	unsigned int k = num_devices_;
+	while(k > 0 && devices_[by_priority_[k - 1]].priority < priority) {
+		by_priority_[k] = by_priority_[k - 1];
+		--k;
+	}
+	by_priority_[k] = n;
+	++num_devices_;
+	return n;
+}
+
+void TrillBus::setPollInterval(unsigned int n, uint32_t us) {
+	if(n < num_devices_)
+		devices_[n].interval_us = us;
+}
+
+bool TrillBus::hasNewFrame(unsigned int n) {
+	if(n >= num_devices_)
+		return false;
+	bool fresh = devices_[n].fresh;
+	devices_[n].fresh = false;
+	return fresh;
+}
+
+unsigned int TrillBus::update() {
+	const uint32_t start = micros();
+	unsigned int count = 0;
+	unsigned int attempts = 0;
+	unsigned int last = num_devices_;
+	for(unsigned int k = 0; k < num_devices_; ++k) {
+		unsigned int n;
+		if(ROUND_ROBIN == policy_)
+			n = (next_ + k) % num_devices_;
+		else
+			n = by_priority_[k];
+		Device& d = devices_[n];
+		uint32_t now = micros();
+		if((int32_t)(now - d.due_us) < 0)
+			continue; /* not due yet */
+		/* A failed read takes bus time too */
+		if(attempts && now - start + d.cost_us > budget_us_)
+			continue; /* doesn't fit, but a cheaper one might */
+		++attempts;
+		if(service(d, now))
+			++count;
+		last = n;
+	}
+	if(last < num_devices_)
+		next_ = (last + 1) % num_devices_;
+	return count;
+}
+
+/* Read a device and schedule its next read */
+bool TrillBus::service(Device& d, uint32_t now) {
+	Trill& trill = *d.trill;
+	bool ok;
+	if(Trill::CENTROID == trill.getMode())
+		ok = trill.read();
+	else
+		ok = trill.requestRawData();
+	uint32_t end = micros();
+	/* Exponential moving average of the read duration */
+	d.cost_us = d.cost_us ? (3 * d.cost_us + (end - now)) / 4 : end - now;
+
+	bool fresh = ok && trill.isNewFrame();
+	if(d.interval_us) {
+		/* Stay on the grid of the interval, unless we fell behind by
+		   more than one, in which case start again from now */
+		d.due_us += d.interval_us;
+		if((int32_t)(end - d.due_us) > 0)
+			d.due_us = now + d.interval_us;
+	} else
+		schedule(d, trill, now, ok, fresh);
+	if(ok) {
+		d.last_frame_us = now;
+		if(fresh)
+			d.fresh = true;
+		++d.frames;
+	} else
+		++d.errors;
+	return ok;
+}
+
+/* Follow the scans of the device. getScanPeriod() is only where the
+   period starts from, and can be some way off, so it is started short:
+   a repeated frame costs a read, but a scan that ends between two reads
+   is lost. A repeated frame means that the scan wasn't over yet, so the
+   device is tried again soon and the period grows. A new frame read
+   just after a repeated one shows that the read was on time; one read
+   after another new frame may have come late, so the period shrinks
+   faster and the next read is due earlier. */
+void TrillBus::schedule(Device& d, Trill& trill, uint32_t now, bool ok, bool fresh) {
+	uint32_t estimate = trill.getScanPeriod();
+	if(estimate != d.estimate_us) {
+		/* The settings changed */
+		d.estimate_us = estimate;
+		d.period_us = estimate - estimate / 4;
+	}
+	if(!ok) {
+		d.due_us = now + d.period_us;
+		return;
+	}
+	if(!fresh) {
+		d.period_us += d.period_us / 16;
+		d.due_us = now + d.period_us / 16;
+	} else if(d.repeated) {
+		d.period_us -= d.period_us / 64;
+		d.due_us = now + d.period_us - d.period_us / 16;
+	} else {
+		d.period_us -= d.period_us / 16;
+		d.due_us = now + d.period_us - d.period_us / 8;
+	}
+	d.repeated = !fresh;
+}
@@ -0,0 +1,106 @@
+/*
+ * Trill library for Arduino
+ * (c) 2020 bela.io
+ *
+ * Schedules reads from several Trill sensors sharing an I2C bus.
+ *
+ * BSD license
+ */
+
+#ifndef TRILL_BUS_H
+#define TRILL_BUS_H
+
+#include "Trill.h"
+
+class TrillBus
+{
+public:
+	enum Policy {
+		ROUND_ROBIN = 0, /* Take turns, starting after the device served last */
+		PRIORITY = 1, /* Always serve higher-priority devices first */
+	};
+
+	enum {
+		kMaxDevices = 8
+	};
+
+	TrillBus();
+
+	/**
+	 * Add a sensor to the bus. The sensor should already have been
+	 * initialised with begin(). Devices in #CENTROID mode are polled
+	 * with read(), the others with requestRawData().
+	 *
+	 * @param trill the sensor
+	 * @param priority with the #PRIORITY policy, devices with a
+	 * higher value are served first.
+	 * @return the index of the device on the bus, or -1 if the bus is
+	 * full.
+	 */
+	int add(Trill& trill, uint8_t priority = 0);
+
+	void setPolicy(Policy policy) { policy_ = policy; }
+	/**
+	 * Set the time update() is allowed to spend reading, in
+	 * microseconds. A read is only started if its expected duration
+	 * fits in what is left of the budget, except that a due device is
+	 * always read if no other read, successful or not, was attempted in
+	 * this update(), so that no device is starved by a budget that is
+	 * too small.
+	 */
+	void setBudget(uint32_t us) { budget_us_ = us; }
+	/**
+	 * Set how often a device should be read, in microseconds. By
+	 * default this follows the scans of the device, starting from
+	 * Trill::getScanPeriod() and adapting to the new and repeated
+	 * frames read (see Trill::isNewFrame()), so that each scan is read
+	 * with few repeats. Pass 0 to go back to the default.
+	 */
+	void setPollInterval(unsigned int n, uint32_t us);
+
+	/**
+	 * Read the devices that are due, within the budget. Call this on
+	 * every iteration of loop().
+	 *
+	 * @return the number of devices read.
+	 */
+	unsigned int update();
+
+	unsigned int getNumDevices() { return num_devices_; }
+	Trill& operator[](unsigned int n) { return *devices_[n].trill; }
+	/* micros() at the time of the last successful read of device n */
+	uint32_t getLastFrameTime(unsigned int n) { return devices_[n].last_frame_us; }
+	/* Whether a new frame was read from device n since the last call,
+	   see Trill::isNewFrame() */
+	bool hasNewFrame(unsigned int n);
+	/* Number of successful and failed reads of device n */
+	uint32_t getNumFrames(unsigned int n) { return devices_[n].frames; }
+	uint32_t getNumErrors(unsigned int n) { return devices_[n].errors; }
+
+private:
+	struct Device {
+		Trill* trill;
+		uint32_t interval_us;	/* 0: follow the scan period */
+		uint32_t due_us;	/* micros() at which the next read is due */
+		uint32_t cost_us;	/* Running estimate of the read duration */
+		uint32_t estimate_us;	/* getScanPeriod() when period_us was reset */
+		uint32_t period_us;	/* Running estimate of the scan period */
+		uint32_t last_frame_us;
+		uint32_t frames;
+		uint32_t errors;
+		uint8_t priority;
+		bool fresh;
+		bool repeated;	/* The last read returned a frame read before */
+	};
+	bool service(Device& d, uint32_t now);
+	void schedule(Device& d, Trill& trill, uint32_t now, bool ok, bool fresh);
+
+	Device devices_[kMaxDevices];
+	uint8_t by_priority_[kMaxDevices];	/* Indices into devices_ */
+	uint8_t num_devices_;
+	uint8_t next_;	/* Where ROUND_ROBIN starts from */
+	Policy policy_;
+	uint32_t budget_us_;
+};
+
+#endif /* TRILL_BUS_H */
@@ -0,0 +1,279 @@
+/*
+ * Trill library for Arduino
+ * (c) 2020 bela.io
+ *
+ * A Trill front end specialised at compile time for one device and mode.
+ *
+ * BSD license
+ */
+
+#ifndef TRILL_DEVICE_H
+#define TRILL_DEVICE_H
+
+#include "Trill.h"
+
+/* Properties of each device, as compile-time constants */
+template <Trill::Device D>
+struct TrillTraits
+{
+	static_assert(D >= Trill::TRILL_BAR && D < Trill::TRILL_NUM_DEVICES, "TrillTraits needs a known device");
+	static constexpr bool is2D = D == Trill::TRILL_SQUARE || D == Trill::TRILL_HEX;
+	static constexpr uint8_t numChannels = D == Trill::TRILL_BAR ? Trill::kNumChannelsBar
+		: D == Trill::TRILL_RING ? Trill::kNumChannelsRing
+		: Trill::kNumChannelsMax;
+	static constexpr uint8_t maxTouches = is2D ? Trill::kMaxTouchNum2D : Trill::kMaxTouchNum1D;
+	static constexpr uint8_t numButtons = D == Trill::TRILL_RING ? 2 : 0;
+	/* Payload lengths in bytes */
+	static constexpr uint8_t centroidLength = is2D ? Trill::kCentroidLength2D
+		: D == Trill::TRILL_RING ? Trill::kCentroidLengthRing
+		: Trill::kCentroidLengthDefault;
+	static constexpr uint8_t rawLength = 2 * numChannels;
+	/* Same as Trill::getDefaults() */
+	static constexpr Trill::Mode defaultMode = Trill::defaultModeOf(D);
+	static constexpr uint8_t defaultAddress = Trill::defaultAddressOf(D);
+};
+
+template <Trill::Device D> constexpr bool TrillTraits<D>::is2D;
+template <Trill::Device D> constexpr uint8_t TrillTraits<D>::numChannels;
+template <Trill::Device D> constexpr uint8_t TrillTraits<D>::maxTouches;
+template <Trill::Device D> constexpr uint8_t TrillTraits<D>::numButtons;
+template <Trill::Device D> constexpr uint8_t TrillTraits<D>::centroidLength;
+template <Trill::Device D> constexpr uint8_t TrillTraits<D>::rawLength;
+template <Trill::Device D> constexpr Trill::Mode TrillTraits<D>::defaultMode;
+template <Trill::Device D> constexpr uint8_t TrillTraits<D>::defaultAddress;
+
+/* Base class of TrillDevice in modes other than CENTROID, which have no touches */
+class TrillNoTouches {};
+
+template <bool condition, class T, class F> struct TrillSelect { typedef T type; };
+template <class T, class F> struct TrillSelect<false, T, F> { typedef F type; };
+
+/*
+ * A Trill device whose type and mode are known at compile time, e.g.:
+ *
+ *   TrillDevice<Trill::TRILL_BAR> bar; // CENTROID mode
+ *   TrillDevice<Trill::TRILL_CRAFT, Trill::DIFF> craft;
+ *
+ * Its buffer only holds the payload of that device in that mode, and
+ * reads don't need to look up the device type. In #CENTROID mode it has
+ * the same touch interface as Trill; in the other modes it offers raw
+ * data. Use Trill when the device type is only known at runtime.
+ */
+template <Trill::Device D, Trill::Mode M = TrillTraits<D>::defaultMode>
+class TrillDevice : public TrillSelect<M == Trill::CENTROID,
+	typename TrillSelect<TrillTraits<D>::is2D, Touches2D, Touches>::type,
+	TrillNoTouches>::type
+{
+	static_assert(M >= Trill::CENTROID && M <= Trill::DIFF, "TrillDevice needs a fixed mode");
+public:
+	typedef TrillTraits<D> Traits;
+	/* Length of the payload read in this mode, in bytes */
+	static constexpr uint8_t frameLength = M == Trill::CENTROID ? Traits::centroidLength : Traits::rawLength;
+
+	TrillDevice()
+	: wire_(&Wire), address_(Traits::defaultAddress), read_loc_(0xFF),
+	  max_transfer_(TRILL_WIRE_BUFFER_LENGTH < 255 ? TRILL_WIRE_BUFFER_LENGTH & ~1 : 254),
+	  raw_index_(frameLength / 2), init_state_(Trill::kInitIdle), init_result_(0),
+	  firmware_version_(0), command_delay_ms_(0), last_command_us_(0)
+	{
+		setupTouches(*this);
+	}
+
+	/* Initialise the hardware. Returns 0 on success, or the same error
+	   codes as Trill::begin() */
+	int begin(uint8_t i2c_address = Traits::defaultAddress, TwoWire* wire = &Wire) {
+		int ret = beginAsync(i2c_address, wire);
+		while(Trill::kBeginInProgress == ret) {
+			/* Wait for the last command to be processed */
+			delay((commandDelayRemaining() + 999) / 1000);
+			ret = poll();
+		}
+		return ret;
+	}
+	/* Start initialising the hardware without blocking, then call poll()
+	   until it returns something other than Trill::kBeginInProgress; see
+	   Trill::beginAsync() */
+	int beginAsync(uint8_t i2c_address = Traits::defaultAddress, TwoWire* wire = &Wire) {
+		wire_ = wire;
+		address_ = i2c_address;
+		wire_->begin();
+		init_state_ = Trill::kInitDone;
+		if(Trill::writeCommand(wire_, address_, read_loc_, Trill::kCommandIdentify, nullptr, 0 TRILL_STATS_ARG(nullptr))) {
+			init_result_ = 2;
+			return init_result_;
+		}
+		scheduleNextCommand(25);
+		init_state_ = Trill::kInitIdentify;
+		return Trill::kBeginInProgress;
+	}
+	/* Advance the initialisation started by beginAsync(); see Trill::poll() */
+	int poll() {
+		if(Trill::kInitIdle == init_state_)
+			return Trill::kBeginNotStarted;
+		if(Trill::kInitDone == init_state_)
+			return init_result_;
+		if(commandDelayRemaining())
+			return Trill::kBeginInProgress;
+
+		switch(init_state_) {
+		case Trill::kInitIdentify:
+		{
+			init_state_ = Trill::kInitDone;
+			Trill::Device device;
+			if(Trill::readIdentity(wire_, address_, read_loc_, device, firmware_version_ TRILL_STATS_ARG(nullptr))) {
+				init_result_ = 2;
+				return init_result_;
+			}
+			if(device != D) {
+				init_result_ = -3;
+				return init_result_;
+			}
+			uint8_t mode[] = { M };
+			command(Trill::kCommandMode, mode, sizeof(mode));
+			scheduleNextCommand(Trill::interCommandDelay);
+			init_state_ = Trill::kInitMode;
+			break;
+		}
+		case Trill::kInitMode:
+			setScanSettings(0, 12);
+			scheduleNextCommand(Trill::interCommandDelay);
+			init_state_ = Trill::kInitScanSettings;
+			break;
+		case Trill::kInitScanSettings:
+			updateBaseline();
+			scheduleNextCommand((firmware_version_ >= 3 ? 10 : 1) * Trill::interCommandDelay);
+			init_state_ = Trill::kInitBaseline;
+			break;
+		case Trill::kInitBaseline:
+			init_state_ = Trill::kInitDone;
+			init_result_ = 0;
+			return init_result_;
+		}
+		return Trill::kBeginInProgress;
+	}
+	int setup(uint8_t i2c_address = Traits::defaultAddress, TwoWire* wire = &Wire) { return begin(i2c_address, wire); }
+
+	static constexpr Trill::Device deviceType() { return D; }
+	static constexpr Trill::Mode getMode() { return M; }
+	static constexpr unsigned int getNumChannels() { return Traits::numChannels; }
+	uint8_t getAddress() { return address_; }
+
+	/* --- CENTROID mode --- */
+
+	/* Read the latest scan value from the sensor. Returns true on success. */
+	boolean read() {
+		static_assert(M == Trill::CENTROID, "read() is only available in CENTROID mode");
+		uint8_t words = Trill::readData(wire_, address_, read_loc_, max_transfer_, buffer_, frameLength, 0 TRILL_STATS_ARG(nullptr));
+		/* A short read leaves no touches */
+		boolean ok = words * 2 >= frameLength;
+		uint8_t maxNumCentroids = ok ? Traits::maxTouches : 0;
+		this->processCentroids(maxNumCentroids);
+		processHorizontal(*this, maxNumCentroids);
+		return ok;
+	}
+
+	/* Button value for Ring */
+	int getButtonValue(uint8_t button_num) {
+		static_assert(M == Trill::CENTROID && Traits::numButtons, "getButtonValue() is only available on Ring in CENTROID mode");
+		if(button_num >= Traits::numButtons)
+			return -1;
+		return buffer_[2 * Traits::maxTouches + button_num];
+	}
+
+	/* --- Other modes --- */
+
+	/* Read a raw frame; then use rawDataAvailable()/rawDataRead() or rawData() */
+	boolean requestRawData() {
+		static_assert(M != Trill::CENTROID, "requestRawData() is not available in CENTROID mode");
+		uint8_t words = Trill::readData(wire_, address_, read_loc_, max_transfer_, buffer_, frameLength, 0 TRILL_STATS_ARG(nullptr));
+		raw_index_ = words ? 0 : frameLength / 2;
+		return words != 0;
+	}
+	int rawDataAvailable() { return frameLength / 2 - raw_index_; }
+	int rawDataRead() {
+		if(raw_index_ >= frameLength / 2)
+			return 0;
+		return buffer_[raw_index_++];
+	}
+	/* Read a raw frame straight into dst, which must hold getNumChannels() words */
+	int readRawFrame(uint16_t* dst) {
+		static_assert(M != Trill::CENTROID, "readRawFrame() is not available in CENTROID mode");
+		return Trill::readData(wire_, address_, read_loc_, max_transfer_, dst, frameLength, 0 TRILL_STATS_ARG(nullptr));
+	}
+	/* The last frame read with requestRawData() */
+	const uint16_t* rawData() const { return buffer_; }
+
+	/* --- Scan configuration settings --- */
+
+	void updateBaseline() { command(Trill::kCommandBaselineUpdate, nullptr, 0); }
+	void setScanSettings(uint8_t speed, uint8_t num_bits) {
+		if(speed > 3)
+			speed = 3;
+		if(num_bits < 9)
+			num_bits = 9;
+		if(num_bits > 16)
+			num_bits = 16;
+		uint8_t args[] = { speed, num_bits };
+		command(Trill::kCommandScanSettings, args, sizeof(args));
+	}
+	void setPrescaler(uint8_t prescaler) { command(Trill::kCommandPrescaler, &prescaler, 1); }
+	void setNoiseThreshold(uint8_t threshold) { command(Trill::kCommandNoiseThreshold, &threshold, 1); }
+	void setIDACValue(uint8_t value) { command(Trill::kCommandIdac, &value, 1); }
+	void setMinimumTouchSize(uint16_t size) {
+		uint8_t args[] = { (uint8_t)(size >> 8), (uint8_t)(size & 0xFF) };
+		command(Trill::kCommandMinimumSize, args, sizeof(args));
+	}
+	void setAutoScanInterval(uint16_t interval) {
+		uint8_t args[] = { (uint8_t)(interval >> 8), (uint8_t)(interval & 0xFF) };
+		command(Trill::kCommandAutoScanInterval, args, sizeof(args));
+	}
+	/* See Trill::setMaxTransferLength() */
+	void setMaxTransferLength(uint8_t length) { max_transfer_ = length < 2 ? 2 : length & ~1; }
+
+private:
+	void scheduleNextCommand(uint16_t delay_ms) {
+		last_command_us_ = micros();
+		command_delay_ms_ = delay_ms;
+	}
+	/* How many microseconds until the device is ready for the next command */
+	uint32_t commandDelayRemaining() {
+		uint32_t elapsed = micros() - last_command_us_;
+		uint32_t delay_us = command_delay_ms_ * 1000UL;
+		return elapsed >= delay_us ? 0 : delay_us - elapsed;
+	}
+	void command(uint8_t command, const uint8_t* args, uint8_t num_args) {
+		Trill::writeCommand(wire_, address_, read_loc_, command, args, num_args TRILL_STATS_ARG(nullptr));
+	}
+
+	/* Point the touches at their place in buffer_, if there are any */
+	void setupTouches(TrillNoTouches&) {}
+	void setupTouches(Touches&) {
+		this->centroids = buffer_;
+		this->sizes = buffer_ + Traits::maxTouches;
+	}
+	void setupTouches(Touches2D& touches) {
+		setupTouches(static_cast<Touches&>(touches));
+		this->horizontal.centroids = buffer_ + 2 * Traits::maxTouches;
+		this->horizontal.sizes = buffer_ + 3 * Traits::maxTouches;
+	}
+	void processHorizontal(Touches&, uint8_t) {}
+	void processHorizontal(Touches2D&, uint8_t maxNumCentroids) {
+		this->horizontal.processCentroids(maxNumCentroids);
+	}
+
+	TwoWire* wire_;
+	uint8_t address_;
+	uint8_t read_loc_;	/* Which byte reads will begin from on the device */
+	uint8_t max_transfer_;
+	uint8_t raw_index_;	/* Next raw word returned by rawDataRead() */
+	uint8_t init_state_;	/* Progress of beginAsync()/poll(), as Trill::kInit* */
+	int8_t init_result_;	/* Return value of poll() once done */
+	uint8_t firmware_version_;
+	uint16_t command_delay_ms_;	/* How long the last command takes to process */
+	uint32_t last_command_us_;	/* micros() at the time of the last command */
+	uint16_t buffer_[frameLength / 2];
+};
+
+template <Trill::Device D, Trill::Mode M> constexpr uint8_t TrillDevice<D, M>::frameLength;
+
+#endif /* TRILL_DEVICE_H */
@@ -0,0 +1,159 @@
+/*
+ * Trill library for Arduino
+ * (c) 2020 bela.io
+ *
+ * BSD license
+ */
+
+#include "TrillEmitter.h"
+
+enum {
+	kFlagResend = 1 << 0	/* Send at the next process(), changed or not */
+};
+
+TrillRateLimiter::TrillRateLimiter(uint16_t perSecond, uint8_t burst)
+{
+	setRate(perSecond, burst);
+}
+
+void TrillRateLimiter::setRate(uint16_t perSecond, uint8_t burst) {
+	interval_us_ = perSecond ? 1000000UL / perSecond : 0;
+	burst_ = burst ? burst : 1;
+	reset();
+}
+
+void TrillRateLimiter::reset() {
+	credit_us_ = 0;
+	last_us_ = 0;
+	started_ = false;
+}
+
+boolean TrillRateLimiter::take(uint8_t count, uint32_t now_us) {
+	if(!interval_us_)
+		return true;
+	const uint32_t full = interval_us_ * burst_;
+	if(!started_) {
+		credit_us_ = full;
+		started_ = true;
+	} else {
+		uint32_t elapsed = now_us - last_us_;
+		credit_us_ = elapsed >= full - credit_us_ ? full : credit_us_ + elapsed;
+	}
+	last_us_ = now_us;
+	const uint32_t cost = interval_us_ * count;
+	/* More than a burst goes out once the bucket is full */
+	if(cost > credit_us_ && credit_us_ < full)
+		return false;
+	credit_us_ = cost > credit_us_ ? 0 : credit_us_ - cost;
+	return true;
+}
+
+TrillParameterEmitter::TrillParameterEmitter(Parameter* parameters, Change* changes, uint8_t size)
+: parameters_(parameters), changes_(changes), size_(size), num_parameters_(0), num_changes_(0), first_(0)
+{}
+
+int TrillParameterEmitter::addParameter(Source source, uint8_t touch, uint16_t inputMin, uint16_t inputMax, uint8_t bits, uint8_t transport, uint16_t deadband) {
+	if(num_parameters_ == size_ || inputMax <= inputMin || !bits || bits > 14 || transport >= kMaxTransports)
+		return -1;
+	const uint32_t range = inputMax - inputMin;
+	Parameter& p = parameters_[num_parameters_];
+	/* Rounded up, so that inputMax maps to the top of the range. This is
+	   the only division */
+	p.scale = (((uint32_t)kFullScale << 16) + range - 1) / range;
+	p.input_min = inputMin;
+	p.input_max = inputMax;
+	p.deadband = deadband;
+	p.sent = 0;
+	p.source = source;
+	p.touch = touch;
+	p.bits = bits;
+	p.transport = transport;
+	p.flags = kFlagResend;
+	return num_parameters_++;
+}
+
+void TrillParameterEmitter::setRate(uint8_t transport, uint16_t perSecond, uint8_t burst) {
+	if(transport < kMaxTransports)
+		limiters_[transport].setRate(perSecond, burst);
+}
+
+void TrillParameterEmitter::resend() {
+	for(uint8_t n = 0; n < num_parameters_; ++n)
+		parameters_[n].flags |= kFlagResend;
+}
+
+uint16_t TrillParameterEmitter::toFullScale(const Parameter& p, uint16_t input) const {
+	if(input <= p.input_min)
+		return 0;
+	if(input >= p.input_max)
+		return kFullScale;
+	/* Less than range * scale, which fits in 32 bits */
+	uint32_t value = ((uint32_t)(input - p.input_min) * p.scale) >> 16;
+	return value > kFullScale ? kFullScale : value;
+}
+
+uint8_t TrillParameterEmitter::process(const Touches& touches, uint32_t now_us) {
+	return process(touches, nullptr, now_us);
+}
+
+uint8_t TrillParameterEmitter::process(Touches2D& touches, uint32_t now_us) {
+	return process(touches, &touches, now_us);
+}
+
+uint8_t TrillParameterEmitter::process(const Touches& touches, Touches2D* touches2D, uint32_t now_us) {
+	num_changes_ = 0;
+	uint8_t held = num_parameters_;
+	for(uint8_t k = 0; k < num_parameters_; ++k) {
+		const uint8_t n = first_ + k < num_parameters_ ? first_ + k : first_ + k - num_parameters_;
+		Parameter& p = parameters_[n];
+		/* A touch that isn't there reads as inputMin */
+		uint16_t input = p.input_min;
+		switch(p.source) {
+		case LOCATION:
+			if(p.touch < touches.getNumTouches())
+				input = touches.touchLocation(p.touch);
+			break;
+		case HORIZONTAL_LOCATION:
+			if(touches2D && p.touch < touches2D->getNumHorizontalTouches())
+				input = touches2D->touchHorizontalLocation(p.touch);
+			break;
+		case SIZE:
+			if(p.touch < touches.getNumTouches())
+				input = touches.touchSize(p.touch);
+			break;
+		default:
+			input = touches.getNumTouches();
+			break;
+		}
+		const uint16_t value = toFullScale(p, input);
+		const uint8_t shift = 14 - p.bits;
+		const uint16_t code = value >> shift;
+		if(!(p.flags & kFlagResend)) {
+			if(code == p.sent)
+				continue;
+			/* Still within the deadband around the values that are sent
+			   as the last one, unless at either end */
+			if(value != 0 && value != kFullScale) {
+				const int32_t low = ((int32_t)p.sent << shift) - p.deadband;
+				const int32_t high = ((int32_t)(p.sent + 1) << shift) - 1 + p.deadband;
+				if(value >= low && value <= high)
+					continue;
+			}
+		}
+		/* One message for each 7 bits */
+		if(!limiters_[p.transport].take((p.bits + 6) / 7, now_us)) {
+			if(held == num_parameters_)
+				held = n;
+			continue;
+		}
+		p.sent = code;
+		p.flags &= ~kFlagResend;
+		Change& c = changes_[num_changes_++];
+		c.parameter = n;
+		c.transport = p.transport;
+		c.value = code;
+	}
+	/* The first one held back goes first next time */
+	first_ = held < num_parameters_ ? held : 0;
+	return num_changes_;
+}
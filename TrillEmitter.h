@@ -0,0 +1,172 @@
+/*
+ * Trill library for Arduino
+ * (c) 2020 bela.io
+ *
+ * Maps touches to MIDI CCs, HID reports or PWM levels, and only reports
+ * the values that changed enough to be worth sending.
+ *
+ * BSD license
+ */
+
+#ifndef TRILL_EMITTER_H
+#define TRILL_EMITTER_H
+
+#include "Trill.h"
+
+/*
+ * A token bucket: allows up to perSecond messages per second on average,
+ * and bursts of up to burst messages after a pause, so that the first
+ * messages of a movement go out at once.
+ */
+class TrillRateLimiter
+{
+public:
+	/* perSecond 0 doesn't limit the rate */
+	TrillRateLimiter(uint16_t perSecond = 0, uint8_t burst = 1);
+	void setRate(uint16_t perSecond, uint8_t burst);
+	/* Whether count messages can be sent at now_us (e.g.: micros()).
+	   If so, they are taken out of the bucket */
+	boolean take(uint8_t count, uint32_t now_us);
+	/* Fill the bucket up */
+	void reset();
+
+private:
+	uint32_t interval_us_;	/* Between two messages at perSecond; 0 if not limited */
+	uint32_t credit_us_;	/* Time saved up, up to burst_ intervals */
+	uint32_t last_us_;
+	uint8_t burst_;
+	boolean started_;
+};
+
+/*
+ * Maps a location, size or number of touches to a value of 7, 14 or any
+ * other number of bits up to 14, and reports it when it has changed:
+ *
+ *   TrillEmitter<2> emitter;
+ *   ...
+ *   emitter.addParameter(TrillEmitter<2>::LOCATION, 0, 0, 3200, 14);
+ *   emitter.addParameter(TrillEmitter<2>::SIZE, 0, 0, 4096, 14);
+ *   emitter.setRate(0, 1000, 8);
+ *   ...
+ *   trill.read();
+ *   emitter.process(trill, micros());
+ *   for(uint8_t n = 0; n < emitter.getNumChanges(); ++n) {
+ *     const TrillEmitter<2>::Change& c = emitter.getChange(n);
+ *     ... send c.value for parameter c.parameter ...
+ *   }
+ *
+ * Each value is mapped to 14 bits first. A new value is sent only once
+ * it leaves the range of values that would be sent as the last value
+ * sent, widened by the deadband either side: a touch that wobbles on the
+ * edge of a 7-bit step, or by a few units anywhere, sends nothing.
+ * Values at either end of the range are always sent, so that a deadband
+ * never keeps a parameter from getting there. A touch that lifts reads
+ * as the bottom of the range.
+ *
+ * Each parameter goes to a transport (e.g.: USB MIDI, BLE MIDI), and each
+ * transport can have a rate limit. A change costs one message for each 7
+ * bits, as a 14-bit CC takes two. A change that can't be sent yet is sent
+ * as soon as there is room, with the latest value, unless the value went
+ * back to what was last sent. Call process() on every loop, even if there
+ * is no new frame, for those to go out.
+ *
+ * This is the part that doesn't depend on the number of parameters;
+ * declare a TrillEmitter.
+ */
+class TrillParameterEmitter
+{
+public:
+	enum {
+		kMaxTransports = 4,
+		kFullScale = 16383	/* Values are mapped to 14 bits first */
+	};
+	enum Source {
+		LOCATION = 0,
+		HORIZONTAL_LOCATION = 1,	/* 2D sensors only */
+		SIZE = 2,
+		NUM_TOUCHES = 3,
+	};
+	struct Change {
+		uint8_t parameter;	/* As returned by addParameter() */
+		uint8_t transport;
+		uint16_t value;	/* In the parameter's number of bits */
+	};
+
+	/**
+	 * Add a parameter, mapping from inputMin to inputMax of source, for
+	 * touch (unless source is NUM_TOUCHES), to bits bits.
+	 *
+	 * @param deadband how far the value can move either way from the
+	 * last value sent, in 14-bit units, without being sent
+	 *
+	 * @return the number of the parameter, or -1 if there is no room or
+	 * inputMax isn't above inputMin
+	 */
+	int addParameter(Source source, uint8_t touch, uint16_t inputMin, uint16_t inputMax, uint8_t bits, uint8_t transport = 0, uint16_t deadband = 0);
+	void setDeadband(uint8_t parameter, uint16_t deadband) { parameters_[parameter].deadband = deadband; }
+	/* Limit transport to perSecond messages per second, in bursts of up to
+	   burst. Not limited by default */
+	void setRate(uint8_t transport, uint16_t perSecond, uint8_t burst);
+
+	/**
+	 * Map the touches, read at now_us (e.g.: micros()), and list the
+	 * parameters to send.
+	 *
+	 * @return the number of changes
+	 */
+	uint8_t process(const Touches& touches, uint32_t now_us);
+	uint8_t process(Touches2D& touches, uint32_t now_us);
+	uint8_t getNumChanges() const { return num_changes_; }
+	const Change& getChange(uint8_t n) const { return changes_[n]; }
+	/* The last value sent for parameter */
+	uint16_t getValue(uint8_t parameter) const { return parameters_[parameter].sent; }
+	uint8_t getNumParameters() const { return num_parameters_; }
+	/* Send every parameter again at the next process(), e.g.: when a
+	   host connects */
+	void resend();
+
+protected:
+	struct Parameter {
+		uint32_t scale;	/* From input to 14 bits, in 1/65536 */
+		uint16_t input_min;
+		uint16_t input_max;
+		uint16_t deadband;
+		uint16_t sent;
+		uint8_t source;
+		uint8_t touch;
+		uint8_t bits;
+		uint8_t transport;
+		uint8_t flags;
+	};
+
+	TrillParameterEmitter(Parameter* parameters, Change* changes, uint8_t size);
+
+private:
+	uint8_t process(const Touches& touches, Touches2D* touches2D, uint32_t now_us);
+	uint16_t toFullScale(const Parameter& p, uint16_t input) const;
+
+	Parameter* parameters_;
+	Change* changes_;	/* One for each parameter */
+	TrillRateLimiter limiters_[kMaxTransports];
+	uint8_t size_;
+	uint8_t num_parameters_;
+	uint8_t num_changes_;
+	uint8_t first_;	/* Parameter to try first, so that all get their turn when rate-limited */
+};
+
+/* Emits up to numParameters parameters. It takes about 24 bytes for each,
+   plus a few dozen */
+template <uint8_t numParameters>
+class TrillEmitter : public TrillParameterEmitter
+{
+public:
+	static_assert(numParameters >= 1, "TrillEmitter needs room for at least one parameter");
+
+	TrillEmitter() : TrillParameterEmitter(parameters_, changes_, numParameters) {}
+
+private:
+	Parameter parameters_[numParameters];
+	Change changes_[numParameters];
+};
+
+#endif /* TRILL_EMITTER_H */
@@ -0,0 +1,114 @@
+/*
+ * Trill library for Arduino
+ * (c) 2020 bela.io
+ *
+ * BSD license
+ */
+
+#include "TrillFilter.h"
+
+enum {
+	kOne = 4096,	/* 1 in omega() */
+	kMaxOmega = 0xFFFF - kOne	/* So that alpha() can divide by omega + 1 */
+};
+
+/* 2 pi f T, for a cutoff f in mHz and a frame T in us, in 1/4096:
+   mHz * us * 2 pi * 4096 / 10^9, that is mHz * us / 38857 */
+static uint16_t omega(uint16_t mHz, uint16_t us) {
+	uint32_t product = (uint32_t)mHz * us;
+	if(product >= (uint32_t)kMaxOmega * 38857)
+		return kMaxOmega;
+	/* 432 / 2^24 is 1 / 38836 */
+	return ((product >> 8) * 432) >> 16;
+}
+
+/* The coefficient of a low-pass filter: omega / (omega + 1), in 1/32768 */
+static uint16_t alpha(uint16_t omega) {
+	return trillDivide(omega, omega + kOne, 15);
+}
+
+/* from moved towards to by alpha. The difference is capped so that it
+   can be multiplied in 32 bits: a touch can't move by 4096 in a frame */
+static int32_t lowPass(int32_t from, int32_t to, uint16_t alpha) {
+	int32_t d = to - from;
+	if(d > 0xFFFF)
+		d = 0xFFFF;
+	else if(d < -0xFFFF)
+		d = -0xFFFF;
+	return from + ((d * alpha) >> 15);
+}
+
+TrillFilter::TrillFilter()
+: min_cutoff_(1000), beta_(20), derivative_cutoff_(1000)
+{
+	centroids = locations_;
+	sizes = sizes_;
+	horizontal.centroids = horizontal_locations_;
+	horizontal.sizes = sizes_;
+	reset();
+}
+
+void TrillFilter::reset() {
+	num_touches = 0;
+	horizontal.num_touches = 0;
+}
+
+/* The One Euro filter: the speed is low-passed, and raises the cutoff of
+   the filter of the value. With the speed as a distance per frame, the
+   cutoff's omega is that of minCutoff plus 2 pi beta speed, whatever the
+   length of the frame */
+void TrillFilter::filter(Axis& axis, uint16_t value, uint16_t minOmega, uint16_t speedAlpha) {
+	const int32_t target = (int32_t)value << 4;
+	axis.speed = lowPass(axis.speed, target - axis.value, speedAlpha);
+	uint32_t speed = axis.speed < 0 ? -axis.speed : axis.speed;
+	uint32_t w = kMaxOmega;
+	/* 2 pi beta / 1000 * speed / 16 * 4096 is beta * speed * 1647 / 1024 */
+	if((uint32_t)beta_ * speed < 38200)
+		w = minOmega + (((uint32_t)beta_ * speed * 1647) >> 10);
+	if(w > kMaxOmega)
+		w = kMaxOmega;
+	axis.value = lowPass(axis.value, target, alpha(w));
+}
+
+void TrillFilter::process(const TrillTracker& tracker, uint32_t timestamp_us) {
+	State next[TrillTracker::kMaxTouches];
+	const uint8_t count = tracker.getNumTouches();
+	const boolean is2D = tracker.is2D();
+	for(uint8_t j = 0; j < count; ++j) {
+		const TrillTracker::Touch& touch = tracker.getTouch(j);
+		const uint16_t values[3] = { touch.location, (uint16_t)(is2D ? touch.horizontal : 0), touch.size };
+		State& s = next[j];
+		uint8_t i = 0;
+		while(i < num_touches && states_[i].id != touch.id)
+			++i;
+		if(i == num_touches) {
+			/* Just landed: start from there */
+			for(uint8_t a = 0; a < 3; ++a) {
+				s.axes[a].value = (int32_t)values[a] << 4;
+				s.axes[a].speed = 0;
+			}
+		} else {
+			s = states_[i];
+			uint32_t dt = timestamp_us - s.last_us;
+			if(dt > 0xFFFF)
+				dt = 0xFFFF;
+			const uint16_t speedAlpha = alpha(omega(derivative_cutoff_, dt));
+			const uint16_t minOmega = omega(min_cutoff_, dt);
+			for(uint8_t a = 0; a < 3; ++a) {
+				if(1 == a && !is2D)
+					continue;
+				filter(s.axes[a], values[a], minOmega, speedAlpha);
+			}
+		}
+		s.id = touch.id;
+		s.last_us = timestamp_us;
+	}
+	for(uint8_t j = 0; j < count; ++j) {
+		states_[j] = next[j];
+		locations_[j] = (states_[j].axes[0].value + 8) >> 4;
+		horizontal_locations_[j] = (states_[j].axes[1].value + 8) >> 4;
+		sizes_[j] = (states_[j].axes[2].value + 8) >> 4;
+	}
+	num_touches = count;
+	horizontal.num_touches = is2D ? count : 0;
+}
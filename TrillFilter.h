@@ -0,0 +1,94 @@
+/*
+ * Trill library for Arduino
+ * (c) 2020 bela.io
+ *
+ * Smooths the location and size of each touch, following it by its
+ * TrillTracker ID, with little lag when it moves.
+ *
+ * BSD license
+ */
+
+#ifndef TRILL_FILTER_H
+#define TRILL_FILTER_H
+
+#include "TrillTracker.h"
+
+/*
+ * A One Euro filter (Casiez et al., 2012) for each touch: a low-pass
+ * filter whose cutoff rises with the speed of the touch. A touch that
+ * stays put is smoothed heavily, which takes out the jitter of a few
+ * units; one that moves is followed closely. The filtered touches are
+ * Touches, in the order of the tracker:
+ *
+ *   TrillTracker tracker;
+ *   TrillFilter filter;
+ *   ...
+ *   if(trill.read()) {
+ *     tracker.update(trill);
+ *     filter.process(tracker, micros());
+ *   }
+ *   for(uint8_t n = 0; n < filter.getNumTouches(); ++n)
+ *     ... filter.touchLocation(n), filter.touchSize(n) ...
+ *
+ * A touch starts from where it lands, without lag. Call process() after
+ * every read, even when the frame isn't new and tracker.update() returns
+ * false: a touch that stopped still has to settle, and the sensor then
+ * sends the same frame over and over.
+ *
+ * The filter runs in fixed point. The cutoff frequencies become filter
+ * coefficients with trillDivide(), once for each axis of each touch;
+ * the rest is multiplications and shifts.
+ */
+class TrillFilter : public Touches2D
+{
+public:
+	TrillFilter();
+
+	/* Match the touches of the last frame tracker processed, read
+	   again at timestamp_us (e.g.: micros()), and filter them */
+	void process(const TrillTracker& tracker, uint32_t timestamp_us);
+	/* Forget all touches */
+	void reset();
+
+	/* The tracker ID of touch n */
+	uint8_t touchId(uint8_t n) const { return states_[n].id; }
+
+	/**
+	 * How much to smooth. The cutoff frequency of a touch that isn't
+	 * moving is minCutoff, and rises by beta for each location per
+	 * second of speed. The speed is itself smoothed with a cutoff of
+	 * derivativeCutoff. Lower minCutoff for less jitter, raise beta
+	 * for less lag. The defaults, 1Hz, 20 and 1Hz, follow a touch that
+	 * jumps by 200 to within 5% in 4 frames of 5ms, and hold one that
+	 * wobbles by 8 to within 2.
+	 *
+	 * @param mHz frequencies, in thousandths of a Hz
+	 * @param beta in thousandths of a Hz per location per second
+	 */
+	void setMinCutoff(uint16_t mHz) { min_cutoff_ = mHz; }
+	void setBeta(uint16_t beta) { beta_ = beta; }
+	void setDerivativeCutoff(uint16_t mHz) { derivative_cutoff_ = mHz; }
+
+private:
+	struct Axis {
+		int32_t value;	/* In 1/16 of a location */
+		int32_t speed;	/* How far it moves in a frame, in 1/16 of a location */
+	};
+	struct State {
+		Axis axes[3];	/* Location, horizontal location and size */
+		uint32_t last_us;
+		uint8_t id;
+	};
+
+	void filter(Axis& axis, uint16_t value, uint16_t minOmega, uint16_t speedAlpha);
+
+	State states_[TrillTracker::kMaxTouches];
+	uint16_t locations_[TrillTracker::kMaxTouches];
+	uint16_t sizes_[TrillTracker::kMaxTouches];
+	uint16_t horizontal_locations_[TrillTracker::kMaxTouches];
+	uint16_t min_cutoff_;
+	uint16_t beta_;
+	uint16_t derivative_cutoff_;
+};
+
+#endif /* TRILL_FILTER_H */
@@ -0,0 +1,74 @@
+/*
+ * Trill library for Arduino
+ * (c) 2020 bela.io
+ *
+ * A copy of one frame read from a Trill, which can be queued, recorded
+ * or replayed without the Trill it came from.
+ *
+ * BSD license
+ */
+
+#ifndef TRILL_FRAME_H
+#define TRILL_FRAME_H
+
+#include "Trill.h"
+
+/* A frame read from a Trill, with the time it was read at */
+struct TrillFrame
+{
+	enum {
+		kMaxWords = 30
+	};
+	uint32_t timestamp_us;	/* micros() once the frame was in */
+	uint8_t tag;	/* Set by the producer, e.g. which sensor it came from */
+	uint8_t mode;	/* The Trill::Mode it was read in */
+	uint8_t num_touches;	/* #CENTROID: touches, vertical ones on a 2D device */
+	uint8_t num_horizontal_touches;
+	uint8_t length;	/* Words of data in use */
+	/* #CENTROID: the locations then the sizes of the touches, then
+	   the same for horizontal ones. Otherwise: one word per channel */
+	uint16_t data[kMaxWords];
+
+	/**
+	 * Read a frame from trill, with read() in #CENTROID mode or
+	 * readRawFrame() otherwise. Raw frames are decoded straight into
+	 * data.
+	 *
+	 * @return `true` on success
+	 */
+	bool read(Trill& trill, uint8_t tag = 0) {
+		this->tag = tag;
+		mode = trill.getMode();
+		num_touches = num_horizontal_touches = 0;
+		if(Trill::CENTROID == mode) {
+			if(!trill.read())
+				return false;
+			num_touches = trill.getNumTouches();
+			if(trill.is2D())
+				num_horizontal_touches = trill.getNumHorizontalTouches();
+			uint16_t* dst = data;
+			for(uint8_t n = 0; n < num_touches; ++n)
+				*dst++ = trill.touchLocation(n);
+			for(uint8_t n = 0; n < num_touches; ++n)
+				*dst++ = trill.touchSize(n);
+			for(uint8_t n = 0; n < num_horizontal_touches; ++n)
+				*dst++ = trill.touchHorizontalLocation(n);
+			for(uint8_t n = 0; n < num_horizontal_touches; ++n)
+				*dst++ = trill.touchHorizontalSize(n);
+			length = dst - data;
+		} else {
+			int words = trill.readRawFrame(data, kMaxWords);
+			if(words <= 0)
+				return false;
+			length = words;
+		}
+		timestamp_us = micros();
+		return true;
+	}
+	uint16_t touchLocation(uint8_t n) const { return data[n]; }
+	uint16_t touchSize(uint8_t n) const { return data[num_touches + n]; }
+	uint16_t touchHorizontalLocation(uint8_t n) const { return data[2 * num_touches + n]; }
+	uint16_t touchHorizontalSize(uint8_t n) const { return data[2 * num_touches + num_horizontal_touches + n]; }
+};
+
+#endif /* TRILL_FRAME_H */
@@ -0,0 +1,276 @@
+/*
+ * Trill library for Arduino
+ * (c) 2020 bela.io
+ *
+ * BSD license
+ */
+
+#include "TrillGestures.h"
+
+enum {
+	kFlagScrolling = 1 << 0,	/* Has started scrolling around a ring */
+	kFlagPaired = 1 << 1	/* Was one of the two touches of a pinch */
+};
+
+/* atan(2^-n), in 1/65536 of a turn */
+static const uint16_t kAtan[] = { 8192, 4836, 2555, 1297, 651, 326, 163, 81, 41, 20, 10, 5, 3, 1 };
+
+/* Length and angle of (x, y), by rotating it onto the x axis in steps of
+   atan(2^-n). The length comes out 8 times larger, for precision, and
+   times the gain of the rotations, about 1.647: see cordicToLocation().
+   x and y up to 4096 */
+static uint32_t cordic(int32_t x, int32_t y, uint16_t& angle) {
+	x *= 8;
+	y *= 8;
+	angle = 0;
+	if(x < 0) {
+		x = -x;
+		y = -y;
+		angle = 32768;
+	}
+	for(uint8_t n = 0; n < sizeof(kAtan) / sizeof(kAtan[0]); ++n) {
+		int32_t dx = x >> n;
+		int32_t dy = y >> n;
+		if(y > 0) {
+			x += dy;
+			y -= dx;
+			angle += kAtan[n];
+		} else {
+			x -= dy;
+			y += dx;
+			angle -= kAtan[n];
+		}
+	}
+	return x;
+}
+
+/* 39797 / 65536 is 1 / 1.647, the gain of cordic() */
+static int32_t cordicToLocation(uint32_t length) {
+	return (length * 39797) >> 19;
+}
+
+static int32_t absolute(int32_t value) {
+	return value < 0 ? -value : value;
+}
+
+TrillGestures::TrillGestures()
+: ring_length_(0), tap_time_ms_(250), tap_distance_(64), swipe_distance_(384),
+  swipe_velocity_(1280), pinch_step_(16), rotate_step_(256), is2D_(false)
+{
+	reset();
+}
+
+void TrillGestures::setup(Trill::Device device) {
+	ring_length_ = Trill::TRILL_RING == device ? TrillTracker::kRingLength : 0;
+	is2D_ = Trill::TRILL_SQUARE == device || Trill::TRILL_HEX == device;
+	reset();
+}
+
+void TrillGestures::reset() {
+	for(uint8_t n = 0; n < TrillTracker::kMaxTouches; ++n)
+		touches_[n].id = TrillTracker::kNoId;
+	pair_[0] = pair_[1] = TrillTracker::kNoId;
+	pair_start_ = pair_distance_ = pair_reported_ = 0;
+	rotation_ = rotation_reported_ = 0;
+	scroll_position_ = 0;
+	num_gestures_ = 0;
+}
+
+int32_t TrillGestures::getPinchDistance() const {
+	return cordicToLocation(pair_distance_) - cordicToLocation(pair_start_);
+}
+
+void TrillGestures::process(const TrillTracker& tracker, uint32_t timestamp_us) {
+	num_gestures_ = 0;
+	const boolean alone = 1 == tracker.getNumTouches();
+	for(uint8_t n = 0; n < tracker.getNumEvents(); ++n) {
+		const TrillTracker::Event& e = tracker.getEvent(n);
+		switch(e.type) {
+		case TrillTracker::DOWN:
+			touchDown(e.touch, timestamp_us);
+			break;
+		case TrillTracker::MOVE:
+			touchMove(e.touch, timestamp_us, alone);
+			break;
+		default:
+			touchUp(e.touch, timestamp_us);
+			break;
+		}
+	}
+	if(is2D_)
+		processPair(tracker);
+}
+
+TrillGestures::TouchState* TrillGestures::findState(uint8_t id) {
+	for(uint8_t n = 0; n < TrillTracker::kMaxTouches; ++n)
+		if(touches_[n].id == id)
+			return &touches_[n];
+	return nullptr;
+}
+
+TrillGestures::Gesture& TrillGestures::addGesture(uint8_t type, uint8_t id, uint16_t location, uint16_t horizontal) {
+	/* There is always room, but just in case */
+	Gesture& g = gestures_[num_gestures_ < kMaxGestures ? num_gestures_++ : kMaxGestures - 1];
+	g.type = type;
+	g.id = id;
+	g.location = location;
+	g.horizontal = horizontal;
+	g.value = 0;
+	g.horizontalValue = 0;
+	return g;
+}
+
+/* The shortest way between two locations on a ring */
+int32_t TrillGestures::wrap(int32_t distance) const {
+	if(!ring_length_)
+		return distance;
+	if(distance > ring_length_ / 2)
+		return distance - ring_length_;
+	if(distance < -(ring_length_ / 2))
+		return distance + ring_length_;
+	return distance;
+}
+
+void TrillGestures::touchDown(const TrillTracker::Touch& touch, uint32_t now) {
+	TouchState* s = findState(TrillTracker::kNoId);
+	if(!s)
+		return;
+	s->id = touch.id;
+	s->flags = 0;
+	s->down_us = s->last_us = now;
+	s->location = touch.location;
+	s->horizontal = is2D_ ? touch.horizontal : 0;
+	s->travel = s->horizontal_travel = 0;
+	s->velocity = s->horizontal_velocity = 0;
+	s->frame_us = 0;
+	s->max_travel = 0;
+}
+
+/* Follow the touch, and smooth its velocity over the last few frames:
+   the distance it moves in a frame and the length of a frame are each
+   averaged, so that there is no division until it is needed */
+void TrillGestures::touchMove(const TrillTracker::Touch& touch, uint32_t now, boolean alone) {
+	TouchState* s = findState(touch.id);
+	if(!s)
+		return;
+	int32_t dx = wrap((int32_t)touch.location - s->location);
+	int32_t dy = is2D_ ? (int32_t)touch.horizontal - s->horizontal : 0;
+	uint32_t dt = now - s->last_us;
+	if(dt > 0xFFFF)
+		dt = 0xFFFF;
+	if(!s->frame_us || 0xFFFF == dt) {
+		/* The first move, or the first after a long stop */
+		s->velocity = dx * 16;
+		s->horizontal_velocity = dy * 16;
+		s->frame_us = dt * 16;
+	} else {
+		s->velocity += (dx * 16 - s->velocity) / 4;
+		s->horizontal_velocity += (dy * 16 - s->horizontal_velocity) / 4;
+		s->frame_us += ((int32_t)dt * 16 - (int32_t)s->frame_us) / 4;
+	}
+	s->location = touch.location;
+	s->horizontal = is2D_ ? touch.horizontal : 0;
+	s->last_us = now;
+	s->travel += dx;
+	s->horizontal_travel += dy;
+	int32_t travel = absolute(s->travel) > absolute(s->horizontal_travel) ? absolute(s->travel) : absolute(s->horizontal_travel);
+	if(travel > s->max_travel)
+		s->max_travel = travel < 0xFFFF ? travel : 0xFFFF;
+
+	if(!ring_length_ || !alone)
+		return;
+	int32_t scroll = dx;
+	if(!(s->flags & kFlagScrolling)) {
+		if(s->max_travel <= tap_distance_)
+			return;
+		/* All the way it went before it could be told from a tap */
+		s->flags |= kFlagScrolling;
+		scroll = s->travel;
+	}
+	if(!scroll)
+		return;
+	addGesture(SCROLL, s->id, touch.location, 0).value = scroll;
+	scroll_position_ += scroll;
+}
+
+void TrillGestures::touchUp(const TrillTracker::Touch& touch, uint32_t now) {
+	TouchState* s = findState(touch.id);
+	if(!s)
+		return;
+	s->id = TrillTracker::kNoId;
+	if(s->flags & (kFlagScrolling | kFlagPaired))
+		return;
+	uint32_t down = now - s->down_us;
+	if(down <= tap_time_ms_ * 1000UL && s->max_travel <= tap_distance_) {
+		addGesture(TAP, touch.id, touch.location, s->horizontal).value = down / 1000;
+		return;
+	}
+	if(s->max_travel < swipe_distance_ || !s->frame_us)
+		return;
+	/* A touch that stopped for a few frames before lifting isn't moving */
+	uint32_t still = now - s->last_us;
+	if(still > 0xFFFF || still * 16 > 3 * s->frame_us)
+		return;
+	/* velocity * 16 * 10^6 / frame_us, within 32 bits */
+	int32_t frame = s->frame_us >> 6;
+	if(!frame)
+		return;
+	int32_t velocity = s->velocity * 15625 / frame;
+	int32_t horizontal = s->horizontal_velocity * 15625 / frame;
+	if(absolute(velocity) < swipe_velocity_ && absolute(horizontal) < swipe_velocity_)
+		return;
+	Gesture& g = addGesture(SWIPE, touch.id, touch.location, s->horizontal);
+	g.value = velocity;
+	g.horizontalValue = horizontal;
+}
+
+/* Two touches on a 2D sensor: follow the distance and angle between
+   them, from the one with the lower ID to the other */
+void TrillGestures::processPair(const TrillTracker& tracker) {
+	if(tracker.getNumTouches() != 2) {
+		pair_[0] = pair_[1] = TrillTracker::kNoId;
+		return;
+	}
+	const TrillTracker::Touch* a = &tracker.getTouch(0);
+	const TrillTracker::Touch* b = &tracker.getTouch(1);
+	if(a->id > b->id) {
+		const TrillTracker::Touch* t = a;
+		a = b;
+		b = t;
+	}
+	const boolean start = pair_[0] != a->id || pair_[1] != b->id;
+	if(!start && !tracker.getNumEvents())
+		return;
+	uint16_t angle;
+	uint32_t distance = cordic((int32_t)b->horizontal - a->horizontal, (int32_t)b->location - a->location, angle);
+	if(start) {
+		pair_[0] = a->id;
+		pair_[1] = b->id;
+		pair_start_ = pair_distance_ = pair_reported_ = distance;
+		pair_angle_ = angle;
+		rotation_ = rotation_reported_ = 0;
+		TouchState* s = findState(a->id);
+		if(s)
+			s->flags |= kFlagPaired;
+		s = findState(b->id);
+		if(s)
+			s->flags |= kFlagPaired;
+		return;
+	}
+	/* The angle wraps around, its change doesn't */
+	rotation_ += (int16_t)(angle - pair_angle_);
+	pair_angle_ = angle;
+	pair_distance_ = distance;
+	const uint16_t location = ((uint32_t)a->location + b->location) / 2;
+	const uint16_t horizontal = ((uint32_t)a->horizontal + b->horizontal) / 2;
+	int32_t pinch = cordicToLocation(distance) - cordicToLocation(pair_reported_);
+	if(absolute(pinch) >= pinch_step_) {
+		addGesture(PINCH, a->id, location, horizontal).value = pinch;
+		pair_reported_ = distance;
+	}
+	int32_t rotation = rotation_ - rotation_reported_;
+	if(absolute(rotation) >= rotate_step_) {
+		addGesture(ROTATE, a->id, location, horizontal).value = rotation;
+		rotation_reported_ = rotation_;
+	}
+}
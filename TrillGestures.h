@@ -0,0 +1,155 @@
+/*
+ * Trill library for Arduino
+ * (c) 2020 bela.io
+ *
+ * Taps, swipes, two-finger pinches and rotations, and circular scrolling,
+ * recognised frame by frame from the touches of a TrillTracker.
+ *
+ * BSD license
+ */
+
+#ifndef TRILL_GESTURES_H
+#define TRILL_GESTURES_H
+
+#include "TrillTracker.h"
+
+/*
+ * Recognises gestures as the touches move, one frame at a time:
+ *
+ *   TrillTracker tracker;
+ *   TrillGestures gestures;
+ *   ...
+ *   gestures.setup(Trill::TRILL_RING);
+ *   ...
+ *   trill.read();
+ *   if(tracker.update(trill)) {
+ *     gestures.process(tracker, micros());
+ *     for(uint8_t n = 0; n < gestures.getNumGestures(); ++n) {
+ *       const TrillGestures::Gesture& g = gestures.getGesture(n);
+ *       ...
+ *     }
+ *   }
+ *
+ * - TAP: a touch lifts soon after landing, without having moved much.
+ * - SWIPE: a touch lifts while moving fast, after moving far enough. Its
+ *   velocity, in locations per second, is smoothed over the last frames.
+ * - SCROLL, on a Ring: a single touch moving around it, once it has moved
+ *   further than a tap would. The position wraps around the ring.
+ * - PINCH and ROTATE, on a Square or Hex: two touches moving apart or
+ *   together, or around each other.
+ *
+ * Everything is integer arithmetic, and each frame costs at most a few
+ * steps for each touch event, plus one 14-step CORDIC for the two touches
+ * of a pinch. Only the velocity of a swipe needs a division, once when
+ * the touch lifts. Nothing is allocated.
+ */
+class TrillGestures
+{
+public:
+	enum {
+		kMaxGestures = 8	/* A TAP or SWIPE for each touch, a SCROLL, a PINCH and a ROTATE */
+	};
+	enum GestureType {
+		TAP = 0,
+		SWIPE = 1,
+		SCROLL = 2,
+		PINCH = 3,
+		ROTATE = 4,
+	};
+	struct Gesture {
+		uint8_t type;	/* A GestureType */
+		uint8_t id;	/* The tracker ID of the touch, the first of the two for PINCH and ROTATE */
+		uint16_t location;	/* Where it happened; between the two touches for PINCH and ROTATE */
+		uint16_t horizontal;	/* 2D sensors only */
+		/* TAP: how long the touch was down, in ms. SWIPE: the
+		   velocity, in locations per second. SCROLL: how far the touch
+		   went around the ring. PINCH: how much further apart the two
+		   touches are. ROTATE: how far the line between them turned,
+		   from the horizontal axis towards the vertical one, in
+		   1/65536 of a turn */
+		int32_t value;
+		int32_t horizontalValue;	/* SWIPE on 2D sensors: the horizontal velocity */
+	};
+
+	TrillGestures();
+
+	/* Which kind of sensor the touches come from: a Ring wraps around,
+	   a Square or Hex has two axes */
+	void setup(Trill::Device device);
+	/* Recognise the gestures in the frame tracker has just processed,
+	   read at timestamp_us (e.g.: micros()) */
+	void process(const TrillTracker& tracker, uint32_t timestamp_us);
+	/* Forget all touches, gestures and positions */
+	void reset();
+
+	/* The gestures recognised in the last frame */
+	uint8_t getNumGestures() const { return num_gestures_; }
+	const Gesture& getGesture(uint8_t n) const { return gestures_[n]; }
+
+	/* Where scrolling got to, the sum of all SCROLLs */
+	int32_t getScrollPosition() const { return scroll_position_; }
+	/* Whether there are two touches on a 2D sensor, and how far they
+	   moved apart and turned since the second one landed */
+	boolean isPinching() const { return pair_[0] != TrillTracker::kNoId; }
+	int32_t getPinchDistance() const;
+	int32_t getRotation() const { return rotation_; }
+
+	/* Thresholds. Distances are in the units of the touch locations,
+	   128 per pad */
+	void setTapTime(uint16_t ms) { tap_time_ms_ = ms; }
+	void setTapDistance(uint16_t distance) { tap_distance_ = distance; }
+	void setSwipeDistance(uint16_t distance) { swipe_distance_ = distance; }
+	void setSwipeVelocity(uint16_t velocity) { swipe_velocity_ = velocity; }
+	/* The smallest change reported by a PINCH, or by a ROTATE */
+	void setPinchStep(uint16_t distance) { pinch_step_ = distance; }
+	void setRotateStep(uint16_t angle) { rotate_step_ = angle; }
+
+private:
+	struct TouchState {
+		uint32_t down_us;
+		uint32_t last_us;
+		int32_t travel;	/* Along the sensor since it landed, wrapping around a ring */
+		int32_t horizontal_travel;
+		int32_t velocity;	/* Of the last moves, in 1/16 location per frame */
+		int32_t horizontal_velocity;
+		uint32_t frame_us;	/* Length of the last frames, in 1/16 us */
+		uint16_t location;
+		uint16_t horizontal;
+		uint16_t max_travel;	/* Furthest it went from where it landed */
+		uint8_t id;	/* kNoId if not in use */
+		uint8_t flags;
+	};
+
+	TouchState* findState(uint8_t id);
+	void touchDown(const TrillTracker::Touch& touch, uint32_t now);
+	void touchMove(const TrillTracker::Touch& touch, uint32_t now, boolean alone);
+	void touchUp(const TrillTracker::Touch& touch, uint32_t now);
+	void processPair(const TrillTracker& tracker);
+	Gesture& addGesture(uint8_t type, uint8_t id, uint16_t location, uint16_t horizontal);
+	int32_t wrap(int32_t distance) const;
+
+	TouchState touches_[TrillTracker::kMaxTouches];
+	Gesture gestures_[kMaxGestures];
+	int32_t scroll_position_;
+	/* The two touches of a pinch, by ID, and the distance between them
+	   when the pinch started, now and when last reported, in the units
+	   of cordic() */
+	uint8_t pair_[2];
+	uint32_t pair_start_;
+	uint32_t pair_distance_;
+	uint32_t pair_reported_;
+	uint16_t pair_angle_;	/* Of the line from the first touch to the second */
+	int32_t rotation_;	/* Since the pinch started */
+	int32_t rotation_reported_;
+	uint16_t ring_length_;	/* 0 if not a Ring */
+	uint16_t tap_time_ms_;
+	uint16_t tap_distance_;
+	uint16_t swipe_distance_;
+	uint16_t swipe_velocity_;
+	uint16_t pinch_step_;
+	uint16_t rotate_step_;
+	uint8_t num_gestures_;
+	bool is2D_;
+};
+
+#endif /* TRILL_GESTURES_H */
@@ -0,0 +1,56 @@
+/*
+ * Trill library for Arduino
+ * (c) 2020 bela.io
+ *
+ * BSD license
+ */
+
+#include "TrillHistory.h"
+
+TrillFrameHistory::TrillFrameHistory(uint16_t* words, Entry* entries, uint8_t slots, uint8_t frameWords)
+: words_(words), entries_(entries), slots_(slots), frame_words_(frameWords)
+{
+	clear();
+}
+
+void TrillFrameHistory::clear() {
+	num_frames_ = 0;
+	write_ = 0;
+	size_ = 0;
+}
+
+void TrillFrameHistory::commit(uint32_t timestamp_us, uint8_t mode, uint8_t length, uint8_t numTouches, uint8_t numHorizontalTouches) {
+	Entry& e = entries_[write_];
+	e.timestamp_us = timestamp_us;
+	e.mode = mode;
+	e.length = length;
+	e.num_touches = numTouches;
+	e.num_horizontal_touches = numHorizontalTouches;
+	if(++write_ == slots_)
+		write_ = 0;
+	if(size_ < slots_ - 1)
+		++size_;
+	++num_frames_;
+}
+
+TrillFrameHistory::Frame TrillFrameHistory::frame(uint8_t age) const {
+	/* The newest frame is in the slot before write_ */
+	uint8_t n = write_ > age ? write_ - 1 - age : write_ + slots_ - 1 - age;
+	const Entry& e = entries_[n];
+	Frame f;
+	f.timestamp_us = e.timestamp_us;
+	f.data = words_ + n * frame_words_;
+	f.mode = e.mode;
+	f.length = e.length;
+	f.num_touches = e.num_touches;
+	f.num_horizontal_touches = e.num_horizontal_touches;
+	return f;
+}
+
+TrillFrameHistory::Window TrillFrameHistory::window(uint8_t count) const {
+	Window w;
+	w.history_ = this;
+	w.size_ = count < size_ ? count : size_;
+	w.first_ = num_frames_ - w.size_;
+	return w;
+}
@@ -0,0 +1,145 @@
+/*
+ * Trill library for Arduino
+ * (c) 2020 bela.io
+ *
+ * The last few frames read from a Trill, with the time each was read at,
+ * kept where the library reads them to.
+ *
+ * BSD license
+ */
+
+#ifndef TRILL_HISTORY_H
+#define TRILL_HISTORY_H
+
+#include "Trill.h"
+
+/*
+ * A ring of frames that a Trill reads straight into, for features that
+ * need more than the latest frame: velocities, flicks, how fast pressure
+ * builds up. Frames are not copied, neither in nor out:
+ *
+ *   TrillHistory<16> history;	// the last 16 frames
+ *   ...
+ *   trill.setHistory(&history);
+ *   ...
+ *   trill.read();
+ *   TrillFrameHistory::Window w = history.window(4);
+ *   // w[0] is the oldest of the last 4 frames, w[w.size() - 1] the
+ *   // newest, each with its timestamp_us
+ *
+ * Only new frames are kept (see Trill::isNewFrame()): reading more often
+ * than the sensor scans doesn't fill the history with copies. There is
+ * one slot more than the frames kept, which the next frame is read into,
+ * so that a frame being read, possibly in the background with
+ * startRead(), is never visible.
+ *
+ * This is the part that doesn't depend on the size; declare a
+ * TrillHistory.
+ */
+class TrillFrameHistory
+{
+protected:
+	struct Entry {
+		uint32_t timestamp_us;
+		uint8_t mode;
+		uint8_t length;
+		uint8_t num_touches;
+		uint8_t num_horizontal_touches;
+	};
+
+public:
+	/* A frame in the history, laid out as the firmware sends it */
+	struct Frame {
+		uint32_t timestamp_us;	/* micros() once the frame was in */
+		const uint16_t* data;
+		uint8_t mode;	/* The Trill::Mode it was read in */
+		uint8_t length;	/* Words in data: one per channel, except in #CENTROID mode */
+		uint8_t num_touches;	/* #CENTROID: touches, vertical ones on a 2D device */
+		uint8_t num_horizontal_touches;
+
+		/* #CENTROID mode only. The locations of all touches come first,
+		   then their sizes, then the same for horizontal ones. 2D
+		   frames are the longest, with room for 4 touches per axis */
+		uint8_t maxTouches() const { return length >= 16 ? 4 : 5; }
+		uint16_t touchLocation(uint8_t n) const { return data[n]; }
+		uint16_t touchSize(uint8_t n) const { return data[maxTouches() + n]; }
+		uint16_t touchHorizontalLocation(uint8_t n) const { return data[2 * maxTouches() + n]; }
+		uint16_t touchHorizontalSize(uint8_t n) const { return data[3 * maxTouches() + n]; }
+	};
+
+	/*
+	 * The frames that were the last few when window() was called,
+	 * oldest first. New frames don't move it, but they overwrite its
+	 * frames once it is older than the whole history: see isValid().
+	 */
+	class Window {
+	public:
+		Window() : history_(nullptr), first_(0), size_(0) {}
+		uint8_t size() const { return size_; }
+		Frame operator[](uint8_t n) const { return history_->frame(history_->num_frames_ - 1 - (first_ + n)); }
+		/* Whether none of its frames were overwritten since */
+		boolean isValid() const { return !size_ || history_->num_frames_ - first_ <= history_->size(); }
+		/* From the oldest frame to the newest */
+		uint32_t getDuration() const { return size_ ? (*this)[size_ - 1].timestamp_us - (*this)[0].timestamp_us : 0; }
+	private:
+		friend class TrillFrameHistory;
+		const TrillFrameHistory* history_;
+		uint32_t first_;	/* Number of the oldest frame */
+		uint8_t size_;
+	};
+
+	/* Frames in the history, up to its capacity */
+	uint8_t size() const { return size_; }
+	uint8_t capacity() const { return slots_ - 1; }
+	/* Largest frame kept, in words. Frames that don't fit are read as
+	   if there were no history */
+	uint8_t getFrameWords() const { return frame_words_; }
+	/* Frames added since the start, or the last clear(). This tells
+	   whether there is anything new */
+	uint32_t getNumFrames() const { return num_frames_; }
+	/* The frame age frames before the newest: 0 is the newest. age must
+	   be less than size() */
+	Frame frame(uint8_t age) const;
+	/* The last count frames, or all of them if there are fewer */
+	Window window(uint8_t count) const;
+	void clear();
+
+	/* --- Used by Trill --- */
+
+	/* The slot the next frame goes to, if it has room for words */
+	uint16_t* acquire(uint8_t words) { return words <= frame_words_ ? slot() : nullptr; }
+	uint16_t* slot() { return words_ + write_ * frame_words_; }
+	/* Add the frame just read into slot() */
+	void commit(uint32_t timestamp_us, uint8_t mode, uint8_t length, uint8_t numTouches, uint8_t numHorizontalTouches);
+
+protected:
+	TrillFrameHistory(uint16_t* words, Entry* entries, uint8_t slots, uint8_t frameWords);
+
+private:
+	uint16_t* words_;	/* frame_words_ for each slot */
+	Entry* entries_;	/* One for each slot */
+	uint32_t num_frames_;
+	uint8_t slots_;
+	uint8_t frame_words_;
+	uint8_t write_;	/* Slot the next frame is read into */
+	uint8_t size_;
+};
+
+/* Keeps the last numFrames frames of up to frameWords words: 30 for a raw
+   frame of any device, 16 for a centroid frame. It takes
+   (numFrames + 1) * (2 * frameWords + 8) bytes, plus a few */
+template <uint8_t numFrames, uint8_t frameWords = 30>
+class TrillHistory : public TrillFrameHistory
+{
+public:
+	static_assert(numFrames >= 1 && numFrames < 255, "TrillHistory keeps 1 to 254 frames");
+	static_assert(frameWords >= 1, "TrillHistory needs room for at least one word per frame");
+
+	TrillHistory() : TrillFrameHistory(words_, entries_, numFrames + 1, frameWords) {}
+
+private:
+	uint16_t words_[(numFrames + 1) * frameWords];
+	Entry entries_[numFrames + 1];
+};
+
+#endif /* TRILL_HISTORY_H */
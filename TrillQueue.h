@@ -0,0 +1,131 @@
+/*
+ * Trill library for Arduino
+ * (c) 2020 bela.io
+ *
+ * A queue of frames from one core, or interrupt, to another: e.g. on an
+ * ESP32 one core reads the sensors while the other sends MIDI.
+ *
+ * BSD license
+ */
+
+#ifndef TRILL_QUEUE_H
+#define TRILL_QUEUE_H
+
+#include "TrillFrame.h"
+
+/*
+ * A fixed-size queue of TrillFrames with one producer and one consumer,
+ * which may run on different cores, or one in an interrupt. Neither side
+ * ever waits for the other: the producer fails when the queue is full,
+ * the consumer finds it empty. A frame is filled in place:
+ *
+ *   TrillFrameQueue<8> queue;
+ *   ...
+ *   // producer
+ *   queue.push(trill, 0);
+ *   // consumer
+ *   const TrillFrame* frame = queue.front();
+ *   if(frame) {
+ *     ...
+ *     queue.pop();
+ *   }
+ *
+ * A slot is only handed to the consumer once the producer has finished
+ * writing it, and only handed back once the consumer has popped it, so
+ * the consumer never sees a frame half written. The indices are single
+ * bytes, which every core loads and stores in one go.
+ */
+template <uint8_t capacity>
+class TrillFrameQueue
+{
+public:
+	static_assert(capacity >= 2 && capacity <= 128 && !(capacity & (capacity - 1)),
+		"TrillFrameQueue needs a capacity that is a power of two, up to 128");
+
+	TrillFrameQueue() : head_(0), tail_(0), overruns_(0) {}
+
+	/* --- Producer side --- */
+
+	/* The slot to fill next, or nullptr if the queue is full. It isn't
+	   visible to the consumer until commit() */
+	TrillFrame* acquire() {
+		uint8_t tail = __atomic_load_n(&tail_, __ATOMIC_ACQUIRE);
+		if((uint8_t)(head_ - tail) >= capacity)
+			return nullptr;
+		return &slots_[head_ & (capacity - 1)];
+	}
+	void commit() {
+		__atomic_store_n(&head_, (uint8_t)(head_ + 1), __ATOMIC_RELEASE);
+	}
+	/**
+	 * Read a frame from trill, see TrillFrame::read(), into the
+	 * queue. If the queue is full the sensor is not read and the
+	 * overrun is counted. A frame that isn't new, see
+	 * Trill::isNewFrame(), is not queued: the consumer already has
+	 * it.
+	 *
+	 * @return `true` if a frame was queued
+	 */
+	bool push(Trill& trill, uint8_t tag = 0) {
+		TrillFrame* frame = acquire();
+		if(!frame) {
+			++overruns_;
+			return false;
+		}
+		if(!frame->read(trill, tag) || !trill.isNewFrame())
+			return false;
+		commit();
+		return true;
+	}
+	bool push(const TrillFrame& frame) {
+		TrillFrame* slot = acquire();
+		if(!slot) {
+			++overruns_;
+			return false;
+		}
+		*slot = frame;
+		commit();
+		return true;
+	}
+	/* Frames the producer couldn't queue because the queue was full */
+	uint32_t getNumOverruns() const { return overruns_; }
+
+	/* --- Consumer side --- */
+
+	/* The oldest frame, or nullptr if the queue is empty. It stays
+	   valid until pop(), which does nothing on an empty queue */
+	const TrillFrame* front() {
+		uint8_t head = __atomic_load_n(&head_, __ATOMIC_ACQUIRE);
+		if(head == tail_)
+			return nullptr;
+		return &slots_[tail_ & (capacity - 1)];
+	}
+	void pop() {
+		if(__atomic_load_n(&head_, __ATOMIC_ACQUIRE) == tail_)
+			return;
+		__atomic_store_n(&tail_, (uint8_t)(tail_ + 1), __ATOMIC_RELEASE);
+	}
+	bool pop(TrillFrame& frame) {
+		const TrillFrame* slot = front();
+		if(!slot)
+			return false;
+		frame = *slot;
+		pop();
+		return true;
+	}
+
+	/* Number of frames queued. Exact on either side when the other
+	   side is idle, a snapshot otherwise */
+	uint8_t size() const {
+		return __atomic_load_n(&head_, __ATOMIC_ACQUIRE) - __atomic_load_n(&tail_, __ATOMIC_ACQUIRE);
+	}
+	bool empty() const { return !size(); }
+
+private:
+	TrillFrame slots_[capacity];
+	uint8_t head_;	/* Frames committed, written by the producer only */
+	uint8_t tail_;	/* Frames popped, written by the consumer only */
+	uint32_t overruns_;	/* Written by the producer only */
+};
+
+#endif /* TRILL_QUEUE_H */
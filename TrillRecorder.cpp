@@ -0,0 +1,124 @@
+/*
+ * Trill library for Arduino
+ * (c) 2020 bela.io
+ *
+ * BSD license
+ */
+
+#include "TrillRecorder.h"
+
+static uint8_t* putVarint(uint8_t* dst, uint32_t value) {
+	while(value >= 0x80) {
+		*dst++ = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+	*dst++ = value;
+	return dst;
+}
+
+/* The difference between two words, wrapped to 16 bits and zigzagged */
+static uint16_t zigzag(uint16_t value, uint16_t previous) {
+	int16_t diff = (int16_t)(uint16_t)(value - previous);
+	return ((uint16_t)diff << 1) ^ (uint16_t)(diff >> 15);
+}
+
+TrillRecorder::TrillRecorder(Print& out, uint8_t tag, uint16_t keyframeInterval)
+: out_(out), bytes_written_(0), keyframe_interval_(keyframeInterval),
+  frames_since_key_(keyframeInterval), tag_(tag),
+  device_(Trill::TRILL_NONE), firmware_(0), frames_since_sensor_(0)
+{
+	last_.length = 0;
+}
+
+uint16_t TrillRecorder::checksum(const uint8_t* data, size_t length) {
+	uint16_t a = 0;
+	uint16_t b = 0;
+	for(size_t n = 0; n < length; ++n) {
+		a = (a + data[n]) % 255;
+		b = (b + a) % 255;
+	}
+	return (a << 8) | b;
+}
+
+/* Fill in the size and checksum of the record that ends at end, and
+   write it */
+size_t TrillRecorder::writeRecord(uint8_t* record, uint8_t* end) {
+	record[2] = end - record - kRecordHeaderLength;
+	uint16_t check = checksum(record, end - record);
+	*end++ = check >> 8;
+	*end++ = check & 0xFF;
+	size_t written = out_.write(record, end - record);
+	bytes_written_ += written;
+	return written;
+}
+
+size_t TrillRecorder::writeSensor() {
+	uint8_t record[kRecordHeaderLength + 5 + kRecordCheckLength] = {
+		kRecordSensor, tag_, 0, 'R', 'L', kVersion,
+		(uint8_t)device_, firmware_,
+	};
+	return writeRecord(record, record + kRecordHeaderLength + 5);
+}
+
+size_t TrillRecorder::begin(Trill& trill) {
+	device_ = trill.deviceType();
+	firmware_ = trill.firmwareVersion();
+	keyframe();
+	frames_since_sensor_ = 0;
+	return writeSensor();
+}
+
+bool TrillRecorder::needsKeyframe(const TrillFrame& frame) {
+	return frames_since_key_ >= keyframe_interval_
+		|| frame.mode != last_.mode
+		|| frame.num_touches != last_.num_touches
+		|| frame.num_horizontal_touches != last_.num_horizontal_touches
+		|| frame.length != last_.length;
+}
+
+size_t TrillRecorder::write(const TrillFrame& frame) {
+	uint8_t record[kMaxRecordLength];
+	uint8_t* dst = record;
+	uint8_t length = frame.length <= TrillFrame::kMaxWords ? frame.length : TrillFrame::kMaxWords;
+	size_t written = 0;
+	if(needsKeyframe(frame)) {
+		/* So that a decoder starting part way knows the sensor, but
+		   not before every keyframe: in CENTROID mode touches coming
+		   and going change the layout often */
+		if(Trill::TRILL_NONE != device_ && frames_since_sensor_ >= keyframe_interval_) {
+			written += writeSensor();
+			frames_since_sensor_ = 0;
+		}
+		*dst++ = kRecordKey;
+		*dst++ = tag_;
+		*dst++ = 0;	/* The size, see writeRecord() */
+		*dst++ = frame.mode;
+		*dst++ = frame.num_touches;
+		*dst++ = frame.num_horizontal_touches;
+		*dst++ = length;
+		dst = putVarint(dst, frame.timestamp_us);
+		for(uint8_t n = 0; n < length; ++n)
+			dst = putVarint(dst, frame.data[n]);
+		frames_since_key_ = 1;
+	} else {
+		*dst++ = kRecordDelta;
+		*dst++ = tag_;
+		*dst++ = 0;	/* The size, see writeRecord() */
+		dst = putVarint(dst, frame.timestamp_us - last_.timestamp_us);
+		for(uint8_t n = 0; n < length; ++n)
+			dst = putVarint(dst, zigzag(frame.data[n], last_.data[n]));
+		++frames_since_key_;
+	}
+	if(frames_since_sensor_ < keyframe_interval_)
+		++frames_since_sensor_;
+	last_ = frame;
+	last_.length = length;
+	return written + writeRecord(record, dst);
+}
+
+size_t TrillRecorder::record(Trill& trill) {
+	TrillFrame frame;
+	if(!frame.read(trill, tag_))
+		return 0;
+	return write(frame);
+}
@@ -0,0 +1,102 @@
+/*
+ * Trill library for Arduino
+ * (c) 2020 bela.io
+ *
+ * Streams frames from a Trill in a compact binary format, e.g. over
+ * Serial, so that a session can be stored and replayed on a computer
+ * (see extras/host/trill-replay).
+ *
+ * BSD license
+ */
+
+#ifndef TRILL_RECORDER_H
+#define TRILL_RECORDER_H
+
+#include "TrillFrame.h"
+
+/*
+ * The stream is a sequence of records:
+ *
+ *   letter tag size body check_a check_b
+ *
+ * The tag is that of the sensor the record belongs to, so that several
+ * recorders can share a stream. size is the number of bytes in the body,
+ * and check_a and check_b are the two sums of a Fletcher-16 checksum of
+ * everything before them (see checksum()). Numbers marked varint are
+ * unsigned LEB128: 7 bits per byte, least significant first, the top bit
+ * set on all but the last byte. Differences are zigzag-encoded first
+ * (0, -1, 1, -2... become 0, 1, 2, 3...), so that small changes either way
+ * take one byte. The letters, each with the body that follows, are:
+ *
+ *   'T' 'R' 'L' version device firmware
+ *       a sensor: written by begin(), and again before the first
+ *       keyframe once `keyframeInterval` frames have gone by
+ *   'K' mode num_touches num_horizontal_touches length
+ *       varint(timestamp_us) varint(word) * length
+ *       a keyframe: the frame as it is
+ *   'D' varint(timestamp_us - previous) varint(zigzag(word - previous)) * length
+ *       a delta frame: the difference with the previous frame of the
+ *       same sensor, which had the same mode, touches and length
+ *
+ * A keyframe is written for the first frame, whenever the layout of the
+ * frame changes and every `keyframeInterval` frames. A decoder that
+ * starts part way through a stream, or loses bytes, skips to the next
+ * record whose size and checksum match, and picks each sensor up again
+ * at its next keyframe once it has had its sensor record.
+ */
+class TrillRecorder
+{
+public:
+	enum {
+		kVersion = 2,
+		kRecordSensor = 'T',
+		kRecordKey = 'K',
+		kRecordDelta = 'D',
+		/* letter, tag and size */
+		kRecordHeaderLength = 3,
+		kRecordCheckLength = 2,
+		/* Longest record: a keyframe of kMaxWords words of 3 bytes */
+		kMaxRecordLength = kRecordHeaderLength + 4 + 5 + 3 * TrillFrame::kMaxWords + kRecordCheckLength
+	};
+
+	TrillRecorder(Print& out, uint8_t tag = 0, uint16_t keyframeInterval = 64);
+
+	/* Write the record describing the sensor. The next frame is a
+	   keyframe */
+	size_t begin(Trill& trill);
+	/* Encode a frame. Returns the number of bytes written */
+	size_t write(const TrillFrame& frame);
+	/**
+	 * Read a frame from trill, see TrillFrame::read(), and encode it.
+	 *
+	 * @return the number of bytes written, 0 if the read failed
+	 */
+	size_t record(Trill& trill);
+	/* Make the next frame a keyframe, e.g. after bytes were lost */
+	void keyframe() { frames_since_key_ = keyframe_interval_; }
+
+	uint8_t getTag() { return tag_; }
+	/* Bytes written since the recorder was created */
+	uint32_t getBytesWritten() { return bytes_written_; }
+
+	/* Fletcher-16 checksum of length bytes: the first sum in the top
+	   byte, the second in the bottom one */
+	static uint16_t checksum(const uint8_t* data, size_t length);
+
+private:
+	bool needsKeyframe(const TrillFrame& frame);
+	size_t writeSensor();
+	size_t writeRecord(uint8_t* record, uint8_t* end);
+
+	Print& out_;
+	TrillFrame last_;	/* The last frame written, which the next one is encoded against */
+	uint32_t bytes_written_;
+	uint16_t keyframe_interval_;
+	uint16_t frames_since_key_;
+	uint8_t tag_;
+	Trill::Device device_;	/* As written by begin(), TRILL_NONE before */
+	uint8_t firmware_;
+	uint16_t frames_since_sensor_;	/* Frames written since the sensor record */
+};
+
+#endif /* TRILL_RECORDER_H */
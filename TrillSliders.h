@@ -0,0 +1,166 @@
+/*
+ * Trill library for Arduino
+ * (c) 2020 bela.io
+ *
+ * Several custom sliders made of the pads of one Trill Craft or Flex,
+ * all computed in a single pass over the frame.
+ *
+ * BSD license
+ */
+
+#ifndef TRILL_SLIDERS_H
+#define TRILL_SLIDERS_H
+
+#include "Trill.h"
+
+/*
+ * The pads of one slider, in order along the slider. Either a run of
+ * adjacent pads, which is read straight from the frame:
+ *
+ *   TrillPadRange<10, 10>      // pads 10, 11, ..., 19
+ *   TrillPadRange<9, 10, -1>   // pads 9, 8, ..., 0
+ *
+ * or any list of pads:
+ *
+ *   TrillPadList<3, 7, 4, 12>
+ */
+template <uint8_t first, uint8_t count, int step = 1>
+struct TrillPadRange
+{
+	static_assert(step == 1 || step == -1, "TrillPadRange needs a step of 1 or -1");
+	static constexpr uint8_t length = count;
+	static constexpr uint8_t pad(uint8_t n) { return first + step * n; }
+	static constexpr bool contains(uint8_t p) {
+		return step > 0 ? p >= first && p < first + count : p <= first && p + count > first;
+	}
+	static constexpr bool fits(uint8_t numPads) {
+		return step > 0 ? first + count <= numPads : first < numPads && count <= first + 1;
+	}
+	static Touches::TouchData_t read(const Touches::TouchData_t* frame, uint8_t n) {
+		return frame[first + step * n];
+	}
+};
+
+template <uint8_t... pads>
+struct TrillPadList
+{
+	static constexpr uint8_t length = sizeof...(pads);
+	static constexpr uint8_t order[sizeof...(pads)] = { pads... };
+	static constexpr uint8_t pad(uint8_t n) { return order[n]; }
+	static constexpr bool contains(uint8_t p, uint8_t n = 0) {
+		return n < length && (order[n] == p || contains(p, n + 1));
+	}
+	static constexpr bool fits(uint8_t numPads, uint8_t n = 0) {
+		return n >= length || (order[n] < numPads && fits(numPads, n + 1));
+	}
+	static Touches::TouchData_t read(const Touches::TouchData_t* frame, uint8_t n) {
+		return frame[order[n]];
+	}
+};
+
+template <uint8_t... pads> constexpr uint8_t TrillPadList<pads...>::order[sizeof...(pads)];
+
+/* Compile-time checks on a set of sliders */
+template <class... Sliders> struct TrillPadMap;
+
+template <>
+struct TrillPadMap<>
+{
+	static constexpr unsigned int uses(uint8_t) { return 0; }
+	static constexpr bool fit(uint8_t) { return true; }
+	static constexpr bool nonEmpty() { return true; }
+};
+
+template <class Slider, class... Sliders>
+struct TrillPadMap<Slider, Sliders...>
+{
+	/* How many sliders pad p belongs to */
+	static constexpr unsigned int uses(uint8_t p) {
+		return Slider::contains(p) + TrillPadMap<Sliders...>::uses(p);
+	}
+	static constexpr bool fit(uint8_t numPads) {
+		return Slider::fits(numPads) && TrillPadMap<Sliders...>::fit(numPads);
+	}
+	static constexpr bool nonEmpty() {
+		return Slider::length > 0 && TrillPadMap<Sliders...>::nonEmpty();
+	}
+	static constexpr bool disjoint(uint8_t numPads, uint8_t p = 0) {
+		return p >= numPads || (uses(p) <= 1 && disjoint(numPads, p + 1));
+	}
+};
+
+/*
+ * Custom sliders over the raw or differential frame of a Trill Craft or
+ * Flex, e.g.:
+ *
+ *   CustomSliders<3, TrillPadRange<9, 10, -1>, TrillPadRange<10, 10>> sliders;
+ *   ...
+ *   sliders.process(frame);
+ *   sliders[1].touchLocation(0);
+ *
+ * Each slider gives the same touches as a CustomSlider set up with the
+ * same pads, but no slider copies its pads out of the frame and every
+ * pad is visited once per process(). The map is checked when compiling:
+ * every pad must exist and belong to at most one slider.
+ */
+template <uint8_t maxNumCentroids, class... Sliders>
+class CustomSliders
+{
+public:
+	typedef Touches::TouchData_t WORD;
+	static constexpr uint8_t kNumPads = 30;
+	static constexpr uint8_t numSliders = sizeof...(Sliders);
+	static_assert(numSliders > 0, "CustomSliders needs at least one slider");
+	static_assert(maxNumCentroids > 0, "CustomSliders needs at least one touch per slider");
+	static_assert(TrillPadMap<Sliders...>::nonEmpty(), "every slider needs at least one pad");
+	static_assert(TrillPadMap<Sliders...>::fit(kNumPads), "a slider uses a pad that doesn't exist");
+	static_assert(TrillPadMap<Sliders...>::disjoint(kNumPads), "a pad belongs to more than one slider");
+
+	CustomSliders() {
+		for(uint8_t n = 0; n < numSliders; ++n) {
+			sliders_[n].centroids = centroids_[n];
+			sliders_[n].sizes = sizes_[n];
+		}
+	}
+
+	/* Find the touches of every slider in a frame of kNumPads words */
+	void process(const WORD* frame) {
+		uint8_t n = 0;
+		/* Expands to one scan per slider, in order */
+		int expand[] = { (scan<Sliders>(frame, n++), 0)... };
+		(void)expand;
+	}
+
+	const Touches& operator[](uint8_t n) const { return sliders_[n]; }
+	const Touches& slider(uint8_t n) const { return sliders_[n]; }
+
+	void setMinimumTouchSize(WORD minSize) { cc_.wMinimumCentroidSize = minSize; }
+	/* See CentroidDetection::setDivisionFree() */
+	void setDivisionFree(bool divisionFree) { cc_.bDivisionFree = divisionFree; }
+
+private:
+	/* The pads of a slider, for calculateCentroids() to read in place */
+	template <class Slider>
+	struct Pads
+	{
+		const WORD* frame;
+		WORD operator[](uint8_t n) const { return Slider::read(frame, n); }
+	};
+
+	template <class Slider>
+	void scan(const WORD* frame, uint8_t s) {
+		const Pads<Slider> pads = { frame };
+		cc_.calculateCentroids(pads, centroids_[s], sizes_[s], maxNumCentroids, 0, Slider::length, Slider::length);
+		sliders_[s].processCentroids(maxNumCentroids);
+	}
+
+	Touches sliders_[numSliders];
+	WORD centroids_[numSliders][maxNumCentroids];
+	WORD sizes_[numSliders][maxNumCentroids];
+	TrillCentroidCalculator cc_;
+};
+
+template <uint8_t maxNumCentroids, class... Sliders> constexpr uint8_t CustomSliders<maxNumCentroids, Sliders...>::kNumPads;
+template <uint8_t maxNumCentroids, class... Sliders> constexpr uint8_t CustomSliders<maxNumCentroids, Sliders...>::numSliders;
+
+#endif /* TRILL_SLIDERS_H */
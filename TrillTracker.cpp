@@ -0,0 +1,243 @@
+/*
+ * Trill library for Arduino
+ * (c) 2020 bela.io
+ *
+ * BSD license
+ */
+
+#include "TrillTracker.h"
+
+static uint16_t distance(uint16_t a, uint16_t b) {
+	return a > b ? a - b : b - a;
+}
+
+TrillTracker::TrillTracker(uint16_t maxDistance)
+: ring_length_(0), num_touches_(0), num_events_(0), next_id_(0), is2D_(false)
+{
+	setMaxDistance(maxDistance);
+}
+
+void TrillTracker::setMaxDistance(uint16_t maxDistance) {
+	max_distance_ = maxDistance < kMaxDistance ? maxDistance : kMaxDistance;
+}
+
+void TrillTracker::reset() {
+	num_touches_ = 0;
+	num_events_ = 0;
+}
+
+boolean TrillTracker::update(Trill& trill) {
+	if(!trill.isNewFrame())
+		return false;
+	process(trill);
+	return true;
+}
+
+void TrillTracker::process(const Touches& touches) {
+	Touch current[kMaxTouches];
+	uint8_t count = touches.getNumTouches();
+	if(count > kMaxTouches)
+		count = kMaxTouches;
+	for(uint8_t n = 0; n < count; ++n) {
+		current[n].location = touches.touchLocation(n);
+		current[n].horizontal = 0;
+		current[n].size = touches.touchSize(n);
+	}
+	process(current, count, false);
+}
+
+void TrillTracker::process(Trill& trill) {
+	ring_length_ = Trill::TRILL_RING == trill.deviceType() ? kRingLength : 0;
+	if(!trill.is2D()) {
+		process((const Touches&)trill);
+		return;
+	}
+	Touch current[kMaxTouches];
+	uint8_t vertical = trill.getNumTouches();
+	uint8_t horizontal = trill.getNumHorizontalTouches();
+	uint8_t count = 0;
+	if(vertical && horizontal)
+		count = vertical > horizontal ? vertical : horizontal;
+	if(count > kMaxTouches)
+		count = kMaxTouches;
+	for(uint8_t n = 0; n < count; ++n) {
+		uint8_t v = n < vertical ? n : vertical - 1;
+		uint8_t h = n < horizontal ? n : horizontal - 1;
+		current[n].location = trill.touchLocation(v);
+		current[n].horizontal = trill.touchHorizontalLocation(h);
+		/* The size from the axis where this touch is on its own */
+		current[n].size = horizontal > vertical ? trill.touchHorizontalSize(h) : trill.touchSize(v);
+	}
+	process(current, count, true);
+}
+
+void TrillTracker::process(const Touch* touches, uint8_t count, boolean is2D) {
+	int8_t previous[kMaxTouches];
+	if(count > kMaxTouches)
+		count = kMaxTouches;
+	/* Touches from the other kind of sensor can't be matched */
+	if(is2D != is2D_)
+		num_touches_ = 0;
+	is2D_ = is2D;
+	if(is2D || ring_length_)
+		match2D(touches, count, previous);
+	else
+		match1D(touches, count, previous);
+	commit(touches, count, previous);
+}
+
+/* Align the old and new touches, both in order along the sensor, at the
+   lowest cost: the distance between the touches of each pair, plus
+   max_distance_ for each touch left out. Pairs further apart than that
+   are never made. */
+void TrillTracker::match1D(const Touch* current, uint8_t count, int8_t* previous) {
+	enum { kPair, kOld, kNew };
+	uint16_t cost[kMaxTouches + 1][kMaxTouches + 1];
+	uint8_t step[kMaxTouches + 1][kMaxTouches + 1];
+	const uint8_t old = num_touches_;
+	for(uint8_t i = 0; i <= old; ++i) {
+		for(uint8_t j = 0; j <= count; ++j) {
+			if(!i && !j) {
+				cost[0][0] = 0;
+				continue;
+			}
+			/* Leave out old touch i - 1, or new touch j - 1 */
+			uint16_t best = 0xFFFF;
+			if(i) {
+				best = cost[i - 1][j] + max_distance_;
+				step[i][j] = kOld;
+			}
+			if(j && cost[i][j - 1] + max_distance_ < best) {
+				best = cost[i][j - 1] + max_distance_;
+				step[i][j] = kNew;
+			}
+			/* Or pair them */
+			if(i && j) {
+				uint16_t d = distance(touches_[i - 1].location, current[j - 1].location);
+				if(d <= max_distance_ && cost[i - 1][j - 1] + d < best) {
+					best = cost[i - 1][j - 1] + d;
+					step[i][j] = kPair;
+				}
+			}
+			cost[i][j] = best;
+		}
+	}
+	uint8_t i = old;
+	uint8_t j = count;
+	while(i || j) {
+		switch(step[i][j]) {
+		case kPair:
+			previous[--j] = --i;
+			break;
+		case kOld:
+			--i;
+			break;
+		default:
+			previous[--j] = -1;
+			break;
+		}
+	}
+}
+
+/* Along the sensor, or the shortest way around a ring */
+uint16_t TrillTracker::locationDistance(uint16_t a, uint16_t b) const {
+	uint16_t d = distance(a, b);
+	if(ring_length_ && d > ring_length_ / 2)
+		return d < ring_length_ ? ring_length_ - d : d;
+	return d;
+}
+
+/* Pair the closest old and new touches first */
+void TrillTracker::match2D(const Touch* current, uint8_t count, int8_t* previous) {
+	uint16_t d[kMaxTouches][kMaxTouches];
+	bool taken[kMaxTouches] = { false };
+	for(uint8_t j = 0; j < count; ++j) {
+		previous[j] = -1;
+		for(uint8_t i = 0; i < num_touches_; ++i) {
+			uint32_t sum = locationDistance(touches_[i].location, current[j].location);
+			if(is2D_)
+				sum += distance(touches_[i].horizontal, current[j].horizontal);
+			d[i][j] = sum > 0xFFFF ? 0xFFFF : sum;
+		}
+	}
+	while(1) {
+		uint16_t best = 0xFFFF;
+		int8_t bestI = -1;
+		int8_t bestJ = -1;
+		for(uint8_t i = 0; i < num_touches_; ++i) {
+			if(taken[i])
+				continue;
+			for(uint8_t j = 0; j < count; ++j) {
+				if(previous[j] < 0 && d[i][j] <= max_distance_ && d[i][j] < best) {
+					best = d[i][j];
+					bestI = i;
+					bestJ = j;
+				}
+			}
+		}
+		if(bestI < 0)
+			break;
+		taken[bestI] = true;
+		previous[bestJ] = bestI;
+	}
+}
+
+/* Turn the matches into IDs and events, and keep the new touches */
+void TrillTracker::commit(const Touch* current, uint8_t count, const int8_t* previous) {
+	bool kept[kMaxTouches] = { false };
+	Touch next[kMaxTouches];
+	for(uint8_t j = 0; j < count; ++j) {
+		next[j] = current[j];
+		if(previous[j] >= 0) {
+			kept[previous[j]] = true;
+			next[j].id = touches_[previous[j]].id;
+		} else
+			next[j].id = kNoId;
+	}
+	num_events_ = 0;
+	for(uint8_t i = 0; i < num_touches_; ++i) {
+		if(kept[i])
+			continue;
+		events_[num_events_].type = UP;
+		events_[num_events_++].touch = touches_[i];
+	}
+	for(uint8_t j = 0; j < count; ++j) {
+		if(kNoId == next[j].id)
+			continue;
+		const Touch& before = touches_[previous[j]];
+		if(before.location == next[j].location && before.horizontal == next[j].horizontal && before.size == next[j].size)
+			continue;
+		events_[num_events_].type = MOVE;
+		events_[num_events_++].touch = next[j];
+	}
+	for(uint8_t j = 0; j < count; ++j) {
+		if(kNoId != next[j].id)
+			continue;
+		next[j].id = newId(next, count);
+		events_[num_events_].type = DOWN;
+		events_[num_events_++].touch = next[j];
+	}
+	for(uint8_t j = 0; j < count; ++j)
+		touches_[j] = next[j];
+	num_touches_ = count;
+}
+
+/* The next ID after the last one given, skipping those of touches */
+uint8_t TrillTracker::newId(const Touch* touches, uint8_t count) {
+	while(1) {
+		uint8_t id = next_id_;
+		next_id_ = next_id_ + 1 < kNoId ? next_id_ + 1 : 0;
+		uint8_t n = 0;
+		while(n < count && touches[n].id != id)
+			++n;
+		if(n == count)
+			return id;
+	}
+}
+
+int TrillTracker::findTouch(uint8_t id) const {
+	for(uint8_t n = 0; n < num_touches_; ++n)
+		if(touches_[n].id == id)
+			return n;
+	return -1;
+}
@@ -0,0 +1,128 @@
+/*
+ * Trill library for Arduino
+ * (c) 2020 bela.io
+ *
+ * Follows touches from one frame to the next, so that each finger keeps
+ * the same ID for as long as it stays on the sensor.
+ *
+ * BSD license
+ */
+
+#ifndef TRILL_TRACKER_H
+#define TRILL_TRACKER_H
+
+#include "Trill.h"
+
+/*
+ * Touches come from the sensor in order of position, so the index of a
+ * touch changes whenever a finger before it lands or lifts. A tracker
+ * matches the touches of each frame with those of the previous one and
+ * gives every finger an ID that stays the same until it lifts:
+ *
+ *   TrillTracker tracker;
+ *   ...
+ *   trill.read();
+ *   if(tracker.update(trill)) {
+ *     for(uint8_t n = 0; n < tracker.getNumEvents(); ++n) {
+ *       const TrillTracker::Event& e = tracker.getEvent(n);
+ *       // e.type is DOWN, MOVE or UP, e.touch.id says which finger
+ *     }
+ *   }
+ *
+ * A touch is only matched with one that was at most setMaxDistance()
+ * away in the previous frame. On a 1D sensor, fingers can't pass each
+ * other, so the order of the touches is kept and the best match is found
+ * by aligning the two lists, in k^2 steps for k touches. On a 2D sensor,
+ * and on a Ring where a touch can go from the end to the start, the
+ * closest pairs are matched first, in at most k^3 steps. Nothing is
+ * allocated.
+ */
+class TrillTracker
+{
+public:
+	enum {
+		kMaxTouches = 5,
+		kMaxEvents = 2 * kMaxTouches,	/* An UP or MOVE for each old touch, a DOWN for each new one */
+		kMaxDistance = 6000,
+		kNoId = 0xFF,
+		kRingLength = 28 * 128	/* The firmware finds touches on the first 28 pads of a Ring */
+	};
+	enum EventType {
+		DOWN = 0,
+		MOVE = 1,
+		UP = 2,
+	};
+	struct Touch {
+		uint16_t location;	/* Along a 1D sensor, vertical on a 2D one */
+		uint16_t horizontal;	/* 2D sensors only */
+		uint16_t size;
+		uint8_t id;
+	};
+	struct Event {
+		uint8_t type;	/* An EventType */
+		Touch touch;	/* Where the touch is now, or was last for an UP */
+	};
+
+	/* maxDistance is in the units of the touch locations: 128 per pad */
+	TrillTracker(uint16_t maxDistance = 256);
+
+	/**
+	 * Match the touches of the frame last read from trill, which must
+	 * be in #CENTROID mode, but only if it is a new frame (see
+	 * Trill::isNewFrame()). Calling this on every loop() is cheap.
+	 *
+	 * @return `true` if the frame was processed
+	 */
+	boolean update(Trill& trill);
+	/* Match the touches of a new frame, unconditionally. This sets
+	   the ring length for a Ring, and none otherwise. On a 2D
+	   sensor, the firmware doesn't pair vertical and horizontal
+	   touches: they are paired in order, and if one axis has fewer
+	   touches its last one is paired with the remaining ones of the
+	   other, as two fingers side by side would be */
+	void process(Trill& trill);
+	/* The same for the touches of a CustomSlider or any 1D Touches */
+	void process(const Touches& touches);
+	/* The same for a list of touches, in order along the sensor if 1D.
+	   Their IDs are ignored */
+	void process(const Touch* touches, uint8_t count, boolean is2D);
+	/* Forget all touches, without any UP event */
+	void reset();
+
+	void setMaxDistance(uint16_t maxDistance);
+	/* Locations wrap around at length, as on a Ring: kRingLength. 0
+	   if they don't */
+	void setRingLength(uint16_t length) { ring_length_ = length; }
+
+	/* The touches of the last frame, in the order the sensor reports
+	   them */
+	uint8_t getNumTouches() const { return num_touches_; }
+	const Touch& getTouch(uint8_t n) const { return touches_[n]; }
+	/* Whether they came from a 2D sensor */
+	boolean is2D() const { return is2D_; }
+	/* The index of the touch with this ID, or -1 if it has lifted */
+	int findTouch(uint8_t id) const;
+
+	/* What changed with the last frame: first the touches that lifted,
+	   then those that moved or changed size, then those that landed */
+	uint8_t getNumEvents() const { return num_events_; }
+	const Event& getEvent(uint8_t n) const { return events_[n]; }
+
+private:
+	void match1D(const Touch* current, uint8_t count, int8_t* previous);
+	void match2D(const Touch* current, uint8_t count, int8_t* previous);
+	void commit(const Touch* current, uint8_t count, const int8_t* previous);
+	uint8_t newId(const Touch* touches, uint8_t count);
+	uint16_t locationDistance(uint16_t a, uint16_t b) const;
+
+	Touch touches_[kMaxTouches];
+	Event events_[kMaxEvents];
+	uint16_t max_distance_;
+	uint16_t ring_length_;	/* 0 if locations don't wrap around */
+	uint8_t num_touches_;
+	uint8_t num_events_;
+	uint8_t next_id_;
+	bool is2D_;	/* Whether touches_ came from a 2D sensor */
+};
+
+#endif /* TRILL_TRACKER_H */
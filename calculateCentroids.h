@@ -1,16 +1,18 @@
 // returns a WORD packing two signed chars. The high bytes is the last active sensor in the last centroid,
 // while the low byte is the first active sensor of the last centroid
-WORD calculateCentroids(WORD *centroidBuffer, WORD *sizeBuffer, BYTE maxNumCentroids, BYTE minSensor, BYTE maxSensor, BYTE numSensors) {
+// CSD_waSnsDiff holds the readings: anything that can be indexed with [], e.g. a pointer,
+// or a class that reads them from somewhere else
+template <typename Readings>
+WORD calculateCentroids(const Readings& CSD_waSnsDiff, WORD *centroidBuffer, WORD *sizeBuffer, BYTE maxNumCentroids, BYTE minSensor, BYTE maxSensor, BYTE numSensors) {
 	signed char lastActiveSensor = -1;
 	BYTE centroidIndex = 0, sensorIndex, actualHardwareIndex;
 	BYTE wrappedAround = 0;
 	BYTE inCentroid = 0;
 	WORD peakValue = 0, troughDepth = 0;
-	BYTE counter;
 	long temp;
 
-	WORD lastSensorVal, currentSensorVal, currentWeightedSum, currentUnweightedSum;
-	BYTE currentStart, currentLength;
+	WORD lastSensorVal, currentSensorVal, currentWeightedSum = 0, currentUnweightedSum = 0;
+	BYTE currentStart = 0, currentLength = 0;
 
 	for(sensorIndex = 0; sensorIndex < maxNumCentroids; sensorIndex++) {
 		centroidBuffer[sensorIndex] = 0xFFFF;
@@ -45,7 +47,7 @@ WORD calculateCentroids(WORD *centroidBuffer, WORD *sizeBuffer, BYTE maxNumCentr
 			if(currentSensorVal == 0) {
 				if(currentUnweightedSum > wMinimumCentroidSize)
 				{
-					temp = ((long)currentWeightedSum << SLIDER_BITS) / currentUnweightedSum;
+					temp = centroidFraction(currentWeightedSum, currentUnweightedSum);
 					centroidBuffer[centroidIndex] = (currentStart << SLIDER_BITS) + (WORD)temp;
 					sizeBuffer[centroidIndex] = currentUnweightedSum;
 					centroidIndex++;
@@ -72,7 +74,7 @@ WORD calculateCentroids(WORD *centroidBuffer, WORD *sizeBuffer, BYTE maxNumCentr
 				if(troughDepth > wAdjacentCentroidNoiseThreshold && currentSensorVal > lastSensorVal + wAdjacentCentroidNoiseThreshold) {
 					if(currentUnweightedSum > wMinimumCentroidSize)
 					{
-						temp = ((long)currentWeightedSum << SLIDER_BITS) / currentUnweightedSum;
+						temp = centroidFraction(currentWeightedSum, currentUnweightedSum);
 						centroidBuffer[centroidIndex] = (currentStart << SLIDER_BITS) + (WORD)temp;
 						sizeBuffer[centroidIndex] = currentUnweightedSum;
 						centroidIndex++;
@@ -116,7 +118,7 @@ WORD calculateCentroids(WORD *centroidBuffer, WORD *sizeBuffer, BYTE maxNumCentr
 	// Finish up the calculation on the last centroid, if necessary
 	if(inCentroid && currentUnweightedSum > wMinimumCentroidSize)
 	{
-		temp = ((long)currentWeightedSum << SLIDER_BITS) / currentUnweightedSum;
+		temp = centroidFraction(currentWeightedSum, currentUnweightedSum);
 		centroidBuffer[centroidIndex] = (currentStart << SLIDER_BITS) + (WORD)temp;
 		sizeBuffer[centroidIndex] = currentUnweightedSum;
 		centroidIndex++;
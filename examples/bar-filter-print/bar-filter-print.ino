@@ -0,0 +1,60 @@
+/*
+ ____  _____ _        _
+| __ )| ____| |      / \
+|  _ \|  _| | |     / _ \
+| |_) | |___| |___ / ___ \
+|____/|_____|_____/_/   \_\
+http://bela.io
+
+\example bar-filter-print
+
+Trill Bar Filter Print
+======================
+
+This example prints the location of each finger on a Trill Bar next to a
+smoothed one, as touch ID, location and smoothed location.
+
+A finger that rests on the sensor still wobbles by a few units from frame
+to frame. A `TrillFilter` smooths each touch, following it by the ID a
+`TrillTracker` gives it, and smooths more the slower it moves: a finger
+that stays put stays put, one that moves is followed without lag. Try
+`setMinCutoff()` and `setBeta()` to trade one for the other.
+*/
+
+#include <Trill.h>
+#include <TrillTracker.h>
+#include <TrillFilter.h>
+
+Trill trillSensor;
+TrillTracker tracker;
+TrillFilter filter;
+
+void setup() {
+  // Initialise serial and touch sensor
+  Serial.begin(115200);
+  int ret;
+  while((ret = trillSensor.setup(Trill::TRILL_BAR))) {
+    Serial.println("failed to initialise trillSensor");
+    Serial.print("Error code: ");
+    Serial.println(ret);
+  }
+}
+
+void loop() {
+  // Read 50 times per second
+  delay(20);
+  if(!trillSensor.read())
+    return;
+  tracker.update(trillSensor);
+  // Filter on every read, even if the frame is the same as the last one:
+  // a finger that stopped still has to settle
+  filter.process(tracker, micros());
+
+  for(uint8_t n = 0; n < filter.getNumTouches(); n++) {
+    Serial.print(filter.touchId(n));
+    Serial.print(" ");
+    Serial.print(tracker.getTouch(n).location);
+    Serial.print(" ");
+    Serial.println(filter.touchLocation(n));
+  }
+}
@@ -0,0 +1,62 @@
+/*
+ ____  _____ _        _
+| __ )| ____| |      / \
+|  _ \|  _| | |     / _ \
+| |_) | |___| |___ / ___ \
+|____/|_____|_____/_/   \_\
+http://bela.io
+
+\example bar-track-print
+
+Trill Bar Track Print
+=====================
+
+This example prints what each finger does on a Trill Bar: when it lands,
+where it moves to and when it lifts.
+
+The sensor reports touches in order along the bar, so when a finger lands
+to the left of another one, the touch that was first becomes the second.
+A `TrillTracker` matches the touches of each new frame with those of the
+previous one, so that every finger keeps the same ID from the moment it
+lands until it lifts, and reports what changed as a list of events.
+*/
+
+#include <Trill.h>
+#include <TrillTracker.h>
+
+Trill trillSensor;
+TrillTracker tracker;
+
+void setup() {
+  // Initialise serial and touch sensor
+  Serial.begin(115200);
+  int ret;
+  while((ret = trillSensor.setup(Trill::TRILL_BAR))) {
+    Serial.println("failed to initialise trillSensor");
+    Serial.print("Error code: ");
+    Serial.println(ret);
+  }
+}
+
+void loop() {
+  // Read 20 times per second
+  delay(50);
+  trillSensor.read();
+  if(!tracker.update(trillSensor))
+    return;
+
+  for(uint8_t n = 0; n < tracker.getNumEvents(); n++) {
+    const TrillTracker::Event& event = tracker.getEvent(n);
+    if(TrillTracker::DOWN == event.type)
+      Serial.print("down ");
+    else if(TrillTracker::MOVE == event.type)
+      Serial.print("move ");
+    else
+      Serial.print("up ");
+    Serial.print(event.touch.id);
+    Serial.print(" ");
+    Serial.print(event.touch.location);
+    Serial.print(" ");
+    Serial.println(event.touch.size);
+  }
+}
@@ -0,0 +1,64 @@
+/*
+ ____  _____ _        _
+| __ )| ____| |      / \
+|  _ \|  _| | |     / _ \
+| |_) | |___| |___ / ___ \
+|____/|_____|_____/_/   \_\
+http://bela.io
+
+\example bar-velocity-print
+
+Trill Bar Velocity Print
+========================
+
+This example prints how fast a single touch moves along a Trill Bar.
+
+The speed is worked out over the last few frames, so that the noise of a
+single frame doesn't dominate. Instead of copying every frame into its own
+arrays, the sketch gives the sensor a `TrillHistory`: each new frame is read
+straight into it, with the time it was read at, and the last few frames
+can be looked at together through a window.
+
+Speeds are in locations per second, where two pads are 128 apart.
+*/
+
+#include <Trill.h>
+#include <TrillHistory.h>
+
+Trill trillSensor;
+// keep the last 8 centroid frames, of up to 16 words each
+TrillHistory<8, 16> history;
+
+void setup() {
+  // Initialise serial and touch sensor
+  Serial.begin(115200);
+  int ret;
+  while((ret = trillSensor.setup(Trill::TRILL_BAR))) {
+    Serial.println("failed to initialise trillSensor");
+    Serial.print("Error code: ");
+    Serial.println(ret);
+  }
+  trillSensor.setHistory(&history);
+}
+
+void loop() {
+  delay(10);
+  trillSensor.read();
+  if(!trillSensor.isNewFrame())
+    return;
+
+  // the last 4 frames, oldest first
+  TrillFrameHistory::Window window = history.window(4);
+  if(window.size() < 4)
+    return;
+  // only when the touch was there all along
+  for(uint8_t n = 0; n < window.size(); n++) {
+    if(window[n].num_touches != 1)
+      return;
+  }
+  long distance = (long)window[3].touchLocation(0) - window[0].touchLocation(0);
+  long ms = window.getDuration() / 1000;
+  if(!ms)
+    return;
+  Serial.println(distance * 1000 / ms);
+}
@@ -0,0 +1,69 @@
+/*
+ ____  _____ _        _
+| __ )| ____| |      / \
+|  _ \|  _| | |     / _ \
+| |_) | |___| |___ / ___ \
+|____/|_____|_____/_/   \_\
+http://bela.io
+
+\example bus-print
+
+Trill Bus Print
+===============
+
+This example shows how to read several Trill sensors connected to the same
+I2C bus without blocking the rest of the sketch for long.
+
+Each sensor is added to a `TrillBus`, and `bus.update()` is called on every
+iteration of `loop()`. It only reads a sensor when it should have completed a new scan
+(learnt from the new and repeated frames it reads), and it stops reading once the time budget set
+with `bus.setBudget()` (in microseconds) has been used up, leaving the other
+sensors for the next iteration. `bus.hasNewFrame()` tells you which sensors
+have new data.
+*/
+
+#include <Trill.h>
+#include <TrillBus.h>
+
+Trill trillBar;
+Trill trillSquare;
+TrillBus bus;
+
+void setup() {
+  Serial.begin(115200);
+
+  if(trillBar.setup(Trill::TRILL_BAR) != 0)
+    Serial.println("failed to initialise trill bar");
+  if(trillSquare.setup(Trill::TRILL_SQUARE) != 0)
+    Serial.println("failed to initialise trill square");
+
+  bus.add(trillBar);
+  bus.add(trillSquare);
+  // don't spend more than 1.5 ms reading sensors on each loop()
+  bus.setBudget(1500);
+}
+
+void loop() {
+  bus.update();
+
+  if(bus.hasNewFrame(0)) {
+    Serial.print("Bar: ");
+    for(int i = 0; i < trillBar.getNumTouches(); i++) {
+      Serial.print(trillBar.touchLocation(i));
+      Serial.print(" ");
+    }
+    Serial.println("");
+  }
+
+  if(bus.hasNewFrame(1)) {
+    Serial.print("Square: ");
+    if(trillSquare.getNumTouches() > 0 && trillSquare.getNumHorizontalTouches() > 0) {
+      Serial.print(trillSquare.touchHorizontalLocation(0));
+      Serial.print(" ");
+      Serial.print(trillSquare.touchLocation(0));
+    }
+    Serial.println("");
+  }
+
+  // ... the rest of the sketch runs here
+}
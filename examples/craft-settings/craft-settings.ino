@@ -57,6 +57,11 @@ or to change sensor mode of operation:
 ```
 (where sensorMode can be one of {centroid, raw, baseline, differential}).
 
+Settings are sent with `applySettings()`, which only sends what has changed, and
+`pollSettings()`, which spaces the commands as the sensor needs without blocking
+the loop. Pass `true` as its third argument to also send the settings that
+`begin()` doesn't set, in case the sensor kept other values from an earlier sketch.
+
 This example also prints the raw data from the sensor, which is useful to see the effects
 of changing the different parameters (specially for Trill Craft).. This can be toggled
 on and off by sending the character 't' over the Serial Monitor.
@@ -102,39 +107,43 @@ void loop() {
       String commandValue = serialInput.substring(delimiterIndex+1);
       commandValue.trim();
 
+      // Changes are sent by pollSettings() below, without stopping the
+      // loop while the sensor processes them
+      Trill::Settings settings = trillSensor.getSettings();
       if(command == "prescaler") {
         Serial.print("setting prescaler to ");
         Serial.println(commandValue.toInt());
-        trillSensor.setPrescaler(commandValue.toInt());
-        gLastMillis = millis();  // Give 100ms for the chip to catch up
+        settings.prescaler = commandValue.toInt();
+        trillSensor.applySettings(settings, false);
       } else if(command == "baseline") {
         Serial.println("updating baseline");
         trillSensor.updateBaseline();
-        gLastMillis = millis();  // Give 100ms for the chip to catch up
       } else if(command == "threshold") {
         Serial.print("setting noise threshold to ");
         Serial.println(commandValue.toInt());
-        trillSensor.setNoiseThreshold(commandValue.toInt());
-        gLastMillis = millis();  // Give 100ms for the chip to catch up
+        settings.noise_threshold = commandValue.toInt();
+        trillSensor.applySettings(settings, false);
       } else if(command == "bits") {
         Serial.print("setting numBits to ");
         Serial.println(commandValue.toInt());
-        trillSensor.setScanSettings(0, commandValue.toInt());
-        gLastMillis = millis();  // Give 100ms for the chip to catch up
+        settings.num_bits = commandValue.toInt();
+        trillSensor.applySettings(settings, false);
       } else if(command == "mode") {
         Serial.print("setting mode to ");
         Serial.println(commandValue);
-        trillSensor.setMode(modeFromString(commandValue));
-        gLastMillis = millis();  // Give 100ms for the chip to catch up
+        settings.mode = modeFromString(commandValue);
+        trillSensor.applySettings(settings, false);
       } else {
         Serial.println("unknown command");
       }
     }
   }
 
-  if(printSensorVal) {
+  // Only read once the sensor has caught up with the last command
+  bool ready = trillSensor.pollSettings() != Trill::kSettingsPending;
+  if(printSensorVal && ready) {
     if(millis() - gLastMillis > 100) {
-      gLastMillis += 100;
+      gLastMillis = millis();
       trillSensor.requestRawData();
 
       if(trillSensor.rawDataAvailable() > 0) {
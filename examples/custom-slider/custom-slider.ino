@@ -13,10 +13,13 @@ learn.bela.io/flex-tutorial/ for more info on the sensor.
 
 Trill Flex has 30 capactive pads in total and we are splitting this
 into 3 groups of 10 pads. The order of the pads and their pin numbering is
-defined in slider0Pads etc. We can also set the max number of centroid
+defined in the Sliders type below: TrillPadRange<9, 10, -1> is the 10 pads
+from 9 down to 0, and TrillPadList<...> lets you list pads in any order.
+The pads are checked when compiling, so a pad that doesn't exist or that
+is used by two sliders is an error. We can also set the max number of centroid
 which will define how many touches can be registered per slider. This
 is currently set to 3 meaning that 3 individual touch points can be registered
-per sensor.
+per sensor. All the sliders are computed together in one call to process().
 
 Each touch has a location and a touch size which equates to how hard the finger
 is pushing on the sensor. This example is particularly useful for working with
@@ -27,29 +30,23 @@ or seeing lots of cross talk between the sensors.
 */
 
 #include <Trill.h>
+#include <TrillSliders.h>
 
 Trill trillSensor;
 
 const unsigned int NUM_TOTAL_PADS = 30;
-CustomSlider::WORD rawData[NUM_TOTAL_PADS];
-
-const uint8_t slider0NumPads = 10;
-const uint8_t slider1NumPads = 10;
-const uint8_t slider2NumPads = 10;
-
-// Order of the pads used by each slider
-uint8_t slider0Pads[slider0NumPads] = {9, 8, 7, 6, 5, 4, 3, 2, 1, 0};
-uint8_t slider1Pads[slider1NumPads] = {10, 11, 12, 13, 14, 15, 16, 17, 18, 19};
-uint8_t slider2Pads[slider2NumPads] = {20, 21, 22, 23, 24, 25, 26, 27, 28, 29};
+uint16_t rawData[NUM_TOTAL_PADS];
 
 const unsigned int maxNumCentroids = 3;
-const unsigned int numSliders = 3;
-CustomSlider sliders[numSliders];
+// Order of the pads used by each slider
+typedef CustomSliders<maxNumCentroids,
+  TrillPadRange<9, 10, -1>,  // 9, 8, 7, 6, 5, 4, 3, 2, 1, 0
+  TrillPadRange<10, 10>,     // 10, 11, 12, ..., 19
+  TrillPadRange<20, 10>      // 20, 21, 22, ..., 29
+> Sliders;
+Sliders sliders;
 
 void setup() {
-  sliders[0].setup(slider0Pads, slider0NumPads);
-  sliders[1].setup(slider1Pads, slider1NumPads);
-  sliders[2].setup(slider2Pads, slider2NumPads);
   // Initialise serial and touch sensor
   Serial.begin(115200);
   int ret;
@@ -73,16 +70,19 @@ void loop() {
   delay(50);
   if(!trillSensor.requestRawData()) {
     Serial.println("Failed reading from device. Is it disconnected?");
-    return setup();
+    // Try to get it back with the same settings, without starting over
+    if(trillSensor.reconnect() != 0)
+      return setup();
+    return;
   }
   unsigned n = 0;
   // read all the data from the device into a local buffer
   while(trillSensor.rawDataAvailable() > 0 && n < NUM_TOTAL_PADS) {
     rawData[n++] = trillSensor.rawDataRead();
   }
-  for(uint8_t n = 0; n < numSliders; ++n) {
-    // have each custom slider process the raw data into touches
-    sliders[n].process(rawData);
+  // process the raw data into the touches of every slider
+  sliders.process(rawData);
+  for(uint8_t n = 0; n < Sliders::numSliders; ++n) {
     Serial.print("| s");
     Serial.print(n);
     Serial.print("[");
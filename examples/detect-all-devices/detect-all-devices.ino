@@ -18,6 +18,9 @@ When the program runs it will print the address and sensor type
 of all the Trill sensors you currently have connected to the I2C bus
 on the serial port.
 
+All the addresses are scanned together, so this takes about as long with
+one sensor as with many.
+
 This is particularly useful if you are unsure of the address of the sensor after
 changing it via the solder bridges on the back. This example will also give
 you a total count of the amount of Trill sensors connected to Bela.
@@ -32,54 +35,25 @@ void setup() {
    // Initialise serial
    Serial.begin(9600);
    Serial.println("Trill devices detected on I2C bus:");
-   Serial.println("Address     |     Type");
-   unsigned int total = 0;
-   for(uint8_t n = 0x20; n <= 0x50; ++n) {
-      Trill::Device device = Trill::probe(n);
-      if(device != Trill::TRILL_NONE) {
-         Serial.print('#');
-         Serial.print(n, HEX);
-         Serial.print(" (");
-         Serial.print(n);
-         Serial.print(")");
-         Serial.print("          ");
-         printDeviceType((int)device);
-         Serial.println("");
-         ++total;
-      }
+   Serial.println("Address     |     Type     |     Firmware");
+   // Scan all the addresses Trill devices can use at once: this takes
+   // about 25ms however many devices are connected
+   Trill::BusDevice devices[16];
+   unsigned int total = Trill::scanBus(devices, 16);
+   for(unsigned int n = 0; n < total; ++n) {
+      Serial.print('#');
+      Serial.print(devices[n].address, HEX);
+      Serial.print(" (");
+      Serial.print(devices[n].address);
+      Serial.print(")");
+      Serial.print("          ");
+      Serial.print(Trill::getNameFromDevice((Trill::Device)devices[n].device));
+      Serial.print("          ");
+      Serial.println(devices[n].firmware);
    }
  Serial.print("Total: ");
  Serial.println(total);
 }
 
-void printDeviceType(int deviceType) {
-   switch(deviceType) {
-    case Trill::TRILL_BAR:
-      Serial.print("bar");
-      break;
-    case Trill::TRILL_SQUARE:
-      Serial.print("square");
-      break;
-    case Trill::TRILL_HEX:
-      Serial.print("hex");
-      break;
-    case Trill::TRILL_RING:
-      Serial.print("ring");
-      break;
-    case Trill::TRILL_CRAFT:
-      Serial.print("craft");
-      break;
-    case Trill::TRILL_FLEX:
-      Serial.print("flex");
-      break;
-    case Trill::TRILL_UNKNOWN:
-      Serial.print("unknown");
-      break;
-    case Trill::TRILL_NONE:
-      Serial.print("none");
-      break;
-  }
-}
-
 void loop() {
 }
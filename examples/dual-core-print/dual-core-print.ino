@@ -0,0 +1,89 @@
+/*
+ ____  _____ _        _
+| __ )| ____| |      / \
+|  _ \|  _| | |     / _ \
+| |_) | |___| |___ / ___ \
+|____/|_____|_____/_/   \_\
+http://bela.io
+
+\example dual-core-print
+
+Trill Dual-Core Print
+=====================
+
+This example shows how to read Trill sensors on one core of an ESP32 while
+the other core uses the data, so that slow work such as sending MIDI or
+USB reports never delays a read.
+
+A task pinned to core 0 reads a Bar and a Square every 5ms and pushes each
+new frame into a `TrillFrameQueue`, tagged with the sensor it came from: a
+frame that is the same as the previous one from that sensor is left out.
+`loop()`, which runs on core 1, takes the frames out of the queue in the
+order they were read and prints them. The queue needs no locks: a frame
+only becomes visible to `loop()` once it has been written completely. If
+`loop()` falls behind and the queue fills up, frames are dropped and
+counted by `getNumOverruns()`.
+*/
+
+#include <Trill.h>
+#include <TrillQueue.h>
+
+#ifndef ESP32
+#error This example needs a dual-core ESP32
+#endif
+
+Trill trillBar;
+Trill trillSquare;
+TrillFrameQueue<16> queue;
+
+enum { kBar, kSquare };
+
+void readSensors(void*) {
+  while(1) {
+    queue.push(trillBar, kBar);
+    queue.push(trillSquare, kSquare);
+    vTaskDelay(pdMS_TO_TICKS(5));
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+
+  if(trillBar.setup(Trill::TRILL_BAR) != 0)
+    Serial.println("failed to initialise trill bar");
+  if(trillSquare.setup(Trill::TRILL_SQUARE) != 0)
+    Serial.println("failed to initialise trill square");
+
+  // from now on only this task uses the sensors and the I2C bus
+  xTaskCreatePinnedToCore(readSensors, "trill", 4096, nullptr, 2, nullptr, 0);
+}
+
+void loop() {
+  const TrillFrame* frame;
+  while((frame = queue.front())) {
+    Serial.print(frame->timestamp_us);
+    if(kBar == frame->tag) {
+      Serial.print(" Bar: ");
+      for(int i = 0; i < frame->num_touches; i++) {
+        Serial.print(frame->touchLocation(i));
+        Serial.print(" ");
+      }
+    } else {
+      Serial.print(" Square: ");
+      if(frame->num_touches > 0 && frame->num_horizontal_touches > 0) {
+        Serial.print(frame->touchHorizontalLocation(0));
+        Serial.print(" ");
+        Serial.print(frame->touchLocation(0));
+      }
+    }
+    Serial.println("");
+    // the frame can be overwritten once popped
+    queue.pop();
+  }
+  static uint32_t overruns = 0;
+  if(queue.getNumOverruns() != overruns) {
+    overruns = queue.getNumOverruns();
+    Serial.print("frames dropped: ");
+    Serial.println(overruns);
+  }
+}
@@ -0,0 +1,67 @@
+/*
+ ____  _____ _        _
+| __ )| ____| |      / \
+|  _ \|  _| | |     / _ \
+| |_) | |___| |___ / ___ \
+|____/|_____|_____/_/   \_\
+http://bela.io
+
+\example evt-print
+
+Trill EVT Print
+===============
+
+This example shows how to use the EVT pin of a Trill sensor to read each
+new scan as soon as it is available, instead of reading on a timer.
+
+Connect the EVT pin of a Trill Bar to a pin of your board that can raise
+interrupts (pin 2 on an Uno) and pass that pin to `setup()`. The library
+then marks a frame as pending whenever the sensor completes a scan, and
+`readIfReady()` only talks to the sensor when there is something new, so
+`loop()` can call it as often as it likes without filling the bus with
+repeated reads.
+
+Without the EVT pin connected, pass -1 (or nothing): `readIfReady()` then
+estimates when the next scan is due from the scan settings.
+*/
+
+#include <Trill.h>
+
+Trill trillSensor;
+const int evtPin = 2;
+boolean touchActive = false;
+
+void setup() {
+  // Initialise serial and touch sensor
+  Serial.begin(115200);
+  int ret;
+  while((ret = trillSensor.setup(Trill::TRILL_BAR, 255, &Wire, evtPin))) {
+    Serial.println("failed to initialise trillSensor");
+    Serial.print("Error code: ");
+    Serial.println(ret);
+  }
+  if(trillSensor.getEventPin() < 0)
+    Serial.println("Pin can't raise interrupts, polling on a timer instead");
+}
+
+void loop() {
+  // Only true when a new scan has been read
+  if(!trillSensor.readIfReady())
+    return;
+
+  if(trillSensor.getNumTouches() > 0) {
+    for(int i = 0; i < trillSensor.getNumTouches(); i++) {
+        Serial.print(trillSensor.touchLocation(i));
+        Serial.print(" ");
+        Serial.print(trillSensor.touchSize(i));
+        Serial.print(" ");
+    }
+    Serial.println("");
+    touchActive = true;
+  }
+  else if(touchActive) {
+    // Print a single line when touch goes off
+    Serial.println("0 0");
+    touchActive = false;
+  }
+}
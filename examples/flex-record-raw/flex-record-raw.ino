@@ -0,0 +1,66 @@
+/*
+ ____  _____ _        _
+| __ )| ____| |      / \
+|  _ \|  _| | |     / _ \
+| |_) | |___| |___ / ___ \
+|____/|_____|_____/_/   \_\
+http://bela.io
+
+\example flex-record-raw
+
+Trill Flex Record Raw
+=====================
+
+This example streams the differential readings of a Trill Flex to the
+serial port in a compact binary format, so that a session can be saved on
+a computer and replayed later.
+
+It is set up like `flex-print-raw`, but instead of printing each channel
+as four decimal digits it passes every frame to a `TrillRecorder`. Only
+the difference with the previous frame is sent, usually one byte per
+channel, with the time each frame was read: about 37 bytes per frame
+instead of 150, so that many more frames get through at 115200 baud.
+
+To save a session, don't open the Serial Monitor. Instead, capture the port
+to a file, e.g. on Linux or macOS:
+
+  stty -F /dev/ttyACM0 115200 raw && cat /dev/ttyACM0 > session.trl
+
+The capture can start after the board: the bytes before the first whole
+record are skipped, and the replay starts once the description of the sensor
+and a full frame have come by, within about 128 frames.
+
+Then, from `extras/host` in the library, run `make` and
+
+  build/trill-replay session.trl
+
+to play it back through the library.
+*/
+
+#include <Trill.h>
+#include <TrillRecorder.h>
+
+Trill trillSensor;
+TrillRecorder recorder(Serial);
+
+void setup() {
+  Serial.begin(115200);
+  while(trillSensor.setup(Trill::TRILL_FLEX))
+    delay(100);
+  // when the slider is connected we increase the
+  // prescaler to deal with the increased baseline
+  // capacitance it brings
+  trillSensor.setPrescaler(3);
+  delay(10);
+  trillSensor.setNoiseThreshold(200);
+  delay(10);
+  trillSensor.updateBaseline();
+  // describe the sensor at the start of the recording
+  recorder.begin(trillSensor);
+}
+
+void loop() {
+  // one frame every 10ms
+  delay(10);
+  recorder.record(trillSensor);
+}
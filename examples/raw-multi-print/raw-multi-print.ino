@@ -39,29 +39,47 @@ Trill trillHex; // for Trill Hex
 Trill trillFlex; // for Trill Flex
 
 
+Trill* trills[] = { &trillBar, &trillSquare, &trillCraft, &trillRing, &trillHex, &trillFlex };
+const Trill::Device devices[] = {
+  Trill::TRILL_BAR,
+  Trill::TRILL_SQUARE,
+  Trill::TRILL_CRAFT,
+  Trill::TRILL_RING,
+  Trill::TRILL_HEX,
+  Trill::TRILL_FLEX,
+};
+const unsigned int numTrills = sizeof(trills) / sizeof(trills[0]);
+
 void setup() {
   // put your setup code here, to run once:
   Serial.begin(115200);
 
-  if(trillBar.setup(Trill::TRILL_BAR) != 0)
-    Serial.println("failed to initialise trill bar");
-
-  if(trillSquare.setup(Trill::TRILL_SQUARE) != 0)
-    Serial.println("failed to initialise trill square");
-
-  if(trillCraft.setup(Trill::TRILL_CRAFT) != 0)
-    Serial.println("failed to initialise trill craft");
-
-  if(trillRing.setup(Trill::TRILL_RING) != 0)
-    Serial.println("failed to initialise trill ring");
-
-  if(trillHex.setup(Trill::TRILL_HEX) != 0)
-    Serial.println("failed to initialise trill hex");
+  // Initialise all sensors at the same time: beginAsync() sends the first
+  // command and poll() sends the next one once the device is ready for it,
+  // so the sensors process their commands in parallel instead of one
+  // after the other.
+  int ret[numTrills];
+  for(unsigned int n = 0; n < numTrills; ++n)
+    ret[n] = trills[n]->beginAsync(devices[n]);
+  bool pending;
+  do {
+    pending = false;
+    for(unsigned int n = 0; n < numTrills; ++n) {
+      if(Trill::kBeginInProgress == ret[n])
+        ret[n] = trills[n]->poll();
+      if(Trill::kBeginInProgress == ret[n])
+        pending = true;
+    }
+  } while(pending);
+
+  for(unsigned int n = 0; n < numTrills; ++n) {
+    if(ret[n] != 0) {
+      Serial.print("failed to initialise trill ");
+      Serial.println(Trill::getNameFromDevice(devices[n]));
+    }
+  }
 
-  if(trillFlex.setup(Trill::TRILL_FLEX) != 0)
-  {
-    Serial.println("failed to initialise trill flex");
-  } else {
+  if(0 == ret[numTrills - 1]) {
     delay(10);
     trillFlex.setPrescaler(4);
     delay(10);
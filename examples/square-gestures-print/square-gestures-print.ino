@@ -0,0 +1,81 @@
+/*
+ ____  _____ _        _
+| __ )| ____| |      / \
+|  _ \|  _| | |     / _ \
+| |_) | |___| |___ / ___ \
+|____/|_____|_____/_/   \_\
+http://bela.io
+
+\example square-gestures-print
+
+Trill Square Gestures Print
+===========================
+
+This example prints the gestures made on a Trill Square: taps, swipes
+with their velocity, and two fingers pinching or turning.
+
+A `TrillTracker` follows each finger from one frame to the next, and
+`TrillGestures` looks at how they move, frame by frame, using integer
+maths only. Change the device to `TRILL_RING` to scroll around a Ring
+instead, or to `TRILL_BAR` for taps and swipes on a Bar.
+*/
+
+#include <Trill.h>
+#include <TrillGestures.h>
+
+const Trill::Device device = Trill::TRILL_SQUARE;
+Trill trillSensor;
+TrillTracker tracker;
+TrillGestures gestures;
+
+void setup() {
+  // Initialise serial and touch sensor
+  Serial.begin(115200);
+  int ret;
+  while((ret = trillSensor.setup(device))) {
+    Serial.println("failed to initialise trillSensor");
+    Serial.print("Error code: ");
+    Serial.println(ret);
+  }
+  gestures.setup(device);
+}
+
+void loop() {
+  // gestures need a few frames a second more than printing does
+  delay(10);
+  trillSensor.read();
+  if(!tracker.update(trillSensor))
+    return;
+  gestures.process(tracker, micros());
+
+  for(uint8_t n = 0; n < gestures.getNumGestures(); n++) {
+    const TrillGestures::Gesture& g = gestures.getGesture(n);
+    switch(g.type) {
+      case TrillGestures::TAP:
+        Serial.print("tap at ");
+        Serial.print(g.location);
+        Serial.print(" ");
+        Serial.println(g.horizontal);
+        break;
+      case TrillGestures::SWIPE:
+        Serial.print("swipe ");
+        Serial.print(g.value);
+        Serial.print(" ");
+        Serial.println(g.horizontalValue);
+        break;
+      case TrillGestures::SCROLL:
+        Serial.print("scroll to ");
+        Serial.println(gestures.getScrollPosition());
+        break;
+      case TrillGestures::PINCH:
+        Serial.print("pinch ");
+        Serial.println(gestures.getPinchDistance());
+        break;
+      case TrillGestures::ROTATE:
+        // 65536 is a whole turn
+        Serial.print("rotate ");
+        Serial.println(gestures.getRotation() * 360L / 65536);
+        break;
+    }
+  }
+}
@@ -22,6 +22,8 @@ patch receives, interprets and labels the high-precision CC values. This sends:
   - square touch size on CC 7 (MSB) and CC 39 (LSB)
   - bar position on CC 8 (MSB) and CC 40 (LSB)
   - bar touch size on CC 9 (MSB) and CC 41 (LSB)
+Values are sent only when they change by more than a small deadband, and BLE CCs are also
+rate-limited, so that a resting finger doesn't flood the link (see `TrillEmitter`).
 - ANALOG_OUT: sends touch information to the "analog" (actually PWM) outputs using the parameters
 set in `pwmBaseFreq` and `pwmResolutionBits`, starting from the GPIO channel set in `pwmFirstGpio`.
 With the default settings (39kHz carrier, 10 bit), a passive low-pass RC filter using a 10k
@@ -105,20 +107,23 @@ void midiBegin() {
 }
 
 void controlChangeHighRes(byte channel, byte control, unsigned value) {
-  uint8_t msb = (value >> 7) & 0x7f;
 #ifdef USB_MIDI
   if (TinyUSBDevice.mounted()) {
     // send a high-resolution (14-bit) CC message:
     // (note that the MIDI class API numbers channels from 1:16 instead of 0:15)
+    uint8_t msb = (value >> 7) & 0x7f;
     uint8_t lsb = value & 0x7f;
     MIDI.sendControlChange(control, lsb, channel + 1 + 32);  // send LSB at CC + 32
     MIDI.sendControlChange(control, msb, channel + 1);       // send MSB
   }
 #endif  // USB_MIDI
+}
+
+void controlChange(byte channel, byte control, unsigned value) {
 #ifdef BLE_MIDI
   // send regular-resolution (7-bit) CC to save bandwidth
   if (BLEMidiServer.isConnected()) {
-    BLEMidiServer.controlChange(channel, control, msb);
+    BLEMidiServer.controlChange(channel, control, value & 0x7f);
   }
 #endif  // BLE_MIDI
 }
@@ -139,9 +144,71 @@ void analogOut(uint8_t channel, uint32_t value) {
 #endif
 
 #include <Trill.h>
+#include <TrillEmitter.h>
 Trill bar;
 Trill square;
 
+// Each value goes out on every transport: as a 14-bit CC over USB, as a
+// 7-bit CC over BLE and as a PWM level. Parameter n * NUM_TRANSPORTS + t
+// of an emitter is value n on transport t
+enum {
+  USB_CC,
+  BLE_CC,
+#ifdef ANALOG_OUT
+  PWM,
+#endif  // ANALOG_OUT
+  NUM_TRANSPORTS
+};
+struct Output {
+  TrillParameterEmitter::Source source;
+  uint16_t inputMin;
+  uint16_t inputMax;
+  uint8_t cc;
+  uint8_t pwmChannel;
+};
+const Output squareOutputs[] = {
+  // remap coordinates to cover the full range
+  { TrillParameterEmitter::HORIZONTAL_LOCATION, 256, 128 * 14, 5, 0 },
+  { TrillParameterEmitter::LOCATION, 256, 128 * 14, 6, 1 },
+  // enlarge size to cover a reasonable portion of the range
+  { TrillParameterEmitter::SIZE, 0, 4096, 7, 2 },
+};
+const Output barOutputs[] = {
+  { TrillParameterEmitter::LOCATION, 0, 128 * 25, 8, 3 },
+  { TrillParameterEmitter::SIZE, 0, 4096, 9, 4 },
+};
+TrillEmitter<3 * NUM_TRANSPORTS> squareEmitter;
+TrillEmitter<2 * NUM_TRANSPORTS> barEmitter;
+
+void addOutputs(TrillParameterEmitter& emitter, const Output* outputs, unsigned count) {
+  for (unsigned n = 0; n < count; ++n) {
+    const Output& o = outputs[n];
+    // deadbands in 14-bit units: a few locations, a bit more for the size
+    uint16_t deadband = TrillParameterEmitter::SIZE == o.source ? 128 : 32;
+    emitter.addParameter(o.source, 0, o.inputMin, o.inputMax, 14, USB_CC, deadband);
+    emitter.addParameter(o.source, 0, o.inputMin, o.inputMax, 7, BLE_CC, deadband);
+#ifdef ANALOG_OUT
+    // half a step either way is enough to keep the level from flickering
+    emitter.addParameter(o.source, 0, o.inputMin, o.inputMax, pwmResolutionBits, PWM, 1 << (13 - pwmResolutionBits));
+#endif  // ANALOG_OUT
+  }
+}
+
+void sendChanges(const TrillParameterEmitter& emitter, const Output* outputs) {
+  for (uint8_t n = 0; n < emitter.getNumChanges(); ++n) {
+    const TrillParameterEmitter::Change& c = emitter.getChange(n);
+    const Output& o = outputs[c.parameter / NUM_TRANSPORTS];
+    if (USB_CC == c.transport)
+      controlChangeHighRes(0, o.cc, c.value);
+    else if (BLE_CC == c.transport)
+      controlChange(0, o.cc, c.value);
+#ifdef ANALOG_OUT
+    else
+      analogOut(o.pwmChannel, c.value);
+#endif  // ANALOG_OUT
+  }
+}
+
 constexpr unsigned RGB_LED_GPIO = 48;  // On ESP32-S3-DevKit-C1 v1.0
 void setup() {
   Serial.begin(115200);
@@ -160,6 +227,12 @@ void setup() {
   Serial.printf("square.setup() returned %d\n\r", ret);
   mouseBegin();
   midiBegin();
+  addOutputs(squareEmitter, squareOutputs, sizeof(squareOutputs) / sizeof(squareOutputs[0]));
+  addOutputs(barEmitter, barOutputs, sizeof(barOutputs) / sizeof(barOutputs[0]));
+  // share about 100 messages per second between the two on BLE, with
+  // room for a burst when a finger starts moving
+  squareEmitter.setRate(BLE_CC, 60, 6);
+  barEmitter.setRate(BLE_CC, 40, 4);
 #ifdef ANALOG_OUT
   for (unsigned n = 0; n < 5; ++n) {
     // set up the PWM channels
@@ -199,25 +272,8 @@ void loop() {
       pastBar = val;
     }
   }
-  if (barHasTouch || barHadTouch) {
-    unsigned int pos = 0;
-    unsigned int size = 0;
-    if (barHasTouch) {
-      pos = bar.touchLocation(0);
-      // remap to cover the full 14-bit range
-      pos = map(pos, 0, 128 * 25, 0, 16383);
-      pos = constrain(pos, 0, 16383);
-      // enlarge to size to cover enough of the 14-bit range
-      size = bar.touchSize(0) * 4;
-      size = constrain(size, 0, 16383);
-    }
-    controlChangeHighRes(0, 8, pos);
-    controlChangeHighRes(0, 9, size);
-#ifdef ANALOG_OUT
-    analogOut(3, pos >> (14 - pwmResolutionBits));
-    analogOut(4, size >> (14 - pwmResolutionBits));
-#endif  // ANALOG_OUT
-  }
+  barEmitter.process(bar, micros());
+  sendChanges(barEmitter, barOutputs);
   barHadTouch = barHasTouch;
 
   static int squareHadTouch = 0;
@@ -237,28 +293,8 @@ void loop() {
     pastSquareX = thisX;
     pastSquareY = thisY;
   }
-  if (squareHasTouch || squareHadTouch) {
-    unsigned int xcc = 0;
-    unsigned int ycc = 0;
-    unsigned int size = 0;
-    if (squareHasTouch) {
-      // remap coordinates to cover the full 14-bit range
-      xcc = map(thisX, 256, 128 * 14, 0, 16383);
-      xcc = constrain(xcc, 0, 16383);
-      ycc = map(thisY, 256, 128 * 14, 0, 16383);
-      ycc = constrain(ycc, 0, 16383);
-      // enlarge to size to cover a reasonable portion of the 14-bit range
-      size = square.touchSize(0) * 4;
-    }
-    controlChangeHighRes(0, 5, xcc);
-    controlChangeHighRes(0, 6, ycc);
-    controlChangeHighRes(0, 7, size);
-#ifdef ANALOG_OUT
-    analogOut(0, xcc >> (14 - pwmResolutionBits));
-    analogOut(1, ycc >> (14 - pwmResolutionBits));
-    analogOut(2, size >> (14 - pwmResolutionBits));
-#endif  // ANALOG_OUT
-  }
+  squareEmitter.process(square, micros());
+  sendChanges(squareEmitter, squareOutputs);
   squareHadTouch = squareHasTouch;
 
   if (x || y || scroll) {
@@ -0,0 +1,167 @@
+/*
+ * Reading and writing the centroid cases, see CentroidCases.h.
+ *
+ * BSD license
+ */
+
+#include "CentroidCases.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool CentroidResult::operator==(const CentroidResult& other) const
+{
+	if(numTouches != other.numTouches)
+		return false;
+	for(unsigned int n = 0; n < numTouches; ++n) {
+		if(locations[n] != other.locations[n] || sizes[n] != other.sizes[n])
+			return false;
+	}
+	return true;
+}
+
+template <uint8_t maxTouches>
+class Runner : public CentroidRunner
+{
+public:
+	Runner(const CentroidCase& c, bool divisionFree) : order(c.order) {
+		cd.setup(order.size() ? order.data() : nullptr, c.numPads);
+		cd.setMinimumTouchSize(c.minSize);
+		cd.setDivisionFree(divisionFree);
+	}
+	void process(const uint16_t* frame) override {
+		cd.process(frame);
+	}
+	CentroidResult result() const override {
+		CentroidResult r;
+		r.numTouches = cd.getNumTouches();
+		for(unsigned int n = 0; n < r.numTouches; ++n) {
+			r.locations[n] = cd.touchLocation(n);
+			r.sizes[n] = cd.touchSize(n);
+		}
+		return r;
+	}
+private:
+	std::vector<uint8_t> order;
+	CentroidDetection<maxTouches, 30> cd;
+};
+
+CentroidRunner* CentroidRunner::create(const CentroidCase& c, bool divisionFree)
+{
+	switch(c.maxTouches) {
+	case 1: return new Runner<1>(c, divisionFree);
+	case 2: return new Runner<2>(c, divisionFree);
+	case 3: return new Runner<3>(c, divisionFree);
+	case 4: return new Runner<4>(c, divisionFree);
+	case 5: return new Runner<5>(c, divisionFree);
+	}
+	return nullptr;
+}
+
+/* Reads the unsigned numbers following the keyword of line */
+static std::vector<unsigned long> numbers(const char* line)
+{
+	std::vector<unsigned long> values;
+	const char* p = strchr(line, ' ');
+	while(p && *p) {
+		char* end;
+		unsigned long v = strtoul(p, &end, 10);
+		if(end == p)
+			break;
+		values.push_back(v);
+		p = end;
+		if('/' == *p)
+			++p;
+	}
+	return values;
+}
+
+bool readCases(const char* path, std::vector<CentroidCase>& cases)
+{
+	FILE* f = fopen(path, "r");
+	if(!f) {
+		fprintf(stderr, "cannot open %s\n", path);
+		return false;
+	}
+	char line[1024];
+	unsigned int lineNumber = 0;
+	bool ok = true;
+	while(ok && fgets(line, sizeof(line), f)) {
+		++lineNumber;
+		line[strcspn(line, "\n")] = 0;
+		if('#' == line[0] || !line[0])
+			continue;
+		if(!strncmp(line, "case ", 5)) {
+			CentroidCase c;
+			char name[256];
+			unsigned int minSize;
+			if(4 != sscanf(line, "case %255s touches=%u pads=%u minSize=%u",
+					name, &c.maxTouches, &c.numPads, &minSize)
+					|| c.maxTouches < 1 || c.maxTouches > 5 || c.numPads > 30) {
+				ok = false;
+				break;
+			}
+			c.name = name;
+			c.minSize = minSize;
+			cases.push_back(c);
+			continue;
+		}
+		if(cases.empty()) {
+			ok = false;
+			break;
+		}
+		CentroidCase& c = cases.back();
+		std::vector<unsigned long> values = numbers(line);
+		if(!strncmp(line, "order ", 6) && values.size() == c.numPads) {
+			c.order.assign(values.begin(), values.end());
+		} else if(!strncmp(line, "frame ", 6) && values.size() >= c.numPads) {
+			c.frames.push_back(std::vector<uint16_t>(values.begin(), values.end()));
+		} else if(!strncmp(line, "expect ", 7) && values.size() && values.size() == 1 + 2 * values[0] && values[0] <= 5) {
+			CentroidResult r;
+			r.numTouches = values[0];
+			for(unsigned int n = 0; n < r.numTouches; ++n) {
+				r.locations[n] = values[1 + 2 * n];
+				r.sizes[n] = values[2 + 2 * n];
+			}
+			c.expected.push_back(r);
+		} else {
+			ok = false;
+		}
+	}
+	fclose(f);
+	for(const CentroidCase& c : cases)
+		ok &= c.frames.size() == c.expected.size();
+	if(!ok)
+		fprintf(stderr, "%s:%u: malformed case\n", path, lineNumber);
+	return ok;
+}
+
+bool writeCases(const char* path, const std::vector<CentroidCase>& cases)
+{
+	FILE* f = fopen(path, "w");
+	if(!f) {
+		fprintf(stderr, "cannot write %s\n", path);
+		return false;
+	}
+	fprintf(f, "# Golden output of CentroidDetection::process(), see CentroidCases.h.\n"
+		"# Regenerate with: make golden\n");
+	for(const CentroidCase& c : cases) {
+		fprintf(f, "\ncase %s touches=%u pads=%u minSize=%u\n", c.name.c_str(), c.maxTouches, c.numPads, c.minSize);
+		if(c.order.size()) {
+			fprintf(f, "order");
+			for(uint8_t pad : c.order)
+				fprintf(f, " %u", pad);
+			fprintf(f, "\n");
+		}
+		for(unsigned int n = 0; n < c.frames.size(); ++n) {
+			fprintf(f, "frame");
+			for(uint16_t v : c.frames[n])
+				fprintf(f, " %u", v);
+			fprintf(f, "\nexpect %u", c.expected[n].numTouches);
+			for(unsigned int t = 0; t < c.expected[n].numTouches; ++t)
+				fprintf(f, " %u/%u", c.expected[n].locations[t], c.expected[n].sizes[t]);
+			fprintf(f, "\n");
+		}
+	}
+	return 0 == fclose(f);
+}
@@ -0,0 +1,54 @@
+/*
+ * The frames that centroid-check and centroid-bench feed through
+ * CentroidDetection::process(), as stored in golden/centroids.txt.
+ *
+ * Each case is a detector configuration and a few frames:
+ *
+ *   case <name> touches=<N> pads=<n> minSize=<size>
+ *   order <pad> ...                  (optional: pads in slider order)
+ *   frame <value> ... (n values)
+ *   expect <numTouches> <location>/<size> ...
+ *
+ * BSD license
+ */
+
+#ifndef CENTROID_CASES_H
+#define CENTROID_CASES_H
+
+#include <Trill.h>
+#include <string>
+#include <vector>
+
+struct CentroidResult
+{
+	unsigned int numTouches;
+	uint16_t locations[5];
+	uint16_t sizes[5];
+	bool operator==(const CentroidResult& other) const;
+};
+
+struct CentroidCase
+{
+	std::string name;
+	unsigned int maxTouches; /* 1 to 5 */
+	unsigned int numPads; /* up to 30 */
+	uint16_t minSize;
+	std::vector<uint8_t> order; /* empty if the frame is already in order */
+	std::vector<std::vector<uint16_t>> frames;
+	std::vector<CentroidResult> expected;
+};
+
+/* A CentroidDetection set up like a case */
+class CentroidRunner
+{
+public:
+	virtual ~CentroidRunner() {}
+	virtual void process(const uint16_t* frame) = 0;
+	virtual CentroidResult result() const = 0;
+	static CentroidRunner* create(const CentroidCase& c, bool divisionFree);
+};
+
+bool readCases(const char* path, std::vector<CentroidCase>& cases);
+bool writeCases(const char* path, const std::vector<CentroidCase>& cases);
+
+#endif /* CENTROID_CASES_H */
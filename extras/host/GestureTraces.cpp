@@ -0,0 +1,90 @@
+/*
+ * Synthetic touch traces, see GestureTraces.h.
+ *
+ * BSD license
+ */
+
+#include "GestureTraces.h"
+#include <math.h>
+
+static bool is2D(Trill::Device device)
+{
+	return Trill::TRILL_SQUARE == device || Trill::TRILL_HEX == device;
+}
+
+static void addFrame(GestureTrace& trace, const TrillTracker::Touch* touches, uint8_t count)
+{
+	GestureFrame frame = {};
+	frame.timestamp_us = trace.frames.size() * kGestureFrameUs;
+	frame.count = count;
+	for(uint8_t n = 0; n < count; ++n)
+		frame.touches[n] = touches[n];
+	trace.frames.push_back(frame);
+}
+
+static void lift(GestureTrace& trace)
+{
+	addFrame(trace, nullptr, 0);
+	addFrame(trace, nullptr, 0);
+}
+
+GestureTrace tapTrace(Trill::Device device, uint16_t location, unsigned int ms)
+{
+	GestureTrace trace = { "tap", device, {} };
+	for(unsigned int n = 0; n * kGestureFrameUs < ms * 1000; ++n) {
+		TrillTracker::Touch touch = { (uint16_t)(location + n % 3 * 4), (uint16_t)(is2D(device) ? location - n % 2 * 4 : 0), 1000, 0 };
+		addFrame(trace, &touch, 1);
+	}
+	lift(trace);
+	return trace;
+}
+
+GestureTrace swipeTrace(Trill::Device device, uint16_t from, int step, unsigned int frames)
+{
+	GestureTrace trace = { "swipe", device, {} };
+	const int ringLength = 28 * 128;
+	for(unsigned int n = 0; n < frames; ++n) {
+		int location = from + (int)n * step;
+		if(Trill::TRILL_RING == device)
+			location = (location % ringLength + ringLength) % ringLength;
+		TrillTracker::Touch touch = { (uint16_t)location, (uint16_t)(is2D(device) ? location : 0), 1000, 0 };
+		addFrame(trace, &touch, 1);
+	}
+	lift(trace);
+	return trace;
+}
+
+GestureTrace pinchTrace(unsigned int distance0, unsigned int distance1, double angle0, double angle1, unsigned int frames)
+{
+	GestureTrace trace = { "pinch", Trill::TRILL_SQUARE, {} };
+	const double kMiddle = 900;
+	for(unsigned int n = 0; n < frames; ++n) {
+		double t = frames > 1 ? (double)n / (frames - 1) : 0;
+		double radius = (distance0 + (distance1 - (double)distance0) * t) / 2;
+		double angle = (angle0 + (angle1 - angle0) * t) * M_PI / 180;
+		double dh = radius * cos(angle);
+		double dl = radius * sin(angle);
+		TrillTracker::Touch touches[2] = {
+			{ (uint16_t)lround(kMiddle - dl), (uint16_t)lround(kMiddle - dh), 1000, 0 },
+			{ (uint16_t)lround(kMiddle + dl), (uint16_t)lround(kMiddle + dh), 1000, 0 },
+		};
+		addFrame(trace, touches, 2);
+	}
+	lift(trace);
+	return trace;
+}
+
+std::vector<TrillGestures::Gesture> runTrace(const GestureTrace& trace, TrillTracker& tracker, TrillGestures& gestures)
+{
+	std::vector<TrillGestures::Gesture> found;
+	tracker.reset();
+	tracker.setRingLength(Trill::TRILL_RING == trace.device ? TrillTracker::kRingLength : 0);
+	gestures.setup(trace.device);
+	for(const GestureFrame& frame : trace.frames) {
+		tracker.process(frame.touches, frame.count, is2D(trace.device));
+		gestures.process(tracker, frame.timestamp_us);
+		for(uint8_t n = 0; n < gestures.getNumGestures(); ++n)
+			found.push_back(gestures.getGesture(n));
+	}
+	return found;
+}
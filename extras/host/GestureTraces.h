@@ -0,0 +1,47 @@
+/*
+ * Synthetic touch traces for the gesture checks in trill-check and the
+ * gesture benchmark in centroid-bench: touches as TrillTracker takes
+ * them, one frame every 5ms, ending with every touch lifted.
+ *
+ * BSD license
+ */
+
+#ifndef GESTURE_TRACES_H
+#define GESTURE_TRACES_H
+
+#include <TrillGestures.h>
+#include <vector>
+
+struct GestureFrame
+{
+	uint32_t timestamp_us;
+	uint8_t count;
+	TrillTracker::Touch touches[TrillTracker::kMaxTouches];
+};
+
+struct GestureTrace
+{
+	const char* name;
+	Trill::Device device;
+	std::vector<GestureFrame> frames;
+};
+
+enum {
+	kGestureFrameUs = 5000
+};
+
+/* A touch that stays at location for ms, wobbling by a few units */
+GestureTrace tapTrace(Trill::Device device, uint16_t location, unsigned int ms);
+/* A touch that moves by step every frame for the given frames, along the
+   sensor, or diagonally on a 2D one. On a Ring it wraps around */
+GestureTrace swipeTrace(Trill::Device device, uint16_t from, int step, unsigned int frames);
+/* Two touches on a Square, either side of its middle, going from
+   distance0 apart at angle0 (in degrees, from the horizontal axis
+   towards the vertical one) to distance1 and angle1 */
+GestureTrace pinchTrace(unsigned int distance0, unsigned int distance1, double angle0, double angle1, unsigned int frames);
+
+/* Feed a trace to a tracker and to gestures, set up for its device, and
+   collect the gestures */
+std::vector<TrillGestures::Gesture> runTrace(const GestureTrace& trace, TrillTracker& tracker, TrillGestures& gestures);
+
+#endif /* GESTURE_TRACES_H */
@@ -0,0 +1,299 @@
+/*
+ * Reading back what TrillRecorder wrote, and playing it to the library
+ * through the host TwoWire.
+ *
+ * BSD license
+ */
+
+#include "Recording.h"
+#include <stdio.h>
+#include <map>
+#include <memory>
+#include <string.h>
+
+const RecordedSensor* Recording::sensor(uint8_t tag) const {
+	for(const RecordedSensor& s : sensors)
+		if(s.tag == tag)
+			return &s;
+	return nullptr;
+}
+
+namespace {
+
+class Reader
+{
+public:
+	Reader(const uint8_t* data, size_t size) : data_(data), size_(size), offset_(0) {}
+	bool done() const { return offset_ >= size_; }
+	size_t offset() const { return offset_; }
+	void skipRest() { offset_ = size_; }
+	bool byte(uint8_t& value) {
+		if(offset_ >= size_)
+			return false;
+		value = data_[offset_++];
+		return true;
+	}
+	bool varint(uint32_t& value) {
+		value = 0;
+		for(unsigned int shift = 0; shift < 35; shift += 7) {
+			uint8_t b;
+			if(!byte(b))
+				return false;
+			value |= (uint32_t)(b & 0x7F) << shift;
+			if(!(b & 0x80))
+				return true;
+		}
+		return false;
+	}
+	bool word(uint16_t& value) {
+		uint32_t v;
+		if(!varint(v) || v > 0xFFFF)
+			return false;
+		value = v;
+		return true;
+	}
+private:
+	const uint8_t* data_;
+	size_t size_;
+	size_t offset_;
+};
+
+}
+
+static uint16_t unzigzag(uint16_t value, uint16_t previous) {
+	int16_t diff = (int16_t)((value >> 1) ^ -(value & 1));
+	return previous + diff;
+}
+
+/* The length of the record at the start of data, or 0 if its size or
+   checksum don't match */
+static size_t recordLength(const uint8_t* data, size_t size)
+{
+	const size_t header = TrillRecorder::kRecordHeaderLength;
+	if(size < header)
+		return 0;
+	size_t length = header + data[2];
+	if(size < length + TrillRecorder::kRecordCheckLength)
+		return 0;
+	uint16_t check = TrillRecorder::checksum(data, length);
+	if(data[length] != check >> 8 || data[length + 1] != (check & 0xFF))
+		return 0;
+	return length + TrillRecorder::kRecordCheckLength;
+}
+
+/* Decode the body of a record. Frames that can't be decoded, because
+   their sensor or the frame before them were lost, are counted as
+   dropped. Returns false if the body is malformed */
+static bool decodeRecord(uint8_t kind, uint8_t tag, Reader& in, Recording& recording, std::map<uint8_t, size_t>& last)
+{
+	if(TrillRecorder::kRecordSensor == kind) {
+		uint8_t magic[2];
+		uint8_t version;
+		uint8_t device;
+		RecordedSensor sensor;
+		if(!(in.byte(magic[0]) && in.byte(magic[1]) && in.byte(version)
+				&& in.byte(device) && in.byte(sensor.firmware)
+				&& 'R' == magic[0] && 'L' == magic[1] && TrillRecorder::kVersion == version))
+			return false;
+		sensor.tag = tag;
+		sensor.device = (Trill::Device)device;
+		last.erase(tag);
+		if(!recording.sensor(tag))
+			recording.sensors.push_back(sensor);
+		return true;
+	}
+	if(TrillRecorder::kRecordKey == kind) {
+		TrillFrame frame;
+		uint32_t timestamp;
+		frame.tag = tag;
+		bool ok = in.byte(frame.mode) && in.byte(frame.num_touches)
+			&& in.byte(frame.num_horizontal_touches) && in.byte(frame.length)
+			&& frame.length <= TrillFrame::kMaxWords && in.varint(timestamp);
+		frame.timestamp_us = timestamp;
+		for(unsigned int n = 0; ok && n < frame.length; ++n)
+			ok = in.word(frame.data[n]);
+		if(!ok)
+			return false;
+		if(!recording.sensor(tag)) {
+			++recording.dropped;
+			in.skipRest();
+			return true;
+		}
+		last[tag] = recording.frames.size();
+		recording.frames.push_back(frame);
+		return true;
+	}
+	if(TrillRecorder::kRecordDelta == kind) {
+		if(!last.count(tag)) {
+			/* Can't tell whether the body fits the frame */
+			++recording.dropped;
+			in.skipRest();
+			return true;
+		}
+		TrillFrame frame = recording.frames[last[tag]];
+		uint32_t elapsed;
+		bool ok = in.varint(elapsed);
+		frame.timestamp_us += elapsed;
+		for(unsigned int n = 0; ok && n < frame.length; ++n) {
+			uint16_t diff;
+			ok = in.word(diff);
+			frame.data[n] = unzigzag(diff, frame.data[n]);
+		}
+		if(!ok)
+			return false;
+		last[tag] = recording.frames.size();
+		recording.frames.push_back(frame);
+		return true;
+	}
+	return false;
+}
+
+bool decodeRecording(const uint8_t* data, size_t size, Recording& recording, std::string& error)
+{
+	/* The last frame of each sensor, which delta frames apply to */
+	std::map<uint8_t, size_t> last;
+	size_t firstSkipped = 0;
+	recording = Recording();
+	for(size_t offset = 0; offset < size;) {
+		size_t length = recordLength(data + offset, size - offset);
+		if(length) {
+			const size_t header = TrillRecorder::kRecordHeaderLength;
+			Reader body(data + offset + header, length - header - TrillRecorder::kRecordCheckLength);
+			if(decodeRecord(data[offset], data[offset + 1], body, recording, last) && body.done()) {
+				offset += length;
+				continue;
+			}
+		}
+		/* Not the start of a record: try the next byte. Whichever
+		   sensor the bytes lost belonged to, its delta frames can't be
+		   decoded before its next keyframe */
+		if(!recording.skipped)
+			firstSkipped = offset;
+		++recording.skipped;
+		last.clear();
+		++offset;
+	}
+	if(recording.skipped || recording.dropped) {
+		char message[128];
+		snprintf(message, sizeof(message), "%zu bytes skipped, from byte %zu, and %u frames dropped",
+			recording.skipped, firstSkipped, recording.dropped);
+		error = message;
+		return false;
+	}
+	return true;
+}
+
+bool readRecording(const char* path, Recording& recording, std::string& error)
+{
+	FILE* file = fopen(path, "rb");
+	if(!file) {
+		error = std::string("can't open ") + path;
+		return false;
+	}
+	std::vector<uint8_t> bytes;
+	uint8_t buffer[4096];
+	size_t n;
+	while((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		bytes.insert(bytes.end(), buffer, buffer + n);
+	fclose(file);
+	return decodeRecording(bytes.data(), bytes.size(), recording, error);
+}
+
+ReplayDevice::ReplayDevice(const RecordedSensor& sensor)
+: sensor_(sensor), pointer_(0), payloadLength_(0)
+{
+}
+
+void ReplayDevice::onReceive(const uint8_t* data, size_t length) {
+	if(length)
+		pointer_ = data[0];
+}
+
+size_t ReplayDevice::onRequest(uint8_t* dst, size_t length) {
+	for(size_t n = 0; n < length; ++n) {
+		size_t offset = pointer_ + n;
+		if(offset < kDataOffset) {
+			const uint8_t status[kDataOffset] = { 0xFE, (uint8_t)sensor_.device, sensor_.firmware, 0 };
+			dst[n] = status[offset];
+		} else if(offset - kDataOffset < payloadLength_)
+			dst[n] = payload_[offset - kDataOffset];
+		else
+			dst[n] = 0;
+	}
+	return length;
+}
+
+void ReplayDevice::writeWord(size_t word, uint16_t value) {
+	payload_[2 * word] = value >> 8;
+	payload_[2 * word + 1] = value & 0xFF;
+}
+
+/* Lay the frame out as the firmware would */
+void ReplayDevice::setFrame(const TrillFrame& frame) {
+	if(Trill::CENTROID != frame.mode) {
+		for(unsigned int n = 0; n < frame.length; ++n)
+			writeWord(n, frame.data[n]);
+		payloadLength_ = 2 * frame.length;
+		return;
+	}
+	const bool is2D = Trill::TRILL_SQUARE == sensor_.device || Trill::TRILL_HEX == sensor_.device;
+	const unsigned int maxTouches = is2D ? 4 : 5;
+	unsigned int word = 0;
+	for(unsigned int axis = 0; axis < (is2D ? 2u : 1u); ++axis) {
+		unsigned int numTouches = axis ? frame.num_horizontal_touches : frame.num_touches;
+		unsigned int first = axis ? 2 * frame.num_touches : 0;
+		for(unsigned int n = 0; n < maxTouches; ++n)
+			writeWord(word++, n < numTouches ? frame.data[first + n] : 0xFFFF);
+		for(unsigned int n = 0; n < maxTouches; ++n)
+			writeWord(word++, n < numTouches ? frame.data[first + numTouches + n] : 0);
+	}
+	/* The buttons of a Ring aren't recorded */
+	if(Trill::TRILL_RING == sensor_.device) {
+		writeWord(word++, 0);
+		writeWord(word++, 0);
+	}
+	payloadLength_ = 2 * word;
+}
+
+static bool sameFrame(const TrillFrame& a, const TrillFrame& b)
+{
+	return a.mode == b.mode && a.num_touches == b.num_touches
+		&& a.num_horizontal_touches == b.num_horizontal_touches && a.length == b.length
+		&& !memcmp(a.data, b.data, a.length * sizeof(a.data[0]));
+}
+
+ReplayResult replayRecording(const Recording& recording)
+{
+	ReplayResult result = {};
+	TwoWire wire;
+	std::map<uint8_t, std::unique_ptr<ReplayDevice>> devices;
+	std::map<uint8_t, std::unique_ptr<Trill>> trills;
+	uint8_t address = 0x20;
+	for(const RecordedSensor& sensor : recording.sensors) {
+		ReplayDevice* device = new ReplayDevice(sensor);
+		Trill* trill = new Trill;
+		devices[sensor.tag].reset(device);
+		trills[sensor.tag].reset(trill);
+		wire.attach(address, device);
+		trill->begin(sensor.device, address++, &wire);
+	}
+	CentroidDetection<5, 30> detector;
+	for(const TrillFrame& frame : recording.frames) {
+		Trill& trill = *trills[frame.tag];
+		if(trill.getMode() != frame.mode)
+			trill.setMode((Trill::Mode)frame.mode);
+		devices[frame.tag]->setFrame(frame);
+		TrillFrame read;
+		if(!read.read(trill, frame.tag) || !sameFrame(read, frame))
+			++result.mismatches;
+		if(Trill::DIFF == frame.mode && !trill.is2D()) {
+			detector.setup(nullptr, frame.length);
+			detector.process(frame.data);
+			result.touches += detector.getNumTouches();
+		}
+		++result.frames;
+	}
+	for(uint8_t a = 0x20; a < address; ++a)
+		wire.attach(a, nullptr);
+	return result;
+}
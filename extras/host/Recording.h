@@ -0,0 +1,100 @@
+/*
+ * Reading back what TrillRecorder wrote, and playing it to the library
+ * through the host TwoWire.
+ *
+ * BSD license
+ */
+
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <TrillRecorder.h>
+#include <Wire.h>
+#include <string>
+#include <vector>
+
+/* Collects what is printed to it */
+class BufferPrint : public Print
+{
+public:
+	size_t write(uint8_t c) override {
+		bytes.push_back(c);
+		return 1;
+	}
+	size_t write(const uint8_t* buffer, size_t size) override {
+		bytes.insert(bytes.end(), buffer, buffer + size);
+		return size;
+	}
+	std::vector<uint8_t> bytes;
+};
+
+struct RecordedSensor
+{
+	uint8_t tag;
+	Trill::Device device;
+	uint8_t firmware;
+};
+
+struct Recording
+{
+	std::vector<RecordedSensor> sensors;
+	/* In the order they were recorded, with the tag of their sensor */
+	std::vector<TrillFrame> frames;
+	/* Bytes that weren't part of a valid record */
+	size_t skipped = 0;
+	/* Frames that couldn't be decoded: delta frames after bytes were
+	   lost, before the next keyframe of their sensor, and frames of a
+	   sensor whose record was lost */
+	unsigned int dropped = 0;
+	const RecordedSensor* sensor(uint8_t tag) const;
+};
+
+/* Decode a stream written by one or more TrillRecorders, skipping what
+   can't be decoded. If anything was, returns false, with what was
+   decoded in recording and error saying how much was lost and from
+   where */
+bool decodeRecording(const uint8_t* data, size_t size, Recording& recording, std::string& error);
+bool readRecording(const char* path, Recording& recording, std::string& error);
+
+/*
+ * Answers the library like a Trill whose scans are the frames of a
+ * recording: identify with the recorded device and firmware, and serve
+ * whatever frame was passed to setFrame() last. Commands are accepted
+ * and ignored.
+ */
+class ReplayDevice : public TwoWireDevice
+{
+public:
+	ReplayDevice(const RecordedSensor& sensor);
+	void onReceive(const uint8_t* data, size_t length) override;
+	size_t onRequest(uint8_t* dst, size_t length) override;
+	void setFrame(const TrillFrame& frame);
+
+private:
+	enum {
+		kDataOffset = 4,
+		kMaxPayload = 60
+	};
+	void writeWord(size_t word, uint16_t value);
+
+	RecordedSensor sensor_;
+	uint8_t pointer_;
+	uint8_t payload_[kMaxPayload];
+	size_t payloadLength_;
+};
+
+struct ReplayResult
+{
+	unsigned int frames;
+	/* Frames the library didn't read back as recorded */
+	unsigned int mismatches;
+	/* Touches CentroidDetection found in the differential frames of
+	   1D sensors */
+	unsigned int touches;
+};
+
+/* Play every frame to a Trill through a ReplayDevice, as fast as
+   possible, and run CentroidDetection on the differential ones */
+ReplayResult replayRecording(const Recording& recording);
+
+#endif /* RECORDING_H */
@@ -0,0 +1,264 @@
+/*
+ * Simulated Trill firmware for the host build.
+ *
+ * BSD license
+ */
+
+#include "TrillSim.h"
+
+enum {
+	kCommandMode = 1,
+	kCommandScanSettings = 2,
+	kCommandPrescaler = 3,
+	kCommandNoiseThreshold = 4,
+	kCommandIdac = 5,
+	kCommandBaselineUpdate = 6,
+	kCommandMinimumSize = 7,
+	kCommandAutoScanInterval = 16,
+	kCommandIdentify = 255
+};
+
+TrillSim::TrillSim(Trill::Device device, uint8_t firmwareVersion)
+: device(device), firmwareVersion(firmwareVersion), mode(Trill::CENTROID),
+  speed(0), numBits(12), prescaler(1), noiseThreshold(0), idac(0),
+  minimumSize(0), autoScanInterval(1), commandsReceived(0), baselineUpdates(0),
+  numTouches_(0), noise_(0), noiseState_(1), pointer_(0),
+  epoch_(host::now()), frameScan_(0), frameValid_(false), payloadLength_(0),
+  eventPin_(-1)
+{
+}
+
+void TrillSim::powerCycle() {
+	mode = Trill::CENTROID;
+	speed = 0;
+	numBits = 12;
+	prescaler = 1;
+	noiseThreshold = 0;
+	idac = 0;
+	minimumSize = 0;
+	autoScanInterval = 1;
+	pointer_ = 0;
+	epoch_ = host::now();
+	frameScan_ = 0;
+	frameValid_ = false;
+	if(eventPin_ >= 0)
+		setEventPin(eventPin_);
+}
+
+TrillSim::~TrillSim() {
+	host::removeTimers(this);
+}
+
+unsigned int TrillSim::getNumChannels() const {
+	switch(device) {
+		case Trill::TRILL_BAR: return 26;
+		default: return 30;
+	}
+}
+
+/* Model of a CapSense CSD scan, independent of the estimate in
+   Trill::getScanPeriod(), so that the benchmarks show how far off that
+   is. Each channel takes 2^numBits cycles of a sense clock that halves
+   with each step of speed (96MHz at ULTRA_FAST), plus a fixed 8us to set
+   it up; each scan has a further 250us of processing and I2C buffer
+   update. These are estimates from the CSD conversion time, not
+   measurements of a sensor. An auto-scan interval (in ticks of the 32kHz
+   clock) puts a lower bound on the period. */
+uint32_t TrillSim::getScanPeriod() const {
+	uint32_t channel = 8 + ((1u << numBits) << (speed & 3)) / 96;
+	uint32_t scan = 250 + channel * getNumChannels();
+	uint32_t interval = (uint32_t)autoScanInterval * 15625 / 512; /* 1000000 / 32768 */
+	return scan > interval ? scan : interval;
+}
+
+uint32_t TrillSim::getScanCount() const {
+	return (host::now() - epoch_) / getScanPeriod();
+}
+
+uint64_t TrillSim::getLastScanTime() const {
+	return epoch_ + (uint64_t)getScanCount() * getScanPeriod();
+}
+
+void TrillSim::setEventPin(int pin) {
+	host::removeTimers(this);
+	eventPin_ = pin;
+	if(eventPin_ >= 0)
+		scheduleEvent();
+}
+
+void TrillSim::scheduleEvent() {
+	host::addTimer(getLastScanTime() + getScanPeriod(), onScanEnd, this);
+}
+
+void TrillSim::onScanEnd(void* arg) {
+	TrillSim* sim = (TrillSim*)arg;
+	host::setPin(sim->eventPin_, true);
+	host::setPin(sim->eventPin_, false);
+	sim->scheduleEvent();
+}
+
+void TrillSim::setTouches(const Touch* touches, uint8_t count) {
+	if(count > kMaxTouches)
+		count = kMaxTouches;
+	memcpy(touches_, touches, count * sizeof(Touch));
+	numTouches_ = count;
+	frameValid_ = false;
+}
+
+void TrillSim::onReceive(const uint8_t* data, size_t length) {
+	if(!length)
+		return;
+	pointer_ = data[0];
+	if(pointer_ != 0 || length < 2)
+		return;
+	/* A write to offset 0 carries a command */
+	const uint8_t* args = data + 2;
+	size_t numArgs = length - 2;
+	++commandsReceived;
+	frameValid_ = false;
+	switch(data[1]) {
+	case kCommandMode:
+		if(numArgs >= 1)
+			mode = (Trill::Mode)args[0];
+		break;
+	case kCommandScanSettings:
+		if(numArgs >= 2) {
+			speed = args[0];
+			numBits = args[1];
+		}
+		break;
+	case kCommandPrescaler:
+		if(numArgs >= 1)
+			prescaler = args[0];
+		break;
+	case kCommandNoiseThreshold:
+		if(numArgs >= 1)
+			noiseThreshold = args[0];
+		break;
+	case kCommandIdac:
+		if(numArgs >= 1)
+			idac = args[0];
+		break;
+	case kCommandBaselineUpdate:
+		++baselineUpdates;
+		break;
+	case kCommandMinimumSize:
+		if(numArgs >= 2)
+			minimumSize = (args[0] << 8) | args[1];
+		break;
+	case kCommandAutoScanInterval:
+		if(numArgs >= 2)
+			autoScanInterval = (args[0] << 8) | args[1];
+		break;
+	case kCommandIdentify:
+		break;
+	}
+}
+
+size_t TrillSim::onRequest(uint8_t* dst, size_t length) {
+	updateFrame();
+	for(size_t n = 0; n < length; ++n)
+		dst[n] = byteAt(pointer_ + n);
+	return length;
+}
+
+uint8_t TrillSim::byteAt(size_t offset) {
+	if(offset < kDataOffset) {
+		const uint8_t status[kDataOffset] = { 0xFE, (uint8_t)device, firmwareVersion, 0 };
+		return status[offset];
+	}
+	offset -= kDataOffset;
+	if(offset < payloadLength_)
+		return payload_[offset];
+	return 0;
+}
+
+void TrillSim::writeWord(size_t word, uint16_t value) {
+	payload_[2 * word] = value >> 8;
+	payload_[2 * word + 1] = value & 0xFF;
+}
+
+/* Regenerate the payload if a new scan has completed since the last one */
+void TrillSim::updateFrame() {
+	uint32_t scan = getScanCount();
+	if(frameValid_ && scan == frameScan_)
+		return;
+	frameScan_ = scan;
+	frameValid_ = true;
+
+	const unsigned int numChannels = getNumChannels();
+	const bool is2D = device == Trill::TRILL_SQUARE || device == Trill::TRILL_HEX;
+	/* On 2D devices the first half of the channels senses the vertical
+	   axis and the second half the horizontal one */
+	const unsigned int axisChannels = is2D ? numChannels / 2 : numChannels;
+	uint16_t diff[kMaxChannels];
+	for(unsigned int c = 0; c < numChannels; ++c) {
+		unsigned int axisChannel = c % axisChannels;
+		bool horizontalAxis = is2D && c >= axisChannels;
+		uint32_t value = 0;
+		for(unsigned int t = 0; t < numTouches_; ++t) {
+			int location = horizontalAxis ? touches_[t].horizontal : touches_[t].location;
+			int distance = (int)axisChannel * 128 + 64 - location;
+			if(distance < 0)
+				distance = -distance;
+			if(distance < 192)
+				value += (uint32_t)touches_[t].size * (192 - distance) / 192;
+		}
+		if(noise_) {
+			noiseState_ = noiseState_ * 1103515245 + 12345;
+			value += (noiseState_ >> 16) % (noise_ + 1);
+		}
+		if(value > 0xFFFF)
+			value = 0xFFFF;
+		diff[c] = value < noiseThreshold ? 0 : value;
+	}
+
+	if(Trill::CENTROID == mode) {
+		if(is2D) {
+			CentroidDetection<4, 15> axis;
+			axis.setup(nullptr, axisChannels);
+			axis.setMinimumTouchSize(minimumSize);
+			for(unsigned int a = 0; a < 2; ++a) {
+				axis.process(diff + a * axisChannels);
+				const Touches& touches = axis;
+				for(unsigned int n = 0; n < 4; ++n) {
+					writeWord(a * 8 + n, touches.centroids[n]);
+					writeWord(a * 8 + 4 + n, touches.sizes[n]);
+				}
+			}
+			payloadLength_ = 32;
+		} else {
+			bool ring = device == Trill::TRILL_RING;
+			unsigned int sliderChannels = ring ? 28 : numChannels;
+			CentroidDetection<5, 30> slider;
+			slider.setup(nullptr, sliderChannels);
+			slider.setMinimumTouchSize(minimumSize);
+			slider.process(diff);
+			const Touches& touches = slider;
+			for(unsigned int n = 0; n < 5; ++n) {
+				writeWord(n, touches.centroids[n]);
+				writeWord(5 + n, touches.sizes[n]);
+			}
+			payloadLength_ = 20;
+			if(ring) {
+				/* The last two channels are the buttons */
+				writeWord(10, diff[28]);
+				writeWord(11, diff[29]);
+				payloadLength_ = 24;
+			}
+		}
+		return;
+	}
+
+	for(unsigned int c = 0; c < numChannels; ++c) {
+		uint16_t baseline = 1800 + 16 * c + 8 * prescaler;
+		uint16_t value;
+		switch(mode) {
+			case Trill::RAW: value = baseline + diff[c]; break;
+			case Trill::BASELINE: value = baseline; break;
+			default: value = diff[c]; break;
+		}
+		writeWord(c, value);
+	}
+	payloadLength_ = 2 * numChannels;
+}
@@ -0,0 +1,98 @@
+/*
+ * Simulated Trill firmware for the host build.
+ *
+ * Emulates the device side of the I2C protocol: the register pointer,
+ * the command area at offset 0 (identify, mode, scan settings, prescaler,
+ * noise threshold, IDAC, baseline, minimum size, auto-scan interval) and
+ * the data area at offset 4, which holds raw, baseline, differential or
+ * centroid payloads depending on the mode. Frames are synthesised from a
+ * list of touches and advance with the virtual clock at the scan rate.
+ * Optionally, the EVT pin is pulsed at the end of every scan.
+ *
+ * BSD license
+ */
+
+#ifndef TRILL_SIM_H
+#define TRILL_SIM_H
+
+#include <Wire.h>
+#include <Trill.h>
+
+class TrillSim : public TwoWireDevice
+{
+public:
+	/* A touch, in centroid units (128 per channel). `horizontal` is only
+	   used by 2D devices */
+	struct Touch
+	{
+		uint16_t location;
+		uint16_t horizontal;
+		uint16_t size;
+	};
+
+	TrillSim(Trill::Device device, uint8_t firmwareVersion = 3);
+	~TrillSim();
+
+	void onReceive(const uint8_t* data, size_t length);
+	size_t onRequest(uint8_t* dst, size_t length);
+
+	void setTouches(const Touch* touches, uint8_t count);
+	/* Peak-to-peak amplitude of the pseudo-random noise added to each channel */
+	void setNoise(uint16_t amplitude) { noise_ = amplitude; }
+
+	/* Time between two scans, in microseconds */
+	uint32_t getScanPeriod() const;
+	/* Number of scans completed so far */
+	uint32_t getScanCount() const;
+	/* host::now() at the end of the last scan completed */
+	uint64_t getLastScanTime() const;
+	/* The scan that the last frame read from the device comes from */
+	uint32_t getFrameScan() const { return frameScan_; }
+	/* Go back to the register state of a device just powered up, as
+	   after a brownout. The counters are kept */
+	void powerCycle();
+	/* Pulse this host pin high at the end of every scan, or stop if -1 */
+	void setEventPin(int pin);
+	unsigned int getNumChannels() const;
+
+	Trill::Device device;
+	uint8_t firmwareVersion;
+	/* Register state, as last written by the host */
+	Trill::Mode mode;
+	uint8_t speed;
+	uint8_t numBits;
+	uint8_t prescaler;
+	uint8_t noiseThreshold;
+	uint8_t idac;
+	uint16_t minimumSize;
+	uint16_t autoScanInterval;
+	uint32_t commandsReceived;
+	uint32_t baselineUpdates;
+
+private:
+	enum {
+		kMaxTouches = 5,
+		kMaxChannels = 30,
+		kDataOffset = 4,
+		kMaxPayload = 2 * kMaxChannels
+	};
+	void updateFrame();
+	uint8_t byteAt(size_t offset);
+	void writeWord(size_t word, uint16_t value);
+	void scheduleEvent();
+	static void onScanEnd(void* sim);
+
+	Touch touches_[kMaxTouches];
+	uint8_t numTouches_;
+	uint16_t noise_;
+	uint32_t noiseState_;
+	uint8_t pointer_;
+	uint64_t epoch_;
+	uint32_t frameScan_;
+	bool frameValid_;
+	uint8_t payload_[kMaxPayload];
+	size_t payloadLength_;
+	int eventPin_;
+};
+
+#endif /* TRILL_SIM_H */
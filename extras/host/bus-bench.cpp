@@ -0,0 +1,135 @@
+/*
+ * Benchmark of TrillBus against a hand-rolled loop reading every sensor
+ * on every iteration, with six simulated sensors on a 400kHz bus.
+ *
+ * Reports how many reads per second each approach performs, how many of
+ * them returned a new scan rather than one already read, how many scans
+ * were never read, and the longest time loop() was blocked on I2C.
+ * TrillBus starts from Trill::getScanPeriod(), an estimate, and adapts
+ * to the frames it reads; the simulator models the scan time separately
+ * (see TrillSim.cpp), so the misses show how well it keeps up.
+ *
+ * BSD license
+ */
+
+#include <stdio.h>
+#include <TrillBus.h>
+#include "TrillSim.h"
+
+static const Trill::Device kDevices[] = {
+	Trill::TRILL_BAR,
+	Trill::TRILL_SQUARE,
+	Trill::TRILL_CRAFT,
+	Trill::TRILL_RING,
+	Trill::TRILL_HEX,
+	Trill::TRILL_FLEX,
+};
+static const unsigned int kNumDevices = sizeof(kDevices) / sizeof(kDevices[0]);
+static const uint32_t kDurationUs = 1000000;
+static const uint32_t kOtherWorkUs = 500; /* the rest of loop() */
+
+struct Result
+{
+	unsigned int reads;
+	unsigned int newFrames;
+	unsigned int scans;
+	uint32_t maxBlockingUs;
+};
+
+/* The scans are counted up to exactly kDurationUs, from a timer, but the
+   loops run a little longer, so that a scan that ended just before then
+   isn't counted as missed just because the loop stopped */
+static const uint32_t kDrainUs = 20000;
+static TrillSim* gSims[kNumDevices];
+static uint32_t gEndScan[kNumDevices];
+
+static void onEnd(void*)
+{
+	for(unsigned int n = 0; n < kNumDevices; ++n)
+		gEndScan[n] = gSims[n]->getScanCount();
+}
+
+/* Account for a read of device n, which loop() started at time start */
+static void countRead(Result& r, unsigned int n, uint64_t start, uint64_t end, uint32_t* lastScan)
+{
+	uint32_t scan = gSims[n]->getFrameScan();
+	if(start < end)
+		++r.reads;
+	/* A scan which ended in the window and wasn't read before */
+	if(scan != lastScan[n] && scan <= gEndScan[n])
+		++r.newFrames;
+	lastScan[n] = scan;
+}
+
+static Result run(bool useBus)
+{
+	host::resetClock();
+	TwoWire wire;
+	wire.setClock(400000);
+	Trill trills[kNumDevices];
+	TrillBus bus;
+	uint32_t firstScan[kNumDevices];
+	uint32_t lastScan[kNumDevices];
+	for(unsigned int n = 0; n < kNumDevices; ++n) {
+		uint8_t address = 0x20 + 8 * (kDevices[n] - 1);
+		gSims[n] = new TrillSim(kDevices[n]);
+		/* A touch and some noise, so that every scan differs */
+		const TrillSim::Touch touch = { 700, 600, 1500 };
+		gSims[n]->setTouches(&touch, 1);
+		gSims[n]->setNoise(20);
+		wire.attach(address, gSims[n]);
+		trills[n].begin(kDevices[n], address, &wire);
+		trills[n].setMode(Trill::CENTROID);
+		trills[n].setScanSettings(TRILL_SPEED_NORMAL, 12);
+		bus.add(trills[n]);
+	}
+	bus.setBudget(2000);
+
+	Result r = {};
+	for(unsigned int n = 0; n < kNumDevices; ++n) {
+		/* Only the scans which end from now on count */
+		firstScan[n] = gSims[n]->getScanCount();
+		lastScan[n] = firstScan[n];
+		gEndScan[n] = ~0u;
+	}
+	uint64_t end = host::now() + kDurationUs;
+	host::addTimer(end, onEnd, NULL);
+	while(host::now() < end + kDrainUs) {
+		uint64_t start = host::now();
+		if(useBus) {
+			uint32_t frames[kNumDevices];
+			for(unsigned int n = 0; n < kNumDevices; ++n)
+				frames[n] = bus.getNumFrames(n);
+			bus.update();
+			for(unsigned int n = 0; n < kNumDevices; ++n) {
+				if(bus.getNumFrames(n) != frames[n])
+					countRead(r, n, start, end, lastScan);
+			}
+		} else {
+			for(unsigned int n = 0; n < kNumDevices; ++n) {
+				trills[n].read();
+				countRead(r, n, start, end, lastScan);
+			}
+		}
+		uint32_t blocking = host::now() - start;
+		if(start < end && blocking > r.maxBlockingUs)
+			r.maxBlockingUs = blocking;
+		delayMicroseconds(kOtherWorkUs);
+	}
+	for(unsigned int n = 0; n < kNumDevices; ++n) {
+		r.scans += gEndScan[n] - firstScan[n];
+		delete gSims[n];
+	}
+	return r;
+}
+
+int main()
+{
+	printf("%-16s %8s %10s %10s %10s %14s\n", "loop", "reads/s", "new/s", "repeated", "missed", "max block/us");
+	for(unsigned int useBus = 0; useBus < 2; ++useBus) {
+		Result r = run(useBus);
+		printf("%-16s %8u %10u %10u %10u %14u\n", useBus ? "TrillBus" : "read() all",
+			r.reads, r.newFrames, r.reads - r.newFrames, r.scans - r.newFrames, r.maxBlockingUs);
+	}
+	return 0;
+}
@@ -0,0 +1,383 @@
+/*
+ * CPU-time benchmark for the centroid detection.
+ *
+ * Reports the time CentroidDetection::process() takes on each kind of
+ * frame in the golden file of centroid-check, with and without
+ * setDivisionFree(); the cost of the centroid quotient alone with a
+ * hardware division, a software one (as on cores without a divider)
+ * and trillDivide(); and the cost of three sliders on a Flex frame as
+ * three CustomSliders and as one CustomSliders; and the cost of
+ * TrillTracker per frame, with 1 to 5 touches moving on a 1D sensor and
+ * 1 to 4 on a 2D one; and that of TrillGestures on top of it, per frame
+ * of the synthetic traces of GestureTraces.h; and that of TrillFilter per
+ * frame, in ns and in cycles where the host has a cycle counter, with the
+ * lag and jitter it leaves compared with moving averages.
+ *
+ * BSD license
+ */
+
+#include <stdio.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include "CentroidCases.h"
+#include "GestureTraces.h"
+#include <TrillSliders.h>
+#include <TrillTracker.h>
+#include <TrillFilter.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_CYCLES 1
+static uint64_t cycles() { return __rdtsc(); }
+#else
+#define HAS_CYCLES 0
+static uint64_t cycles() { return 0; }
+#endif
+
+/* 32-bit shift-and-subtract division, as done in software by cores
+   without a hardware divider (e.g.: __udivmodsi4 on AVR) */
+static uint32_t __attribute__((noinline)) softDivide(uint32_t dividend, uint32_t divisor)
+{
+	uint32_t quotient = 0;
+	uint32_t remainder = 0;
+	for(int bit = 31; bit >= 0; --bit) {
+		remainder = (remainder << 1) | ((dividend >> bit) & 1);
+		quotient <<= 1;
+		if(remainder >= divisor) {
+			remainder -= divisor;
+			quotient |= 1;
+		}
+	}
+	return quotient;
+}
+
+/* A touch at 1000 that jumps by 200 after 10 frames, and stays there
+   wobbling by up to 4 either way */
+static uint16_t stepTrace(unsigned int frame, uint32_t& seed)
+{
+	seed = seed * 1664525 + 1013904223;
+	return (frame < 10 ? 1000 : 1200) + (int)((seed >> 16) % 9) - 4;
+}
+
+/* How a smoothing stage does on stepTrace(): frames until it is within
+   10 (5% of the step) of where the touch went, and how far it wanders
+   once it should have settled */
+template <typename F>
+static void smoothingRow(const char* name, F smooth)
+{
+	uint32_t seed = 1;
+	unsigned int settled = 0;
+	int lowest = 0xFFFF;
+	int highest = 0;
+	for(unsigned int n = 0; n < 300; ++n) {
+		int location = smooth(stepTrace(n, seed));
+		if(n >= 10 && n < 100 && !settled && location >= 1190 && location <= 1210)
+			settled = n - 10 + 1;
+		if(n >= 100) {
+			if(location < lowest)
+				lowest = location;
+			if(location > highest)
+				highest = location;
+		}
+	}
+	printf("%-30s %10u %10d\n", name, settled, highest - lowest);
+}
+
+template <unsigned int N>
+struct MovingAverage {
+	MovingAverage() : written(0) {
+		for(unsigned int n = 0; n < N; ++n)
+			window[n] = 1000;
+	}
+	int operator()(uint16_t location) {
+		window[written++ % N] = location;
+		unsigned int sum = 0;
+		for(unsigned int n = 0; n < N; ++n)
+			sum += window[n];
+		return (sum + N / 2) / N;
+	}
+	uint16_t window[N];
+	unsigned int written;
+};
+
+static uint32_t __attribute__((noinline)) hardDivide(uint32_t dividend, uint32_t divisor)
+{
+	return dividend / divisor;
+}
+
+int main(int argc, char** argv)
+{
+	const char* path = argc > 1 ? argv[1] : "golden/centroids.txt";
+	std::vector<CentroidCase> cases;
+	if(!readCases(path, cases))
+		return 1;
+	printf("%-24s %6s %14s %14s\n", "frames", "count", "division/ns", "div-free/ns");
+	/* One row per kind of case, e.g.: touches-3 for touches-3-pads-* */
+	for(unsigned int first = 0; first < cases.size();) {
+		std::string kind = cases[first].name.substr(0, cases[first].name.find("-pads"));
+		unsigned int last = first;
+		unsigned int count = 0;
+		while(last < cases.size() && 0 == cases[last].name.compare(0, kind.size() + 5, kind + "-pads"))
+			count += cases[last++].frames.size();
+		double ns[2];
+		for(unsigned int divisionFree = 0; divisionFree < 2; ++divisionFree) {
+			const unsigned int kRepeats = 20000;
+			std::chrono::nanoseconds elapsed(0);
+			volatile unsigned int sink = 0;
+			for(unsigned int c = first; c < last; ++c) {
+				std::unique_ptr<CentroidRunner> runner(CentroidRunner::create(cases[c], divisionFree));
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				for(unsigned int r = 0; r < kRepeats; ++r) {
+					for(const std::vector<uint16_t>& frame : cases[c].frames)
+						runner->process(frame.data());
+				}
+				elapsed += std::chrono::steady_clock::now() - start;
+				sink += runner->result().numTouches;
+			}
+			ns[divisionFree] = (double)elapsed.count() / kRepeats / count;
+		}
+		printf("%-24s %6u %14.1f %14.1f\n", kind.c_str(), count, ns[0], ns[1]);
+		first = last;
+	}
+
+	printf("\n%-30s %6s %10s\n", "3 sliders on a Flex frame", "bytes", "ns/frame");
+	{
+		const unsigned int kFrames = 200000;
+		static uint8_t pads[3][10];
+		for(unsigned int n = 0; n < 10; ++n) {
+			pads[0][n] = 9 - n;
+			pads[1][n] = 10 + n;
+			pads[2][n] = 20 + n;
+		}
+		/* The same three touches with a little noise, different in every
+		   frame so that none is skipped as unchanged */
+		const unsigned int kVariants = 64;
+		static uint16_t frames[kVariants][30];
+		const unsigned int bump[] = { 300, 1500, 2400, 900 };
+		uint32_t seed = 1;
+		for(unsigned int v = 0; v < kVariants; ++v) {
+			uint16_t* frame = frames[v];
+			for(unsigned int n = 0; n < 4; ++n) {
+				frame[3 + n] = bump[n];
+				frame[12 + n] = bump[n];
+				frame[16 + n] = bump[3 - n];
+				frame[24 + n] = bump[n];
+			}
+			for(unsigned int n = 0; n < 30; ++n) {
+				seed = seed * 1664525 + 1013904223;
+				if(frame[n])
+					frame[n] += 1 + (seed >> 16) % 40;
+			}
+		}
+		CustomSlider separate[3];
+		for(unsigned int n = 0; n < 3; ++n)
+			separate[n].setup(pads[n], 10);
+		CustomSliders<5, TrillPadRange<9, 10, -1>, TrillPadRange<10, 10>, TrillPadRange<20, 10>> single;
+		for(unsigned int engine = 0; engine < 2; ++engine) {
+			volatile unsigned int sink = 0;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for(unsigned int f = 0; f < kFrames; ++f) {
+				const uint16_t* frame = frames[f % kVariants];
+				if(engine) {
+					single.process(frame);
+					sink += single[f % 3].getNumTouches();
+				} else {
+					for(unsigned int n = 0; n < 3; ++n)
+						separate[n].process(frame);
+					sink += separate[f % 3].getNumTouches();
+				}
+			}
+			std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+			printf("%-30s %6zu %10.1f\n", engine ? "CustomSliders" : "3 x CustomSlider",
+				engine ? sizeof(single) : sizeof(separate), (double)elapsed.count() / kFrames);
+		}
+	}
+
+	printf("\n%-30s %10s\n", "centroid quotient (w << 7) / u", "ns/op");
+	{
+		const unsigned int kOps = 1 << 20;
+		/* Sums as found on a slider: u up to a few thousand, w / u < 30 */
+		static uint16_t weighted[1024];
+		static uint16_t unweighted[1024];
+		uint32_t seed = 1;
+		for(unsigned int n = 0; n < 1024; ++n) {
+			seed = seed * 1664525 + 1013904223;
+			unweighted[n] = 200 + (seed >> 16) % 6000;
+			weighted[n] = (uint32_t)unweighted[n] * ((seed >> 8) % 256) / 128;
+		}
+		for(unsigned int kernel = 0; kernel < 3; ++kernel) {
+			volatile uint32_t sink = 0;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for(unsigned int n = 0; n < kOps; ++n) {
+				uint16_t w = weighted[n & 1023];
+				uint16_t u = unweighted[n & 1023];
+				if(0 == kernel)
+					sink += hardDivide((uint32_t)w << 7, u);
+				else if(1 == kernel)
+					sink += softDivide((uint32_t)w << 7, u);
+				else
+					sink += trillDivide(w, u, 7);
+			}
+			std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+			const char* names[] = { "hardware division", "software division", "trillDivide()" };
+			printf("%-30s %10.2f\n", names[kernel], (double)elapsed.count() / kOps);
+		}
+	}
+
+	printf("\n%-30s %10s %10s\n", "TrillTracker, touches", "1D ns", "2D ns");
+	{
+		const unsigned int kFrames = 1 << 16;
+		const unsigned int kLength = 4096;
+		static TrillTracker::Touch frames[kLength][TrillTracker::kMaxTouches];
+		for(unsigned int count = 1; count <= TrillTracker::kMaxTouches; ++count) {
+			double ns[2] = { 0, 0 };
+			for(unsigned int is2D = 0; is2D < 2; ++is2D) {
+				if(is2D && count > 4)
+					continue;
+				/* Fingers wandering by up to 40 per frame, in order along
+				   the sensor in 1D; one lifts and lands again now and
+				   then */
+				uint32_t seed = 1;
+				for(unsigned int n = 0; n < count; ++n) {
+					frames[0][n].location = 200 + n * 800;
+					frames[0][n].horizontal = 1800 - n * 400;
+					frames[0][n].size = 1000;
+				}
+				for(unsigned int f = 1; f < kLength; ++f) {
+					for(unsigned int n = 0; n < count; ++n) {
+						seed = seed * 1664525 + 1013904223;
+						frames[f][n] = frames[f - 1][n];
+						frames[f][n].location += (int)((seed >> 8) % 81) - 40;
+						frames[f][n].horizontal += (int)((seed >> 16) % 81) - 40;
+					}
+				}
+				TrillTracker tracker;
+				volatile unsigned int sink = 0;
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				for(unsigned int f = 0; f < kFrames; ++f) {
+					unsigned int n = f % kLength;
+					tracker.process(frames[n], n % 64 ? count : count - 1, is2D);
+					sink += tracker.getNumEvents();
+				}
+				std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+				ns[is2D] = (double)elapsed.count() / kFrames;
+			}
+			char name[32];
+			snprintf(name, sizeof(name), "%u", count);
+			if(count > 4)
+				printf("%-30s %10.1f %10s\n", name, ns[0], "-");
+			else
+				printf("%-30s %10.1f %10.1f\n", name, ns[0], ns[1]);
+		}
+	}
+
+	printf("\n%-30s %10s %10s\n", "TrillGestures, trace", "frames", "ns/frame");
+	{
+		const GestureTrace traces[] = {
+			tapTrace(Trill::TRILL_BAR, 1000, 100),
+			swipeTrace(Trill::TRILL_BAR, 200, 40, 60),
+			swipeTrace(Trill::TRILL_SQUARE, 200, 20, 60),
+			swipeTrace(Trill::TRILL_RING, 3000, 25, 200),
+			pinchTrace(300, 1200, 0, 0, 60),
+			pinchTrace(800, 800, 0, 180, 60),
+		};
+		const char* names[] = { "Bar tap", "Bar swipe", "Square swipe", "Ring scroll", "Square pinch", "Square rotate" };
+		for(unsigned int t = 0; t < sizeof(traces) / sizeof(traces[0]); ++t) {
+			/* Track the touches once, so that only the gestures are
+			   timed */
+			const GestureTrace& trace = traces[t];
+			TrillTracker tracker;
+			tracker.setRingLength(Trill::TRILL_RING == trace.device ? TrillTracker::kRingLength : 0);
+			std::vector<TrillTracker> tracked;
+			for(const GestureFrame& frame : trace.frames) {
+				tracker.process(frame.touches, frame.count, Trill::TRILL_SQUARE == trace.device);
+				tracked.push_back(tracker);
+			}
+			const unsigned int kRepeats = 20000;
+			TrillGestures gestures;
+			gestures.setup(trace.device);
+			volatile unsigned int sink = 0;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for(unsigned int r = 0; r < kRepeats; ++r) {
+				for(unsigned int f = 0; f < tracked.size(); ++f) {
+					gestures.process(tracked[f], trace.frames[f].timestamp_us + r * 1000000);
+					sink += gestures.getNumGestures();
+				}
+			}
+			std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+			printf("%-30s %10zu %10.1f\n", names[t], trace.frames.size(), (double)elapsed.count() / kRepeats / tracked.size());
+		}
+	}
+
+	printf("\n%-30s %10s %10s %10s %10s\n", "TrillFilter, touches", "1D ns", "1D cycles", "2D ns", "2D cycles");
+	{
+		/* Fingers wobbling where they are, tracked once so that only
+		   the filter is timed */
+		const unsigned int kLength = 1024;
+		const unsigned int kRepeats = 64;
+		for(unsigned int count = 1; count <= TrillTracker::kMaxTouches; ++count) {
+			double ns[2] = { 0, 0 };
+			double perFrame[2] = { 0, 0 };
+			for(unsigned int is2D = 0; is2D < 2; ++is2D) {
+				if(is2D && count > 4)
+					continue;
+				TrillTracker tracker;
+				std::vector<TrillTracker> tracked;
+				TrillTracker::Touch touches[TrillTracker::kMaxTouches];
+				uint32_t seed = 1;
+				for(unsigned int f = 0; f < kLength; ++f) {
+					for(unsigned int n = 0; n < count; ++n) {
+						seed = seed * 1664525 + 1013904223;
+						touches[n].location = 200 + n * 600 + (seed >> 8) % 9;
+						touches[n].horizontal = is2D ? 1800 - n * 400 + (seed >> 16) % 9 : 0;
+						touches[n].size = 1000 + (seed >> 24) % 64;
+					}
+					tracker.process(touches, count, is2D);
+					tracked.push_back(tracker);
+				}
+				TrillFilter filter;
+				volatile unsigned int sink = 0;
+				uint32_t now = 0;
+				uint64_t startCycles = cycles();
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				for(unsigned int r = 0; r < kRepeats; ++r) {
+					for(const TrillTracker& t : tracked) {
+						filter.process(t, now += 5000);
+						sink += filter.touchLocation(0);
+					}
+				}
+				std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+				perFrame[is2D] = (double)(cycles() - startCycles) / kRepeats / kLength;
+				ns[is2D] = (double)elapsed.count() / kRepeats / kLength;
+			}
+			char name[32];
+			snprintf(name, sizeof(name), "%u", count);
+			char columns[4][16];
+			snprintf(columns[0], sizeof(columns[0]), "%.1f", ns[0]);
+			snprintf(columns[1], sizeof(columns[1]), HAS_CYCLES ? "%.0f" : "-", perFrame[0]);
+			snprintf(columns[2], sizeof(columns[2]), count > 4 ? "-" : "%.1f", ns[1]);
+			snprintf(columns[3], sizeof(columns[3]), count > 4 || !HAS_CYCLES ? "-" : "%.0f", perFrame[1]);
+			printf("%-30s %10s %10s %10s %10s\n", name, columns[0], columns[1], columns[2], columns[3]);
+		}
+	}
+
+	printf("\n%-30s %10s %10s\n", "Smoothing a step of 200", "frames", "jitter");
+	{
+		smoothingRow("none", [](uint16_t location) { return (int)location; });
+		smoothingRow("moving average of 4", MovingAverage<4>());
+		smoothingRow("moving average of 8", MovingAverage<8>());
+		TrillTracker tracker;
+		TrillFilter filter;
+		uint32_t now = 0;
+		smoothingRow("TrillFilter", [&](uint16_t location) {
+			TrillTracker::Touch touch;
+			touch.location = location;
+			touch.horizontal = 0;
+			touch.size = 1000;
+			tracker.process(&touch, 1, false);
+			filter.process(tracker, now += 5000);
+			return filter.touchLocation(0);
+		});
+	}
+	return 0;
+}
@@ -0,0 +1,210 @@
+/*
+ * Golden-output regression test for calculateCentroids(), run through
+ * CentroidDetection::process().
+ *
+ * Every frame in golden/centroids.txt is processed, with and without
+ * setDivisionFree(), and the touches compared with the stored ones.
+ * The frames are synthetic: touches of random position, width and
+ * height on 10 to 30 pads, with noisy edges, touches on the first and
+ * last pad, troughs either side of the splitting threshold, touches
+ * around the minimum size, pads out of order, more touches than the
+ * detector reports and sums large enough to overflow.
+ *
+ *   centroid-check [file]            compare with the golden file
+ *   centroid-check --update [file]   regenerate it from the current code
+ *
+ * BSD license
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <memory>
+#include "CentroidCases.h"
+
+static const char* kGoldenPath = "golden/centroids.txt";
+static const unsigned int kFramesPerCase = 6;
+
+static uint32_t gSeed = 1;
+
+static uint32_t nextRandom(uint32_t range)
+{
+	gSeed = gSeed * 1664525 + 1013904223;
+	return (gSeed >> 8) % range;
+}
+
+/* Adds a triangular touch, and maybe some low values either side of it */
+static void addTouch(std::vector<uint16_t>& frame, unsigned int numPads, unsigned int centre,
+	unsigned int width, unsigned int height, bool noisyEdges)
+{
+	for(unsigned int n = 0; n < numPads; ++n) {
+		unsigned int distance = n > centre ? n - centre : centre - n;
+		unsigned int value = 0;
+		if(distance < width)
+			value = height * (width - distance) / width;
+		else if(noisyEdges && distance == width)
+			value = nextRandom(3) ? nextRandom(80) : 0;
+		unsigned int sum = frame[n] + value;
+		frame[n] = sum > 0xFFFF ? 0xFFFF : sum;
+	}
+}
+
+static std::vector<uint16_t> randomFrame(unsigned int numPads, unsigned int numTouches,
+	unsigned int maxHeight, bool noisyEdges)
+{
+	std::vector<uint16_t> frame(numPads);
+	for(unsigned int t = 0; t < numTouches; ++t)
+		addTouch(frame, numPads, nextRandom(numPads), 1 + nextRandom(3), 200 + nextRandom(maxHeight - 200), noisyEdges);
+	return frame;
+}
+
+static CentroidCase makeCase(const char* name, unsigned int maxTouches, unsigned int numPads, uint16_t minSize)
+{
+	CentroidCase c;
+	c.name = name;
+	c.maxTouches = maxTouches;
+	c.numPads = numPads;
+	c.minSize = minSize;
+	return c;
+}
+
+static std::vector<CentroidCase> generateCases()
+{
+	std::vector<CentroidCase> cases;
+	char name[64];
+	const unsigned int kPads[] = { 10, 15, 20, 26, 30 };
+	for(unsigned int touches = 1; touches <= 5; ++touches) {
+		for(unsigned int pads : kPads) {
+			snprintf(name, sizeof(name), "touches-%u-pads-%u", touches, pads);
+			CentroidCase c = makeCase(name, 5, pads, 0);
+			for(unsigned int f = 0; f < kFramesPerCase; ++f)
+				c.frames.push_back(randomFrame(pads, touches, 3000, true));
+			cases.push_back(c);
+		}
+	}
+	/* Touches ending on the last pad or starting on the first, where the
+	   scan wraps around */
+	for(unsigned int pads : { 10u, 30u }) {
+		snprintf(name, sizeof(name), "edges-pads-%u", pads);
+		CentroidCase c = makeCase(name, 5, pads, 0);
+		for(unsigned int f = 0; f < kFramesPerCase; ++f) {
+			std::vector<uint16_t> frame = randomFrame(pads, f % 3, 3000, true);
+			if(f & 1)
+				addTouch(frame, pads, 0, 1 + nextRandom(3), 500 + nextRandom(2000), false);
+			if(f & 2 || !(f & 1))
+				addTouch(frame, pads, pads - 1, 1 + nextRandom(3), 500 + nextRandom(2000), false);
+			c.frames.push_back(frame);
+		}
+		cases.push_back(c);
+	}
+	/* Two peaks with a trough either side of wAdjacentCentroidNoiseThreshold */
+	{
+		CentroidCase c = makeCase("trough-pads-30", 5, 30, 0);
+		for(unsigned int f = 0; f < 3 * kFramesPerCase; ++f) {
+			std::vector<uint16_t> frame(30);
+			unsigned int start = nextRandom(20);
+			unsigned int peak = 1500 + nextRandom(1000);
+			unsigned int trough = 370 + nextRandom(60);
+			const uint16_t shape[] = {
+				(uint16_t)(peak / 2), (uint16_t)peak, (uint16_t)(peak - trough),
+				(uint16_t)(peak - trough + 380 + nextRandom(60)), (uint16_t)(peak / 3),
+			};
+			for(unsigned int n = 0; n < 5; ++n)
+				frame[start + n] = shape[n];
+			c.frames.push_back(frame);
+		}
+		cases.push_back(c);
+	}
+	/* Touches around the minimum size, and noise alone */
+	for(unsigned int minSize : { 50u, 500u, 2000u }) {
+		snprintf(name, sizeof(name), "min-size-%u-pads-20", minSize);
+		CentroidCase c = makeCase(name, 5, 20, minSize);
+		for(unsigned int f = 0; f < kFramesPerCase; ++f)
+			c.frames.push_back(randomFrame(20, 1 + f % 4, 2 * minSize + 300, true));
+		cases.push_back(c);
+	}
+	{
+		CentroidCase c = makeCase("noise-pads-30", 5, 30, 100);
+		for(unsigned int f = 0; f < kFramesPerCase; ++f) {
+			std::vector<uint16_t> frame(30);
+			for(uint16_t& v : frame)
+				v = nextRandom(4) ? 0 : nextRandom(120);
+			c.frames.push_back(frame);
+		}
+		cases.push_back(c);
+	}
+	/* Pads out of order */
+	for(unsigned int shuffled = 0; shuffled < 2; ++shuffled) {
+		unsigned int pads = shuffled ? 26 : 20;
+		CentroidCase c = makeCase(shuffled ? "order-shuffled-pads-26" : "order-reversed-pads-20", 5, pads, 0);
+		for(unsigned int n = 0; n < pads; ++n)
+			c.order.push_back(shuffled ? (n * 7 + 3) % 30 : pads - 1 - n);
+		for(unsigned int f = 0; f < kFramesPerCase; ++f)
+			c.frames.push_back(randomFrame(30, 1 + f % 5, 3000, true));
+		cases.push_back(c);
+	}
+	/* More touches than the detector reports */
+	for(unsigned int maxTouches = 1; maxTouches <= 4; ++maxTouches) {
+		snprintf(name, sizeof(name), "limit-%u-pads-30", maxTouches);
+		CentroidCase c = makeCase(name, maxTouches, 30, 0);
+		for(unsigned int f = 0; f < kFramesPerCase; ++f)
+			c.frames.push_back(randomFrame(30, 5, 3000, false));
+		cases.push_back(c);
+	}
+	/* Wide, strong touches whose sums overflow 16 bits */
+	{
+		CentroidCase c = makeCase("overflow-pads-30", 5, 30, 0);
+		for(unsigned int f = 0; f < kFramesPerCase; ++f) {
+			std::vector<uint16_t> frame(30);
+			addTouch(frame, 30, 5 + nextRandom(20), 4 + nextRandom(6), 8000 + nextRandom(50000), false);
+			c.frames.push_back(frame);
+		}
+		cases.push_back(c);
+	}
+	for(CentroidCase& c : cases) {
+		std::unique_ptr<CentroidRunner> runner(CentroidRunner::create(c, false));
+		for(const std::vector<uint16_t>& frame : c.frames) {
+			runner->process(frame.data());
+			c.expected.push_back(runner->result());
+		}
+	}
+	return cases;
+}
+
+int main(int argc, char** argv)
+{
+	bool update = argc > 1 && !strcmp(argv[1], "--update");
+	const char* path = argc > 1 + update ? argv[1 + update] : kGoldenPath;
+	if(update) {
+		std::vector<CentroidCase> cases = generateCases();
+		if(!writeCases(path, cases))
+			return 1;
+		printf("wrote %zu cases to %s\n", cases.size(), path);
+		return 0;
+	}
+
+	std::vector<CentroidCase> cases;
+	if(!readCases(path, cases))
+		return 1;
+	unsigned int failures = 0;
+	unsigned int frames = 0;
+	for(const CentroidCase& c : cases) {
+		for(unsigned int divisionFree = 0; divisionFree < 2; ++divisionFree) {
+			std::unique_ptr<CentroidRunner> runner(CentroidRunner::create(c, divisionFree));
+			for(unsigned int f = 0; f < c.frames.size(); ++f) {
+				runner->process(c.frames[f].data());
+				++frames;
+				if(runner->result() == c.expected[f])
+					continue;
+				printf("%s: frame %u%s differs from the golden output\n", c.name.c_str(), f,
+					divisionFree ? " (division-free)" : "");
+				++failures;
+			}
+		}
+	}
+	if(failures) {
+		printf("%u of %u frames failed\n", failures, frames);
+		return 1;
+	}
+	printf("all %u frames of %zu cases match\n", frames, cases.size());
+	return 0;
+}
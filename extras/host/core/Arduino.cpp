@@ -0,0 +1,139 @@
+/*
+ * Host stand-in for the Arduino core: virtual clock, timers and pins.
+ *
+ * BSD license
+ */
+
+#include "Arduino.h"
+#include <vector>
+
+static uint64_t gNowUs;
+
+struct Timer
+{
+	uint64_t at;
+	host::TimerCallback callback;
+	void* arg;
+};
+static std::vector<Timer> gTimers;
+
+struct Pin
+{
+	uint8_t mode;
+	bool level;
+	void (*isr)(void);
+	int edge;
+};
+static Pin gPins[host::kNumPins];
+static uint32_t gInterruptCount;
+
+namespace host {
+uint64_t now() {
+	return gNowUs;
+}
+
+void advance(uint64_t us) {
+	const uint64_t end = gNowUs + us;
+	for(;;) {
+		/* The earliest timer due by the end, if any */
+		size_t next = gTimers.size();
+		for(size_t n = 0; n < gTimers.size(); ++n) {
+			if(gTimers[n].at <= end && (next == gTimers.size() || gTimers[n].at < gTimers[next].at))
+				next = n;
+		}
+		if(next == gTimers.size())
+			break;
+		Timer t = gTimers[next];
+		gTimers.erase(gTimers.begin() + next);
+		if(t.at > gNowUs)
+			gNowUs = t.at;
+		t.callback(t.arg);
+	}
+	gNowUs = end;
+}
+
+void resetClock() {
+	gNowUs = 0;
+	gTimers.clear();
+}
+
+void addTimer(uint64_t at, TimerCallback callback, void* arg) {
+	gTimers.push_back({ at, callback, arg });
+}
+
+void removeTimers(void* arg) {
+	for(size_t n = 0; n < gTimers.size();) {
+		if(gTimers[n].arg == arg)
+			gTimers.erase(gTimers.begin() + n);
+		else
+			++n;
+	}
+}
+
+void setPin(uint8_t pin, bool level) {
+	if(pin >= kNumPins)
+		return;
+	Pin& p = gPins[pin];
+	bool previous = p.level;
+	p.level = level;
+	if(!p.isr || previous == level)
+		return;
+	if(CHANGE == p.edge || (RISING == p.edge && level) || (FALLING == p.edge && !level)) {
+		++gInterruptCount;
+		p.isr();
+	}
+}
+
+uint32_t interruptCount() {
+	return gInterruptCount;
+}
+
+void resetPins() {
+	for(Pin& p : gPins)
+		p = Pin();
+	gInterruptCount = 0;
+}
+} // namespace host
+
+/* Like on the boards, these wrap around at 32 bits */
+unsigned long millis() {
+	return (uint32_t)(gNowUs / 1000);
+}
+
+unsigned long micros() {
+	return (uint32_t)gNowUs;
+}
+
+void delay(unsigned long ms) {
+	host::advance((uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+	host::advance(us);
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+	if(pin < host::kNumPins)
+		gPins[pin].mode = mode;
+}
+
+int digitalRead(uint8_t pin) {
+	return pin < host::kNumPins && gPins[pin].level ? HIGH : LOW;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+	if(pin < host::kNumPins && OUTPUT == gPins[pin].mode)
+		gPins[pin].level = value;
+}
+
+void attachInterrupt(uint8_t interruptNum, void (*isr)(void), int mode) {
+	if(interruptNum < host::kNumPins) {
+		gPins[interruptNum].isr = isr;
+		gPins[interruptNum].edge = mode;
+	}
+}
+
+void detachInterrupt(uint8_t interruptNum) {
+	if(interruptNum < host::kNumPins)
+		gPins[interruptNum].isr = nullptr;
+}
@@ -0,0 +1,73 @@
+/*
+ * Host stand-in for the Arduino core, used to build the Trill library
+ * on a desktop machine for benchmarking.
+ *
+ * Only what the library needs is provided. Time is virtual: delay()
+ * and I2C transfers advance the clock instead of sleeping, so that
+ * timings reported by the benchmarks are deterministic.
+ *
+ * BSD license
+ */
+
+#ifndef TRILL_HOST_ARDUINO_H
+#define TRILL_HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "Print.h"
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define LOW 0x0
+#define HIGH 0x1
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define NOT_AN_INTERRUPT -1
+#define digitalPinToInterrupt(p) ((p) < host::kNumPins ? (int)(p) : NOT_AN_INTERRUPT)
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+void attachInterrupt(uint8_t interruptNum, void (*isr)(void), int mode);
+void detachInterrupt(uint8_t interruptNum);
+
+namespace host {
+	/* Virtual time, in microseconds since the last resetClock() */
+	uint64_t now();
+	/* Move time on, calling the timers that fall due on the way */
+	void advance(uint64_t us);
+	/* Also cancels all timers */
+	void resetClock();
+
+	/* Call callback(arg) once, when the clock reaches `at` */
+	typedef void (*TimerCallback)(void* arg);
+	void addTimer(uint64_t at, TimerCallback callback, void* arg);
+	void removeTimers(void* arg);
+
+	/* Every pin can be driven from outside and can raise an interrupt,
+	   whose number is the pin number */
+	static const uint8_t kNumPins = 32;
+	/* Drive an input pin, as a device connected to it would. This runs
+	   the interrupt handler attached to the pin, if the edge matches. */
+	void setPin(uint8_t pin, bool level);
+	/* Number of interrupts raised since the last resetPins() */
+	uint32_t interruptCount();
+	/* Detach all handlers and set all pins low */
+	void resetPins();
+}
+
+#endif /* TRILL_HOST_ARDUINO_H */
@@ -0,0 +1,44 @@
+/*
+ * Host stand-in for the Arduino Print class.
+ *
+ * BSD license
+ */
+
+#include "Print.h"
+#include <string.h>
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+	size_t n = 0;
+	while(size--) {
+		if(!write(*buffer++))
+			break;
+		++n;
+	}
+	return n;
+}
+
+size_t Print::write(const char* str) {
+	if(!str)
+		return 0;
+	return write((const uint8_t*)str, strlen(str));
+}
+
+size_t Print::print(unsigned long n, int base) {
+	char digits[8 * sizeof(long) + 1];
+	char* p = digits + sizeof(digits) - 1;
+	*p = 0;
+	if(base < 2)
+		base = 10;
+	do {
+		unsigned long digit = n % base;
+		n /= base;
+		*--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+	} while(n);
+	return write(p);
+}
+
+size_t Print::print(long n, int base) {
+	if(n < 0 && base == DEC)
+		return print('-') + print(0UL - (unsigned long)n, base);
+	return print((unsigned long)n, base);
+}
@@ -0,0 +1,39 @@
+/*
+ * Host stand-in for the Arduino Print class: formatted output over a
+ * byte sink. Only the overloads the library and the harness use are
+ * provided.
+ *
+ * BSD license
+ */
+
+#ifndef TRILL_HOST_PRINT_H
+#define TRILL_HOST_PRINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DEC 10
+#define HEX 16
+
+class Print
+{
+public:
+	virtual ~Print() {}
+	virtual size_t write(uint8_t c) = 0;
+	virtual size_t write(const uint8_t* buffer, size_t size);
+	size_t write(const char* str);
+
+	size_t print(const char* str) { return write(str); }
+	size_t print(char c) { return write((uint8_t)c); }
+	size_t print(unsigned long n, int base = DEC);
+	size_t print(long n, int base = DEC);
+	size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+	size_t print(int n, int base = DEC) { return print((long)n, base); }
+	size_t println() { return write("\r\n"); }
+	template <typename T>
+	size_t println(T value) { return print(value) + println(); }
+	template <typename T>
+	size_t println(T value, int base) { return print(value, base) + println(); }
+};
+
+#endif /* TRILL_HOST_PRINT_H */
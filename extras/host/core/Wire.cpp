@@ -0,0 +1,189 @@
+/*
+ * Host stand-in for the Arduino Wire library.
+ *
+ * BSD license
+ */
+
+#include "Wire.h"
+
+TwoWire Wire;
+
+TwoWire::TwoWire()
+: rxIndex_(0), rxLength_(0), txLength_(0), txAddress_(0),
+  transmitting_(false), bufferLength_(BUFFER_LENGTH), clock_(100000),
+  asyncPending_(false), asyncStalled_(false), asyncAddress_(0), asyncEnd_(0),
+  asyncDst_(nullptr), asyncLength_(0)
+{
+	memset(devices_, 0, sizeof(devices_));
+	resetStats();
+}
+
+void TwoWire::begin() {
+	rxIndex_ = rxLength_ = 0;
+	txLength_ = 0;
+	transmitting_ = false;
+}
+
+void TwoWire::attach(uint8_t address, TwoWireDevice* device) {
+	if(address < 128)
+		devices_[address] = device;
+}
+
+void TwoWire::setBufferLength(size_t length) {
+	if(length > kMaxBufferLength)
+		length = kMaxBufferLength;
+	bufferLength_ = length;
+}
+
+void TwoWire::resetStats() {
+	memset(&stats_, 0, sizeof(stats_));
+}
+
+/* Start, address + R/W, ACK, then 9 clocks per byte and a stop.
+   Returns the duration of the transaction on the bus, in microseconds. */
+uint64_t TwoWire::account(size_t bytes, bool acked) {
+	uint64_t bits = 1 + 9 + (acked ? 9 * bytes : 0) + 1;
+	stats_.bits += bits;
+	if(!acked)
+		++stats_.nacks;
+	return (bits * 1000000 + clock_ - 1) / clock_;
+}
+
+bool TwoWire::writeReadAsync(uint8_t address, const void* wbuffer, size_t wbytes, void* rbuffer, size_t rbytes, bool sendStop) {
+	(void)sendStop;
+	waitAsync();
+	if(wbytes > bufferLength_ || rbytes > bufferLength_)
+		return false;
+	TwoWireDevice* device = address < 128 ? devices_[address] : nullptr;
+	uint64_t duration = 0;
+	if(wbytes) {
+		++stats_.writeTransactions;
+		duration += account(wbytes, device != nullptr);
+		if(device) {
+			stats_.bytesWritten += wbytes;
+			device->onReceive((const uint8_t*)wbuffer, wbytes);
+		}
+	}
+	++stats_.readTransactions;
+	duration += account(rbytes, device != nullptr);
+	if(!device)
+		return false;
+	/* Sample the device now, deliver when the transfer completes */
+	size_t sent = device->onRequest(asyncBuffer_, rbytes);
+	memset(asyncBuffer_ + sent, 0xFF, rbytes - sent);
+	stats_.bytesRead += rbytes;
+	asyncAddress_ = address;
+	asyncDst_ = (uint8_t*)rbuffer;
+	asyncLength_ = rbytes;
+	asyncEnd_ = host::now() + duration;
+	asyncPending_ = true;
+	return true;
+}
+
+/* A device detached before the end of the transfer leaves rbuffer as it
+   was, like a transfer that failed part way */
+bool TwoWire::finishedAsync() {
+	if(asyncPending_ && !asyncStalled_ && host::now() >= asyncEnd_) {
+		if(devices_[asyncAddress_])
+			memcpy(asyncDst_, asyncBuffer_, asyncLength_);
+		asyncPending_ = false;
+	}
+	return !asyncPending_;
+}
+
+void TwoWire::abortAsync() {
+	asyncPending_ = false;
+}
+
+/* Block until the background transfer, if any, is complete. A stalled
+   one is dropped */
+void TwoWire::waitAsync() {
+	if(!asyncPending_)
+		return;
+	if(host::now() < asyncEnd_)
+		host::advance(asyncEnd_ - host::now());
+	if(!finishedAsync())
+		abortAsync();
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+	txAddress_ = address;
+	txLength_ = 0;
+	transmitting_ = true;
+}
+
+size_t TwoWire::write(uint8_t data) {
+	if(!transmitting_ || txLength_ >= bufferLength_)
+		return 0;
+	txBuffer_[txLength_++] = data;
+	return 1;
+}
+
+size_t TwoWire::write(const uint8_t* data, size_t quantity) {
+	size_t n;
+	for(n = 0; n < quantity; ++n) {
+		if(!write(data[n]))
+			break;
+	}
+	return n;
+}
+
+uint8_t TwoWire::endTransmission(uint8_t sendStop) {
+	(void)sendStop;
+	transmitting_ = false;
+	waitAsync();
+	TwoWireDevice* device = txAddress_ < 128 ? devices_[txAddress_] : nullptr;
+	++stats_.writeTransactions;
+	host::advance(account(txLength_, device != nullptr));
+	if(!device)
+		return 2; /* NACK on address */
+	stats_.bytesWritten += txLength_;
+	device->onReceive(txBuffer_, txLength_);
+	return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, uint8_t sendStop) {
+	(void)sendStop;
+	if(quantity > bufferLength_)
+		quantity = bufferLength_;
+	waitAsync();
+	TwoWireDevice* device = address < 128 ? devices_[address] : nullptr;
+	rxIndex_ = 0;
+	rxLength_ = 0;
+	if(device) {
+		/* The master clocks out every byte it asked for: whatever the
+		   device doesn't drive reads as an idle (high) line */
+		size_t sent = device->onRequest(rxBuffer_, quantity);
+		memset(rxBuffer_ + sent, 0xFF, quantity - sent);
+		rxLength_ = quantity;
+	}
+	++stats_.readTransactions;
+	host::advance(account(rxLength_, device != nullptr));
+	stats_.bytesRead += rxLength_;
+	return rxLength_;
+}
+
+int TwoWire::available() {
+	return rxLength_ - rxIndex_;
+}
+
+int TwoWire::read() {
+	if(rxIndex_ >= rxLength_)
+		return -1;
+	return rxBuffer_[rxIndex_++];
+}
+
+int TwoWire::peek() {
+	if(rxIndex_ >= rxLength_)
+		return -1;
+	return rxBuffer_[rxIndex_];
+}
+
+size_t TwoWire::readBytes(uint8_t* buffer, size_t length) {
+	size_t n = rxLength_ - rxIndex_;
+	if(n > length)
+		n = length;
+	memcpy(buffer, rxBuffer_ + rxIndex_, n);
+	rxIndex_ += n;
+	return n;
+}
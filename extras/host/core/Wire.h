@@ -0,0 +1,128 @@
+/*
+ * Host stand-in for the Arduino Wire library.
+ *
+ * Behaves like the AVR TwoWire as far as the master side is concerned
+ * (same buffer size, same clamping of requestFrom()), but instead of
+ * driving pins it forwards each transaction to a TwoWireDevice attached
+ * at the target address. Every transaction is accounted for in
+ * TwoWireStats and advances the virtual clock by its duration on the
+ * bus.
+ *
+ * BSD license
+ */
+
+#ifndef TRILL_HOST_WIRE_H
+#define TRILL_HOST_WIRE_H
+
+#include "Arduino.h"
+
+#define BUFFER_LENGTH 32
+
+/* A simulated I2C peripheral */
+class TwoWireDevice
+{
+public:
+	virtual ~TwoWireDevice() {}
+	/* The master wrote `length` bytes in a single transaction */
+	virtual void onReceive(const uint8_t* data, size_t length) = 0;
+	/* The master requests `length` bytes. Fill `dst` and return how
+	   many bytes the device actually sent. */
+	virtual size_t onRequest(uint8_t* dst, size_t length) = 0;
+};
+
+struct TwoWireStats
+{
+	uint32_t writeTransactions;
+	uint32_t readTransactions;
+	uint32_t nacks;		/* transactions not acknowledged by any device */
+	uint32_t bytesWritten;	/* payload bytes, excluding the address */
+	uint32_t bytesRead;
+	uint64_t bits;		/* bit clocks on SCL, including start/stop and ACKs */
+
+	uint32_t transactions() const { return writeTransactions + readTransactions; }
+	uint32_t bytes() const { return bytesWritten + bytesRead; }
+	/* Time the recorded traffic takes on a bus clocked at `clockHz` */
+	double busTimeUs(uint32_t clockHz) const { return bits * 1000000.0 / clockHz; }
+};
+
+class TwoWire
+{
+public:
+	TwoWire();
+
+	void begin();
+	void end() {}
+	void setClock(uint32_t clockHz) { clock_ = clockHz; }
+
+	void beginTransmission(uint8_t address);
+	void beginTransmission(int address) { beginTransmission((uint8_t)address); }
+	uint8_t endTransmission(uint8_t sendStop);
+	uint8_t endTransmission() { return endTransmission((uint8_t)true); }
+
+	uint8_t requestFrom(uint8_t address, uint8_t quantity, uint8_t sendStop);
+	uint8_t requestFrom(uint8_t address, uint8_t quantity) { return requestFrom(address, quantity, (uint8_t)true); }
+	uint8_t requestFrom(int address, int quantity) { return requestFrom((uint8_t)address, (uint8_t)quantity, (uint8_t)true); }
+	uint8_t requestFrom(int address, int quantity, int sendStop) { return requestFrom((uint8_t)address, (uint8_t)quantity, (uint8_t)sendStop); }
+
+	size_t write(uint8_t data);
+	size_t write(const uint8_t* data, size_t quantity);
+	size_t write(unsigned long n) { return write((uint8_t)n); }
+	size_t write(long n) { return write((uint8_t)n); }
+	size_t write(unsigned int n) { return write((uint8_t)n); }
+	size_t write(int n) { return write((uint8_t)n); }
+
+	int available();
+	int read();
+	int peek();
+	size_t readBytes(uint8_t* buffer, size_t length);
+	size_t readBytes(char* buffer, size_t length) { return readBytes((uint8_t*)buffer, length); }
+
+	/* Background transfers, with the same interface as arduino-pico:
+	   optionally write wbytes, then read rbytes into rbuffer. The
+	   transfer completes once the virtual clock has advanced by its
+	   duration on the bus; any other operation waits for it first. */
+	bool writeReadAsync(uint8_t address, const void* wbuffer, size_t wbytes, void* rbuffer, size_t rbytes, bool sendStop = true);
+	bool finishedAsync();
+	void abortAsync();
+
+	/* --- Host-only API --- */
+
+	/* Attach a simulated device at `address`, or detach with nullptr */
+	void attach(uint8_t address, TwoWireDevice* device);
+	/* Largest transfer the driver accepts (BUFFER_LENGTH by default) */
+	void setBufferLength(size_t length);
+	size_t getBufferLength() const { return bufferLength_; }
+	const TwoWireStats& stats() const { return stats_; }
+	void resetStats();
+	/* Keep background transfers from completing, as a device holding
+	   SCL low would */
+	void setStalled(bool stalled) { asyncStalled_ = stalled; }
+
+private:
+	enum { kMaxBufferLength = 256 };
+	uint64_t account(size_t bytes, bool acked);
+	void waitAsync();
+
+	TwoWireDevice* devices_[128];
+	uint8_t rxBuffer_[kMaxBufferLength];
+	size_t rxIndex_;
+	size_t rxLength_;
+	uint8_t txBuffer_[kMaxBufferLength];
+	size_t txLength_;
+	uint8_t txAddress_;
+	bool transmitting_;
+	size_t bufferLength_;
+	uint32_t clock_;
+	TwoWireStats stats_;
+	bool asyncPending_;
+	bool asyncStalled_;
+	uint8_t asyncAddress_;
+	uint64_t asyncEnd_;	/* virtual time at which the transfer completes */
+	uint8_t* asyncDst_;
+	size_t asyncLength_;
+	uint8_t asyncBuffer_[kMaxBufferLength];
+};
+
+extern TwoWire Wire;
+
+#endif /* TRILL_HOST_WIRE_H */
@@ -0,0 +1,250 @@
+/*
+ * Checks on TrillFrameQueue: what push() stores from a simulated
+ * sensor, and a stress run with the producer and the consumer on two
+ * threads, where every frame popped must be whole and in order.
+ *
+ * BSD license
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <TrillQueue.h>
+#include "TrillSim.h"
+
+static unsigned int gFailures;
+
+#define CHECK(cond) do { \
+	if(!(cond)) { \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		++gFailures; \
+	} \
+} while(0)
+
+#define CHECK_EQUAL(a, b) do { \
+	long long _a = (a), _b = (b); \
+	if(_a != _b) { \
+		printf("%s:%d: check failed: %s == %s (%lld != %lld)\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+		++gFailures; \
+	} \
+} while(0)
+
+static const TrillSim::Touch kTouches[] = {
+	{ 700, 600, 1500 },
+	{ 1500, 1300, 900 },
+};
+
+/* Frames pushed from a sensor hold what the sensor reports */
+static void checkPush()
+{
+	host::resetClock();
+	TwoWire wire;
+	TrillSim square(Trill::TRILL_SQUARE);
+	TrillSim craft(Trill::TRILL_CRAFT);
+	square.setTouches(kTouches, 2);
+	craft.setTouches(kTouches, 2);
+	wire.attach(0x28, &square);
+	wire.attach(0x30, &craft);
+	Trill trillSquare;
+	Trill trillCraft;
+	trillSquare.begin(Trill::TRILL_SQUARE, 0x28, &wire);
+	trillCraft.begin(Trill::TRILL_CRAFT, 0x30, &wire);
+
+	TrillFrameQueue<4> queue;
+	uint32_t before = micros();
+	CHECK(queue.empty());
+	CHECK(!queue.front());
+	CHECK(queue.push(trillSquare, 1));
+	CHECK(queue.push(trillCraft, 2));
+	CHECK_EQUAL(queue.size(), 2);
+
+	const TrillFrame* frame = queue.front();
+	CHECK(frame);
+	CHECK_EQUAL(frame->tag, 1);
+	CHECK_EQUAL(frame->mode, Trill::CENTROID);
+	CHECK_EQUAL(frame->num_touches, trillSquare.getNumTouches());
+	CHECK_EQUAL(frame->num_horizontal_touches, trillSquare.getNumHorizontalTouches());
+	CHECK_EQUAL(frame->length, 2 * (frame->num_touches + frame->num_horizontal_touches));
+	CHECK(frame->timestamp_us > before && frame->timestamp_us < micros());
+	for(uint8_t n = 0; n < frame->num_touches; ++n) {
+		CHECK_EQUAL(frame->touchLocation(n), trillSquare.touchLocation(n));
+		CHECK_EQUAL(frame->touchSize(n), trillSquare.touchSize(n));
+	}
+	for(uint8_t n = 0; n < frame->num_horizontal_touches; ++n) {
+		CHECK_EQUAL(frame->touchHorizontalLocation(n), trillSquare.touchHorizontalLocation(n));
+		CHECK_EQUAL(frame->touchHorizontalSize(n), trillSquare.touchHorizontalSize(n));
+	}
+	queue.pop();
+
+	TrillFrame raw;
+	CHECK(queue.pop(raw));
+	CHECK_EQUAL(raw.tag, 2);
+	CHECK_EQUAL(raw.mode, Trill::DIFF);
+	CHECK_EQUAL(raw.length, craft.getNumChannels());
+	uint16_t expected[30];
+	CHECK_EQUAL(trillCraft.readRawFrame(expected, 30), 30);
+	for(unsigned int n = 0; n < 30; ++n)
+		CHECK_EQUAL(raw.data[n], expected[n]);
+	CHECK(queue.empty());
+
+	/* A frame read before isn't queued again, and isn't an overrun.
+	   Popping an empty queue leaves it empty */
+	CHECK(!queue.push(trillSquare));
+	CHECK(!queue.push(trillCraft));
+	queue.pop();
+	CHECK(queue.empty());
+	CHECK(!queue.front());
+	CHECK_EQUAL(queue.getNumOverruns(), 0);
+	square.setTouches(kTouches, 1);
+	CHECK(queue.push(trillSquare, 1));
+	CHECK_EQUAL(queue.size(), 1);
+	CHECK_EQUAL(queue.front()->num_touches, 1);
+	CHECK(queue.pop(raw));
+	CHECK(!queue.pop(raw));
+	CHECK(queue.empty());
+
+	/* A full queue doesn't read the sensor */
+	for(unsigned int n = 0; n < 4; ++n) {
+		craft.setTouches(kTouches, 1 + n % 2);
+		CHECK(queue.push(trillCraft));
+	}
+	wire.resetStats();
+	CHECK(!queue.push(trillCraft));
+	CHECK(!queue.push(raw));
+	CHECK_EQUAL(wire.stats().transactions(), 0);
+	CHECK_EQUAL(queue.getNumOverruns(), 2);
+	CHECK_EQUAL(queue.size(), 4);
+
+	/* Nor does a failed read queue anything */
+	while(queue.front())
+		queue.pop();
+	wire.attach(0x30, nullptr);
+	CHECK(!queue.push(trillCraft));
+	CHECK(queue.empty());
+	wire.attach(0x28, nullptr);
+}
+
+/* Fill a frame so that any mix of two frames shows */
+static void fill(TrillFrame& frame, uint32_t seq)
+{
+	frame.timestamp_us = seq;
+	frame.tag = seq;
+	frame.length = 1 + seq % TrillFrame::kMaxWords;
+	for(unsigned int n = 0; n < TrillFrame::kMaxWords; ++n)
+		frame.data[n] = seq * 31 + n;
+}
+
+static bool isWhole(const TrillFrame& frame, uint32_t seq)
+{
+	if(frame.timestamp_us != seq || frame.tag != (uint8_t)seq || frame.length != 1 + seq % TrillFrame::kMaxWords)
+		return false;
+	for(unsigned int n = 0; n < TrillFrame::kMaxWords; ++n)
+		if(frame.data[n] != (uint16_t)(seq * 31 + n))
+			return false;
+	return true;
+}
+
+/* One thread produces as fast as it can, the other consumes. The queue
+   is small so that it is full and empty often */
+static void checkThreads()
+{
+	const uint32_t kFrames = 1000000;
+	TrillFrameQueue<4> queue;
+	unsigned int torn = 0;
+	uint32_t received = 0;
+	std::thread consumer([&]() {
+		while(received < kFrames) {
+			const TrillFrame* frame = queue.front();
+			if(!frame) {
+				std::this_thread::yield();
+				continue;
+			}
+			if(!isWhole(*frame, received))
+				++torn;
+			queue.pop();
+			++received;
+		}
+	});
+	std::thread producer([&]() {
+		uint32_t seq = 0;
+		while(seq < kFrames) {
+			TrillFrame* frame = queue.acquire();
+			if(!frame) {
+				std::this_thread::yield();
+				continue;
+			}
+			fill(*frame, seq++);
+			queue.commit();
+		}
+	});
+	producer.join();
+	consumer.join();
+	CHECK_EQUAL(received, kFrames);
+	CHECK_EQUAL(torn, 0);
+	CHECK(queue.empty());
+}
+
+/* The same with frames read from a sensor on the producer thread, which
+   alone drives the virtual clock and the bus. The touches change after
+   each frame queued, so that the next one is new */
+static void checkSensorThreads()
+{
+	const uint32_t kFrames = 20000;
+	host::resetClock();
+	TwoWire wire;
+	TrillSim sim(Trill::TRILL_BAR);
+	sim.setTouches(kTouches, 2);
+	wire.attach(0x20, &sim);
+	Trill trill;
+	trill.begin(Trill::TRILL_BAR, 0x20, &wire);
+	TrillFrame references[2];
+	CHECK(references[0].read(trill));
+	sim.setTouches(kTouches, 1);
+	CHECK(references[1].read(trill));
+
+	TrillFrameQueue<8> queue;
+	unsigned int mismatches = 0;
+	uint32_t received = 0;
+	std::thread consumer([&]() {
+		uint32_t last = 0;
+		while(received < kFrames) {
+			const TrillFrame* frame = queue.front();
+			if(!frame) {
+				std::this_thread::yield();
+				continue;
+			}
+			const TrillFrame& reference = references[received % 2];
+			if(frame->timestamp_us <= last || frame->length != reference.length
+				|| memcmp(frame->data, reference.data, reference.length * sizeof(frame->data[0])))
+				++mismatches;
+			last = frame->timestamp_us;
+			queue.pop();
+			++received;
+		}
+	});
+	uint32_t sent = 0;
+	while(sent < kFrames) {
+		sim.setTouches(kTouches, sent % 2 ? 1 : 2);
+		if(queue.push(trill))
+			++sent;
+		else
+			std::this_thread::yield();
+	}
+	consumer.join();
+	CHECK_EQUAL(received, kFrames);
+	CHECK_EQUAL(mismatches, 0);
+	wire.attach(0x20, nullptr);
+}
+
+int main()
+{
+	checkPush();
+	checkThreads();
+	checkSensorThreads();
+	if(gFailures) {
+		printf("%u checks failed\n", gFailures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,537 @@
+/*
+ * I2C transaction-cost benchmark for the Trill library.
+ *
+ * Runs Trill.cpp against the host TwoWire and the simulated firmware
+ * and reports, for every device, the bus traffic caused by begin(),
+ * by a centroid read() and by a full raw frame
+ * (requestRawData() + rawDataRead() until empty), the latter both with
+ * the default Wire buffer and with a 128-byte one, and the traffic of
+ * reading only some of the pads of a Craft. It then compares
+ * bringing up all the devices on one bus one after the other with
+ * begin() and interleaved with beginAsync()/poll(), finding them with
+ * probe() on each address and with scanBus(), and the CPU time
+ * spent decoding a raw frame channel by channel and in bulk, and that
+ * of keeping the last frames of a Bar with TrillFrame copies and with
+ * TrillHistory. Finally it
+ * measures how long loop() is blocked by read() and by a split-phase
+ * startRead()/finishRead() overlapped with 3ms of other work, compares
+ * polling a sensor blindly with readIfReady(), with and without its EVT
+ * pin, how long changing settings holds up loop(), how long reconnect()
+ * takes to bring back a sensor that was reset, how many bytes a noisy
+ * Craft frame takes over serial in ASCII and with TrillRecorder, how
+ * many MIDI messages a Bar sends when every loop sends its CCs and with
+ * TrillEmitter, and compares the size of Trill with that of TrillDevice.
+ *
+ * BSD license
+ */
+
+#include <stdio.h>
+#include <chrono>
+#include "TrillSim.h"
+#include "Recording.h"
+#include <TrillDevice.h>
+#include <TrillHistory.h>
+#include <TrillEmitter.h>
+
+static const Trill::Device kDevices[] = {
+	Trill::TRILL_BAR,
+	Trill::TRILL_SQUARE,
+	Trill::TRILL_CRAFT,
+	Trill::TRILL_RING,
+	Trill::TRILL_HEX,
+	Trill::TRILL_FLEX,
+};
+
+static const unsigned int kIterations = 100;
+
+struct Cost
+{
+	double transactions;
+	double bytes;
+	double us100k;
+	double us400k;
+	double elapsedUs; /* virtual time, including delays */
+};
+
+template <typename F>
+static Cost measure(TwoWire& wire, unsigned int iterations, F operation)
+{
+	wire.resetStats();
+	uint64_t start = host::now();
+	for(unsigned int n = 0; n < iterations; ++n)
+		operation();
+	const TwoWireStats& s = wire.stats();
+	Cost c;
+	c.transactions = (double)s.transactions() / iterations;
+	c.bytes = (double)s.bytes() / iterations;
+	c.us100k = s.busTimeUs(100000) / iterations;
+	c.us400k = s.busTimeUs(400000) / iterations;
+	c.elapsedUs = (double)(host::now() - start) / iterations;
+	return c;
+}
+
+static void print(const char* device, const char* operation, const Cost& c)
+{
+	printf("%-7s %-9s %6.2f %7.1f %12.1f %12.1f %12.1f\n", device, operation,
+		c.transactions, c.bytes, c.us100k, c.us400k, c.elapsedUs);
+}
+
+int main()
+{
+	printf("%-7s %-9s %6s %7s %12s %12s %12s\n", "device", "operation",
+		"trans", "bytes", "bus@100k/us", "bus@400k/us", "elapsed/us");
+	for(Trill::Device device : kDevices) {
+		host::resetClock();
+		TwoWire wire;
+		TrillSim sim(device);
+		const TrillSim::Touch touches[] = {
+			{ 600, 500, 1200 },
+			{ 2000, 1400, 800 },
+		};
+		sim.setTouches(touches, 2);
+		Trill trill;
+		uint8_t address = 0x20 + 8 * (device - 1);
+		wire.attach(address, &sim);
+		const char* name = Trill::getNameFromDevice(device);
+
+		Cost c = measure(wire, 1, [&]() {
+			trill.begin(device, address, &wire);
+		});
+		print(name, "begin()", c);
+
+		trill.setMode(Trill::CENTROID);
+		trill.read(); // settle the read pointer
+		c = measure(wire, kIterations, [&]() {
+			trill.read();
+		});
+		print(name, "read()", c);
+
+		trill.setMode(Trill::DIFF);
+		c = measure(wire, kIterations, [&]() {
+			trill.requestRawData();
+			while(trill.rawDataAvailable() > 0)
+				trill.rawDataRead();
+		});
+		print(name, "raw frame", c);
+
+		wire.setBufferLength(128);
+		trill.setMaxTransferLength(128);
+		trill.requestRawData();
+		c = measure(wire, kIterations, [&]() {
+			trill.requestRawData();
+			while(trill.rawDataAvailable() > 0)
+				trill.rawDataRead();
+		});
+		print(name, "raw @128B", c);
+	}
+
+	printf("\n%-24s %6s %7s %12s %12s\n", "Craft DIFF, pads read", "trans", "bytes", "bus@100k/us", "bus@400k/us");
+	for(unsigned int pads = 0; pads < 4; ++pads) {
+		host::resetClock();
+		TwoWire wire;
+		TrillSim sim(Trill::TRILL_CRAFT);
+		Trill trill;
+		wire.attach(0x30, &sim);
+		trill.begin(Trill::TRILL_CRAFT, 0x30, &wire);
+		trill.setMode(Trill::DIFF);
+		const Trill::ChannelWindow windows[][2] = {
+			{ { 0, 30 } },
+			{ { 0, 4 } },
+			{ { 0, 8 } },
+			{ { 0, 4 }, { 16, 4 } },
+		};
+		const uint8_t numWindows = 3 == pads ? 2 : 1;
+		uint16_t channels[30];
+		trill.readRawChannels(windows[pads], numWindows, channels); // settle the read pointer
+		Cost c = measure(wire, kIterations, [&]() {
+			trill.readRawChannels(windows[pads], numWindows, channels);
+		});
+		const char* names[] = { "all 30", "0-3", "0-7", "0-3 and 16-19" };
+		printf("%-24s %6.2f %7.1f %12.1f %12.1f\n", names[pads], c.transactions, c.bytes, c.us100k, c.us400k);
+	}
+
+	printf("\n%-24s %6s %7s %12s\n", "startup of all devices", "trans", "bytes", "elapsed/ms");
+	for(unsigned int interleaved = 0; interleaved < 2; ++interleaved) {
+		const unsigned int kNumDevices = sizeof(kDevices) / sizeof(kDevices[0]);
+		host::resetClock();
+		TwoWire wire;
+		TrillSim* sims[kNumDevices];
+		Trill trills[kNumDevices];
+		uint8_t addresses[kNumDevices];
+		for(unsigned int n = 0; n < kNumDevices; ++n) {
+			sims[n] = new TrillSim(kDevices[n]);
+			addresses[n] = 0x20 + 8 * (kDevices[n] - 1);
+			wire.attach(addresses[n], sims[n]);
+		}
+		Cost c = measure(wire, 1, [&]() {
+			if(!interleaved) {
+				for(unsigned int n = 0; n < kNumDevices; ++n)
+					trills[n].begin(kDevices[n], addresses[n], &wire);
+				return;
+			}
+			int ret[kNumDevices];
+			for(unsigned int n = 0; n < kNumDevices; ++n)
+				ret[n] = trills[n].beginAsync(kDevices[n], addresses[n], &wire);
+			bool pending;
+			do {
+				pending = false;
+				for(unsigned int n = 0; n < kNumDevices; ++n) {
+					if(Trill::kBeginInProgress == ret[n])
+						ret[n] = trills[n].poll();
+					pending |= Trill::kBeginInProgress == ret[n];
+				}
+				delayMicroseconds(100); // the rest of the loop
+			} while(pending);
+		});
+		printf("%-24s %6.0f %7.0f %12.1f\n", interleaved ? "beginAsync()/poll()" : "begin()",
+			c.transactions, c.bytes, c.elapsedUs / 1000);
+		for(unsigned int n = 0; n < kNumDevices; ++n)
+			delete sims[n];
+	}
+
+	printf("\n%-24s %6s %7s %12s\n", "scan 0x20-0x50", "trans", "bytes", "elapsed/ms");
+	for(unsigned int scan = 0; scan < 2; ++scan) {
+		const unsigned int kNumDevices = sizeof(kDevices) / sizeof(kDevices[0]);
+		host::resetClock();
+		TrillSim* sims[kNumDevices];
+		for(unsigned int n = 0; n < kNumDevices; ++n) {
+			sims[n] = new TrillSim(kDevices[n]);
+			Wire.attach(0x20 + 8 * (kDevices[n] - 1), sims[n]);
+		}
+		unsigned int found = 0;
+		Cost c = measure(Wire, 1, [&]() {
+			if(scan) {
+				Trill::BusDevice devices[16];
+				found = Trill::scanBus(devices, 16);
+				return;
+			}
+			for(uint8_t address = 0x20; address <= 0x50; ++address)
+				found += Trill::probe(address) != Trill::TRILL_NONE;
+		});
+		printf("%-24s %6.0f %7.0f %12.1f\n", scan ? "scanBus()" : "probe() each address",
+			c.transactions, c.bytes, c.elapsedUs / 1000);
+		for(unsigned int n = 0; n < kNumDevices; ++n) {
+			Wire.attach(0x20 + 8 * (kDevices[n] - 1), nullptr);
+			delete sims[n];
+		}
+	}
+
+	printf("\n%-24s %12s\n", "decode Flex raw frame", "ns/frame");
+	for(unsigned int bulk = 0; bulk < 2; ++bulk) {
+		const unsigned int kFrames = 20000;
+		host::resetClock();
+		TwoWire wire;
+		TrillSim sim(Trill::TRILL_FLEX);
+		Trill trill;
+		wire.attach(0x48, &sim);
+		trill.begin(Trill::TRILL_FLEX, 0x48, &wire);
+		uint16_t frame[30];
+		volatile uint16_t sink = 0;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for(unsigned int f = 0; f < kFrames; ++f) {
+			if(bulk) {
+				trill.readRawFrame(frame, 30);
+			} else {
+				trill.requestRawData();
+				unsigned int n = 0;
+				while(trill.rawDataAvailable() > 0 && n < 30)
+					frame[n++] = trill.rawDataRead();
+			}
+			sink += frame[f % 30];
+		}
+		std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+		printf("%-24s %12.1f\n", bulk ? "readRawFrame()" : "rawDataRead() loop",
+			(double)elapsed.count() / kFrames);
+	}
+
+	/* Most of the time goes to the simulator: the point is that the
+	   history takes less memory for the same frames, at no extra cost */
+	printf("\n%-30s %12s %8s\n", "last 16 Bar frames + velocity", "ns/frame", "bytes");
+	for(unsigned int strategy = 0; strategy < 3; ++strategy) {
+		const unsigned int kFrames = 20000;
+		host::resetClock();
+		TwoWire wire;
+		TrillSim sim(Trill::TRILL_BAR);
+		Trill trill;
+		wire.attach(0x20, &sim);
+		trill.begin(Trill::TRILL_BAR, 0x20, &wire);
+		static TrillFrame frames[16];
+		TrillHistory<16, 10> history;
+		if(2 == strategy)
+			trill.setHistory(&history);
+		volatile int sink = 0;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for(unsigned int f = 0; f < kFrames; ++f) {
+			const TrillSim::Touch touch = { (uint16_t)(f % 3000), 0, 1200 };
+			sim.setTouches(&touch, 1);
+			delay(5);
+			/* How far the touch went over the last 4 frames */
+			if(0 == strategy) {
+				trill.read();
+				sink += trill.touchLocation(0);
+			} else if(1 == strategy) {
+				frames[f % 16].read(trill);
+				if(f >= 3)
+					sink += frames[f % 16].touchLocation(0) - frames[(f - 3) % 16].touchLocation(0);
+			} else {
+				trill.read();
+				TrillFrameHistory::Window w = history.window(4);
+				if(w.size() == 4)
+					sink += w[3].touchLocation(0) - w[0].touchLocation(0);
+			}
+		}
+		std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+		const char* names[] = { "read(), nothing kept", "TrillFrame::read() into a ring", "read() into TrillHistory" };
+		const size_t bytes[] = { 0, sizeof(frames), sizeof(history) };
+		printf("%-30s %12.1f %8zu\n", names[strategy], (double)elapsed.count() / kFrames, bytes[strategy]);
+	}
+
+	printf("\n%-24s %14s\n", "Square frame at 100kHz", "blocked/us");
+	for(unsigned int split = 0; split < 2; ++split) {
+		const unsigned int kFrames = 100;
+		const unsigned int kOtherWorkUs = 3000;
+		host::resetClock();
+		TwoWire wire;
+		TrillSim sim(Trill::TRILL_SQUARE);
+		Trill trill;
+		wire.attach(0x28, &sim);
+		trill.begin(Trill::TRILL_SQUARE, 0x28, &wire);
+		trill.read();
+		uint64_t start = host::now();
+		for(unsigned int f = 0; f < kFrames; ++f) {
+			if(split) {
+				trill.startRead();
+				for(unsigned int n = 0; n < kOtherWorkUs / 100; ++n) {
+					trill.isReadComplete();
+					delayMicroseconds(100);
+				}
+				trill.finishRead();
+			} else {
+				trill.read();
+				delayMicroseconds(kOtherWorkUs);
+			}
+		}
+		double blocked = (double)(host::now() - start) / kFrames - kOtherWorkUs;
+		printf("%-24s %14.1f\n", split ? "startRead()/finishRead()" : "read()", blocked);
+	}
+
+	printf("\n%-30s %6s %12s %12s\n", "change 3 Craft settings", "trans", "longest/ms", "total/ms");
+	for(unsigned int strategy = 0; strategy < 4; ++strategy) {
+		host::resetClock();
+		TwoWire wire;
+		TrillSim sim(Trill::TRILL_CRAFT);
+		wire.attach(0x30, &sim);
+		Trill trill;
+		trill.begin(Trill::TRILL_CRAFT, 0x30, &wire);
+		Trill::Settings settings = trill.getSettings();
+		settings.prescaler = 4;
+		settings.noise_threshold = 40;
+		settings.idac = 20;
+		/* Everything but the idac is already set */
+		if(3 == strategy) {
+			trill.setPrescaler(4);
+			trill.setNoiseThreshold(40);
+			delay(50);
+		}
+		wire.resetStats();
+		const uint64_t start = host::now();
+		uint64_t longest = 0;
+		bool pending = true;
+		/* loop() runs every 100us */
+		while(pending) {
+			uint64_t iteration = host::now();
+			switch(strategy) {
+			case 0:
+				trill.setPrescaler(settings.prescaler);
+				delay(Trill::interCommandDelay);
+				trill.setNoiseThreshold(settings.noise_threshold);
+				delay(Trill::interCommandDelay);
+				trill.setIDACValue(settings.idac);
+				delay(Trill::interCommandDelay);
+				pending = false;
+				break;
+			case 1:
+				pending = trill.applySettings(settings) == Trill::kSettingsPending;
+				break;
+			default:
+				if(host::now() == start)
+					trill.applySettings(settings, false);
+				pending = trill.pollSettings() == Trill::kSettingsPending;
+				break;
+			}
+			if(host::now() - iteration > longest)
+				longest = host::now() - iteration;
+			delayMicroseconds(100);
+		}
+		const char* names[] = { "setters + delay()", "applySettings()", "applySettings() + poll", "the same, 1 changed" };
+		printf("%-30s %6u %12.2f %12.2f\n", names[strategy], (unsigned int)wire.stats().transactions(),
+			longest / 1000.0, (host::now() - start) / 1000.0);
+	}
+
+	printf("\n%-30s %6s %12s\n", "Craft back after a reset", "trans", "time/ms");
+	for(unsigned int strategy = 0; strategy < 2; ++strategy) {
+		host::resetClock();
+		TwoWire wire;
+		TrillSim sim(Trill::TRILL_CRAFT);
+		wire.attach(0x30, &sim);
+		Trill trill;
+		trill.begin(Trill::TRILL_CRAFT, 0x30, &wire);
+		trill.setPrescaler(4);
+		trill.setNoiseThreshold(40);
+		delay(50);
+		sim.powerCycle();
+		wire.resetStats();
+		const uint64_t start = host::now();
+		if(strategy) {
+			trill.reconnect();
+		} else {
+			trill.begin(Trill::TRILL_CRAFT, 0x30, &wire);
+			trill.setPrescaler(4);
+			delay(Trill::interCommandDelay);
+			trill.setNoiseThreshold(40);
+			delay(Trill::interCommandDelay);
+		}
+		printf("%-30s %6u %12.2f\n", strategy ? "reconnect()" : "begin() + setters", (unsigned int)wire.stats().transactions(),
+			(host::now() - start) / 1000.0);
+	}
+
+	{
+		/* 1000 frames of a Craft in DIFF mode with some noise and a moving
+		   touch, printed as raw-multi-print does and recorded */
+		host::resetClock();
+		TwoWire wire;
+		TrillSim sim(Trill::TRILL_CRAFT);
+		sim.setNoise(20);
+		wire.attach(0x30, &sim);
+		Trill trill;
+		trill.begin(Trill::TRILL_CRAFT, 0x30, &wire);
+		const unsigned int kFrames = 1000;
+		size_t ascii = 0;
+		BufferPrint out;
+		TrillRecorder recorder(out);
+		recorder.begin(trill);
+		for(unsigned int n = 0; n < kFrames; ++n) {
+			const TrillSim::Touch touch = { (uint16_t)(n * 3), 0, 1500 };
+			sim.setTouches(&touch, 1);
+			TrillFrame frame;
+			frame.read(trill);
+			ascii += 7 + 5 * frame.length + 2; // "CRAFT  ", "0123 " per channel, "\r\n"
+			recorder.write(frame);
+			delay(5);
+		}
+		Recording recording;
+		std::string error;
+		auto start = std::chrono::steady_clock::now();
+		decodeRecording(out.bytes.data(), out.bytes.size(), recording, error);
+		ReplayResult result = replayRecording(recording);
+		double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+		printf("\n%-30s %12s %16s\n", "Craft DIFF frames over serial", "bytes/frame", "frames/s@115200");
+		printf("%-30s %12.1f %16.0f\n", "ASCII", (double)ascii / kFrames, 11520.0 * kFrames / ascii);
+		printf("%-30s %12.1f %16.0f\n", "TrillRecorder", (double)out.bytes.size() / kFrames, 11520.0 * kFrames / out.bytes.size());
+		printf("%-30s %12.2f us/frame\n", "decode + replay", us / result.frames);
+		wire.attach(0x30, nullptr);
+	}
+
+	printf("\n%-24s %8s %8s %8s %10s %12s\n", "Bar at 400kHz for 1s", "reads/s", "new/s", "stale/s", "bus busy", "latency/us");
+	for(unsigned int strategy = 0; strategy < 4; ++strategy) {
+		host::resetClock();
+		host::resetPins();
+		TwoWire wire;
+		wire.setClock(400000);
+		TrillSim sim(Trill::TRILL_BAR);
+		const TrillSim::Touch touch = { 1000, 0, 1500 };
+		sim.setTouches(&touch, 1);
+		sim.setNoise(20);
+		wire.attach(0x20, &sim);
+		Trill trill;
+		const int kEvtPin = 2;
+		if(3 == strategy)
+			sim.setEventPin(kEvtPin);
+		trill.begin(Trill::TRILL_BAR, 0x20, &wire, 3 == strategy ? kEvtPin : -1);
+		wire.resetStats();
+		trill.resetReadCounters();
+		const uint64_t start = host::now();
+		unsigned int reads = 0;
+		unsigned int frames = 0;
+		uint64_t latency = 0;
+		uint32_t lastScan = sim.getScanCount();
+		while(host::now() - start < 1000000) {
+			bool didRead;
+			if(strategy < 2)
+				didRead = trill.read();
+			else
+				didRead = trill.readIfReady();
+			if(didRead) {
+				++reads;
+				if(sim.getScanCount() != lastScan) {
+					lastScan = sim.getScanCount();
+					++frames;
+					latency += host::now() - sim.getLastScanTime();
+				}
+			}
+			if(1 == strategy)
+				delay(50);
+			else
+				delayMicroseconds(100); // the rest of the loop
+		}
+		const char* names[] = { "read() every loop", "read() + delay(50)", "readIfReady()", "readIfReady() + EVT" };
+		printf("%-24s %8u %8u %8u %9.1f%% %12.1f\n", names[strategy], reads, frames, trill.getNumStaleReads(),
+			100.0 * wire.stats().busTimeUs(400000) / (host::now() - start),
+			frames ? (double)latency / frames : 0);
+	}
+
+	/* A 10s session on a Bar, read every 7ms as trill-connect does:
+	   idle, a finger resting and wobbling by a few units, sliding
+	   along, resting again, lifted. Location and size go out as CCs,
+	   two messages each at 14 bits. The lag is from the first frame
+	   that moved to the first message */
+	printf("\n%-30s %8s %8s %8s %8s\n", "Bar CCs in 10s, messages", "idle", "resting", "moving", "lag/ms");
+	for(unsigned int strategy = 0; strategy < 3; ++strategy) {
+		struct BarTouch : public Touches {
+			BarTouch() { centroids = &location; sizes = &size; }
+			uint16_t location;
+			uint16_t size;
+		} bar;
+		TrillEmitter<2> emitter;
+		const uint8_t bits = 2 == strategy ? 7 : 14;
+		emitter.addParameter(TrillParameterEmitter::LOCATION, 0, 0, 3200, bits, 0, 32);
+		emitter.addParameter(TrillParameterEmitter::SIZE, 0, 0, 4096, bits, 0, 128);
+		if(2 == strategy)
+			emitter.setRate(0, 100, 4);
+		unsigned int messages[3] = { 0, 0, 0 };
+		int lag = -1;
+		int firstMoving = -1;
+		boolean hadTouch = false;
+		uint32_t seed = 1;
+		for(unsigned int ms = 0; ms < 10000; ms += 7) {
+			const boolean moving = ms >= 5000 && ms < 7000;
+			seed = seed * 1664525 + 1013904223;
+			bar.num_touches = ms >= 2000 && ms < 8000;
+			bar.location = (moving ? 1000 + (ms - 5000) : ms < 5000 ? 1000 : 3000) + (seed >> 8) % 9 - 4;
+			bar.size = 2400 + (seed >> 16) % 33 - 16;
+			unsigned int sent = 0;
+			if(strategy) {
+				emitter.process(bar, ms * 1000);
+				for(uint8_t n = 0; n < emitter.getNumChanges(); ++n)
+					sent += (bits + 6) / 7;
+			} else if(bar.num_touches || hadTouch) {
+				sent = 4;
+			}
+			hadTouch = bar.num_touches;
+			if(moving && firstMoving < 0)
+				firstMoving = ms;
+			if(moving && sent && lag < 0)
+				lag = ms - firstMoving;
+			messages[moving ? 2 : bar.num_touches ? 1 : 0] += sent;
+		}
+		const char* names[] = { "every loop", "TrillEmitter, 14 bits", "TrillEmitter, 7 bits, 100/s" };
+		printf("%-30s %8u %8u %8u %8d\n", names[strategy], messages[0], messages[1], messages[2], lag);
+	}
+
+	/* Time per frame is dominated by the simulator here, so only
+	   compare the memory each front end needs */
+	printf("\n%-30s %6s\n", "Bar CENTROID front end", "bytes");
+	printf("%-30s %6zu\n", "Trill", sizeof(Trill));
+	printf("%-30s %6zu\n", "TrillDevice<TRILL_BAR>", sizeof(TrillDevice<Trill::TRILL_BAR>));
+	return 0;
+}
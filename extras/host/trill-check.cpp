@@ -0,0 +1,1997 @@
+/*
+ * Checks on the I2C traffic generated by the Trill library, run against
+ * the simulated firmware.
+ *
+ * BSD license
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "TrillSim.h"
+#include "Recording.h"
+#include "GestureTraces.h"
+#include <TrillDevice.h>
+#include <TrillBus.h>
+#include <TrillSliders.h>
+#include <TrillTracker.h>
+#include <TrillHistory.h>
+#include <TrillFilter.h>
+#include <TrillEmitter.h>
+
+static unsigned int gFailures;
+
+#define CHECK(cond) do { \
+	if(!(cond)) { \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		++gFailures; \
+	} \
+} while(0)
+
+#define CHECK_EQUAL(a, b) do { \
+	long long _a = (a), _b = (b); \
+	if(_a != _b) { \
+		printf("%s:%d: check failed: %s == %s (%lld != %lld)\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+		++gFailures; \
+	} \
+} while(0)
+
+static const Trill::Device kDevices[] = {
+	Trill::TRILL_BAR,
+	Trill::TRILL_SQUARE,
+	Trill::TRILL_CRAFT,
+	Trill::TRILL_RING,
+	Trill::TRILL_HEX,
+	Trill::TRILL_FLEX,
+};
+
+/* Restarts the virtual clock, before the simulated device is created */
+struct ClockReset
+{
+	ClockReset() { host::resetClock(); }
+};
+
+struct Fixture
+{
+	Fixture(Trill::Device device)
+	: sim(device), address(0x20 + 8 * (device - 1))
+	{
+		const TrillSim::Touch touches[] = {
+			{ 700, 600, 1500 },
+			{ 1500, 1300, 900 },
+		};
+		sim.setTouches(touches, 2);
+		wire.attach(address, &sim);
+		trill.begin(device, address, &wire);
+	}
+	ClockReset reset;
+	TwoWire wire;
+	TrillSim sim;
+	Trill trill;
+	uint8_t address;
+};
+
+/* Steady-state raw polling needs one read per chunk of at most
+   BUFFER_LENGTH bytes, plus one seek between consecutive chunks */
+static void checkRawTransactions()
+{
+	for(Trill::Device device : kDevices) {
+		Fixture f(device);
+		f.trill.setMode(Trill::DIFF);
+		unsigned int frameBytes = 2 * f.sim.getNumChannels();
+		unsigned int chunks = (frameBytes + BUFFER_LENGTH - 1) / BUFFER_LENGTH;
+		f.trill.requestRawData(); // settle the read pointer
+		for(unsigned int n = 0; n < 10; ++n) {
+			f.wire.resetStats();
+			CHECK(f.trill.requestRawData());
+			CHECK_EQUAL(f.trill.rawDataAvailable(), f.sim.getNumChannels());
+			while(f.trill.rawDataAvailable() > 0)
+				f.trill.rawDataRead();
+			CHECK_EQUAL(f.wire.stats().readTransactions, chunks);
+			CHECK_EQUAL(f.wire.stats().writeTransactions, chunks - 1);
+			CHECK_EQUAL(f.wire.stats().bytesRead, frameBytes);
+		}
+	}
+}
+
+static void checkReadTransactions()
+{
+	for(Trill::Device device : kDevices) {
+		Fixture f(device);
+		f.trill.setMode(Trill::CENTROID);
+		f.trill.read();
+		for(unsigned int n = 0; n < 10; ++n) {
+			f.wire.resetStats();
+			CHECK(f.trill.read());
+			CHECK_EQUAL(f.wire.stats().transactions(), 1);
+		}
+		CHECK_EQUAL(f.trill.getNumTouches(), 2);
+	}
+}
+
+/* All the ways of reading a raw frame return the same data, whatever
+   order the chunks are read in */
+static void checkRawContent()
+{
+	for(Trill::Device device : kDevices) {
+		Fixture f(device);
+		f.trill.setMode(Trill::RAW);
+		unsigned int numChannels = f.sim.getNumChannels();
+		uint16_t bulk[30];
+		uint16_t streamed[30];
+		for(unsigned int frame = 0; frame < 3; ++frame) {
+			CHECK_EQUAL(f.trill.readRawFrame(bulk, 30), numChannels);
+			f.trill.requestRawData();
+			unsigned int n = 0;
+			while(f.trill.rawDataAvailable() > 0 && n < 30)
+				streamed[n++] = f.trill.rawDataRead();
+			CHECK_EQUAL(n, numChannels);
+			CHECK(0 == memcmp(bulk, streamed, numChannels * sizeof(bulk[0])));
+			CHECK(bulk[0] >= 1800);
+		}
+		uint16_t partial[4];
+		CHECK_EQUAL(f.trill.readRawFrame(partial, 4), 4);
+		CHECK(0 == memcmp(partial, bulk, sizeof(partial)));
+		CHECK_EQUAL(f.trill.rawDataAvailable(), numChannels - 4);
+	}
+}
+
+/* Channel windows return the same data as the whole frame, for the bytes
+   of the channels asked for only, and windows read every frame need one
+   seek fewer than there are runs of adjacent windows */
+static void checkRawChannels()
+{
+	for(Trill::Device device : kDevices) {
+		Fixture f(device);
+		f.trill.setMode(Trill::DIFF);
+		unsigned int numChannels = f.sim.getNumChannels();
+		uint16_t frame[30];
+		CHECK_EQUAL(f.trill.readRawFrame(frame, 30), numChannels);
+
+		f.trill.requestRawChannels(4, 6); // settle the read pointer
+		for(unsigned int n = 0; n < 3; ++n) {
+			f.wire.resetStats();
+			CHECK(f.trill.requestRawChannels(4, 6));
+			CHECK_EQUAL(f.wire.stats().transactions(), 1);
+			CHECK_EQUAL(f.wire.stats().bytesRead, 12);
+			CHECK_EQUAL(f.trill.rawDataAvailable(), 6);
+			for(unsigned int c = 4; c < 10; ++c)
+				CHECK_EQUAL(f.trill.rawDataRead(), frame[c]);
+		}
+
+		/* The first window is adjacent to the second, the last one runs
+		   past the end of the device */
+		const Trill::ChannelWindow windows[] = {
+			{ 20, 2 }, { 2, 3 }, { 5, 1 }, { 12, 2 }, { 24, 10 },
+		};
+		const uint8_t expected[] = { 20, 21, 2, 3, 4, 5, 12, 13, 24, 25, 26, 27, 28, 29 };
+		const unsigned int numExpected = numChannels - 24 + 8;
+		uint16_t channels[30];
+		f.trill.readRawChannels(windows, 5, channels);
+		for(unsigned int n = 0; n < 3; ++n) {
+			memset(channels, 0, sizeof(channels));
+			f.wire.resetStats();
+			CHECK_EQUAL(f.trill.readRawChannels(windows, 5, channels), numExpected);
+			CHECK_EQUAL(f.wire.stats().readTransactions, 4);
+			CHECK_EQUAL(f.wire.stats().writeTransactions, 3);
+			CHECK_EQUAL(f.wire.stats().bytesRead, 2 * numExpected);
+			for(unsigned int c = 0; c < numExpected; ++c)
+				CHECK_EQUAL(channels[c], frame[expected[c]]);
+		}
+
+		const Trill::ChannelWindow outside = { 30, 4 };
+		CHECK_EQUAL(f.trill.readRawChannels(&outside, 1, channels), 0);
+		CHECK(!f.trill.requestRawChannels(40, 2));
+		CHECK(f.trill.requestRawData(8));
+		CHECK_EQUAL(f.trill.rawDataAvailable(), 4);
+	}
+}
+
+/* Something else on the bus, which answers every read with zeros */
+class OtherDevice : public TwoWireDevice
+{
+public:
+	void onReceive(const uint8_t*, size_t) override {}
+	size_t onRequest(uint8_t* dst, size_t length) override {
+		memset(dst, 0, length);
+		return length;
+	}
+};
+
+/* A device whose reads stop after limit bytes */
+class ShortDevice : public TwoWireDevice
+{
+public:
+	ShortDevice(TwoWireDevice& device, size_t limit) : device_(device), limit_(limit) {}
+	void onReceive(const uint8_t* src, size_t length) override { device_.onReceive(src, length); }
+	size_t onRequest(uint8_t* dst, size_t length) override {
+		return device_.onRequest(dst, length < limit_ ? length : limit_);
+	}
+private:
+	TwoWireDevice& device_;
+	size_t limit_;
+};
+
+/* A bus scan finds every Trill, leaves out other devices and waits once,
+   whatever the number of devices */
+static void checkScanBus()
+{
+	const unsigned int kNumDevices = sizeof(kDevices) / sizeof(kDevices[0]);
+	host::resetClock();
+	TwoWire wire;
+	TrillSim* sims[kNumDevices];
+	OtherDevice other;
+	wire.attach(0x21, &other);
+	for(unsigned int n = 0; n < kNumDevices; ++n) {
+		sims[n] = new TrillSim(kDevices[n]);
+		wire.attach(0x20 + 8 * (kDevices[n] - 1), sims[n]);
+	}
+	Trill::BusDevice found[16];
+	uint64_t start = host::now();
+	CHECK_EQUAL(Trill::scanBus(found, 16, &wire), kNumDevices);
+	uint64_t elapsed = host::now() - start;
+	CHECK(elapsed >= 25000 && elapsed < 40000);
+	/* One ACK check per address, one identify and one read per device */
+	CHECK_EQUAL(wire.stats().writeTransactions, 0x50 - 0x20 + 1 + kNumDevices + 1);
+	CHECK_EQUAL(wire.stats().readTransactions, kNumDevices + 1);
+	for(unsigned int n = 0; n < kNumDevices; ++n) {
+		CHECK_EQUAL(found[n].address, 0x20 + 8 * (kDevices[n] - 1));
+		CHECK_EQUAL(found[n].device, kDevices[n]);
+		CHECK_EQUAL(found[n].firmware, sims[n]->firmwareVersion);
+	}
+
+	/* Fewer entries than devices: the other device at 0x21 doesn't
+	   take one. Only the identities that fit are read */
+	wire.resetStats();
+	CHECK_EQUAL(Trill::scanBus(found, 2, &wire), 2);
+	CHECK_EQUAL(found[0].device, Trill::TRILL_BAR);
+	CHECK_EQUAL(found[1].device, Trill::TRILL_SQUARE);
+	CHECK_EQUAL(found[1].address, 0x28);
+	CHECK_EQUAL(wire.stats().readTransactions, 3);
+	CHECK_EQUAL(Trill::scanBus(found, 1, &wire, 0x21), 1);
+	CHECK_EQUAL(found[0].device, Trill::TRILL_SQUARE);
+	for(unsigned int n = 0; n < kNumDevices; ++n) {
+		wire.attach(0x20 + 8 * (kDevices[n] - 1), nullptr);
+		delete sims[n];
+	}
+	wire.attach(0x21, nullptr);
+	start = host::now();
+	CHECK_EQUAL(Trill::scanBus(found, 16, &wire), 0);
+	CHECK(host::now() - start < 25000);
+	CHECK_EQUAL(Trill::getNameFromDevice(Trill::TRILL_CRAFT)[0], 'C');
+}
+
+/* applySettings() only sends what changed and only waits for the time
+   left since the previous command */
+static void checkSettings()
+{
+	Fixture f(Trill::TRILL_CRAFT);
+	Trill::Settings settings = f.trill.getSettings();
+	CHECK_EQUAL(settings.mode, Trill::DIFF);
+	CHECK_EQUAL(settings.speed, 0);
+	CHECK_EQUAL(settings.num_bits, 12);
+	/* What begin() didn't send reads as the defaults of the firmware */
+	CHECK_EQUAL(settings.prescaler, f.sim.prescaler);
+	CHECK_EQUAL(settings.noise_threshold, f.sim.noiseThreshold);
+	CHECK_EQUAL(settings.idac, f.sim.idac);
+	CHECK_EQUAL(settings.minimum_size, f.sim.minimumSize);
+	CHECK_EQUAL(settings.auto_scan_interval, f.sim.autoScanInterval);
+	/* but the device may have kept other values, e.g. from before a
+	   reset of the board only: those are only sent when asked for */
+	f.sim.prescaler = 4;
+	unsigned int commands = f.sim.commandsReceived;
+	CHECK_EQUAL(f.trill.applySettings(settings), 0);
+	CHECK_EQUAL(f.sim.commandsReceived, commands);
+	CHECK_EQUAL(f.sim.prescaler, 4);
+	CHECK_EQUAL(f.trill.applySettings(settings, true, true), 0);
+	CHECK_EQUAL(f.sim.commandsReceived, commands + 5);
+	CHECK_EQUAL(f.sim.prescaler, 1);
+	/* and once they have been, not again */
+	commands = f.sim.commandsReceived;
+	CHECK_EQUAL(f.trill.applySettings(settings, true, true), 0);
+	CHECK_EQUAL(f.sim.commandsReceived, commands);
+	f.wire.resetStats();
+	uint64_t start = host::now();
+	CHECK_EQUAL(f.trill.applySettings(settings), 0);
+	CHECK_EQUAL(f.wire.stats().transactions(), 0);
+	CHECK_EQUAL(host::now(), start);
+
+	/* Two commands, 15ms apart, then 15ms for the last one */
+	settings.prescaler = 4;
+	settings.noise_threshold = 40;
+	settings.num_bits = 20;
+	start = host::now();
+	CHECK_EQUAL(f.trill.applySettings(settings), 0);
+	uint64_t elapsed = host::now() - start;
+	CHECK(elapsed >= 3 * 15000 && elapsed < 3 * 15000 + 2000);
+	CHECK_EQUAL(f.sim.commandsReceived, commands + 3);
+	CHECK_EQUAL(f.sim.prescaler, 4);
+	CHECK_EQUAL(f.sim.noiseThreshold, 40);
+	CHECK_EQUAL(f.sim.numBits, 16);
+	CHECK_EQUAL(f.trill.getSettings().num_bits, 16);
+
+	/* A command sent 10ms ago only holds the next one back for 5ms */
+	f.trill.setIDACValue(20);
+	delayMicroseconds(10000);
+	settings = f.trill.getSettings();
+	CHECK_EQUAL(settings.idac, 20);
+	settings.minimum_size = 300;
+	start = host::now();
+	CHECK_EQUAL(f.trill.applySettings(settings, false), Trill::kSettingsPending);
+	CHECK_EQUAL(host::now(), start);
+	CHECK_EQUAL(f.sim.minimumSize, 0);
+	int ret;
+	uint64_t sent = 0;
+	while(Trill::kSettingsPending == (ret = f.trill.pollSettings())) {
+		if(f.sim.minimumSize && !sent)
+			sent = host::now() - start;
+		delayMicroseconds(100);
+	}
+	CHECK_EQUAL(ret, 0);
+	CHECK(sent >= 5000 && sent < 5600);
+	CHECK_EQUAL(f.sim.minimumSize, 300);
+	CHECK_EQUAL(f.sim.idac, 20);
+
+	/* Setting the mode through applySettings() behaves as setMode() */
+	settings.mode = Trill::CENTROID;
+	CHECK_EQUAL(f.trill.applySettings(settings), 0);
+	CHECK_EQUAL(f.trill.getMode(), Trill::CENTROID);
+	CHECK(f.trill.read());
+
+	f.wire.attach(f.address, nullptr);
+	settings.prescaler = 2;
+	CHECK_EQUAL(f.trill.applySettings(settings), -1);
+	CHECK_EQUAL(f.trill.getSettings().prescaler, 4);
+
+	/* A field set to 0 when it defaults to something else is sent */
+	Fixture g(Trill::TRILL_BAR);
+	settings = g.trill.getSettings();
+	settings.auto_scan_interval = 0;
+	CHECK_EQUAL(g.trill.applySettings(settings), 0);
+	CHECK_EQUAL(g.sim.autoScanInterval, 0);
+	CHECK_EQUAL(g.trill.getSettings().auto_scan_interval, 0);
+}
+
+/* reconnect() brings back a device that was reset, without identifying
+   it again, and gives up quickly when nothing answers */
+static void checkReconnect()
+{
+	Fixture f(Trill::TRILL_CRAFT);
+	f.trill.setPrescaler(4);
+	f.trill.read();
+	f.wire.attach(f.address, nullptr);
+	CHECK(!f.trill.read());
+	f.sim.powerCycle();
+	f.wire.attach(f.address, &f.sim);
+	unsigned int commands = f.sim.commandsReceived;
+	uint64_t start = host::now();
+	CHECK_EQUAL(f.trill.reconnect(), 0);
+	uint64_t elapsed = host::now() - start;
+	/* Mode, scan settings and prescaler, 15ms apart, then the baseline */
+	CHECK(elapsed >= 3 * 15000 && elapsed < 3 * 15000 + 3000);
+	CHECK_EQUAL(f.sim.commandsReceived, commands + 4);
+	CHECK_EQUAL(f.sim.mode, Trill::DIFF);
+	CHECK_EQUAL(f.sim.prescaler, 4);
+	CHECK_EQUAL(f.sim.numBits, 12);
+	CHECK_EQUAL(f.sim.autoScanInterval, 1);
+	CHECK(f.trill.requestRawData());
+	CHECK_EQUAL(f.trill.rawDataAvailable(), 30);
+
+	/* Nothing there: 5 attempts, 1 + 2 + 4 + 8ms apart */
+	f.wire.attach(f.address, nullptr);
+	start = host::now();
+	CHECK_EQUAL(f.trill.reconnect(), 2);
+	elapsed = host::now() - start;
+	CHECK(elapsed >= 15000 && elapsed < 17000);
+#ifdef TRILL_ENABLE_STATS
+	CHECK_EQUAL(f.trill.getStats().retries, 4);
+#endif
+
+	/* Something else at the same address */
+	TrillSim bar(Trill::TRILL_BAR);
+	f.wire.attach(f.address, &bar);
+	CHECK_EQUAL(f.trill.reconnect(), -3);
+	CHECK_EQUAL(f.trill.deviceType(), Trill::TRILL_NONE);
+	f.wire.attach(f.address, nullptr);
+}
+
+/* A read that fails uses up the budget like one that succeeds */
+static void checkBusBudget()
+{
+	Fixture first(Trill::TRILL_BAR);
+	Fixture second(Trill::TRILL_SQUARE);
+	first.trill.setMode(Trill::CENTROID);
+	second.trill.setMode(Trill::CENTROID);
+	TrillBus bus;
+	bus.setPolicy(TrillBus::PRIORITY);
+	bus.add(first.trill, 1);
+	bus.add(second.trill, 0);
+	bus.setBudget(1000000);
+	CHECK_EQUAL(bus.update(), 2);
+	bus.setBudget(1);
+	delay(100);
+	first.wire.attach(first.address, nullptr);
+	CHECK_EQUAL(bus.update(), 0);
+	CHECK_EQUAL(bus.getNumErrors(0), 1);
+	CHECK_EQUAL(bus.getNumFrames(1), 1);
+	/* It is read next time, once the first one isn't due */
+	CHECK_EQUAL(bus.update(), 1);
+	CHECK_EQUAL(bus.getNumFrames(1), 2);
+}
+
+/* TrillBus reads every scan, with few repeats, whether getScanPeriod()
+   is too long or too short */
+static void checkBusSchedule()
+{
+	for(unsigned int slow = 0; slow < 2; ++slow) {
+		Fixture f(Trill::TRILL_BAR);
+		f.wire.setClock(400000);
+		f.sim.setNoise(20);
+		f.trill.setMode(Trill::CENTROID);
+		if(slow) {
+			/* Behind the back of the Trill, which still expects
+			   the period of the scan settings */
+			f.sim.autoScanInterval = 400;
+			CHECK(f.trill.getScanPeriod() < f.sim.getScanPeriod() / 2);
+		}
+		TrillBus bus;
+		bus.add(f.trill);
+		/* Let the period settle */
+		for(unsigned int n = 0; n < 1000; ++n) {
+			bus.update();
+			delayMicroseconds(100);
+		}
+		uint32_t firstScan = f.sim.getScanCount();
+		uint32_t lastScan = f.sim.getFrameScan();
+		uint32_t reads = bus.getNumFrames(0);
+		unsigned int missed = 0;
+		for(unsigned int n = 0; n < 10000; ++n) {
+			bus.update();
+			uint32_t scan = f.sim.getFrameScan();
+			if(scan != lastScan)
+				missed += scan - lastScan - 1;
+			lastScan = scan;
+			delayMicroseconds(100);
+		}
+		unsigned int scans = f.sim.getScanCount() - firstScan;
+		reads = bus.getNumFrames(0) - reads;
+		CHECK(scans > 50);
+		CHECK_EQUAL(missed, 0);
+		/* The device is tried again soon after a repeated frame */
+		CHECK(reads < scans * 2);
+		CHECK_EQUAL(bus.getNumErrors(0), 0);
+	}
+
+	/* The auto-scan interval doesn't overflow the estimate */
+	Fixture f(Trill::TRILL_BAR);
+	f.trill.setAutoScanInterval(65535);
+	CHECK_EQUAL(f.trill.getScanPeriod(), 65535UL * 1000000 / 32768);
+}
+
+#ifdef TRILL_ENABLE_STATS
+/* Collects what is printed to it */
+class StringPrint : public Print
+{
+public:
+	size_t write(uint8_t c) override {
+		text += (char)c;
+		return 1;
+	}
+	std::string text;
+};
+
+/* The statistics match the traffic seen on the bus */
+static void checkStats()
+{
+	Fixture f(Trill::TRILL_BAR);
+	f.trill.read(); // settle the read pointer
+	f.trill.resetStats();
+	f.wire.resetStats();
+	for(unsigned int n = 0; n < 10; ++n)
+		CHECK(f.trill.read());
+	const TrillStats& stats = f.trill.getStats();
+	CHECK_EQUAL(stats.transactions, f.wire.stats().transactions());
+	CHECK_EQUAL(stats.bytes_read, f.wire.stats().bytesRead);
+	CHECK_EQUAL(stats.transactions, 10);
+	CHECK_EQUAL(stats.seeks, 0);
+	CHECK_EQUAL(stats.frames, 10);
+	/* 20 bytes at 100kHz take about 1.9ms */
+	CHECK_EQUAL(stats.latency[3], 10);
+	CHECK(stats.max_latency_us >= 1024 && stats.max_latency_us < 2048);
+
+	/* Raw frames in 32-byte chunks need seeks */
+	f.trill.setMode(Trill::DIFF);
+	f.trill.resetStats();
+	f.wire.resetStats();
+	CHECK(f.trill.requestRawData());
+	CHECK(f.trill.startRead());
+	/* Virtual time only moves on when told to */
+	while(!f.trill.isReadComplete())
+		delayMicroseconds(100);
+	CHECK(f.trill.finishRead());
+	CHECK_EQUAL(stats.transactions, f.wire.stats().transactions());
+	CHECK_EQUAL(stats.bytes_written, f.wire.stats().bytesWritten);
+	CHECK_EQUAL(stats.bytes_read, f.wire.stats().bytesRead);
+	CHECK_EQUAL(stats.seeks, f.wire.stats().writeTransactions);
+	CHECK_EQUAL(stats.frames, 2);
+
+	f.trill.setMode(Trill::CENTROID);
+	f.wire.attach(f.address, nullptr);
+	CHECK(!f.trill.read());
+	CHECK_EQUAL(stats.failed_frames, 1);
+	CHECK_EQUAL(stats.short_reads, 1);
+
+	StringPrint out;
+	f.trill.dumpStats(out);
+	CHECK(out.text.find("frames: 2\r\n") != std::string::npos);
+	CHECK(out.text.find("latency >= 16384us: 0") != std::string::npos);
+	f.trill.resetStats();
+	CHECK_EQUAL(stats.transactions, 0);
+
+#ifdef TRILL_WIRE_HAS_ASYNC
+	/* A background transfer of a centroid frame that stops part way is a
+	   short read of what it got, and fails the frame */
+	ShortDevice shortDevice(f.sim, 10);
+	f.wire.attach(f.address, &shortDevice);
+	f.trill.setMode(Trill::CENTROID);
+	f.trill.resetStats();
+	CHECK(f.trill.startRead());
+	CHECK(!f.trill.finishRead());
+	CHECK_EQUAL(stats.short_reads, 1);
+	CHECK_EQUAL(stats.failed_frames, 1);
+	f.wire.attach(f.address, nullptr);
+#endif
+}
+#endif // TRILL_ENABLE_STATS
+
+static bool sameFrame(const TrillFrame& a, const TrillFrame& b)
+{
+	return a.timestamp_us == b.timestamp_us && a.tag == b.tag && a.mode == b.mode && a.num_touches == b.num_touches
+		&& a.num_horizontal_touches == b.num_horizontal_touches && a.length == b.length
+		&& !memcmp(a.data, b.data, a.length * sizeof(a.data[0]));
+}
+
+/* Whether decoded holds frames of recorded, in the same order, and ends
+   with the same frame */
+static bool isTailSubset(const std::vector<TrillFrame>& decoded, const std::vector<TrillFrame>& recorded)
+{
+	size_t n = 0;
+	for(const TrillFrame& frame : decoded) {
+		while(n < recorded.size() && !sameFrame(frame, recorded[n]))
+			++n;
+		if(n++ >= recorded.size())
+			return false;
+	}
+	return n == recorded.size();
+}
+
+/* What TrillRecorder writes decodes to the same frames, which replay
+   through the library unchanged */
+static void checkRecording()
+{
+	host::resetClock();
+	TwoWire wire;
+	TrillSim craftSim(Trill::TRILL_CRAFT);
+	TrillSim squareSim(Trill::TRILL_SQUARE);
+	craftSim.setNoise(20);
+	wire.attach(0x30, &craftSim);
+	wire.attach(0x28, &squareSim);
+	Trill craft;
+	Trill square;
+	craft.begin(Trill::TRILL_CRAFT, 0x30, &wire);
+	square.begin(Trill::TRILL_SQUARE, 0x28, &wire);
+
+	BufferPrint out;
+	TrillRecorder craftRecorder(out, 3);
+	TrillRecorder squareRecorder(out, 7, 16);
+	craftRecorder.begin(craft);
+	squareRecorder.begin(square);
+	std::vector<TrillFrame> frames;
+	size_t craftBytes = 0;
+	for(unsigned int n = 0; n < 200; ++n) {
+		/* Touches come and go, which changes the layout of the centroid
+		   frames */
+		const TrillSim::Touch touches[] = {
+			{ (uint16_t)(n * 20), (uint16_t)(3000 - n * 10), 1000 },
+			{ 1500, 1300, 900 },
+		};
+		craftSim.setTouches(touches, 1);
+		squareSim.setTouches(touches, n / 10 % 3);
+		TrillFrame frame;
+		CHECK(frame.read(craft, 3));
+		craftBytes += craftRecorder.write(frame);
+		frames.push_back(frame);
+		CHECK(frame.read(square, 7));
+		squareRecorder.write(frame);
+		frames.push_back(frame);
+		delay(5);
+	}
+	CHECK_EQUAL(craftRecorder.getBytesWritten() + squareRecorder.getBytesWritten(), out.bytes.size());
+	/* Noise of up to 20 takes one byte per channel, against five in
+	   ASCII */
+	CHECK(craftBytes < 200 * 40);
+
+	Recording recording;
+	std::string error;
+	CHECK(decodeRecording(out.bytes.data(), out.bytes.size(), recording, error));
+	CHECK_EQUAL(recording.sensors.size(), 2);
+	CHECK_EQUAL(recording.sensor(3)->device, Trill::TRILL_CRAFT);
+	CHECK_EQUAL(recording.sensor(7)->device, Trill::TRILL_SQUARE);
+	CHECK_EQUAL(recording.sensor(7)->firmware, squareSim.firmwareVersion);
+	CHECK_EQUAL(recording.frames.size(), frames.size());
+	unsigned int differences = 0;
+	for(size_t n = 0; n < frames.size() && n < recording.frames.size(); ++n)
+		differences += !sameFrame(frames[n], recording.frames[n]);
+	CHECK_EQUAL(differences, 0);
+
+	ReplayResult result = replayRecording(recording);
+	CHECK_EQUAL(result.frames, frames.size());
+	CHECK_EQUAL(result.mismatches, 0);
+	/* At least the touch on the Craft, plus some noise */
+	CHECK(result.touches >= 200);
+
+	/* A stream cut short is reported */
+	CHECK(!decodeRecording(out.bytes.data(), out.bytes.size() - 1, recording, error));
+	CHECK(!error.empty());
+	CHECK_EQUAL(recording.frames.size(), frames.size() - 1);
+
+	/* Lost bytes cost the frames up to the next keyframe of the
+	   sensor, even when they hold record letters */
+	std::vector<uint8_t> damaged = out.bytes;
+	const size_t middle = damaged.size() / 2;
+	damaged.erase(damaged.begin() + middle, damaged.begin() + middle + 5);
+	damaged[middle + 20] = TrillRecorder::kRecordKey;
+	CHECK(!decodeRecording(damaged.data(), damaged.size(), recording, error));
+	CHECK(recording.skipped > 0);
+	CHECK(recording.dropped > 0);
+	CHECK(recording.frames.size() < frames.size());
+	CHECK(recording.frames.size() > frames.size() / 2);
+	CHECK(isTailSubset(recording.frames, frames));
+	CHECK_EQUAL(recording.sensors.size(), 2);
+
+	/* A capture that starts part way picks both sensors up at their
+	   next keyframe after their sensor record */
+	CHECK(!decodeRecording(out.bytes.data() + middle, out.bytes.size() - middle, recording, error));
+	CHECK_EQUAL(recording.sensors.size(), 2);
+	CHECK(recording.frames.size() > frames.size() / 4);
+	CHECK(isTailSubset(recording.frames, frames));
+	wire.attach(0x30, nullptr);
+	wire.attach(0x28, nullptr);
+}
+
+/* A 1D frame of touches, as a CustomSlider would give them */
+struct TouchList : public Touches
+{
+	TouchList(std::initializer_list<uint16_t> list) {
+		num_touches = 0;
+		for(uint16_t location : list) {
+			locations[num_touches] = location;
+			sizeList[num_touches++] = 1000 + location / 10;
+		}
+		centroids = locations;
+		sizes = sizeList;
+	}
+	uint16_t locations[5];
+	uint16_t sizeList[5];
+};
+
+static unsigned int countEvents(const TrillTracker& tracker, uint8_t type)
+{
+	unsigned int count = 0;
+	for(uint8_t n = 0; n < tracker.getNumEvents(); ++n)
+		count += tracker.getEvent(n).type == type;
+	return count;
+}
+
+/* Fingers keep their IDs while others land and lift around them */
+static void checkTracker()
+{
+	TrillTracker tracker(256);
+	tracker.process(TouchList({ 1000 }));
+	CHECK_EQUAL(tracker.getNumEvents(), 1);
+	CHECK_EQUAL(tracker.getEvent(0).type, TrillTracker::DOWN);
+	const uint8_t first = tracker.getTouch(0).id;
+
+	/* A finger lands before it: it is now touch 1 */
+	tracker.process(TouchList({ 500, 1010 }));
+	CHECK_EQUAL(tracker.findTouch(first), 1);
+	CHECK_EQUAL(countEvents(tracker, TrillTracker::DOWN), 1);
+	CHECK_EQUAL(countEvents(tracker, TrillTracker::MOVE), 1);
+	CHECK_EQUAL(tracker.getEvent(0).type, TrillTracker::MOVE);
+	CHECK_EQUAL(tracker.getEvent(0).touch.location, 1010);
+	const uint8_t second = tracker.getTouch(0).id;
+	CHECK(second != first);
+
+	/* Nothing changed, nothing to report */
+	tracker.process(TouchList({ 500, 1010 }));
+	CHECK_EQUAL(tracker.getNumEvents(), 0);
+
+	/* The first one lifts, and the UP comes first */
+	tracker.process(TouchList({ 505 }));
+	CHECK_EQUAL(tracker.getNumEvents(), 2);
+	CHECK_EQUAL(tracker.getEvent(0).type, TrillTracker::UP);
+	CHECK_EQUAL(tracker.getEvent(0).touch.id, first);
+	CHECK_EQUAL(tracker.getEvent(0).touch.location, 1010);
+	CHECK_EQUAL(tracker.findTouch(first), -1);
+	CHECK_EQUAL(tracker.findTouch(second), 0);
+
+	/* Of two fingers, the one that stays is the closest to the touch
+	   left, even if the other one is within reach */
+	tracker.process(TouchList({ 500, 700 }));
+	const uint8_t third = tracker.getTouch(1).id;
+	tracker.process(TouchList({ 680 }));
+	CHECK_EQUAL(tracker.getNumEvents(), 2);
+	CHECK_EQUAL(tracker.getEvent(0).touch.id, second);
+	CHECK_EQUAL(tracker.getTouch(0).id, third);
+
+	/* Too far to be the same finger */
+	tracker.process(TouchList({ 3000 }));
+	CHECK_EQUAL(countEvents(tracker, TrillTracker::UP), 1);
+	CHECK_EQUAL(countEvents(tracker, TrillTracker::DOWN), 1);
+	CHECK(tracker.getTouch(0).id != third);
+
+	/* Five fingers land, then all lift */
+	tracker.process(TouchList({ 100, 700, 1300, 1900, 2500 }));
+	CHECK_EQUAL(countEvents(tracker, TrillTracker::DOWN), 5);
+	CHECK_EQUAL(countEvents(tracker, TrillTracker::UP), 1);
+	tracker.process(TouchList({}));
+	CHECK_EQUAL(countEvents(tracker, TrillTracker::UP), 5);
+	CHECK_EQUAL(tracker.getNumTouches(), 0);
+
+	/* On a Square, a finger lands before the first one, which then
+	   lifts. The firmware doesn't say which vertical touch goes with
+	   which horizontal one, so they don't cross */
+	Fixture f(Trill::TRILL_SQUARE);
+	f.trill.setMode(Trill::CENTROID);
+	TrillTracker square;
+	const TrillSim::Touch touches[] = {
+		{ 400, 400, 1500 },
+		{ 1200, 1300, 1500 },
+	};
+	f.sim.setTouches(touches + 1, 1);
+	delay(10);
+	CHECK(f.trill.read());
+	CHECK(square.update(f.trill));
+	CHECK_EQUAL(square.getNumEvents(), 1);
+	const uint8_t id = square.getTouch(0).id;
+	f.sim.setTouches(touches, 2);
+	delay(10);
+	CHECK(f.trill.read());
+	CHECK(square.update(f.trill));
+	CHECK_EQUAL(square.getNumTouches(), 2);
+	CHECK_EQUAL(square.findTouch(id), 1);
+	CHECK_EQUAL(countEvents(square, TrillTracker::DOWN), 1);
+	CHECK(square.getTouch(1).horizontal > square.getTouch(0).horizontal);
+	/* The same frame again */
+	CHECK(f.trill.read());
+	CHECK(!square.update(f.trill));
+	f.sim.setTouches(touches, 1);
+	delay(10);
+	CHECK(f.trill.read());
+	CHECK(square.update(f.trill));
+	CHECK_EQUAL(square.getNumEvents(), 1);
+	CHECK_EQUAL(square.getEvent(0).type, TrillTracker::UP);
+	CHECK_EQUAL(square.getEvent(0).touch.id, id);
+}
+
+/* On a Ring, a touch that goes across the end is the same touch,
+   whichever way it goes, and touches either side of the end are told
+   apart */
+static void checkRingTracker()
+{
+	TrillTracker ring;
+	ring.setRingLength(TrillTracker::kRingLength);
+	ring.process(TouchList({ 1000, 3570 }));
+	const uint8_t wrapping = ring.getTouch(1).id;
+	const uint8_t still = ring.getTouch(0).id;
+	/* Forwards through the end: it is now first along the ring */
+	ring.process(TouchList({ 10, 1000 }));
+	CHECK_EQUAL(ring.getNumEvents(), 1);
+	CHECK_EQUAL(ring.getEvent(0).type, TrillTracker::MOVE);
+	CHECK_EQUAL(ring.findTouch(wrapping), 0);
+	CHECK_EQUAL(ring.findTouch(still), 1);
+	/* and back */
+	ring.process(TouchList({ 1000, 3500 }));
+	CHECK_EQUAL(ring.getNumEvents(), 1);
+	CHECK_EQUAL(ring.getEvent(0).type, TrillTracker::MOVE);
+	CHECK_EQUAL(ring.findTouch(wrapping), 1);
+
+	/* Two touches either side of the end, one of them crossing it */
+	ring.reset();
+	ring.process(TouchList({ 50, 3530 }));
+	const uint8_t after = ring.getTouch(0).id;
+	const uint8_t before = ring.getTouch(1).id;
+	ring.process(TouchList({ 150, 3580 }));
+	CHECK_EQUAL(countEvents(ring, TrillTracker::MOVE), 2);
+	CHECK_EQUAL(ring.findTouch(after), 0);
+	CHECK_EQUAL(ring.findTouch(before), 1);
+	ring.process(TouchList({ 40, 250 }));
+	CHECK_EQUAL(countEvents(ring, TrillTracker::MOVE), 2);
+	CHECK_EQUAL(countEvents(ring, TrillTracker::DOWN), 0);
+	CHECK_EQUAL(ring.findTouch(before), 0);
+	CHECK_EQUAL(ring.findTouch(after), 1);
+
+	/* Without a ring length, crossing the end is a lift and a new touch */
+	TrillTracker bar;
+	bar.process(TouchList({ 3570 }));
+	bar.process(TouchList({ 10 }));
+	CHECK_EQUAL(countEvents(bar, TrillTracker::UP), 1);
+	CHECK_EQUAL(countEvents(bar, TrillTracker::DOWN), 1);
+
+	/* update() sets the ring length for a Ring */
+	Fixture f(Trill::TRILL_RING);
+	TrillTracker tracker;
+	const TrillSim::Touch touches[] = {
+		{ 3520, 0, 1500 },
+		{ 40, 0, 1500 },
+	};
+	f.sim.setTouches(touches, 1);
+	delay(10);
+	CHECK(f.trill.read());
+	CHECK(tracker.update(f.trill));
+	CHECK_EQUAL(tracker.getNumTouches(), 1);
+	const uint8_t id = tracker.getTouch(0).id;
+	f.sim.setTouches(touches + 1, 1);
+	delay(10);
+	CHECK(f.trill.read());
+	CHECK(tracker.update(f.trill));
+	CHECK_EQUAL(tracker.getNumEvents(), 1);
+	CHECK_EQUAL(tracker.getEvent(0).type, TrillTracker::MOVE);
+	CHECK_EQUAL(tracker.findTouch(id), 0);
+}
+
+/* With a Wire buffer large enough for a whole frame, raw frames come back
+   in a single transaction once the buffer size has been probed */
+static void checkMaxTransferLength()
+{
+	for(Trill::Device device : kDevices) {
+		Fixture f(device);
+		f.trill.setMode(Trill::DIFF);
+		CHECK_EQUAL(f.trill.getMaxTransferLength(), BUFFER_LENGTH);
+		CHECK_EQUAL(f.trill.probeMaxTransferLength(), BUFFER_LENGTH);
+
+		TwoWire wire;
+		wire.setBufferLength(128);
+		wire.attach(f.address, &f.sim);
+		Trill trill;
+		trill.begin(device, f.address, &wire);
+		trill.setMode(Trill::DIFF);
+		CHECK_EQUAL(trill.probeMaxTransferLength(), 60);
+		trill.requestRawData();
+		for(unsigned int n = 0; n < 5; ++n) {
+			wire.resetStats();
+			CHECK(trill.requestRawData());
+			CHECK_EQUAL(trill.rawDataAvailable(), f.sim.getNumChannels());
+			CHECK_EQUAL(wire.stats().transactions(), 1);
+		}
+		/* Other devices on the same bus reuse the result */
+		Trill other;
+		other.begin(device, f.address, &wire);
+		wire.resetStats();
+		CHECK_EQUAL(other.probeMaxTransferLength(), 60);
+		CHECK_EQUAL(wire.stats().transactions(), 0);
+	}
+
+	/* Cores with a small buffer still read whole centroid frames */
+	Fixture f(Trill::TRILL_SQUARE);
+	f.trill.setMaxTransferLength(10);
+	f.trill.setMode(Trill::CENTROID);
+	CHECK(f.trill.read());
+	CHECK_EQUAL(f.trill.getNumTouches(), 2);
+	CHECK_EQUAL(f.trill.getNumHorizontalTouches(), 2);
+}
+
+/* startRead()/finishRead() return the same data as read() and
+   requestRawData(). With background transfers startRead() takes no time */
+static void checkSplitPhaseRead()
+{
+	for(Trill::Device device : kDevices) {
+		Fixture f(device);
+		f.trill.setMode(Trill::CENTROID);
+		CHECK(f.trill.read());
+		unsigned int numTouches = f.trill.getNumTouches();
+		int location = f.trill.touchLocation(0);
+
+		uint64_t start = host::now();
+		CHECK(f.trill.startRead());
+		CHECK(!f.trill.startRead());
+#ifdef TRILL_WIRE_HAS_ASYNC
+		CHECK_EQUAL(host::now() - start, 0);
+		CHECK(!f.trill.isReadComplete());
+		delayMicroseconds(5000);
+#else
+		CHECK(host::now() > start);
+#endif
+		CHECK(f.trill.isReadComplete());
+		CHECK(f.trill.finishRead());
+		CHECK(!f.trill.finishRead());
+		CHECK_EQUAL(f.trill.getNumTouches(), numTouches);
+		CHECK_EQUAL(f.trill.touchLocation(0), location);
+
+		f.trill.setMode(Trill::RAW);
+		uint16_t frame[30];
+		unsigned int numChannels = f.trill.readRawFrame(frame, 30);
+		for(unsigned int n = 0; n < 3; ++n) {
+			f.wire.resetStats();
+			CHECK(f.trill.startRead());
+			while(!f.trill.isReadComplete())
+				delayMicroseconds(100);
+			CHECK(f.trill.finishRead());
+			CHECK_EQUAL(f.trill.rawDataAvailable(), numChannels);
+			for(unsigned int c = 0; c < numChannels; ++c)
+				CHECK_EQUAL(f.trill.rawDataRead(), frame[c]);
+			unsigned int chunks = (2 * numChannels + BUFFER_LENGTH - 1) / BUFFER_LENGTH;
+			CHECK_EQUAL(f.wire.stats().readTransactions, chunks);
+			CHECK_EQUAL(f.wire.stats().writeTransactions, chunks - 1);
+		}
+	}
+}
+
+#ifdef TRILL_WIRE_HAS_ASYNC
+/* A background read that fails, whether it doesn't start, doesn't
+   complete or is cut short, returns no frame, and the next read sets the
+   read pointer again */
+static void checkFailedBackgroundRead()
+{
+	Fixture f(Trill::TRILL_BAR);
+	f.trill.setMode(Trill::CENTROID);
+	CHECK(f.trill.read());
+	int location = f.trill.touchLocation(0);
+
+	/* The device goes away during the transfer */
+	CHECK(f.trill.startRead());
+	f.wire.attach(f.address, nullptr);
+	delayMicroseconds(5000);
+	CHECK(!f.trill.finishRead());
+	CHECK_EQUAL(f.trill.getNumTouches(), 0);
+	f.wire.attach(f.address, &f.sim);
+	f.wire.resetStats();
+	CHECK(f.trill.read());
+	CHECK_EQUAL(f.trill.touchLocation(0), location);
+	CHECK_EQUAL(f.wire.stats().writeTransactions, 1);
+
+	/* The transfer can't start, after a command moved the read pointer */
+	f.trill.updateBaseline();
+	f.wire.attach(f.address, nullptr);
+	CHECK(f.trill.startRead());
+	CHECK(!f.trill.finishRead());
+	f.wire.attach(f.address, &f.sim);
+	CHECK(f.trill.read());
+	CHECK_EQUAL(f.trill.touchLocation(0), location);
+
+	/* The transfer never completes: finishRead() gives up */
+	CHECK(f.trill.startRead());
+	f.wire.setStalled(true);
+	uint64_t start = host::now();
+	CHECK(!f.trill.finishRead());
+	CHECK(host::now() - start >= 20000);
+	f.wire.setStalled(false);
+	CHECK(f.trill.read());
+	CHECK_EQUAL(f.trill.touchLocation(0), location);
+
+	/* A centroid frame in several chunks, cut short after the first */
+	f.trill.setMaxTransferLength(8);
+	f.wire.resetStats();
+	CHECK(f.trill.startRead());
+	while(f.wire.stats().readTransactions < 2) {
+		CHECK(!f.trill.isReadComplete());
+		delayMicroseconds(10);
+	}
+	f.wire.attach(f.address, nullptr);
+	CHECK(!f.trill.finishRead());
+	CHECK_EQUAL(f.trill.getNumTouches(), 0);
+	f.wire.attach(f.address, &f.sim);
+	CHECK(f.trill.read());
+	CHECK_EQUAL(f.trill.touchLocation(0), location);
+
+	/* A raw frame in several chunks whose last channel is saturated at
+	   16 bits reads in full: only the end of a centroid frame tells a
+	   transfer cut short */
+	f.trill.setMaxTransferLength(BUFFER_LENGTH);
+	f.trill.setMode(Trill::DIFF);
+	f.trill.setScanSettings(TRILL_SPEED_NORMAL, 16);
+	const unsigned int last = f.sim.getNumChannels() - 1;
+	const TrillSim::Touch saturated = { (uint16_t)(last * 128 + 64), 0, 0xFFFF };
+	f.sim.setTouches(&saturated, 1);
+	delay(10);
+	CHECK(f.trill.startRead());
+	CHECK(f.trill.finishRead());
+	CHECK_EQUAL(f.trill.rawDataAvailable(), last + 1);
+	CHECK(f.trill.rawDataAvailable() * 2 > BUFFER_LENGTH);
+	uint16_t value = 0;
+	while(f.trill.rawDataAvailable() > 0)
+		value = f.trill.rawDataRead();
+	CHECK_EQUAL(value, 0xFFFF);
+}
+#endif
+
+/* Frames are read straight into a TrillHistory, and only new ones are
+   kept */
+static void checkHistory()
+{
+	{
+		Fixture f(Trill::TRILL_BAR);
+		TrillHistory<8, 16> history;
+		f.trill.setHistory(&history);
+		CHECK(f.trill.getHistory() == &history);
+		std::vector<int> locations;
+		TrillFrameHistory::Window early;
+		for(unsigned int n = 0; n < 20; ++n) {
+			const TrillSim::Touch touch = { (uint16_t)(200 + n * 100), 0, 1200 };
+			f.sim.setTouches(&touch, 1);
+			delay(10);
+			CHECK(f.trill.read());
+			CHECK(f.trill.isNewFrame());
+			locations.push_back(f.trill.touchLocation(0));
+			const TrillFrameHistory::Frame frame = history.frame(0);
+			/* The touches are read from the history */
+			CHECK(frame.data == f.trill.centroids);
+			CHECK_EQUAL(frame.mode, Trill::CENTROID);
+			CHECK_EQUAL(frame.length, 10);
+			CHECK_EQUAL(frame.num_touches, 1);
+			CHECK_EQUAL(frame.touchLocation(0), locations.back());
+			CHECK_EQUAL(frame.touchSize(0), f.trill.touchSize(0));
+			CHECK_EQUAL(frame.timestamp_us, micros());
+			if(n == 15)
+				early = history.window(4);
+		}
+		CHECK_EQUAL(history.getNumFrames(), 20);
+		CHECK_EQUAL(history.size(), 8);
+		CHECK_EQUAL(history.capacity(), 8);
+		for(unsigned int age = 0; age < history.size(); ++age)
+			CHECK_EQUAL(history.frame(age).touchLocation(0), locations[19 - age]);
+
+		TrillFrameHistory::Window w = history.window(4);
+		CHECK_EQUAL(w.size(), 4);
+		CHECK(w.isValid());
+		for(unsigned int n = 0; n < w.size(); ++n) {
+			CHECK_EQUAL(w[n].touchLocation(0), locations[16 + n]);
+			if(n)
+				CHECK(w[n].timestamp_us > w[n - 1].timestamp_us);
+		}
+		CHECK(w.getDuration() >= 30000);
+		CHECK_EQUAL(history.window(100).size(), 8);
+		/* A window keeps its frames as new ones come, until they are
+		   overwritten */
+		CHECK(early.isValid());
+		CHECK_EQUAL(early[0].touchLocation(0), locations[12]);
+
+		/* Reading the same scan again keeps nothing */
+		CHECK(f.trill.read());
+		CHECK(!f.trill.isNewFrame());
+		CHECK_EQUAL(history.getNumFrames(), 20);
+		CHECK_EQUAL(f.trill.touchLocation(0), locations.back());
+
+		/* Split-phase reads go to the history too */
+		const TrillSim::Touch touch = { 3000, 0, 1200 };
+		f.sim.setTouches(&touch, 1);
+		delay(10);
+		CHECK(f.trill.startRead());
+		while(!f.trill.isReadComplete())
+			delayMicroseconds(100);
+		CHECK(f.trill.finishRead());
+		CHECK_EQUAL(history.getNumFrames(), 21);
+		CHECK_EQUAL(history.frame(0).touchLocation(0), f.trill.touchLocation(0));
+		CHECK(!early.isValid());
+
+		history.clear();
+		CHECK_EQUAL(history.size(), 0);
+		CHECK_EQUAL(history.window(4).size(), 0);
+		f.trill.setHistory(nullptr);
+		delay(10);
+		f.sim.setTouches(nullptr, 0);
+		CHECK(f.trill.read());
+		CHECK_EQUAL(f.trill.getNumTouches(), 0);
+		CHECK_EQUAL(history.getNumFrames(), 0);
+	}
+	{
+		/* Both axes of a 2D frame */
+		Fixture f(Trill::TRILL_SQUARE);
+		TrillHistory<2, 16> history;
+		f.trill.setHistory(&history);
+		CHECK(f.trill.read());
+		const TrillFrameHistory::Frame frame = history.frame(0);
+		CHECK_EQUAL(frame.num_touches, f.trill.getNumTouches());
+		CHECK_EQUAL(frame.num_horizontal_touches, f.trill.getNumHorizontalTouches());
+		CHECK(frame.num_horizontal_touches > 0);
+		CHECK_EQUAL(frame.touchHorizontalLocation(0), f.trill.touchHorizontalLocation(0));
+		CHECK_EQUAL(frame.touchHorizontalSize(0), f.trill.touchHorizontalSize(0));
+	}
+	{
+		Fixture f(Trill::TRILL_CRAFT);
+		f.sim.setNoise(20);
+		f.trill.setMode(Trill::DIFF);
+		TrillHistory<4> history;
+		f.trill.setHistory(&history);
+		for(unsigned int n = 0; n < 6; ++n) {
+			delay(10);
+			if(n % 2)
+				CHECK(f.trill.requestRawData());
+			else {
+				CHECK(f.trill.startRead());
+				while(!f.trill.isReadComplete())
+					delayMicroseconds(100);
+				CHECK(f.trill.finishRead());
+			}
+			const TrillFrameHistory::Frame frame = history.frame(0);
+			CHECK_EQUAL(frame.mode, Trill::DIFF);
+			CHECK_EQUAL(frame.length, 30);
+			CHECK_EQUAL(f.trill.rawDataAvailable(), 30);
+			for(unsigned int c = 0; c < 30; ++c)
+				CHECK_EQUAL(f.trill.rawDataRead(), frame.data[c]);
+		}
+		CHECK_EQUAL(history.getNumFrames(), 6);
+
+		/* Frames that don't fit are read as without a history */
+		TrillHistory<4, 16> small;
+		f.trill.setHistory(&small);
+		delay(10);
+		CHECK(f.trill.requestRawData());
+		CHECK_EQUAL(f.trill.rawDataAvailable(), 30);
+		CHECK_EQUAL(small.getNumFrames(), 0);
+		delay(10);
+		CHECK(f.trill.requestRawChannels(4, 12));
+		CHECK_EQUAL(small.getNumFrames(), 1);
+		CHECK_EQUAL(small.frame(0).length, 12);
+		for(unsigned int c = 0; c < 12; ++c)
+			CHECK_EQUAL(f.trill.rawDataRead(), small.frame(0).data[c]);
+		/* readRawFrame() decodes into the array it is given */
+		uint16_t frame[30];
+		delay(10);
+		CHECK_EQUAL(f.trill.readRawFrame(frame, 30), 30);
+		CHECK_EQUAL(small.getNumFrames(), 1);
+	}
+}
+
+/* Gestures of a given type in a run */
+static std::vector<TrillGestures::Gesture> gesturesOf(const std::vector<TrillGestures::Gesture>& found, uint8_t type)
+{
+	std::vector<TrillGestures::Gesture> of;
+	for(const TrillGestures::Gesture& g : found)
+		if(g.type == type)
+			of.push_back(g);
+	return of;
+}
+
+static void checkGestures()
+{
+	TrillTracker tracker;
+	TrillGestures gestures;
+	std::vector<TrillGestures::Gesture> found;
+
+	/* A short touch is a tap, a long one nothing, on any device */
+	const Trill::Device kTapDevices[] = { Trill::TRILL_BAR, Trill::TRILL_RING, Trill::TRILL_SQUARE };
+	for(Trill::Device device : kTapDevices) {
+		found = runTrace(tapTrace(device, 1000, 100), tracker, gestures);
+		CHECK_EQUAL(found.size(), 1);
+		if(found.size()) {
+			CHECK_EQUAL(found[0].type, TrillGestures::TAP);
+			CHECK_EQUAL(found[0].value, 100);
+			CHECK(found[0].location >= 1000 && found[0].location <= 1008);
+		}
+		CHECK(runTrace(tapTrace(device, 1000, 400), tracker, gestures).empty());
+	}
+
+	/* 40 every 5ms is 8000 per second, either way */
+	const int kSteps[] = { 40, -40 };
+	for(int step : kSteps) {
+		found = runTrace(swipeTrace(Trill::TRILL_BAR, 1600, step, 20), tracker, gestures);
+		CHECK_EQUAL(found.size(), 1);
+		if(found.size()) {
+			CHECK_EQUAL(found[0].type, TrillGestures::SWIPE);
+			CHECK(found[0].value >= 200 * step - 100 && found[0].value <= 200 * step + 100);
+			CHECK_EQUAL(found[0].horizontalValue, 0);
+		}
+	}
+	found = runTrace(swipeTrace(Trill::TRILL_SQUARE, 300, 30, 30), tracker, gestures);
+	CHECK_EQUAL(found.size(), 1);
+	if(found.size()) {
+		CHECK_EQUAL(found[0].type, TrillGestures::SWIPE);
+		CHECK(found[0].value >= 5900 && found[0].value <= 6100);
+		CHECK(found[0].horizontalValue >= 5900 && found[0].horizontalValue <= 6100);
+	}
+	/* Too slow, or too short */
+	CHECK(runTrace(swipeTrace(Trill::TRILL_BAR, 500, 4, 150), tracker, gestures).empty());
+	CHECK(runTrace(swipeTrace(Trill::TRILL_BAR, 500, 60, 4), tracker, gestures).empty());
+	/* A swipe that stops before lifting isn't one */
+	GestureTrace stop = swipeTrace(Trill::TRILL_BAR, 500, 40, 20);
+	GestureFrame still = stop.frames[19];
+	for(unsigned int n = 0; n < 10; ++n) {
+		still.timestamp_us += kGestureFrameUs;
+		stop.frames.insert(stop.frames.begin() + 20 + n, still);
+	}
+	for(unsigned int n = 20; n < stop.frames.size(); ++n)
+		stop.frames[n].timestamp_us = n * kGestureFrameUs;
+	CHECK(runTrace(stop, tracker, gestures).empty());
+
+	/* Scrolling around a Ring, through the end of it, only once it
+	   can't be a tap */
+	found = runTrace(swipeTrace(Trill::TRILL_RING, 3400, 10, 60), tracker, gestures);
+	std::vector<TrillGestures::Gesture> scrolls = gesturesOf(found, TrillGestures::SCROLL);
+	CHECK_EQUAL(gestures.getScrollPosition(), 590);
+	CHECK(scrolls.size() > 40);
+	int32_t total = 0;
+	for(const TrillGestures::Gesture& g : scrolls)
+		total += g.value;
+	CHECK_EQUAL(total, 590);
+	if(scrolls.size())
+		CHECK(scrolls[0].value > 64 && scrolls[0].value <= 80);
+	CHECK(gesturesOf(found, TrillGestures::TAP).empty());
+	found = runTrace(swipeTrace(Trill::TRILL_RING, 100, -30, 40), tracker, gestures);
+	CHECK_EQUAL(gestures.getScrollPosition(), -1170);
+	/* Scrolling ends with the touch, not with a swipe */
+	CHECK(gesturesOf(found, TrillGestures::SWIPE).empty());
+	/* Not on a Bar */
+	found = runTrace(swipeTrace(Trill::TRILL_BAR, 500, 10, 60), tracker, gestures);
+	CHECK(gesturesOf(found, TrillGestures::SCROLL).empty());
+
+	/* Two fingers moving apart */
+	found = runTrace(pinchTrace(400, 1000, 0, 0, 31), tracker, gestures);
+	std::vector<TrillGestures::Gesture> pinches = gesturesOf(found, TrillGestures::PINCH);
+	total = 0;
+	for(const TrillGestures::Gesture& g : pinches) {
+		total += g.value;
+		CHECK(g.value >= 16);
+		CHECK(g.location >= 895 && g.location <= 905);
+	}
+	CHECK(total >= 590 && total <= 610);
+	CHECK(pinches.size() >= 20);
+	CHECK(gesturesOf(found, TrillGestures::ROTATE).empty());
+	/* Lifting two fingers isn't a tap or a swipe */
+	CHECK(gesturesOf(found, TrillGestures::TAP).empty());
+	CHECK(gesturesOf(found, TrillGestures::SWIPE).empty());
+	/* Together */
+	found = runTrace(pinchTrace(1000, 500, 30, 30, 20), tracker, gestures);
+	total = 0;
+	for(const TrillGestures::Gesture& g : gesturesOf(found, TrillGestures::PINCH))
+		total += g.value;
+	CHECK(total >= -510 && total <= -490);
+
+	/* And turning by a quarter of a turn each way, staying as far
+	   apart */
+	const double kTurns[] = { 90, -90 };
+	for(double turn : kTurns) {
+		GestureTrace trace = pinchTrace(800, 800, 20, 20 + turn, 40);
+		/* Keep the fingers down, to look at the totals */
+		trace.frames.resize(trace.frames.size() - 2);
+		found = runTrace(trace, tracker, gestures);
+		std::vector<TrillGestures::Gesture> rotations = gesturesOf(found, TrillGestures::ROTATE);
+		total = 0;
+		for(const TrillGestures::Gesture& g : rotations)
+			total += g.value;
+		const int32_t expected = turn > 0 ? 16384 : -16384;
+		CHECK(gestures.isPinching());
+		CHECK(gestures.getRotation() >= expected - 100 && gestures.getRotation() <= expected + 100);
+		CHECK(total > expected - 300 && total < expected + 300);
+		CHECK(rotations.size() >= 30);
+		CHECK(gestures.getPinchDistance() >= -8 && gestures.getPinchDistance() <= 8);
+		CHECK(gesturesOf(found, TrillGestures::PINCH).empty());
+	}
+}
+
+/* Filter a touch at location for a frame of 5ms, on a Bar */
+static void filterFrame(TrillTracker& tracker, TrillFilter& filter, std::initializer_list<uint16_t> locations, uint32_t& now)
+{
+	TrillTracker::Touch touches[TrillTracker::kMaxTouches];
+	uint8_t count = 0;
+	for(uint16_t location : locations) {
+		touches[count].location = location;
+		touches[count].horizontal = 0;
+		touches[count++].size = 1000;
+	}
+	tracker.process(touches, count, false);
+	now += 5000;
+	filter.process(tracker, now);
+}
+
+/* Frames it takes a filter to get within 5% of a step of 200, as far
+   as a touch can move in a frame and keep its ID */
+template <typename F>
+static unsigned int stepFrames(F filterStep)
+{
+	for(unsigned int n = 0; n < 100; ++n) {
+		int location = filterStep(n < 10 ? 1000 : 1200);
+		if(n >= 10 && location >= 1190 && location <= 1210)
+			return n - 10 + 1;
+	}
+	return 100;
+}
+
+/* Little lag on a step, little jitter when still, and each touch
+   filtered on its own */
+static void checkFilter()
+{
+	TrillTracker tracker;
+	TrillFilter filter;
+	uint32_t now = 0;
+
+	/* A touch starts where it lands */
+	filterFrame(tracker, filter, { 1000 }, now);
+	CHECK_EQUAL(filter.getNumTouches(), 1);
+	CHECK_EQUAL(filter.touchLocation(0), 1000);
+	CHECK_EQUAL(filter.touchSize(0), 1000);
+	CHECK_EQUAL(filter.touchId(0), tracker.getTouch(0).id);
+	CHECK_EQUAL(filter.getNumHorizontalTouches(), 0);
+
+	/* It settles on a step sooner than an average of 8 frames */
+	unsigned int frames = stepFrames([&](uint16_t location) {
+		filterFrame(tracker, filter, { location }, now);
+		return filter.touchLocation(0);
+	});
+	uint16_t window[8] = { 1000, 1000, 1000, 1000, 1000, 1000, 1000, 1000 };
+	unsigned int written = 0;
+	unsigned int averageFrames = stepFrames([&](uint16_t location) {
+		window[written++ % 8] = location;
+		unsigned int sum = 0;
+		for(uint16_t w : window)
+			sum += w;
+		return (int)(sum / 8);
+	});
+	CHECK_EQUAL(averageFrames, 8);
+	CHECK(frames <= 4);
+
+	/* A touch that stays put wobbles much less than the sensor */
+	uint32_t seed = 1;
+	int lowest = 0xFFFF;
+	int highest = 0;
+	for(unsigned int n = 0; n < 400; ++n) {
+		seed = seed * 1664525 + 1013904223;
+		filterFrame(tracker, filter, { (uint16_t)(1196 + (seed >> 16) % 9) }, now);
+		if(n < 200)
+			continue;
+		int location = filter.touchLocation(0);
+		if(location < lowest)
+			lowest = location;
+		if(location > highest)
+			highest = location;
+	}
+	CHECK(lowest >= 1198 && highest <= 1202);
+	CHECK(highest - lowest <= 2);
+
+	/* A finger lands before it: each keeps its own filter, and the new
+	   one starts without lag */
+	const uint8_t first = filter.touchId(0);
+	filterFrame(tracker, filter, { 300, 1200 }, now);
+	CHECK_EQUAL(filter.getNumTouches(), 2);
+	CHECK_EQUAL(filter.touchId(1), first);
+	CHECK(filter.touchLocation(1) >= 1198 && filter.touchLocation(1) <= 1202);
+	CHECK_EQUAL(filter.touchLocation(0), 300);
+	/* The first lifts */
+	filterFrame(tracker, filter, { 310 }, now);
+	CHECK_EQUAL(filter.getNumTouches(), 1);
+	CHECK(filter.touchId(0) != first);
+	CHECK(filter.touchLocation(0) >= 300 && filter.touchLocation(0) <= 310);
+
+	/* Both axes and the size on a Square */
+	filter.reset();
+	TrillTracker::Touch square;
+	square.location = 600;
+	square.horizontal = 1200;
+	square.size = 500;
+	tracker.process(&square, 1, true);
+	filter.process(tracker, now += 5000);
+	CHECK_EQUAL(filter.getNumHorizontalTouches(), 1);
+	CHECK_EQUAL(filter.touchHorizontalLocation(0), 1200);
+	for(unsigned int n = 0; n < 20; ++n) {
+		square.location = 800;
+		square.horizontal = 1000;
+		square.size = 1500;
+		tracker.process(&square, 1, true);
+		filter.process(tracker, now += 5000);
+	}
+	CHECK(filter.touchLocation(0) >= 790 && filter.touchLocation(0) <= 810);
+	CHECK(filter.touchHorizontalLocation(0) >= 990 && filter.touchHorizontalLocation(0) <= 1010);
+	CHECK(filter.touchSize(0) > 500 && filter.touchSize(0) <= 1500);
+	CHECK_EQUAL(filter.touchHorizontalSize(0), filter.touchSize(0));
+	tracker.process(&square, 0, true);
+	filter.process(tracker, now += 5000);
+	CHECK_EQUAL(filter.getNumTouches(), 0);
+	CHECK_EQUAL(filter.getNumHorizontalTouches(), 0);
+
+	/* Through a Trill and its tracker: after a step, the sensor sends
+	   the same frame until something changes, and the filter still
+	   settles on it */
+	Fixture f(Trill::TRILL_BAR);
+	const TrillSim::Touch steps[] = {
+		{ 1000, 0, 1500 },
+		{ 1200, 0, 1500 },
+	};
+	TrillTracker barTracker;
+	TrillFilter barFilter;
+	f.sim.setTouches(steps, 1);
+	for(unsigned int n = 0; n < 10; ++n) {
+		delay(5);
+		if(f.trill.read()) {
+			barTracker.update(f.trill);
+			barFilter.process(barTracker, micros());
+		}
+	}
+	f.sim.setTouches(steps + 1, 1);
+	unsigned int updates = 0;
+	for(unsigned int n = 0; n < 8; ++n) {
+		delay(5);
+		CHECK(f.trill.read());
+		updates += barTracker.update(f.trill);
+		barFilter.process(barTracker, micros());
+	}
+	CHECK(updates <= 2);
+	CHECK_EQUAL(barFilter.touchId(0), barTracker.getTouch(0).id);
+	int held = barTracker.getTouch(0).location;
+	CHECK(barFilter.touchLocation(0) >= held - 10 && barFilter.touchLocation(0) <= held + 10);
+}
+
+/* Changes of a parameter in the last process() */
+static int changeOf(const TrillParameterEmitter& emitter, int parameter)
+{
+	for(uint8_t n = 0; n < emitter.getNumChanges(); ++n)
+		if(emitter.getChange(n).parameter == parameter)
+			return emitter.getChange(n).value;
+	return -1;
+}
+
+/* Only changes are sent, past the deadband, within the rate limit */
+static void checkEmitter()
+{
+	typedef TrillParameterEmitter E;
+	TrillEmitter<3> emitter;
+	const int fine = emitter.addParameter(E::LOCATION, 0, 0, 3200, 14, 0, 32);
+	const int coarse = emitter.addParameter(E::LOCATION, 0, 0, 3200, 7, 1, 32);
+	CHECK_EQUAL(emitter.addParameter(E::SIZE, 0, 100, 100, 7), -1);
+	CHECK_EQUAL(emitter.addParameter(E::SIZE, 0, 0, 4096, 15), -1);
+	const int count = emitter.addParameter(E::NUM_TOUCHES, 0, 0, 5, 7, 1);
+	CHECK_EQUAL(fine, 0);
+	CHECK_EQUAL(coarse, 1);
+	CHECK_EQUAL(count, 2);
+	CHECK_EQUAL(emitter.addParameter(E::SIZE, 0, 0, 4096, 7), -1);
+	uint32_t now = 0;
+
+	/* Everything once at the start, then nothing until it changes */
+	CHECK_EQUAL(emitter.process(TouchList({}), now), 3);
+	CHECK_EQUAL(changeOf(emitter, fine), 0);
+	CHECK_EQUAL(emitter.process(TouchList({}), now += 7000), 0);
+	CHECK_EQUAL(emitter.process(TouchList({ 1600 }), now += 7000), 3);
+	CHECK_EQUAL(changeOf(emitter, fine), 8191);
+	CHECK_EQUAL(changeOf(emitter, coarse), 63);
+	CHECK_EQUAL(changeOf(emitter, count), 25);
+	CHECK_EQUAL(emitter.getChange(0).transport, 0);
+
+	/* A touch that wobbles, here across the edge of a 7-bit step */
+	for(unsigned int n = 0; n < 100; ++n) {
+		const uint16_t location = 1596 + n % 9;
+		CHECK_EQUAL(emitter.process(TouchList({ location }), now += 7000), 0);
+	}
+	/* Moving on is sent at once */
+	CHECK_EQUAL(emitter.process(TouchList({ 1700 }), now += 7000), 2);
+	CHECK_EQUAL(changeOf(emitter, fine), 8703);
+	CHECK_EQUAL(changeOf(emitter, coarse), 67);
+
+	/* The ends of the range get through any deadband */
+	emitter.setDeadband(fine, 400);
+	CHECK_EQUAL(emitter.process(TouchList({ 3180 }), now += 7000), 2);
+	CHECK_EQUAL(emitter.process(TouchList({ 3190 }), now += 7000), 0);
+	CHECK_EQUAL(emitter.process(TouchList({ 3300 }), now += 7000), 1);
+	CHECK_EQUAL(emitter.getValue(fine), 16383);
+	emitter.setDeadband(fine, 32);
+
+	/* 100 messages a second on transport 1, in bursts of 2: a touch
+	   moving every loop for a second is followed on transport 0, and as
+	   often as allowed on transport 1. The last move gets there too */
+	emitter.setRate(1, 100, 2);
+	unsigned int sent[2] = { 0, 0 };
+	for(unsigned int n = 0; n < 143; ++n) {
+		const uint16_t location = 100 + n * 20;
+		emitter.process(TouchList({ location }), now += 7000);
+		for(uint8_t c = 0; c < emitter.getNumChanges(); ++c)
+			++sent[emitter.getChange(c).transport];
+	}
+	CHECK_EQUAL(sent[0], 143);
+	CHECK(sent[1] >= 90 && sent[1] <= 103);
+	for(unsigned int n = 0; n < 3; ++n)
+		emitter.process(TouchList({ 2940 }), now += 7000);
+	CHECK_EQUAL(emitter.getValue(coarse), 117);
+	/* Two touches, then one: both parameters of transport 1 get their
+	   turn while it is busy */
+	for(unsigned int n = 0; n < 20; ++n) {
+		const uint16_t location = 2000 - n * 20;
+		emitter.process(TouchList({ 200, location }), now += 7000);
+	}
+	CHECK_EQUAL(emitter.getValue(count), 51);
+	CHECK_EQUAL(emitter.getValue(coarse), 7);
+	/* After a pause, a burst goes out at once */
+	emitter.process(TouchList({ 200 }), now += 100000);
+	CHECK_EQUAL(emitter.getNumChanges(), 1);
+	CHECK_EQUAL(changeOf(emitter, count), 25);
+	emitter.process(TouchList({ 1000 }), now += 7000);
+	CHECK_EQUAL(emitter.getNumChanges(), 2);
+
+	/* A touch that lifts goes to the bottom of the range, once */
+	CHECK_EQUAL(emitter.process(TouchList({}), now += 100000), 3);
+	CHECK_EQUAL(emitter.getValue(fine), 0);
+	CHECK_EQUAL(emitter.process(TouchList({}), now += 7000), 0);
+	emitter.resend();
+	CHECK_EQUAL(emitter.process(TouchList({}), now += 100000), 3);
+
+	/* Both axes of a 2D sensor */
+	TrillEmitter<2> square;
+	const int x = square.addParameter(E::HORIZONTAL_LOCATION, 0, 256, 1792, 14);
+	const int y = square.addParameter(E::LOCATION, 0, 256, 1792, 14);
+	TrillTracker tracker;
+	TrillFilter filter;
+	TrillTracker::Touch touch;
+	touch.location = 1024;
+	touch.horizontal = 1792;
+	touch.size = 1000;
+	tracker.process(&touch, 1, true);
+	filter.process(tracker, now);
+	CHECK_EQUAL(square.process(filter, now), 2);
+	CHECK_EQUAL(square.getValue(x), 16383);
+	CHECK_EQUAL(square.getValue(y), 8191);
+}
+
+/* TrillDevice gives the same results as Trill, with the same traffic */
+template <Trill::Device D>
+static void checkTrillDevice()
+{
+	Fixture f(D);
+	CHECK_EQUAL(Trill::getDefaults(D).device, D);
+	CHECK_EQUAL(Trill::getDefaults(D).mode, TrillTraits<D>::defaultMode);
+	CHECK_EQUAL(Trill::getDefaults(D).address, TrillTraits<D>::defaultAddress);
+	CHECK_EQUAL(TrillTraits<D>::defaultAddress, f.address);
+	f.trill.setMode(Trill::CENTROID);
+	f.trill.read();
+	TrillDevice<D, Trill::CENTROID> centroid;
+	CHECK_EQUAL(centroid.begin(f.address, &f.wire), 0);
+	f.trill.read();
+	centroid.read();
+	f.wire.resetStats();
+	CHECK(f.trill.read());
+	unsigned int trillTransactions = f.wire.stats().transactions();
+	f.wire.resetStats();
+	CHECK(centroid.read());
+	CHECK_EQUAL(f.wire.stats().transactions(), trillTransactions);
+	CHECK_EQUAL(centroid.getNumTouches(), f.trill.getNumTouches());
+	for(unsigned int n = 0; n < f.trill.getNumTouches(); ++n) {
+		CHECK_EQUAL(centroid.touchLocation(n), f.trill.touchLocation(n));
+		CHECK_EQUAL(centroid.touchSize(n), f.trill.touchSize(n));
+	}
+
+	f.trill.setMode(Trill::RAW);
+	TrillDevice<D, Trill::RAW> raw;
+	CHECK_EQUAL(raw.begin(f.address, &f.wire), 0);
+	uint16_t expected[30];
+	CHECK_EQUAL(f.trill.readRawFrame(expected, 30), raw.getNumChannels());
+	CHECK(raw.requestRawData());
+	CHECK_EQUAL(raw.rawDataAvailable(), raw.getNumChannels());
+	CHECK(0 == memcmp(raw.rawData(), expected, raw.getNumChannels() * sizeof(expected[0])));
+	CHECK_EQUAL(raw.rawDataRead(), expected[0]);
+
+	/* beginAsync() doesn't wait for the device, and poll() gets to the
+	   same result as begin() in the same time */
+	TrillDevice<D, Trill::CENTROID> async;
+	CHECK_EQUAL(async.poll(), Trill::kBeginNotStarted);
+	uint64_t start = host::now();
+	CHECK_EQUAL(centroid.begin(f.address, &f.wire), 0);
+	uint64_t blocking = host::now() - start;
+	start = host::now();
+	CHECK_EQUAL(async.beginAsync(f.address, &f.wire), Trill::kBeginInProgress);
+	CHECK(host::now() - start < 1000);
+	int ret;
+	while(Trill::kBeginInProgress == (ret = async.poll()))
+		delayMicroseconds(100);
+	CHECK_EQUAL(ret, 0);
+	CHECK(host::now() - start >= blocking - 1000);
+	CHECK(host::now() - start <= blocking + 1000);
+	CHECK(centroid.read());
+	CHECK(async.read());
+	CHECK_EQUAL(async.touchLocation(0), centroid.touchLocation(0));
+
+	/* The wrong device is refused */
+	const Trill::Device other = D == Trill::TRILL_BAR ? Trill::TRILL_FLEX : Trill::TRILL_BAR;
+	TrillDevice<other> wrong;
+	CHECK_EQUAL(wrong.begin(f.address, &f.wire), -3);
+}
+
+static void checkTrillDevices()
+{
+	checkTrillDevice<Trill::TRILL_BAR>();
+	checkTrillDevice<Trill::TRILL_SQUARE>();
+	checkTrillDevice<Trill::TRILL_CRAFT>();
+	checkTrillDevice<Trill::TRILL_RING>();
+	checkTrillDevice<Trill::TRILL_HEX>();
+	checkTrillDevice<Trill::TRILL_FLEX>();
+	CHECK_EQUAL(Trill::getDefaults(Trill::TRILL_CRAFT).mode, Trill::DIFF);
+	CHECK_EQUAL(Trill::getDefaults(Trill::TRILL_RING).mode, Trill::CENTROID);
+	CHECK_EQUAL(Trill::getDefaults(Trill::TRILL_UNKNOWN).mode, Trill::AUTO);
+	CHECK_EQUAL(Trill::getDefaults(Trill::TRILL_NONE).address, 0xFF);
+}
+
+/* beginAsync() and poll() fail the way begin() does, and the failure
+   sticks until the next beginAsync(), with no device identified */
+static void checkBeginErrors()
+{
+	Fixture f(Trill::TRILL_SQUARE);
+	Trill trill;
+	CHECK_EQUAL(trill.poll(), Trill::kBeginNotStarted);
+	CHECK_EQUAL(trill.deviceType(), Trill::TRILL_NONE);
+
+	/* No address given and no default address to fall back on: nothing
+	   is sent */
+	f.wire.resetStats();
+	CHECK_EQUAL(trill.beginAsync(Trill::TRILL_UNKNOWN, 255, &f.wire), -2);
+	CHECK_EQUAL(trill.poll(), -2);
+	CHECK_EQUAL(trill.beginAsync(Trill::TRILL_NONE, 255, &f.wire), -2);
+	CHECK_EQUAL(trill.poll(), -2);
+	CHECK_EQUAL(f.wire.stats().transactions(), 0);
+	CHECK_EQUAL(trill.deviceType(), Trill::TRILL_NONE);
+
+	/* Nothing acks the identify command */
+	const uint8_t kEmpty = 0x38;
+	CHECK_EQUAL(trill.beginAsync(Trill::TRILL_SQUARE, kEmpty, &f.wire), 2);
+	CHECK_EQUAL(trill.poll(), 2);
+	CHECK_EQUAL(trill.deviceType(), Trill::TRILL_NONE);
+
+	/* The device goes away before its identity is read */
+	CHECK_EQUAL(trill.beginAsync(Trill::TRILL_SQUARE, f.address, &f.wire), Trill::kBeginInProgress);
+	f.wire.attach(f.address, nullptr);
+	int ret;
+	while(Trill::kBeginInProgress == (ret = trill.poll()))
+		delayMicroseconds(100);
+	CHECK_EQUAL(ret, 2);
+	CHECK_EQUAL(trill.poll(), 2);
+	CHECK_EQUAL(trill.deviceType(), Trill::TRILL_NONE);
+	f.wire.attach(f.address, &f.sim);
+
+	/* Another type of device answers: it is left in the mode it was in */
+	unsigned int commands = f.sim.commandsReceived;
+	CHECK_EQUAL(trill.beginAsync(Trill::TRILL_BAR, f.address, &f.wire), Trill::kBeginInProgress);
+	while(Trill::kBeginInProgress == (ret = trill.poll()))
+		delayMicroseconds(100);
+	CHECK_EQUAL(ret, -3);
+	CHECK_EQUAL(trill.poll(), -3);
+	CHECK_EQUAL(trill.deviceType(), Trill::TRILL_NONE);
+	CHECK_EQUAL(f.sim.commandsReceived, commands + 1);
+
+	/* A Trill that was running forgets its device when begun again
+	   somewhere empty */
+	CHECK_EQUAL(f.trill.deviceType(), Trill::TRILL_SQUARE);
+	CHECK_EQUAL(f.trill.beginAsync(Trill::TRILL_SQUARE, kEmpty, &f.wire), 2);
+	CHECK_EQUAL(f.trill.deviceType(), Trill::TRILL_NONE);
+	CHECK_EQUAL(f.trill.firmwareVersion(), 0);
+
+	/* None of this stops the right device from starting afterwards */
+	CHECK_EQUAL(trill.beginAsync(Trill::TRILL_SQUARE, f.address, &f.wire), Trill::kBeginInProgress);
+	while(Trill::kBeginInProgress == (ret = trill.poll()))
+		delayMicroseconds(100);
+	CHECK_EQUAL(ret, 0);
+	CHECK_EQUAL(trill.deviceType(), Trill::TRILL_SQUARE);
+	CHECK(trill.read());
+	CHECK_EQUAL(trill.getNumTouches(), 2);
+}
+
+/* A frame of touches with random sizes and shapes, some of them close
+   enough to need splitting at a trough */
+static void randomFrame(uint16_t* frame, unsigned int numPads, uint32_t& seed)
+{
+	memset(frame, 0, numPads * sizeof(frame[0]));
+	unsigned int numBumps = (seed = seed * 1664525 + 1013904223) >> 30;
+	for(unsigned int b = 0; b <= numBumps; ++b) {
+		seed = seed * 1664525 + 1013904223;
+		unsigned int centre = (seed >> 8) % numPads;
+		unsigned int width = 1 + (seed >> 16) % 3;
+		unsigned int height = 100 + (seed >> 20) % 3000;
+		for(unsigned int n = 0; n < numPads; ++n) {
+			unsigned int distance = n > centre ? n - centre : centre - n;
+			if(distance < width)
+				frame[n] += height * (width - distance) / width;
+		}
+	}
+}
+
+/* CustomSliders, which runs calculateCentroids() on the pads where they
+   are in the frame, finds the same touches as one CustomSlider per
+   slider, which copies them out first, for any number of touches,
+   minimum size and division */
+template <uint8_t maxNumCentroids>
+static void checkCustomSliders(uint16_t minSize, bool divisionFree, uint32_t seed)
+{
+	static uint8_t pads0[] = { 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 };
+	static uint8_t pads1[] = { 10, 11, 12, 13, 14, 15, 16, 17, 18, 19 };
+	static uint8_t pads2[] = { 23, 21, 29, 20, 22 };
+	CustomSliders<maxNumCentroids, TrillPadRange<9, 10, -1>, TrillPadRange<10, 10>, TrillPadList<23, 21, 29, 20, 22>> sliders;
+	CentroidDetection<maxNumCentroids, 30> expected[3];
+	expected[0].setup(pads0, sizeof(pads0));
+	expected[1].setup(pads1, sizeof(pads1));
+	expected[2].setup(pads2, sizeof(pads2));
+	for(unsigned int n = 0; n < 3; ++n) {
+		expected[n].setMinimumTouchSize(minSize);
+		expected[n].setDivisionFree(divisionFree);
+	}
+	sliders.setMinimumTouchSize(minSize);
+	sliders.setDivisionFree(divisionFree);
+	for(unsigned int f = 0; f < 2000; ++f) {
+		uint16_t frame[30];
+		randomFrame(frame, 30, seed);
+		sliders.process(frame);
+		for(unsigned int n = 0; n < 3; ++n) {
+			expected[n].process(frame);
+			CHECK_EQUAL(sliders[n].getNumTouches(), expected[n].getNumTouches());
+			for(unsigned int t = 0; t < expected[n].getNumTouches(); ++t) {
+				CHECK_EQUAL(sliders[n].touchLocation(t), expected[n].touchLocation(t));
+				CHECK_EQUAL(sliders[n].touchSize(t), expected[n].touchSize(t));
+			}
+		}
+	}
+}
+
+static void checkCustomSliders()
+{
+	const uint16_t minSizes[] = { 0, 150, 1000 };
+	uint32_t seed = 1;
+	for(unsigned int divisionFree = 0; divisionFree < 2; ++divisionFree) {
+		for(uint16_t minSize : minSizes) {
+			checkCustomSliders<1>(minSize, divisionFree, seed++);
+			checkCustomSliders<3>(minSize, divisionFree, seed++);
+			checkCustomSliders<5>(minSize, divisionFree, seed++);
+		}
+	}
+}
+
+/* trillDivide() gives the same quotient as a division, for every
+   divisor and a spread of dividends that includes the edge cases */
+static void checkDivisionFree()
+{
+	/* A few results worked out by hand */
+	const struct { uint16_t dividend, divisor; uint8_t shift; uint32_t quotient; } golden[] = {
+		{ 0, 1, 7, 0 },
+		{ 1, 1, 7, 128 },
+		{ 65535, 1, 7, 8388480 },
+		{ 65535, 65535, 7, 128 },
+		{ 1, 3, 7, 42 },
+		{ 2800, 2400, 7, 149 },
+		{ 32767, 32768, 15, 32767 },
+		{ 12345, 678, 0, 18 },
+	};
+	for(const auto& g : golden)
+		CHECK_EQUAL(trillDivide(g.dividend, g.divisor, g.shift), g.quotient);
+
+	unsigned int mismatches = 0;
+	uint32_t seed = 1;
+	for(uint32_t divisor = 1; divisor <= 0xFFFF; ++divisor) {
+		const uint16_t edges[] = {
+			0, 1, (uint16_t)(divisor - 1), (uint16_t)divisor, (uint16_t)(divisor + 1),
+			(uint16_t)(2 * divisor - 1), (uint16_t)(30 * divisor), 0x7FFF, 0x8000, 0xFFFF,
+		};
+		for(uint16_t dividend : edges)
+			mismatches += trillDivide(dividend, divisor, 7) != ((uint32_t)dividend << 7) / divisor;
+		for(unsigned int n = 0; n < 8; ++n) {
+			seed = seed * 1664525 + 1013904223;
+			uint16_t dividend = seed >> 16;
+			uint8_t shift = seed & 15;
+			mismatches += trillDivide(dividend, divisor, shift) != ((uint32_t)dividend << shift) / divisor;
+		}
+	}
+	/* Every dividend, for small divisors and for powers of two */
+	const uint16_t divisors[] = { 1, 2, 3, 5, 7, 127, 255, 256, 1023, 1024, 4097, 32767, 32768, 65535 };
+	for(uint16_t divisor : divisors) {
+		for(uint32_t dividend = 0; dividend <= 0xFFFF; ++dividend)
+			mismatches += trillDivide(dividend, divisor, 7) != (dividend << 7) / divisor;
+	}
+	CHECK_EQUAL(mismatches, 0);
+
+	/* Whole frames give the same touches either way */
+	CentroidDetection<5, 30> divided;
+	CentroidDetection<5, 30> divisionFree;
+	divided.setup(nullptr, 30);
+	divisionFree.setup(nullptr, 30);
+	divisionFree.setDivisionFree(true);
+	for(unsigned int f = 0; f < 1000; ++f) {
+		uint16_t frame[30];
+		randomFrame(frame, 30, seed);
+		divided.process(frame);
+		divisionFree.process(frame);
+		CHECK_EQUAL(divisionFree.getNumTouches(), divided.getNumTouches());
+		for(unsigned int t = 0; t < divided.getNumTouches(); ++t)
+			CHECK_EQUAL(divisionFree.touchLocation(t), divided.touchLocation(t));
+	}
+}
+
+/* With the EVT pin, readIfReady() reads each scan once, soon after it
+   ends; without it, about once per estimated scan period */
+static void checkEventPin()
+{
+	for(unsigned int useEvt = 0; useEvt < 2; ++useEvt) {
+		host::resetPins();
+		Fixture f(Trill::TRILL_BAR);
+		/* So that a read is shorter than a scan */
+		f.wire.setClock(400000);
+		const int kPin = 5;
+		if(useEvt) {
+			f.sim.setEventPin(kPin);
+			CHECK(f.trill.setEventPin(kPin));
+			CHECK_EQUAL(f.trill.getEventPin(), kPin);
+		}
+		f.trill.readIfReady();
+		uint32_t firstScan = f.sim.getScanCount();
+		unsigned int reads = 0;
+		unsigned int repeated = 0;
+		uint32_t lastScan = firstScan;
+		uint64_t maxLatency = 0;
+		for(unsigned int n = 0; n < 2000; ++n) {
+			if(f.trill.readIfReady()) {
+				++reads;
+				CHECK(!f.trill.isFramePending());
+				uint32_t scan = f.sim.getScanCount();
+				repeated += scan == lastScan;
+				lastScan = scan;
+				uint64_t latency = host::now() - f.sim.getLastScanTime();
+				if(latency > maxLatency)
+					maxLatency = latency;
+			}
+			delayMicroseconds(100);
+		}
+		unsigned int scans = f.sim.getScanCount() - firstScan;
+		CHECK(reads <= scans);
+		/* The estimate drifts behind the scans a little */
+		CHECK(reads >= scans * 9 / 10);
+		if(useEvt) {
+			CHECK_EQUAL(reads, scans);
+			CHECK_EQUAL(repeated, 0);
+			CHECK_EQUAL(host::interruptCount(), scans);
+			/* Read within one loop iteration plus the transfer */
+			CHECK(maxLatency < 100 + 1000);
+		}
+		f.trill.setEventPin(-1);
+	}
+
+	/* Pins without an interrupt, and running out of handlers */
+	host::resetPins();
+	Trill trills[Trill::kMaxEventPins + 1];
+	CHECK(!trills[0].setEventPin(host::kNumPins));
+	for(unsigned int n = 0; n < Trill::kMaxEventPins; ++n)
+		CHECK(trills[n].setEventPin(n));
+	CHECK(!trills[Trill::kMaxEventPins].setEventPin(10));
+	CHECK(trills[0].setEventPin(-1));
+	CHECK(trills[Trill::kMaxEventPins].setEventPin(10));
+	host::setPin(10, true);
+	CHECK(trills[Trill::kMaxEventPins].isFramePending());
+	CHECK(!trills[1].isFramePending() || trills[1].getEventPin() < 0);
+}
+
+/* Polling faster than the sensor scans gives frames that are reported
+   as not new, and counted */
+static void checkStaleFrames()
+{
+	const Trill::Mode kModes[] = { Trill::CENTROID, Trill::DIFF };
+	for(Trill::Mode mode : kModes) {
+		Fixture f(Trill::TRILL_BAR);
+		f.wire.setClock(400000);
+		/* Read whole frames in one transaction, so that none is made of
+		   two scans */
+		f.wire.setBufferLength(64);
+		f.trill.setMaxTransferLength(64);
+		f.sim.setNoise(20);
+		f.trill.setMode(mode);
+		f.trill.setScanSettings(TRILL_SPEED_SLOW, 12);
+		CHECK(Trill::CENTROID == mode ? f.trill.read() : f.trill.requestRawData());
+		f.trill.resetReadCounters();
+		uint32_t lastScan = f.sim.getScanCount();
+		unsigned int repeated = 0;
+		unsigned int reported = 0;
+		const unsigned int kReads = 500;
+		for(unsigned int n = 0; n < kReads; ++n) {
+			CHECK(Trill::CENTROID == mode ? f.trill.read() : f.trill.requestRawData());
+			uint32_t scan = f.sim.getScanCount();
+			repeated += scan == lastScan;
+			reported += !f.trill.isNewFrame();
+			lastScan = scan;
+			delayMicroseconds(100);
+		}
+		CHECK(repeated > kReads / 2);
+		CHECK_EQUAL(reported, repeated);
+		CHECK_EQUAL(f.trill.getNumReads(), kReads);
+		CHECK_EQUAL(f.trill.getNumStaleReads(), repeated);
+	}
+
+	/* Without noise or changes in the touches, every centroid frame is
+	   the same */
+	Fixture f(Trill::TRILL_BAR);
+	f.trill.setMode(Trill::CENTROID);
+	CHECK(f.trill.read());
+	CHECK(f.trill.isNewFrame());
+	delay(10);
+	CHECK(f.trill.read());
+	CHECK(!f.trill.isNewFrame());
+
+	/* CentroidDetection skips the frames it has just processed */
+	CentroidDetection<5, 30> cd;
+	cd.setup(nullptr, 30);
+	uint16_t frame[30] = { 0 };
+	frame[4] = 1000;
+	frame[5] = 2000;
+	CHECK(cd.process(frame));
+	CHECK(!cd.process(frame));
+	CHECK_EQUAL(cd.getNumTouches(), 1);
+	cd.setMinimumTouchSize(5000);
+	CHECK(cd.process(frame));
+	CHECK_EQUAL(cd.getNumTouches(), 0);
+	frame[5] = 1999;
+	CHECK(cd.process(frame));
+
+	/* Changes that keep sums and weighted sums the same, as a Fletcher
+	   checksum would have missed, still make a new frame */
+	cd.setMinimumTouchSize(0);
+	for(unsigned int n = 2; n < 10; ++n)
+		frame[n] = 1000 + 100 * n;
+	CHECK(cd.process(frame));
+	const int kDeltas[][4] = {
+		{ 100, -200, 100, 0 },	/* Equally spaced words, 2 apart */
+		{ 1, -1, -1, 1 },	/* Adjacent words */
+	};
+	const unsigned int kSpacing[] = { 2, 1 };
+	for(unsigned int d = 0; d < 2; ++d) {
+		for(unsigned int n = 0; n < 4; ++n)
+			frame[2 + n * kSpacing[d]] += kDeltas[d][n];
+		CHECK(cd.process(frame));
+		CHECK(!cd.process(frame));
+	}
+	CentroidDetection<5, 30> reference;
+	reference.setup(nullptr, 30);
+	CHECK(reference.process(frame));
+	CHECK_EQUAL(cd.touchLocation(0), reference.touchLocation(0));
+	CHECK_EQUAL(cd.touchSize(0), reference.touchSize(0));
+
+	/* The same goes for the frames Trill reads */
+	LastFrame last;
+	uint16_t words[16] = { 0 };
+	for(unsigned int n = 3; n < 7; ++n)
+		words[n] = 500;
+	CHECK(last.update(words, 16));
+	CHECK(!last.update(words, 16));
+	words[3] += 1;
+	words[4] -= 1;
+	words[5] -= 1;
+	words[6] += 1;
+	CHECK(last.update(words, 16));
+	CHECK(!last.update(words, 16));
+	CHECK(last.update(words, 15));
+}
+
+int main()
+{
+	checkRawTransactions();
+	checkReadTransactions();
+	checkRawContent();
+	checkRawChannels();
+	checkScanBus();
+	checkSettings();
+	checkReconnect();
+	checkBusBudget();
+	checkBusSchedule();
+#ifdef TRILL_ENABLE_STATS
+	checkStats();
+#endif
+	checkMaxTransferLength();
+	checkSplitPhaseRead();
+#ifdef TRILL_WIRE_HAS_ASYNC
+	checkFailedBackgroundRead();
+#endif
+	checkRecording();
+	checkTracker();
+	checkRingTracker();
+	checkHistory();
+	checkGestures();
+	checkFilter();
+	checkEmitter();
+	checkTrillDevices();
+	checkBeginErrors();
+	checkCustomSliders();
+	checkDivisionFree();
+	checkEventPin();
+	checkStaleFrames();
+	if(gFailures) {
+		printf("%u checks failed\n", gFailures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,92 @@
+/*
+ * Replays a session recorded with TrillRecorder through the library, as
+ * fast as possible: every frame is served by a simulated device over
+ * the host TwoWire, read back with the library and, if differential,
+ * run through CentroidDetection.
+ *
+ *   trill-replay <file>             replay a recording
+ *   trill-replay --record <file>    record a synthetic session from the
+ *                                   simulator, to try things out
+ *
+ * BSD license
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "Recording.h"
+#include "TrillSim.h"
+
+/* Ten seconds of a Craft in DIFF mode and a Bar in CENTROID mode, with
+   a touch sweeping across each */
+static bool recordSession(const char* path)
+{
+	host::resetClock();
+	TwoWire wire;
+	TrillSim craftSim(Trill::TRILL_CRAFT);
+	TrillSim barSim(Trill::TRILL_BAR);
+	craftSim.setNoise(20);
+	barSim.setNoise(20);
+	wire.attach(0x30, &craftSim);
+	wire.attach(0x20, &barSim);
+	Trill craft;
+	Trill bar;
+	craft.begin(Trill::TRILL_CRAFT, 0x30, &wire);
+	bar.begin(Trill::TRILL_BAR, 0x20, &wire);
+
+	BufferPrint out;
+	TrillRecorder craftRecorder(out, 0);
+	TrillRecorder barRecorder(out, 1);
+	craftRecorder.begin(craft);
+	barRecorder.begin(bar);
+	const unsigned int kFrames = 1000;
+	for(unsigned int n = 0; n < kFrames; ++n) {
+		const TrillSim::Touch touch = { (uint16_t)(n * 30 * 128 / kFrames), 0, 1200 };
+		craftSim.setTouches(&touch, n % 200 < 150);
+		barSim.setTouches(&touch, n % 100 < 70);
+		craftRecorder.record(craft);
+		barRecorder.record(bar);
+		delay(10);
+	}
+	wire.attach(0x30, nullptr);
+	wire.attach(0x20, nullptr);
+
+	FILE* file = fopen(path, "wb");
+	if(!file || fwrite(out.bytes.data(), 1, out.bytes.size(), file) != out.bytes.size()) {
+		printf("can't write %s\n", path);
+		if(file)
+			fclose(file);
+		return false;
+	}
+	fclose(file);
+	printf("wrote %u frames, %zu bytes, to %s\n", 2 * kFrames, out.bytes.size(), path);
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if(argc == 3 && !strcmp(argv[1], "--record"))
+		return recordSession(argv[2]) ? 0 : 1;
+	if(argc != 2) {
+		printf("usage: %s <file> | --record <file>\n", argv[0]);
+		return 1;
+	}
+
+	Recording recording;
+	std::string error;
+	if(!readRecording(argv[1], recording, error)) {
+		printf("%s: %s\n", argv[1], error.c_str());
+		/* The rest of a stream that lost bytes still replays */
+		if(recording.frames.empty())
+			return 1;
+	}
+	for(const RecordedSensor& sensor : recording.sensors)
+		printf("sensor %u: %s, firmware %u\n", sensor.tag, Trill::getNameFromDevice(sensor.device), sensor.firmware);
+
+	auto start = std::chrono::steady_clock::now();
+	ReplayResult result = replayRecording(recording);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("%u frames in %.3fs (%.0f frames/s), %u touches found, %u frames read back differently\n",
+		result.frames, seconds, result.frames / seconds, result.touches, result.mismatches);
+	return result.mismatches ? 1 : 0;
+}